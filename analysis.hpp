@@ -26,11 +26,14 @@
 #include "desquirr.hpp"
 #include "node.hpp"
 
+/**
+ * Instruction list editing shared by all analyses, see AnalysisImpl
+ */
 class Analysis/*{{{*/
 {
 	protected:
 		Analysis()
-			: mInstructions(NULL)
+			: mInstructions(NULL), mChangeCount(0)
 		{}
 
     public:
@@ -43,6 +46,130 @@ class Analysis/*{{{*/
 			INSTRUCTION_REMOVED
 		};
 	
+		Instruction_list::iterator Insert(Instruction_ptr instruction)/*{{{*/
+		{
+			Changed(instruction.get());
+			return Instructions().insert(Iterator(), instruction);
+		}/*}}}*/
+		
+		Instruction_list::iterator Replace(Instruction_ptr instruction)/*{{{*/
+		{
+			Erase(Iterator());
+			return Insert(instruction);
+		}/*}}}*/
+		
+		Instruction_list::iterator Insert(Instruction* instruction)/*{{{*/
+		{
+			return Insert( Instruction_ptr(instruction) );
+		}/*}}}*/
+
+		Instruction_list::iterator Replace(Instruction* instruction)/*{{{*/
+		{
+			return Replace( Instruction_ptr(instruction) );
+		}/*}}}*/
+
+		void EraseInstructions(int count)/*{{{*/
+		{
+			for(Instruction_list::iterator item = Iterator();
+					count > 0 && item != Instructions().end();
+					item++)
+			{
+				Erase(item);
+				count--;
+			}
+		}/*}}}*/
+
+		/** Add an instruction iterator to erase pool */
+		void Erase(Instruction_list::iterator i) 
+		{ 
+			if (mErasePool->Erase(i))
+				Changed();
+		}
+
+		/** 
+		 * Add an instruction iterator in another instruction list to erase
+		 * pool, the caller marks whatever contains that list as dirty
+		 */
+		void Erase(Instruction_list& instructions, Instruction_list::iterator i) 
+		{ 
+			if (mErasePool->Erase(instructions, i))
+				mChangeCount++;
+		}
+
+		/** Number of changes made to instruction lists so far */
+		int ChangeCount() const { return mChangeCount; }
+
+		/**
+		 * Record a change to the instruction list, or to an instruction
+		 * that was rewritten in place
+		 */
+		void Changed(Instruction* instruction = NULL)
+		{
+			mChangeCount++;
+			if (instruction)
+			{
+				instruction->MarkDirty();
+				instruction->OperandChanged();
+			}
+			OnChanged();
+		}
+
+		/**
+		 * Called for every change, so the analysis can mark what 
+		 * contains Instructions() as dirty. This is the only virtual
+		 * hook, it is not called for unchanged instructions.
+		 */
+		virtual void OnChanged()
+		{ }
+
+		/** Get instruction */
+		Instruction_ptr Instr() { return *mIterator; }
+
+		/** Set instruction list */
+		void Instructions(Instruction_list* instructions)
+		{
+			mInstructions = instructions;
+			if (instructions)
+			{
+				mErasePool.reset( new ErasePool(*instructions) );
+			}
+			else
+			{
+				mErasePool.reset();
+			}
+		}
+		
+		/** Get instruction list */
+		Instruction_list& Instructions() { return *mInstructions; }
+
+		/** Get instruction iterator */
+		Instruction_list::iterator Iterator() { return mIterator; }
+
+		/** Set instruction iterator */
+		void Iterator(Instruction_list::iterator i) { mIterator = i; }
+
+	private:
+		Instruction_list* mInstructions;
+		ErasePool_ptr mErasePool;
+		Instruction_list::iterator mIterator;
+		int mChangeCount;
+};/*}}}*/
+
+/**
+ * Analysis with instruction hooks bound at compile time.
+ *
+ * Derived passes itself as template parameter and hides the On* hooks it
+ * handles; the defaults here do nothing. Hooks may be private if Derived
+ * is a friend of AnalysisImpl<Derived>.
+ */
+template<class Derived>
+class AnalysisImpl : public Analysis/*{{{*/
+{
+	protected:
+		AnalysisImpl()
+		{}
+
+	public:
 		/**
 		 * Analyze an instruction list (call Instructions() to get it)
 		 */
@@ -64,30 +191,33 @@ class Analysis/*{{{*/
 		 */
 		void AnalyzeInstruction()/*{{{*/
 		{
-			if (Instr()->Type() == Instruction::TO_BE_DELETED)
+			Derived* self = static_cast<Derived*>(this);
+			Instruction* instruction = Iterator()->get();
+
+			if (instruction->Type() == Instruction::TO_BE_DELETED)
 			{
 				return;
 			}
 			
-			if (INSTRUCTION_REMOVED == OnInstruction())
+			if (INSTRUCTION_REMOVED == self->OnInstruction())
 				return;
 			
-			switch (Instr()->Type())
+			switch (instruction->Type())
 			{
 				case Instruction::ASSIGNMENT:
-					OnAssignment( static_cast<Assignment*>(Instr().get()) );
+					self->OnAssignment( static_cast<Assignment*>(instruction) );
 					break;
 
 				case Instruction::LOW_LEVEL:    // this calls the processor specific handling
-					OnLowLevel( Instr().get() );
+					self->OnLowLevel( instruction );
 					break;
 
 				case Instruction::POP:
-					OnPop( static_cast<Pop*>(Instr().get()) );
+					self->OnPop( static_cast<Pop*>(instruction) );
 					break;
 
 				case Instruction::PUSH:
-					OnPush( static_cast<Push*>(Instr().get()) );
+					self->OnPush( static_cast<Push*>(instruction) );
 					break;
 
 				default:
@@ -100,7 +230,7 @@ class Analysis/*{{{*/
 		 *
 		 * \return true to continue to specific instruction
 		 */
-		virtual AnalysisResult OnInstruction()
+		AnalysisResult OnInstruction()
 		{
 			return CONTINUE;
 		}
@@ -108,92 +238,26 @@ class Analysis/*{{{*/
 		/**
 		 * Handle an Assignment instruction
 		 */
-		virtual void OnAssignment(Assignment* assignment)
+		void OnAssignment(Assignment* assignment)
 		{ }
 
 		/**
 		 * Handle a Push instruction
 		 */
-		virtual void OnPush(Push* push)
+		void OnPush(Push* push)
 		{ }
 
 		/**
 		 * Handle a Pop instruction
 		 */
-		virtual void OnPop(Pop* pop)
+		void OnPop(Pop* pop)
 		{ }
 
 		/**
 		 * Handle a LowLevel instruction
 		 */
-		virtual void OnLowLevel(Instruction* lowLevel)
+		void OnLowLevel(Instruction* lowLevel)
 		{ }
-
-		Instruction_list::iterator Insert(Instruction_ptr instruction)/*{{{*/
-		{
-			return Instructions().insert(Iterator(), instruction);
-		}/*}}}*/
-		
-		Instruction_list::iterator Replace(Instruction_ptr instruction)/*{{{*/
-		{
-			Erase(Iterator());
-			return Insert(instruction);
-		}/*}}}*/
-		
-		Instruction_list::iterator Insert(Instruction* instruction)/*{{{*/
-		{
-			return Insert( Instruction_ptr(instruction) );
-		}/*}}}*/
-
-		Instruction_list::iterator Replace(Instruction* instruction)/*{{{*/
-		{
-			return Replace( Instruction_ptr(instruction) );
-		}/*}}}*/
-
-		void EraseInstructions(int count)/*{{{*/
-		{
-			for(Instruction_list::iterator item = Iterator();
-					count > 0 && item != Instructions().end();
-					item++)
-			{
-				Erase(item);
-				count--;
-			}
-		}/*}}}*/
-
-		/** Add an instruction iterator to erase pool */
-		void Erase(Instruction_list::iterator i) { mErasePool->Erase(i); }
-
-		/** Get instruction */
-		Instruction_ptr Instr() { return *mIterator; }
-
-		/** Set instruction list */
-		void Instructions(Instruction_list* instructions)
-		{
-			mInstructions = instructions;
-			if (instructions)
-			{
-				mErasePool.reset( new ErasePool(*instructions) );
-			}
-			else
-			{
-				mErasePool.reset();
-			}
-		}
-		
-		/** Get instruction list */
-		Instruction_list& Instructions() { return *mInstructions; }
-
-		/** Get instruction iterator */
-		Instruction_list::iterator Iterator() { return mIterator; }
-
-		/** Set instruction iterator */
-		void Iterator(Instruction_list::iterator i) { mIterator = i; }
-
-	private:
-		Instruction_list* mInstructions;
-		ErasePool_ptr mErasePool;
-		Instruction_list::iterator mIterator;
 };/*}}}*/
 
 
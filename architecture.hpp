@@ -0,0 +1,51 @@
+// 
+// Copyright (c) 2002 David Eriksson <david@2good.nu>
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a
+// copy of this software and associated documentation files (the "Software"),
+// to deal in the Software without restriction, including without limitation
+// the rights to use, copy, modify, merge, publish, distribute, sublicense,
+// and/or sell copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+// DEALINGS IN THE SOFTWARE.
+//
+// $Id$
+#ifndef _ARCHITECTURE_HPP
+#define _ARCHITECTURE_HPP
+
+#include "desquirr.hpp"
+#include "instruction.hpp"
+
+/**
+ * Properties of the target architecture that the analyses need for every
+ * instruction. They are used as template parameters, so the frontend is
+ * asked once per function instead of once per instruction.
+ */
+template<bool ParametersOnStack, int ParameterRegisters>
+struct ArchitectureTraits/*{{{*/
+{
+	enum
+	{
+		PARAMETERS_ON_STACK = ParametersOnStack,
+		PARAMETER_REGISTERS = ParameterRegisters,  // R0.. used as call parameters
+		REGISTER_COUNT      = BoolArray::SIZE      // registers tracked in a BoolArray
+	};
+};/*}}}*/
+
+/** x86: parameters are pushed before the call */
+typedef ArchitectureTraits<true, 0>  X86Traits;
+
+/** ARM: the first four parameters are passed in R0-R3 */
+typedef ArchitectureTraits<false, 4> ArmTraits;
+
+#endif // _ARCHITECTURE_HPP
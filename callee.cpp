@@ -0,0 +1,51 @@
+// 
+// Copyright (c) 2002 David Eriksson <david@2good.nu>
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a
+// copy of this software and associated documentation files (the "Software"),
+// to deal in the Software without restriction, including without limitation
+// the rights to use, copy, modify, merge, publish, distribute, sublicense,
+// and/or sell copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+// DEALINGS IN THE SOFTWARE.
+//
+// $Id$
+#include "callee.hpp"
+
+const CalleeSummary* CalleeCache::Find(Addr address)/*{{{*/
+{
+	Summary_map::iterator item = mSummaries.find(address);
+	if (mSummaries.end() == item)
+	{
+		mMisses++;
+		return NULL;
+	}
+
+	mHits++;
+	return &item->second;
+}/*}}}*/
+
+const CalleeSummary& CalleeCache::Add(Addr address, /*{{{*/
+		const CalleeSummary& summary)
+{
+	CalleeSummary& entry = mSummaries[address];
+	entry = summary;
+	return entry;
+}/*}}}*/
+
+void CalleeCache::Clear()/*{{{*/
+{
+	mSummaries.clear();
+	mHits = 0;
+	mMisses = 0;
+}/*}}}*/
@@ -0,0 +1,87 @@
+// 
+// Copyright (c) 2002 David Eriksson <david@2good.nu>
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a
+// copy of this software and associated documentation files (the "Software"),
+// to deal in the Software without restriction, including without limitation
+// the rights to use, copy, modify, merge, publish, distribute, sublicense,
+// and/or sell copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+// DEALINGS IN THE SOFTWARE.
+//
+// $Id$
+#ifndef _CALLEE_HPP
+#define _CALLEE_HPP
+
+#include "desquirr.hpp"
+
+/**
+ * What a call site needs to know about the function it calls
+ */
+struct CalleeSummary/*{{{*/
+{
+	enum ReturnClass
+	{
+		RETURN_UNKNOWN,
+		RETURN_VOID,
+		RETURN_INTEGER,
+		RETURN_POINTER,
+		RETURN_FLOAT,
+		RETURN_OTHER
+	};
+
+	CalleeSummary()
+		: purge(-1), hasType(false), parameterCount(-1),
+			callingConvention(CALLING_UNKNOWN), returnClass(RETURN_UNKNOWN)
+	{}
+	
+	long purge;                 // bytes popped by the callee, -1 if unknown
+	bool hasType;               // the fields below come from a prototype
+	int parameterCount;
+	Calling callingConvention;
+	ReturnClass returnClass;
+};/*}}}*/
+
+/**
+ * Callee summaries by address for a decompilation session
+ */
+class CalleeCache/*{{{*/
+{
+	public:
+		CalleeCache()
+			: mHits(0), mMisses(0)
+		{}
+
+		/** \return NULL if address has not been summarized */
+		const CalleeSummary* Find(Addr address);
+		
+		const CalleeSummary& Add(Addr address, const CalleeSummary& summary);
+
+		/** The type or frame of the function at address changed */
+		void Invalidate(Addr address) { mSummaries.erase(address); }
+
+		void Clear();
+
+		size_t Size() const { return mSummaries.size(); }
+		unsigned long Hits() const { return mHits; }
+		unsigned long Misses() const { return mMisses; }
+
+	private:
+		typedef std::map<Addr, CalleeSummary> Summary_map;
+		
+		Summary_map mSummaries;
+		unsigned long mHits;
+		unsigned long mMisses;
+};/*}}}*/
+
+#endif // _CALLEE_HPP
@@ -20,42 +20,28 @@
 // DEALINGS IN THE SOFTWARE.
 //
 // $Id: codegen.cpp,v 1.6 2007/01/30 09:48:02 wjhengeveld Exp $
+#include <ctime>
+
+#include <boost/bind.hpp>
+#include <boost/thread/thread.hpp>
+
 #include "codegen.hpp"
 #include "instruction.hpp"
 #include "node.hpp"
+#include "json.hpp"
+#include "trace.hpp"
 
-#include "idainternal.hpp"  // for LowLevel
+#include "lowlevel.hpp"
 /**
  * Instruction visitor for code generation
  */
 class CodeGenerator : public InstructionVisitor
 {
 	public:
-		CodeGenerator(CodeStyle style)
-			: mStyle(style)
+		CodeGenerator(CodeStyle style, OutputStream& out)
+			: mStyle(style), mOut(out)
 		{}
 
-		virtual ~CodeGenerator()
-		{
-			static const int  MAX_LINE_LEN   = 80;
-			char              tmp[MAX_LINE_LEN + 1];
-			int               len;
-			std::string       outstring = mOut.str();
-            const char      * pos = outstring.c_str();
-			for ( size_t i = 0; i < mOut.str().size() + 1; i += MAX_LINE_LEN )
-			{
-				len = mOut.str().size() - i;
-				if ( len >= MAX_LINE_LEN )
-				{
-					len = MAX_LINE_LEN;
-				}
-				memcpy(tmp, pos, len);
-				tmp[len] = 0;
-				message("%s", tmp);
-				pos += len;
-			}
-		}
-
 		//
 		// Implementation of InstructionVisitor interface follows
 		//
@@ -74,8 +60,16 @@ class CodeGenerator : public InstructionVisitor
 
 		virtual void Visit(Case& instruction)
 		{
-			Prefix(instruction);
-			mOut << "case " << instruction.Value() << ':' << std::endl;
+			for (int i = 0; i < instruction.ValueCount(); i++)
+			{
+				Prefix(instruction);
+				mOut << "case " << instruction.Value(i) << ':' << std::endl;
+			}
+			if (instruction.IsDefault())
+			{
+				Prefix(instruction);
+				mOut << "default:" << std::endl;
+			}
 		}
 
 		virtual void Visit(ConditionalJump& instruction)
@@ -173,7 +167,7 @@ class CodeGenerator : public InstructionVisitor
 		{
 			if (LISTING_STYLE == mStyle)
 			{
-				mOut << boost::format("%08x ") % instruction.Address();
+				mOut << Hex8(instruction.Address()) << ' ';
 			}
 
 			if (indent == INDENT)
@@ -183,16 +177,81 @@ class CodeGenerator : public InstructionVisitor
 	private:
 
 		CodeStyle mStyle;
-		std::ostringstream mOut;
+		OutputStream& mOut;
 };
 
+/**
+ * Output of the code generator, kept so its memory is reused
+ */
+static OutputStream s_output;
+
+// functions with fewer nodes are generated on the calling thread
+int g_iParallelCodeNodes = 256;
+
+// number of threads for larger functions
+int g_iCodeThreads = 4;
+
+/**
+ * Output of each thread of GenerateInParallel, freed when the plugin is
+ * unloaded
+ */
+static std::vector<boost::shared_ptr<OutputStream> > s_outputs;
+
+/**
+ * Generate code for the nodes from begin to end into out. The code
+ * generator only reads the instructions and the names already in the
+ * expressions, so nodes can be generated on any thread.
+ */
+static void GenerateNodes(Node_ptr* begin, Node_ptr* end, /*{{{*/
+		CodeStyle style, OutputStream* out)
+{
+	TraceSpan span("codegen thread");
+	CodeGenerator code_generator(style, *out);
+	for (Node_ptr* node = begin; node != end; node++)
+	{
+		code_generator.NodeBegin(*node);
+		Accept((**node).Instructions(), code_generator);
+		code_generator.NodeEnd();
+	}
+}/*}}}*/
+
+/**
+ * Split the nodes into one run per thread and concatenate the output of
+ * the runs in node order, which gives the same text as one thread
+ */
+static void GenerateInParallel(Node_list& nodes, CodeStyle style)/*{{{*/
+{
+	std::vector<Node_ptr> order(nodes.begin(), nodes.end());
+	size_t threads = std::min((size_t)g_iCodeThreads, order.size());
+	size_t run = (order.size() + threads - 1) / threads;
+	
+	while (s_outputs.size() < threads)
+		s_outputs.push_back(boost::shared_ptr<OutputStream>(new OutputStream()));
+
+	boost::thread_group group;
+	for (size_t i = 0; i < threads; i++)
+	{
+		Node_ptr* begin = &order[0] + std::min(i * run, order.size());
+		Node_ptr* end   = &order[0] + std::min((i + 1) * run, order.size());
+		group.create_thread(boost::bind(&GenerateNodes, begin, end, style, s_outputs[i].get()));
+	}
+	group.join_all();
+
+	for (size_t i = 0; i < threads; i++)
+	{
+		s_output.write(s_outputs[i]->Data(), s_outputs[i]->Size());
+		s_outputs[i]->Clear();
+	}
+}/*}}}*/
+
 /**
  * Generate code for a list of instructions
  */
 void GenerateCode(Instruction_list& instructions, CodeStyle style)
 {
-	CodeGenerator code_generator(style);
+	CodeGenerator code_generator(style, s_output);
 	Accept(instructions, code_generator);
+	s_output.Flush();
 }
 
 /**
@@ -200,8 +259,155 @@ void GenerateCode(Instruction_list& instructions, CodeStyle style)
  */
 void GenerateCode(Node_list& nodes, CodeStyle style)
 {
-	CodeGenerator code_generator(style);
-	Accept(nodes, code_generator);
+	TraceSpan span("codegen");
+	if (g_iCodeThreads > 1 && !nodes.empty() &&
+			nodes.size() >= (size_t)g_iParallelCodeNodes)
+	{
+		GenerateInParallel(nodes, style);
+	}
+	else
+	{
+		CodeGenerator code_generator(style, s_output);
+		Accept(nodes, code_generator);
+	}
+	s_output.Flush();
 }
 
 
+
+/**
+ * Collects the calls in an expression tree
+ */
+class CallCollector/*{{{*/
+{
+	public:
+		template<class T>
+		void Visit(T&) {}
+
+		void Visit(CallExpression& call) { mCalls.push_back(&call); }
+
+		std::vector<CallExpression*>& Calls() { return mCalls; }
+
+	private:
+		std::vector<CallExpression*> mCalls;
+};/*}}}*/
+
+static const char* const NODE_TYPE_NAMES[] =
+{
+	"call",
+	"conditional_jump",
+	"fall_through",
+	"jump",
+	"n_way",
+	"return"
+};
+
+static void WriteCalls(JsonWriter& json, Node_list& nodes)/*{{{*/
+{
+	ExpressionWalker walker;
+	
+	json.Key("calls");
+	json.BeginArray();
+	for (Node_list::iterator node = nodes.begin(); node != nodes.end(); node++)
+	{
+		Instruction_list& instructions = (**node).Instructions();
+		for (Instruction_list::iterator item = instructions.begin();
+				item != instructions.end();
+				item++)
+		{
+			CallCollector collector;
+			for (int i = 0; i < (**item).OperandCount(); i++)
+			{
+				Expression_ptr* slot = (**item).OperandSlot(i);
+				if (NULL != slot && NULL != slot->get())
+					walker.PreOrder(**slot, collector);
+			}
+
+			for (size_t i = 0; i < collector.Calls().size(); i++)
+			{
+				CallExpression& call = *collector.Calls()[i];
+				Expression_ptr function = call.SubExpression(0);
+				
+				json.BeginObject();
+				json.Key("address");
+				json.Number((**item).Address());
+				json.Key("target");
+				json.Number(call.Address());
+				if (function->IsType(Expression::GLOBAL))
+				{
+					json.Key("name");
+					json.String(static_cast<GlobalVariable&>(*function).Name());
+				}
+				json.Key("parameters");
+				json.Number(call.ParameterCount());
+				json.EndObject();
+			}
+		}
+	}
+	json.EndArray();
+}/*}}}*/
+
+void GenerateJson(const FunctionRecord& function, Node_list& nodes, /*{{{*/
+		std::ostream& out)
+{
+	// C code of one node at a time, kept so its memory is reused
+	static OutputStream s_code;
+	
+	clock_t start = clock();
+	JsonWriter json(out);
+
+	json.BeginObject();
+	json.Key("address");
+	json.Number(function.address);
+	json.Key("name");
+	json.String(function.name);
+	json.Key("deduplicated");
+	json.Bool(function.deduplicated);
+
+	json.Key("nodes");
+	json.BeginArray();
+	for (Node_list::iterator item = nodes.begin(); item != nodes.end(); item++)
+	{
+		Node& node = **item;
+		
+		json.BeginObject();
+		json.Key("address");
+		json.Number(node.Address());
+		json.Key("type");
+		json.String(NODE_TYPE_NAMES[node.Type()]);
+		
+		json.Key("successors");
+		json.BeginArray();
+		for (int i = 0; i < node.SuccessorCount(); i++)
+			json.Number(node.SuccessorAddress(i));
+		json.EndArray();
+
+		{
+			CodeGenerator code_generator(JSON_STYLE, s_code);
+			Accept(node.Instructions(), code_generator);
+		}
+		json.Key("code");
+		json.String(s_code.Data(), s_code.Size());
+		s_code.Clear();
+		
+		json.EndObject();
+	}
+	json.EndArray();
+
+	WriteCalls(json, nodes);
+
+	json.Key("timings");
+	json.BeginObject();
+	json.Key("lift");
+	json.Number(function.lift);
+	json.Key("nodes");
+	json.Number(function.nodes);
+	json.Key("passes");
+	json.Number(function.passes);
+	json.Key("generate");
+	json.Number((clock() - start) * 1000.0 / CLOCKS_PER_SEC);
+	json.EndObject();
+	
+	json.EndObject();
+	out.put('\n');
+}/*}}}*/
@@ -28,11 +28,47 @@
 enum CodeStyle
 {
 	C_STYLE,
-	LISTING_STYLE
+	LISTING_STYLE,
+	JSON_STYLE      // one JSON record per function, see GenerateJson
 };
 
+extern int g_iParallelCodeNodes;
+extern int g_iCodeThreads;
+
+/**
+ * Generate code for the nodes of a function. Functions with at least
+ * g_iParallelCodeNodes nodes are split over g_iCodeThreads threads; the
+ * output is the same either way.
+ */
 void GenerateCode(Node_list& nodes, CodeStyle style);
 void GenerateCode(Instruction_list& instructions, CodeStyle style);
 
+/**
+ * What a JSON_STYLE record tells about a function besides its nodes
+ */
+struct FunctionRecord/*{{{*/
+{
+	FunctionRecord()
+		: address(INVALID_ADDR), deduplicated(false), lift(0), nodes(0), passes(0)
+	{}
+	
+	Addr address;
+	std::string name;
+	bool deduplicated;     // the nodes were reused from an earlier function
+
+	// stage timings in milliseconds
+	double lift;
+	double nodes;
+	double passes;
+};/*}}}*/
+
+/**
+ * Write one line with the JSON record of a function to out: address,
+ * name, the C code, address and successors of each node, the calls and
+ * the stage timings
+ */
+void GenerateJson(const FunctionRecord& function, Node_list& nodes, 
+		std::ostream& out);
+
 #endif // _CODEGEN_HPP
 
@@ -0,0 +1,168 @@
+// 
+// Copyright (c) 2002 David Eriksson <david@2good.nu>
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a
+// copy of this software and associated documentation files (the "Software"),
+// to deal in the Software without restriction, including without limitation
+// the rights to use, copy, modify, merge, publish, distribute, sublicense,
+// and/or sell copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+// DEALINGS IN THE SOFTWARE.
+//
+// $Id$
+#include "counters.hpp"
+
+#if DESQUIRR_COUNT_OBJECTS
+
+ObjectCount ObjectCounters::sObjects[OBJECT_KIND_COUNT][TYPE_COUNT];
+ObjectCount ObjectCounters::sKindObjects[OBJECT_KIND_COUNT];
+ObjectCount ObjectCounters::sBytes[OBJECT_KIND_COUNT];
+ObjectCount ObjectCounters::sSampled[OBJECT_KIND_COUNT];
+ObjectCount ObjectCounters::sBegun[OBJECT_KIND_COUNT][TYPE_COUNT];
+Addr ObjectCounters::sFunction = INVALID_ADDR;
+
+static const char* const KIND_NAMES[OBJECT_KIND_COUNT] =
+{
+	"expressions", "instructions", "nodes"
+};
+
+// in the order of Expression::ExpressionType, Instruction::InstructionType
+// and Node::NodeType
+static const char* const TYPE_NAMES[OBJECT_KIND_COUNT][ObjectCounters::TYPE_COUNT] =
+{
+	{
+		"BinaryExpression", "CallExpression", "Dummy", "GlobalVariable",
+		"NumericLiteral", "Register", "StackVariable", "StringLiteral",
+		"TernaryExpression", "UnaryExpression"
+	},
+	{
+		"Assignment", "Call", "Case", "ConditionalJump", "Jump", "Label",
+		"LowLevel", "Push", "Pop", "Return", "Switch", "Throw", "ToBeDeleted"
+	},
+	{
+		"CallNode", "ConditionalJumpNode", "FallThroughNode", "JumpNode",
+		"N_WayNode", "ReturnNode"
+	}
+};
+
+// objects still alive stay live, they are destroyed later in the run
+static void ResetRun(ObjectCount& count)
+{
+	count.total = 0;
+	count.peak = count.runPeak = count.live;
+}
+
+void ObjectCounters::Reset()/*{{{*/
+{
+	for (int kind = 0; kind < OBJECT_KIND_COUNT; kind++)
+	{
+		for (int type = 0; type < TYPE_COUNT; type++)
+			ResetRun(sObjects[kind][type]);
+		ResetRun(sKindObjects[kind]);
+		ResetRun(sBytes[kind]);
+	}
+	sFunction = INVALID_ADDR;
+}/*}}}*/
+
+void ObjectCounters::ResetPeaks()/*{{{*/
+{
+	for (int kind = 0; kind < OBJECT_KIND_COUNT; kind++)
+	{
+		for (int type = 0; type < TYPE_COUNT; type++)
+			sObjects[kind][type].ResetPeak();
+		sKindObjects[kind].ResetPeak();
+		sBytes[kind].ResetPeak();
+	}
+}/*}}}*/
+
+void ObjectCounters::BeginFunction(Addr address)/*{{{*/
+{
+	ResetPeaks();
+	
+	for (int kind = 0; kind < OBJECT_KIND_COUNT; kind++)
+	{
+		for (int type = 0; type < TYPE_COUNT; type++)
+			sBegun[kind][type] = sObjects[kind][type];
+		sSampled[kind] = sKindObjects[kind];
+	}
+	sFunction = address;
+}/*}}}*/
+
+void ObjectCounters::Sample(const char* stage)/*{{{*/
+{
+	message("%08lx objects after %s:", sFunction, stage);
+	
+	for (int kind = 0; kind < OBJECT_KIND_COUNT; kind++)
+	{
+		const ObjectCount& now = sKindObjects[kind];
+		const ObjectCount& then = sSampled[kind];
+		
+		unsigned long created = now.total - then.total;
+		unsigned long destroyed = created + then.live - now.live;
+		
+		message("%s %s +%lu -%lu (%lu live, %lu bytes)", 
+				kind ? "," : "", KIND_NAMES[kind], 
+				created, destroyed, now.live, sBytes[kind].live);
+		
+		sSampled[kind] = now;
+	}
+	message("\n");
+}/*}}}*/
+
+void ObjectCounters::EndFunction()/*{{{*/
+{
+	message("%08lx objects created:\n", sFunction);
+	message("  %-20s %8s %8s %8s\n", "type", "created", "live", "peak");
+
+	for (int kind = 0; kind < OBJECT_KIND_COUNT; kind++)
+	{
+		for (int type = 0; type < TYPE_COUNT; type++)
+		{
+			const ObjectCount& count = sObjects[kind][type];
+			unsigned long created = count.total - sBegun[kind][type].total;
+			if (created)
+			{
+				message("  %-20s %8lu %8lu %8lu\n", TYPE_NAMES[kind][type], 
+						created, count.live, count.peak);
+			}
+		}
+
+		message("  %-20s %8s %8lu %8lu bytes\n", KIND_NAMES[kind], "",
+				sBytes[kind].live, sBytes[kind].peak);
+	}
+}/*}}}*/
+
+void ObjectCounters::Report()/*{{{*/
+{
+	message("Objects of the run:\n");
+	message("  %-20s %10s %10s %10s\n", "type", "total", "live", "peak");
+	
+	for (int kind = 0; kind < OBJECT_KIND_COUNT; kind++)
+	{
+		for (int type = 0; type < TYPE_COUNT; type++)
+		{
+			const ObjectCount& count = sObjects[kind][type];
+			if (count.total)
+			{
+				message("  %-20s %10lu %10lu %10lu\n", TYPE_NAMES[kind][type], 
+						count.total, count.live, count.RunPeak());
+			}
+		}
+
+		const ObjectCount& bytes = sBytes[kind];
+		message("  %-20s %10lu %10lu %10lu bytes\n", KIND_NAMES[kind],
+				bytes.total, bytes.live, bytes.RunPeak());
+	}
+}/*}}}*/
+
+#endif // DESQUIRR_COUNT_OBJECTS
@@ -0,0 +1,197 @@
+// 
+// Copyright (c) 2002 David Eriksson <david@2good.nu>
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a
+// copy of this software and associated documentation files (the "Software"),
+// to deal in the Software without restriction, including without limitation
+// the rights to use, copy, modify, merge, publish, distribute, sublicense,
+// and/or sell copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+// DEALINGS IN THE SOFTWARE.
+//
+// $Id$
+#ifndef _COUNTERS_HPP
+#define _COUNTERS_HPP
+
+#include "desquirr.hpp"
+
+/*
+ * Object counters for the IR classes: live, peak and total objects of each
+ * Expression, Instruction and Node type, and the bytes of each kind.
+ *
+ * Compiled in with DESQUIRR_COUNT_OBJECTS=1. Otherwise Counted is an empty
+ * base class and every ObjectCounters function is an empty inline one.
+ * The counts are not atomic, code generation threads must not create or
+ * destroy IR objects.
+ */
+
+#ifndef DESQUIRR_COUNT_OBJECTS
+#define DESQUIRR_COUNT_OBJECTS 0
+#endif
+
+enum ObjectKind
+{
+	OBJECT_EXPRESSION,
+	OBJECT_INSTRUCTION,
+	OBJECT_NODE,
+	OBJECT_KIND_COUNT
+};
+
+struct ObjectCount/*{{{*/
+{
+	ObjectCount()
+		: live(0), peak(0), runPeak(0), total(0)
+	{}
+
+	void Add(unsigned long count)
+	{
+		live  += count;
+		total += count;
+		if (live > peak)
+			peak = live;
+	}
+
+	void Remove(unsigned long count) { live -= count; }
+
+	/** Start a new peak, keeping the highest one of the run */
+	void ResetPeak()
+	{
+		if (peak > runPeak)
+			runPeak = peak;
+		peak = live;
+	}
+
+	unsigned long RunPeak() const { return peak > runPeak ? peak : runPeak; }
+	
+	unsigned long live;
+	unsigned long peak;      // since the function began
+	unsigned long runPeak;   // of the earlier functions of the run
+	unsigned long total;     // ever created or allocated
+};/*}}}*/
+
+class ObjectCounters/*{{{*/
+{
+	public:
+		enum
+		{
+			TYPE_COUNT = 16   // at least the number of types of any kind
+		};
+
+#if DESQUIRR_COUNT_OBJECTS
+		static void Created(ObjectKind kind, int type)
+		{
+			sObjects[kind][type].Add(1);
+			sKindObjects[kind].Add(1);
+		}
+
+		static void Destroyed(ObjectKind kind, int type)
+		{
+			sObjects[kind][type].Remove(1);
+			sKindObjects[kind].Remove(1);
+		}
+
+		static void Allocated(ObjectKind kind, size_t size) { sBytes[kind].Add(size); }
+		static void Freed(ObjectKind kind, size_t size) { sBytes[kind].Remove(size); }
+
+		static unsigned long Live(ObjectKind kind) { return sKindObjects[kind].live; }
+
+		/** Start a run, forgetting the totals of the previous one */
+		static void Reset();
+		
+		/** Peaks and stage deltas from here on belong to the function */
+		static void BeginFunction(Addr address);
+
+		/** Print what was created and destroyed since the previous sample */
+		static void Sample(const char* stage);
+
+		/** Print the objects of each type created by the function */
+		static void EndFunction();
+
+		/** Print the counts of the run */
+		static void Report();
+
+	private:
+		static void ResetPeaks();
+		
+		static ObjectCount sObjects[OBJECT_KIND_COUNT][TYPE_COUNT];
+		static ObjectCount sKindObjects[OBJECT_KIND_COUNT];
+		static ObjectCount sBytes[OBJECT_KIND_COUNT];
+
+		// at the previous sample and at BeginFunction
+		static ObjectCount sSampled[OBJECT_KIND_COUNT];
+		static ObjectCount sBegun[OBJECT_KIND_COUNT][TYPE_COUNT];
+		static Addr sFunction;
+#else
+		static void Created(ObjectKind, int) {}
+		static void Destroyed(ObjectKind, int) {}
+		static void Allocated(ObjectKind, size_t) {}
+		static void Freed(ObjectKind, size_t) {}
+		static void Reset() {}
+		static void BeginFunction(Addr) {}
+		static void Sample(const char*) {}
+		static void EndFunction() {}
+		static void Report() {}
+#endif
+};/*}}}*/
+
+/**
+ * Base class of the IR classes of a kind, counts their objects by type
+ * and their bytes by the sizes operator new is asked for
+ */
+template<ObjectKind KIND>
+class Counted/*{{{*/
+{
+#if DESQUIRR_COUNT_OBJECTS
+	public:
+		static void* operator new(size_t size)
+		{
+			ObjectCounters::Allocated(KIND, size);
+			return ::operator new(size);
+		}
+
+		static void operator delete(void* p, size_t size)
+		{
+			ObjectCounters::Freed(KIND, size);
+			::operator delete(p);
+		}
+
+	protected:
+		Counted(int type)
+			: mCountedType(type)
+		{
+			ObjectCounters::Created(KIND, type);
+		}
+
+		Counted(const Counted& other)
+			: mCountedType(other.mCountedType)
+		{
+			ObjectCounters::Created(KIND, mCountedType);
+		}
+
+		~Counted()
+		{
+			ObjectCounters::Destroyed(KIND, mCountedType);
+		}
+
+		// an object keeps its own type when assigned to
+		Counted& operator= (const Counted&) { return *this; }
+
+	private:
+		int mCountedType;   // as created, Instruction types can change
+#else
+	protected:
+		Counted(int) {}
+#endif
+};/*}}}*/
+
+#endif // _COUNTERS_HPP
@@ -20,11 +20,16 @@
 // DEALINGS IN THE SOFTWARE.
 //
 // $Id: dataflow.cpp,v 1.6 2007/01/30 09:48:19 wjhengeveld Exp $
-#include "idainternal.hpp"
 #include "dataflow.hpp"
 #include "node.hpp"
-#include "idapro.hpp"
-#include "ida-x86.hpp"
+#include "lowlevel.hpp"
+#include "frontend.hpp"
+
+DataFlowAnalysis::DataFlowAnalysis(Node_list& nodes)/*{{{*/
+	: mNodeList(nodes),
+		mParametersOnStack(Frontend::Get().ParametersOnStack())
+{
+}/*}}}*/
 
 bool DataFlowAnalysis::RemoveUnusedDefinition()/*{{{*/
 {
@@ -40,6 +45,7 @@ bool DataFlowAnalysis::RemoveUnusedDefinition()/*{{{*/
 					!(Instr()->IsLastDefinition(reg) && 
 						Node()->InLiveOut(reg)))
 			{
+				Changed(Instr().get());
 				if (Instr()->RemoveDefinition(reg))
 				{
 					// We can remove the whole instruction!
@@ -53,64 +59,6 @@ bool DataFlowAnalysis::RemoveUnusedDefinition()/*{{{*/
 	return false;
 }/*}}}*/
 
-// ReplaceRegisterExpression {{{
-class ReplaceRegisterExpressionHelper
-{
-	public:
-		ReplaceRegisterExpressionHelper(
-				unsigned short reg,
-				Expression_ptr replacement)
-			: mReplaceDone(false), mRegister(reg), mReplacement(replacement)
-		{ }
-
-		void Replace(Instruction_ptr instruction, int operand)
-		{
-			if (Replace(instruction->Operand(operand)))
-			{
-				instruction->Operand(operand, mReplacement);
-				mReplaceDone = true;
-			}
-		}
-
-		bool Replace(Expression_ptr parent)
-		{
-			if (parent->IsType(Expression::REGISTER) &&
-					static_cast<Register*>(parent.get())->Index() == mRegister)
-			{
-				return true; /* tell caller to replace the parent! */
-			}
-
-			for (int i = 0; i < parent->SubExpressionCount(); i++)
-			{
-				if (Replace(parent->SubExpression(i)))
-				{
-					parent->SubExpression(i, mReplacement);
-					mReplaceDone = true;
-					return false;
-				}
-			}
-			return false;
-		}
-
-		bool ReplaceDone() { return mReplaceDone; }
-
-	private:
-		bool mReplaceDone;
-		unsigned short mRegister;
-		Expression_ptr mReplacement;
-};
-
-bool ReplaceRegisterExpression(
-		Instruction_ptr instruction,
-		int operand,
-		unsigned short reg,
-		Expression_ptr replacement)
-{
-	ReplaceRegisterExpressionHelper helper(reg, replacement);
-	helper.Replace(instruction, operand);
-	return helper.ReplaceDone();
-}/*}}}*/
-
 class GetFunctionParametersFromStackHelper : public ExpressionVisitor/*{{{*/
 {
 	public:
@@ -142,7 +90,7 @@ void DataFlowAnalysis::CollectParameters(CallExpression* call)/*{{{*/
 	if (call->IsFinishedAddingParameters())
 		return; // already collected parameters for this call 
 	
-	if (static_cast<IdaPro&>(Frontend::Get()).ParametersOnStack()) {
+	if (mParametersOnStack) {
         int parameters_left = call->ParameterCount();
 
         if (CallExpression::UNKNOWN_PARAMETER_COUNT == parameters_left)
@@ -155,14 +103,18 @@ void DataFlowAnalysis::CollectParameters(CallExpression* call)/*{{{*/
 
         while (!Stack().empty() && parameters_left > 0)
         {
-            Push* push = static_cast<Push*>(Stack().top()->get());
+            PendingPush& pending = Stack().top();
+            Push* push = static_cast<Push*>(pending.item->get());
             call->AddParameter( push->Operand() );
-            Erase(Stack().top());
+            // the push may be in an earlier node
+            Erase(pending.node->Instructions(), pending.item);
+            pending.node->MarkDirty();
             Stack().pop();
             parameters_left--;
         }
 
         call->SetFinishedAddingParameters();
+        Changed(Instr().get());
 
         if (parameters_left != 0)
         {
@@ -182,21 +134,21 @@ void DataFlowAnalysis::GetFunctionParametersFromStack()/*{{{*/
 	
 	for (int i = 0; i < Instr()->OperandCount(); i++)
 	{
-		Instr()->Operand(i)->AcceptDepthFirst(helper);
+		Walker().PostOrder(*Instr()->Operand(i), helper);
 	}
 }/*}}}*/
 
 void DataFlowAnalysis::TryConvertPushPopToAssignment()/*{{{*/
 {
-	Instruction_list::iterator pop  = Iterator();
-	Instruction_list::iterator push = Stack().top();
-
 	if (Stack().size() == 0)
 	{
 		message("%p [TryConvertPushPopToAssignment] Empty stack\n", Instr()->Address());
 		return;
 	}
 
+	Instruction_list::iterator pop  = Iterator();
+	Instruction_list::iterator push = Stack().top().item;
+
 	if (Instructions().end() == pop)
 	{
 		message("%p [TryConvertPushPopToAssignment] Bad pop\n", Instr()->Address());
@@ -246,7 +198,7 @@ void DataFlowAnalysis::TryConvertPushPopToAssignment()/*{{{*/
 		}
 	}
     else {
-        msg("WARNING: popped expr is not a register: %d\n", popped->Type());
+        message("WARNING: popped expr is not a register: %d\n", popped->Type());
     }
 }/*}}}*/
 
@@ -261,6 +213,27 @@ Instruction_list::iterator DataFlowAnalysis::FindInstructionAtAddress(/*{{{*/
 	return item;
 }/*}}}*/
 
+/**
+ * \return true if instruction may change memory a moved expression reads
+ */
+static bool WritesMemory(Instruction& instruction)/*{{{*/
+{
+	for (int i = 0; i < instruction.OperandCount(); i++)
+	{
+		Expression_ptr operand = instruction.Operand(i);
+		if (Expression::ContainsCall(operand))
+			return true;
+	}
+
+	if (instruction.IsType(Instruction::ASSIGNMENT))
+	{
+		Expression_ptr target = static_cast<Assignment&>(instruction).First();
+		return !target->IsType(Expression::REGISTER) && 
+			!target->IsType(Expression::DUMMY);
+	}
+	return false;
+}/*}}}*/
+
 Analysis::AnalysisResult DataFlowAnalysis::ReplaceUseWithDefinition(/*{{{*/
 		Assignment* assignment)
 {
@@ -270,6 +243,13 @@ Analysis::AnalysisResult DataFlowAnalysis::ReplaceUseWithDefinition(/*{{{*/
 		return CONTINUE;
 
 	unsigned short reg = du_chain.begin()->first;
+
+	// Only the assigned register holds the value of the expression, other
+	// registers are defined by a call as a side effect
+	Expression_ptr first = assignment->First();
+	if (!first->IsType(Expression::REGISTER) ||
+			static_cast<Register*>(first.get())->SimpleIndex() != reg)
+		return CONTINUE;
 //	message("%p du_chain.count(%i) = %i\n", assignment->Address(), reg, du_chain.count(reg));
 
 	// Don't do this for the last defintion if it is in LiveOut
@@ -296,8 +276,22 @@ Analysis::AnalysisResult DataFlowAnalysis::ReplaceUseWithDefinition(/*{{{*/
 	if (Instructions().end() == target_item)
 		return CONTINUE;
 
+	// The expression must mean the same at the use: none of the registers
+	// or memory it reads may change on the way there
+	bool reads_memory = Expression::ReadsMemory(assignment->Second());
+	Instruction_list::iterator between = Iterator();
+	for (between++; between != target_item; between++)
+	{
+		if (((**between).Definitions() & assignment->Uses()) != BoolArray())
+			return CONTINUE;
+		if (reads_memory && WritesMemory(**between))
+			return CONTINUE;
+	}
+
+	bool call = Expression::ContainsCall(assignment->Second());
+
 	// XXX: not for calls?
-	if (assignment->IsCall())
+	if (call)
 	{
 		// XXX: See if adjacent instructions
 		Instruction_list::iterator tmp = Iterator();
@@ -308,25 +302,38 @@ Analysis::AnalysisResult DataFlowAnalysis::ReplaceUseWithDefinition(/*{{{*/
 
 	Instruction_ptr target = *target_item;
 	bool replace_done = false;
+	int i;
+
+	// Don't duplicate a call
+	if (call)
+	{
+		int uses = 0;
+		for (i = 0; i < target->OperandCount(); i++)
+		{
+			if (target->OperandType(i) == Instruction::USE)
+				uses += target->RegisterCount(i, reg);
+		}
+		if (uses > 1)
+			return CONTINUE;
+	}
 
-	// assuming the register is only used once
-	for (int i = 0; i < target->OperandCount(); i++)
+	for (i = 0; i < target->OperandCount(); i++)
 	{
 		if (target->OperandType(i) == Instruction::USE)
 		{
-			if (ReplaceRegisterExpression(target, i, reg, assignment->Second()))
-			{
+			if (target->ReplaceRegister(i, reg, assignment->Second()))
 				replace_done = true;
-				break;
-			}
 		}
 	}
 
 	if (replace_done)
 	{
+		// Keep the sets usable for the rest of this pass, the next
+		// update of uses and definitions recomputes them from scratch
 		target->Uses().Clear(reg);
 		target->Uses() |= assignment->Uses();
 		target->LastDefinitions() |= assignment->LastDefinitions();
+		Changed(target.get());
 		Erase(Iterator());
 	}
 
@@ -418,16 +425,12 @@ Analysis::AnalysisResult DataFlowAnalysis::ReplaceUseWithDefinition2(/*{{{*/
 #if 1
 			bool replace_done = false;
 
-			// assuming the register is only used once
 			for (int i = 0; i < target->OperandCount(); i++)
 			{
 				if (target->OperandType(i) == Instruction::USE)
 				{
-					if (ReplaceRegisterExpression(target, i, reg, assignment->Second()))
-					{
+					if (target->ReplaceRegister(i, reg, assignment->Second()))
 						replace_done = true;
-						break;
-					}
 				}
 			}
 
@@ -438,6 +441,8 @@ Analysis::AnalysisResult DataFlowAnalysis::ReplaceUseWithDefinition2(/*{{{*/
 				target->Uses().Clear(reg);
 				target->Uses() |= assignment->Uses();
 				//target->LastDefinitions() |= assignment->LastDefinitions();
+				target->MarkDirty();
+				successor->MarkDirty();
 			}
 
 			// Stop if the register was redefined by this instruction
@@ -471,7 +476,7 @@ void DataFlowAnalysis::OnAssignment(Assignment* assignment)/*{{{*/
 	// Propagate data type
 	//assignment->First()->DataType() = assignment->Second()->DataType();
 
-	IdaX86::TryBorlandThrow(this, assignment);
+	Frontend::Get().OnAssignment(this, assignment);
 }/*}}}*/
 
 
@@ -25,13 +25,14 @@
 
 #include "desquirr.hpp"
 #include "analysis.hpp"
+#include "expression.hpp"
 
-class DataFlowAnalysis : public Analysis/*{{{*/
+class DataFlowAnalysis : public AnalysisImpl<DataFlowAnalysis>/*{{{*/
 {
+	friend class AnalysisImpl<DataFlowAnalysis>;
+
 	public:
-		DataFlowAnalysis(Node_list& nodes)
-			: mNodeList(nodes)
-		{}
+		DataFlowAnalysis(Node_list& nodes);
 		
 		/**
 		 * Analyze a list of nodes
@@ -50,6 +51,28 @@ class DataFlowAnalysis : public Analysis/*{{{*/
 		void CollectParameters(CallExpression* call);
 	
 	private:
+		/** A push not yet used as a call parameter, and the node it is in */
+		struct PendingPush
+		{
+			PendingPush(Instruction_list::iterator item, Node_ptr node)
+				: item(item), node(node)
+			{}
+
+			Instruction_list::iterator item;
+			Node_ptr node;
+		};
+
+		typedef std::stack<PendingPush> PendingPush_stack;
+
+		/**
+		 * Any change marks the current node dirty, so its analyses
+		 * can be updated incrementally
+		 */
+		virtual void OnChanged()/*{{{*/
+		{
+			Node()->MarkDirty();
+		}/*}}}*/
+
 		/**
 		 * Analyze an individual node (in mNode)
 		 */
@@ -58,7 +81,7 @@ class DataFlowAnalysis : public Analysis/*{{{*/
 			AnalyzeInstructionList();
 		}/*}}}*/
 
-		virtual AnalysisResult OnInstruction()/*{{{*/
+		AnalysisResult OnInstruction()/*{{{*/
 		{
 //			message("%p\n", Instr()->Address());
 			
@@ -72,20 +95,20 @@ class DataFlowAnalysis : public Analysis/*{{{*/
 		/**
 		 * Handle an ASSIGNMENT instruction
 		 */
-		virtual void OnAssignment(Assignment* assignment);
+		void OnAssignment(Assignment* assignment);
 
 		/**
 		 * Handle a PUSH instruction
 		 */
-		virtual void OnPush(Push*)/*{{{*/
+		void OnPush(Push*)/*{{{*/
 		{
-			Stack().push( Iterator() );
+			Stack().push( PendingPush(Iterator(), Node()) );
 		}/*}}}*/
 
 		/**
 		 * Handle a POP instruction
 		 */
-		virtual void OnPop(Pop*)/*{{{*/
+		void OnPop(Pop*)/*{{{*/
 		{
 			if (Stack().empty())
 			{
@@ -122,8 +145,11 @@ class DataFlowAnalysis : public Analysis/*{{{*/
 		
 		//AnalysisResult TryIncDec(Assignment* assignment);
 
-		/** Get instruction iterator stack */
-		Instruction_list_iterator_stack& Stack() { return mStack; }
+		/** Get push stack */
+		PendingPush_stack& Stack() { return mStack; }
+
+		/** Get expression walker, shared by all traversals of this analysis */
+		ExpressionWalker& Walker() { return mWalker; }
 
 		/** Get node */
 		Node_list& NodeList() { return mNodeList; }
@@ -141,7 +167,9 @@ class DataFlowAnalysis : public Analysis/*{{{*/
 	private:
 		Node_list& mNodeList;
 		Node_ptr mNode;
-		Instruction_list_iterator_stack mStack;
+		PendingPush_stack mStack;
+		ExpressionWalker mWalker;
+		bool mParametersOnStack;   // asked once, not for every call
 	
 };/*}}}*/
 
@@ -0,0 +1,80 @@
+// 
+// Copyright (c) 2002 David Eriksson <david@2good.nu>
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a
+// copy of this software and associated documentation files (the "Software"),
+// to deal in the Software without restriction, including without limitation
+// the rights to use, copy, modify, merge, publish, distribute, sublicense,
+// and/or sell copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+// DEALINGS IN THE SOFTWARE.
+//
+// $Id$
+#include "decoded.hpp"
+
+const DecodedInsn* DecodedInstructionCache::Get(Addr address)/*{{{*/
+{
+	Entry_map::iterator item = mLast;
+	if (mEntries.end() != item && item->first != address)
+		item++;
+	if (mEntries.end() == item || item->first != address)
+		item = mEntries.find(address);
+
+	if (mEntries.end() != item && item->second.valid)
+	{
+		mLast = item;
+		mHits++;
+		return &item->second.insn;
+	}
+
+	mMisses++;
+
+	// Earlier records keep their contents if decoding fails
+	DecodedInsn insn;
+	if (!mDecoder.Decode(address, insn))
+	{
+		if (mEntries.end() != item)
+			item->second.valid = false;
+		return NULL;
+	}
+
+	if (mEntries.end() == item)
+		item = mEntries.insert(Entry_map::value_type(address, Entry())).first;
+
+	Entry& entry = item->second;
+	entry.insn = insn;
+	entry.valid = true;
+	mLast = item;
+	return &entry.insn;
+}/*}}}*/
+
+void DecodedInstructionCache::Invalidate(Addr start, Addr end)/*{{{*/
+{
+	// Instructions starting before start may reach into the range
+	Addr first = start > MAX_INSTRUCTION_SIZE ? start - MAX_INSTRUCTION_SIZE : 0;
+	Entry_map::iterator item = mEntries.lower_bound(first);
+
+	for (; item != mEntries.end() && item->first < end; item++)
+	{
+		if (item->first + item->second.insn.size > start || item->first >= start)
+			item->second.valid = false;
+	}
+}/*}}}*/
+
+void DecodedInstructionCache::Clear()/*{{{*/
+{
+	mEntries.clear();
+	mLast = mEntries.end();
+	mHits = 0;
+	mMisses = 0;
+}/*}}}*/
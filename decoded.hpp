@@ -0,0 +1,161 @@
+// 
+// Copyright (c) 2002 David Eriksson <david@2good.nu>
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a
+// copy of this software and associated documentation files (the "Software"),
+// to deal in the Software without restriction, including without limitation
+// the rights to use, copy, modify, merge, publish, distribute, sublicense,
+// and/or sell copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+// DEALINGS IN THE SOFTWARE.
+//
+// $Id$
+#ifndef _DECODED_HPP
+#define _DECODED_HPP
+
+#include "desquirr.hpp"
+
+/**
+ * Operand of a decoded instruction.
+ *
+ * Holds the fields of IDA's op_t that the lifters use, under the same
+ * names so the processor module macros (hasSIB, sib, segrg) still apply.
+ */
+struct DecodedOperand/*{{{*/
+{
+	enum
+	{
+		TYPE_VOID = 0     // o_void
+	};
+
+	unsigned char n;          // operand number
+	unsigned char type;       // o_void terminates the operands
+	unsigned char flags;
+	char dtyp;
+	union
+	{
+		unsigned short reg;
+		unsigned short phrase;
+	};
+	unsigned long value;
+	unsigned long addr;
+	union
+	{
+		unsigned long specval;
+		struct
+		{
+			unsigned short low;
+			unsigned short high;
+		} specval_shorts;
+	};
+	char specflag1;
+	char specflag2;
+	char specflag3;
+	char specflag4;
+};/*}}}*/
+
+/**
+ * Decoded instruction, with only the operands the lifters look at
+ */
+struct DecodedInsn/*{{{*/
+{
+	enum
+	{
+		OPERAND_COUNT = 3
+	};
+
+	Addr ea;
+	unsigned short itype;
+	unsigned short size;
+	unsigned short auxpref;
+	char segpref;
+	DecodedOperand Operands[OPERAND_COUNT];
+};/*}}}*/
+
+/**
+ * Source of decoded instructions, implemented on top of IDA by the
+ * frontend or by a stand-in that decodes from a local buffer
+ */
+class InstructionDecoder/*{{{*/
+{
+	public:
+		virtual ~InstructionDecoder() {}
+
+		/**
+		 * Decode the instruction at address
+		 *
+		 * \return false if there is no instruction at address
+		 */
+		virtual bool Decode(Addr address, DecodedInsn& insn) = 0;
+};/*}}}*/
+
+/**
+ * Decoded instructions by address, shared by all functions and passes
+ * that lift the same database. A lookup does not touch the database; the
+ * owner calls Invalidate when bytes or flags change, and Clear when the
+ * database is closed.
+ */
+class DecodedInstructionCache/*{{{*/
+{
+	public:
+		DecodedInstructionCache(InstructionDecoder& decoder)
+			: mDecoder(decoder), mLast(mEntries.end()), mHits(0), mMisses(0)
+		{}
+
+		/**
+		 * Get the decoded instruction at address
+		 *
+		 * \return NULL if there is no instruction at address. Records
+		 * are never freed before Clear(), but a record is overwritten
+		 * when its instruction is decoded again after a change.
+		 */
+		const DecodedInsn* Get(Addr address);
+
+		enum
+		{
+			MAX_INSTRUCTION_SIZE = 16
+		};
+
+		/**
+		 * Decode the instructions that overlap the bytes from start to
+		 * end again on the next Get, the records stay where they are
+		 */
+		void Invalidate(Addr start, Addr end);
+
+		/** A byte or the flags at address changed */
+		void Invalidate(Addr address) { Invalidate(address, address + 1); }
+
+		/** Forget everything, e.g. when the database is closed */
+		void Clear();
+
+		size_t Size() const { return mEntries.size(); }
+		unsigned long Hits() const { return mHits; }
+		unsigned long Misses() const { return mMisses; }
+
+	private:
+		struct Entry
+		{
+			DecodedInsn insn;
+			bool valid;       // false if insn must be decoded again
+		};
+
+		typedef std::map<Addr, Entry> Entry_map;
+
+		InstructionDecoder& mDecoder;
+		Entry_map mEntries;
+		Entry_map::iterator mLast;   // lifters mostly ask for the next one
+		unsigned long mHits;
+		unsigned long mMisses;
+};/*}}}*/
+
+#endif // _DECODED_HPP
@@ -23,6 +23,8 @@
 
 // C++ headers
 
+#include <cstdio>
+#include <ctime>
 #include <sstream>
 #include <algorithm>
 #include <stack>
@@ -43,12 +45,18 @@
 
 // Local headers
 
+#include "idainternal.hpp"
+#include "log.hpp"
 #include "instruction.hpp"
 #include "node.hpp"
 #include "dataflow.hpp"
 #include "expression.hpp"
 #include "codegen.hpp"
 #include "usedefine.hpp"
+#include "passmanager.hpp"
+#include "fingerprint.hpp"
+#include "snapshot.hpp"
+#include "trace.hpp"
 #include "idapro.hpp"
 #include "ida-x86.hpp"
 #include "ida-arm.hpp"
@@ -57,21 +65,10 @@
 // after each processing step.
 bool g_bDumpNodeContents= false;
 
-int message(const char *format,...)
-{
-  va_list va;
-  va_start(va, format);
-  int nbytes = Frontend::Get().vmsg(format, va);
-  va_end(va);
-  return nbytes;
-}
-int message(const std::string& str)
-{
-    int nbytes=0;
-    for (size_t i= 0 ; i<str.size() ; i+=1024)
-        nbytes += message("%s", str.substr(i, 1024).c_str());
-    return nbytes;
-}
+// passes run on each function after the node list is created,
+// see PassManager for the syntax. Use "(dataflow)*" to iterate the
+// data flow analysis until nothing changes.
+const char* g_szPipeline= "dataflow";
 
 static LongSize s_size = UNKNOWN_LONG_SIZE;
 
@@ -96,6 +93,103 @@ static int sample_callback(void * /*user_data*/, int event_id, va_list /*va*/)
                                 // otherwise the event would be ignored
 }
 
+//--------------------------------------------------------------------------
+// This callback is called for processor module events, renames made while
+// decompiling invalidate the cached names
+static int rename_callback(void * /*user_data*/, int event_id, va_list va)
+{
+  if ( event_id == processor_t::rename )
+  {
+    ea_t ea = va_arg(va, ea_t);
+    const char *name = va_arg(va, const char *);
+    Frontend::Get().Names().Renamed(ea, name);
+  }
+  return 0;                     // let the processor module see it too
+}
+
+//--------------------------------------------------------------------------
+// These callbacks keep the decoded instructions up to date while the
+// plugin is loaded: new code or data and patched bytes or operand types
+// change what decoding gives, a closed database leaves nothing valid
+static int decoded_idp_callback(void * /*user_data*/, int event_id, va_list va)
+{
+  switch ( event_id )
+  {
+    case processor_t::make_code:
+      {
+        ea_t ea = va_arg(va, ea_t);
+        asize_t size = va_arg(va, asize_t);
+        DecodedInstructions().Invalidate(ea, ea + size);
+      }
+      break;
+
+    case processor_t::make_data:
+      {
+        ea_t ea = va_arg(va, ea_t);
+        va_arg(va, flags_t);    // flags
+        va_arg(va, tid_t);      // structure id
+        asize_t len = va_arg(va, asize_t);
+        DecodedInstructions().Invalidate(ea, ea + len);
+      }
+      break;
+
+    case processor_t::undefine:
+      {
+        ea_t ea = va_arg(va, ea_t);
+        DecodedInstructions().Invalidate(ea);
+      }
+      break;
+
+    case processor_t::closebase:
+      DecodedInstructions().Clear();
+      break;
+  }
+  return 0;
+}
+
+static int decoded_idb_callback(void * /*user_data*/, int event_id, va_list va)
+{
+  switch ( event_id )
+  {
+    case idb_event::byte_patched:
+    case idb_event::op_type_changed:
+      {
+        ea_t ea = va_arg(va, ea_t);
+        DecodedInstructions().Invalidate(ea);
+      }
+      break;
+  }
+  return 0;
+}
+
+//--------------------------------------------------------------------------
+// This callback is called for database events, a new prototype changes
+// what the call sites know about a callee, and a changed structure or
+// stack frame the cached member paths
+static int idb_callback(void * /*user_data*/, int event_id, va_list va)
+{
+  switch ( event_id )
+  {
+    case idb_event::ti_changed:
+      {
+        ea_t ea = va_arg(va, ea_t);
+        Frontend::Get().Callees().Invalidate(ea);
+      }
+      break;
+
+    case idb_event::struc_deleted:
+    case idb_event::struc_renamed:
+    case idb_event::struc_expanded:
+    case idb_event::struc_member_created:
+    case idb_event::struc_member_deleted:
+    case idb_event::struc_member_renamed:
+    case idb_event::struc_member_changed:
+      Frontend::Get().Names().StructChanged();
+      break;
+  }
+  return 0;
+}
+
 //--------------------------------------------------------------------------
 // A sample how to generate user-defined line prefixes
 static const int prefix_width = 8;
@@ -176,7 +270,11 @@ int idaapi init(void)
 // Please uncomment the following line to see how the user-defined prefix works
 //  set_user_defined_prefix(prefix_width, get_user_defined_prefix);
 
-  return PLUGIN_OK;
+  // Decoded instructions are kept between runs, see term()
+  hook_to_notification_point(HT_IDP, decoded_idp_callback, NULL);
+  hook_to_notification_point(HT_IDB, decoded_idb_callback, NULL);
+
+  return PLUGIN_KEEP;
 }
 
 //--------------------------------------------------------------------------
@@ -190,14 +288,61 @@ int idaapi init(void)
 
 void idaapi term(void)
 {
+  unhook_from_notification_point(HT_IDP, decoded_idp_callback);
+  unhook_from_notification_point(HT_IDB, decoded_idb_callback);
+  DecodedInstructions().Clear();
+  CurrentScan().Clear();
   unhook_from_notification_point(HT_UI, (hook_cb_t*)sample_callback);
   set_user_defined_prefix(0, NULL);
 }
 
+static void CaptureSnapshot(Addr start, Node_list& nodes)
+{
+	char path[32];
+	qsnprintf(path, sizeof(path), "%08lx.dsq", start);
+	if (SaveSnapshot(path, start, nodes))
+		msg("Snapshot saved to %s\n", path);
+}
+
+static double Milliseconds(clock_t start)
+{
+	return (clock() - start) * 1000.0 / CLOCKS_PER_SEC;
+}
+
+/**
+ * Print the code of a function, or append its record to jsonl
+ */
+static void Output(CodeStyle style, const FunctionRecord& function, 
+		Node_list& nodes, FILE* jsonl)
+{
+	// one JSON line at a time, kept so its memory is reused
+	static OutputStream s_record;
+	
+	if (JSON_STYLE == style)
+	{
+		GenerateJson(function, nodes, s_record);
+		fwrite(s_record.Data(), 1, s_record.Size(), jsonl);
+		s_record.Clear();
+	}
+	else
+	{
+		if (function.deduplicated)
+			msg("Basic block list (same as an earlier function):\n");
+		else
+			msg("Basic block list:\n");
+		GenerateCode(nodes, style);
+	}
+}
+
 // arg & 1: decompile to C code (1) or normally (0)
 // arg & 2: print instruction list before splitting into nodes
 // arg & 4: dump current instruction
 // arg & 8: process all functions
+// arg & 16: save a snapshot of the nodes of each function to <address>.dsq,
+//           before the passes run, as input for tests/corpus
+// arg & 32: write one JSON record per function to <database>.jsonl
+// arg & 64: write a trace of the stages to <database>.trace.json, for
+//           chrome://tracing or ui.perfetto.dev
 void idaapi run(int arg)
 {
 	msg("Running The Desquirr decompiler plugin\n");
@@ -216,6 +361,8 @@ void idaapi run(int arg)
 	
 	Frontend_ptr frontend(idapro);
 	Frontend::Set(frontend);
+	Log::Reset();
+	ObjectCounters::Reset();
 
 	if (arg & 4)
 	{
@@ -223,50 +370,153 @@ void idaapi run(int arg)
 		return;
 	}
 	CodeStyle style = (arg & 1) ? C_STYLE : LISTING_STYLE;
+
+	FILE* jsonl = NULL;
+	if (arg & 32)
+	{
+		char path[QMAXPATH];
+		get_root_filename(path, sizeof(path) - 6);
+		qstrncat(path, ".jsonl", sizeof(path));
+
+		jsonl = fopen(path, "w");
+		if (NULL == jsonl)
+		{
+			msg("Error, could not create %s\n", path);
+			return;
+		}
+		msg("Writing JSON records to %s\n", path);
+		style = JSON_STYLE;
+	}
+
+	if (arg & 64)
+	{
+		char path[QMAXPATH];
+		get_root_filename(path, sizeof(path) - 11);
+		qstrncat(path, ".trace.json", sizeof(path));
+
+		if (!Trace::Open(path))
+		{
+			msg("Error, could not create %s\n", path);
+			if (jsonl)
+				fclose(jsonl);
+			return;
+		}
+		msg("Writing trace to %s\n", path);
+	}
+
+	std::string pipeline = g_szPipeline;
+	if (g_bDumpNodeContents)
+		pipeline = "dump," + pipeline + ",dump";
+
+	// A bad pipeline would fail for every function
+	if (!PassManager::IsValid(pipeline))
+	{
+		msg("Error, bad pipeline \"%s\"\n", pipeline.c_str());
+		Trace::Close();
+		if (jsonl)
+			fclose(jsonl);
+		return;
+	}
+
+	hook_to_notification_point(HT_IDP, rename_callback, NULL);
+	hook_to_notification_point(HT_IDB, idb_callback, NULL);
+
+	// functions already decompiled in this run, by fingerprint
+	CloneCache clones;
 	
 	for (func_t *function= (arg&8)?get_next_func(0) : get_func(get_screen_ea()) ; function ; function= (arg&8)?get_next_func(function->startEA):0)
 	{
 		if (function->flags & FUNC_LIB)
 			msg("Warning: Library function\n");
 		
+		FunctionRecord record;
+		record.address = function->startEA;
+		char name[MAXSTR] = "";
+		if (JSON_STYLE == style || Trace::Enabled())
+		{
+			if (get_func_name(function->startEA, name, sizeof(name)))
+				record.name = name;
+		}
+		TraceSpan span("function", function->startEA, name);
+		
 		Instruction_list instructions;
 
 		msg("-> Creating instruction list\n");
-		idapro->FillList(function, instructions);
+		ObjectCounters::BeginFunction(function->startEA);
+		clock_t start = clock();
+		{
+			TraceSpan span("FillList");
+			idapro->FillList(function, instructions);
+		}
+		record.lift = Milliseconds(start);
+		ObjectCounters::Sample("lift");
 
 		if (arg & 2)
 		{
 			msg("Instruction list:\n");
 			GenerateCode(instructions, style);
+			ObjectCounters::EndFunction();
 			break;
 		}
 
+		FunctionFingerprint fingerprint;
+		fingerprint.Compute(function->startEA, instructions);
+
+		Node_list* clone = clones.Find(fingerprint);
+		if (clone)
+		{
+			record.deduplicated = true;
+			Output(style, record, *clone, jsonl);
+			ObjectCounters::EndFunction();
+			continue;
+		}
+
 		Node_list nodes;
 		msg("-> Creating node list\n");
-		Node::CreateList(instructions, nodes);
-        //if (g_bDumpNodeContents) DumpList(nodes);
-		msg("-> Update uses and definitions\n");
-		UpdateUsesAndDefinitions(nodes);
-        //if (g_bDumpNodeContents) DumpList(nodes);
-		msg("-> Live register analysis\n");
-		Node::LiveRegisterAnalysis(nodes);
-        //if (g_bDumpNodeContents) DumpList(nodes);
-		msg("-> Finding DU chains\n");
-		Node::FindDefintionUseChains(nodes);
-        if (g_bDumpNodeContents) DumpList(nodes);
-		
-		msg("-> Data flow analysis\n");
+		start = clock();
 		{
-			DataFlowAnalysis analysis(nodes);
-			analysis.AnalyzeNodeList();
-			// want destructor to run here :-)
+			TraceSpan span("CreateList");
+			Node::CreateList(instructions, nodes);
 		}
-        if (g_bDumpNodeContents) DumpList(nodes);
+		record.nodes = Milliseconds(start);
+		ObjectCounters::Sample("nodes");
 
-		msg("Basic block list:\n");
-		GenerateCode(nodes, style);
+		PassManager passes(nodes);
+		if (arg & 16)
+		{
+			// The snapshot records dominators, the passes keep them cached
+			passes.Cache().Require(ANALYSIS_DOMINATORS);
+			CaptureSnapshot(function->startEA, nodes);
+		}
 
+		start = clock();
+		passes.Run(pipeline);
+		record.passes = Milliseconds(start);
+
+		{
+			TraceSpan span("output");
+			Output(style, record, nodes, jsonl);
+		}
+		ObjectCounters::Sample("output");
+		ObjectCounters::EndFunction();
+
+		clones.Add(fingerprint, nodes);
+	}
+
+	if (arg & 8)
+	{
+		msg("%lu of %lu functions were deduplicated\n", 
+				clones.Hits(), clones.Hits() + clones.Misses());
 	}
+
+	ObjectCounters::Report();
+	Trace::Close();
+
+	if (jsonl)
+		fclose(jsonl);
+
+	unhook_from_notification_point(HT_IDP, rename_callback);
+	unhook_from_notification_point(HT_IDB, idb_callback);
 }
 
 //--------------------------------------------------------------------------
@@ -320,85 +570,3 @@ plugin_t PLUGIN = {
   wanted_name,          // the preferred short name of the plugin
   wanted_hotkey         // the preferred hotkey to run the plugin
 };
-
-// .... dump helpers
-struct DumpInsnHelper {
-    DumpInsnHelper(std::ostream& os)
-        : os(os) 
-    {}
-    void operator() (Instruction_ptr item)
-    {
-        os << *item.get();
-    }
-    std::ostream& os;
-};
-
-std::ostream& printlist(std::ostream& os, Instruction_list& list)
-{
-    for_each(list.begin(), list.end(), DumpInsnHelper(os));
-
-    return os;
-}
-
-void DumpList(Instruction_list& list)
-{
-    std::ostringstream strstr;
-    printlist(strstr, list);
-    message(strstr.str());
-}
-
-struct DumpNodeHelper {
-    DumpNodeHelper(std::ostream& os)
-        : os(os) 
-    {}
-    void operator() (Node_ptr item)
-    {
-        os << *item.get();
-    }
-    std::ostream& os;
-};
-
-std::ostream& printlist(std::ostream& os, Node_list& list)
-{
-    for_each(list.begin(), list.end(), DumpNodeHelper(os));
-
-    return os;
-}
-
-void DumpList(Node_list& list)
-{
-    std::ostringstream strstr;
-    printlist(strstr, list);
-    message(strstr.str());
-}
-
-struct DumpExprHelper {
-    DumpExprHelper(std::ostream& os)
-        : os(os), first(true)
-    {}
-    void operator() (Expression_ptr item)
-    {
-        if (!first)
-            os << ", ";
-        os << *item.get();
-        first= false;
-    }
-    std::ostream& os;
-    bool first;
-};
-
-std::ostream& printvector(std::ostream& os, Expression_vector& list)
-{
-    for_each(list.begin(), list.end(), DumpExprHelper(os));
-
-    return os;
-}
-
-void DumpVector(Expression_vector& list)
-{
-    std::ostringstream strstr;
-    printvector(strstr, list);
-    message(strstr.str());
-}
-
-
@@ -135,6 +135,7 @@ bool is16bit();
 bool is32bit();
 
 int message(const char *format,...);
+int message(const std::string& str);
 
 void DumpList(Instruction_list& list);
 std::ostream& printlist(std::ostream& os, Instruction_list& list);
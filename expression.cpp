@@ -26,16 +26,6 @@
 //
 #include <sstream>
 
-//
-// IDA headers
-//
-#include <ida.hpp>
-#include <idp.hpp>
-#include <typeinf.hpp>
-#include <funcs.hpp>
-#include <struct.hpp>
-#include <frame.hpp>
-
 //
 // Local headers
 //
@@ -43,7 +33,6 @@
 #include "instruction.hpp"
 #include "expression.hpp"
 #include "frontend.hpp"
-#include "idapro.hpp"
 
 BinaryOpPrecedences precedencemap;
 
@@ -53,9 +42,9 @@ std::string Register::Name(RegisterIndex index)/*{{{*/
 }/*}}}*/
 
 CallExpression::CallExpression(Expression_ptr function)/*{{{*/
-	: Expression(CALL), mFunctionAddress(BADADDR),
+	: Expression(CALL), mFunctionAddress(INVALID_ADDR),
 		mParameterCount(UNKNOWN_PARAMETER_COUNT), 
-		mCallingConvention(CM_CC_UNKNOWN),
+		mCallingConvention(CALLING_UNKNOWN),
 		mFinishedAddingParameters(false)
 {
 //	memset(mReturnType,     0, sizeof(mReturnType));
@@ -68,40 +57,30 @@ CallExpression::CallExpression(Expression_ptr function)/*{{{*/
 		mFunctionAddress = static_cast<GlobalVariable*>(function.get())->Address();
 	}
 
-	LoadFunctionInformation();
-	LoadTypeInformation();
+	LoadCalleeSummary();
 }/*}}}*/
 
 CallExpression::~CallExpression()/*{{{*/
 {
 }/*}}}*/
 
-void CallExpression::LoadFunctionInformation()/*{{{*/
+void CallExpression::LoadCalleeSummary()/*{{{*/
 {
-	if (BADADDR == mFunctionAddress)
+	if (INVALID_ADDR == mFunctionAddress)
 		return;
-	
-	func_t* func = get_func(mFunctionAddress);
-	if (func)
-	{
-		if (func->argsize > 0)
-		{
-//			msg("Function at %p purges %i bytes\n", mFunctionAddress, func->argsize);
 
-			// XXX: this is for 32-bit code
-			ParameterCount(func->argsize >> 2);
-		}
+	const CalleeSummary& callee = Frontend::Get().Callee(mFunctionAddress);
+
+	if (callee.purge >= 0)
+	{
+		// XXX: this is for 32-bit code
+		ParameterCount(callee.purge >> 2);
 	}
-	else
+
+	if (callee.hasType)
 	{
-		ulong purge = get_ind_purged(mFunctionAddress);
-		if (purge != (ulong)-1)
-		{
-//			msg("Function at %p purges %i bytes\n", mFunctionAddress, purge);
-		
-			// XXX: this is for 32-bit code
-			ParameterCount(purge >> 2);
-		}
+		CallingConvention(callee.callingConvention);
+		ParameterCount(callee.parameterCount);
 	}
 }/*}}}*/
 
@@ -116,11 +95,7 @@ int mymsg(const char *format, ...)
 }
 #endif
 
-void CallExpression::LoadTypeInformation()/*{{{*/
-{
-	IdaPro::LoadCallTypeInformation(this);
-}/*}}}*/
-
+#if 0
 ea_t DataSeg()
 {
 	for(int i = 0; i < get_segm_qty(); i++)
@@ -132,7 +107,6 @@ ea_t DataSeg()
 	return 0;
 }
 
-#if 0
 void CallExpression::SetDataTypes()/*{{{*/
 {
 	ea_t base = DataSeg();
@@ -147,7 +121,7 @@ void CallExpression::SetDataTypes()/*{{{*/
 			char buffer[MAXSTR]; 
 			buffer[0] = '\0';
 			print_type_to_one_line(buffer, sizeof(buffer), idati, mDataTypes[i]);
-			msg("Parameter %i type: %s\n", i, buffer);
+			message("Parameter %i type: %s\n", i, buffer);
 #endif
 			
 			e->DataType().Set(mDataTypes[i]);
@@ -171,48 +145,82 @@ void CallExpression::SetDataTypes()/*{{{*/
 }/*}}}*/
 #endif
 
-Expression_ptr StringLiteral::CreateFrom(ea_t address)/*{{{*/
+/**
+ * How each byte is written in a C string literal, empty if it stands for
+ * itself
+ */
+class EscapeTable/*{{{*/
 {
-	Expression_ptr result;
-	
-	ulong type = get_str_type(address);
+	public:
+		EscapeTable()
+		{
+			// not HexDigits, which may not be constructed yet
+			static const char DIGITS[] = "0123456789abcdef";
+			
+			for (int c = 0; c < 256; c++)
+			{
+				if (c >= 0x20 && c < 0x7f)
+				{
+					mEscapes[c][0] = '\0';
+				}
+				else
+				{
+					mEscapes[c][0] = '\\';
+					mEscapes[c][1] = 'x';
+					mEscapes[c][2] = DIGITS[c >> 4];
+					mEscapes[c][3] = DIGITS[c & 0xf];
+					mEscapes[c][4] = '\0';
+				}
+			}
 
-    std::string value = GetString(address, type);
-	if (!value.empty())
-		result.reset(new StringLiteral(value, type));
-	else
-		msg("ERROR: StringLiteral::CreateFrom(%08lx) -> NULL\n", address);
+			Set('\n', "\\n");    // 0x0a newline
+			Set('\r', "\\r");    // 0x0d carriage return
+			Set('\t', "\\t");    // 0x09 tab
+			Set('\\', "\\\\");   // 0x5c backslash
+			Set('\v', "\\v");    // 0x0b vertical tab
+			Set('\b', "\\b");    // 0x08 backspace
+			Set('\f', "\\f");    // 0x0c form feed
+			Set('\a', "\\a");    // 0x07 bell
+			Set('\"', "\\\"");   // 0x22 double quote
+		}
 
-	return result;
-}/*}}}*/
+		const char* Escape(unsigned char c) const { return mEscapes[c]; }
 
-std::string StringLiteral::GetString(ea_t address, ulong type)/*{{{*/
-{
-	size_t len = get_max_ascii_length(address, type, false);
-	boost::shared_array<char> str(new char[len+1]);
-	get_ascii_contents(address, len, type, str.get(), len+1);
-	return str.get();
-}/*}}}*/
+	private:
+		void Set(unsigned char c, const char* escape)
+		{
+			char* out = mEscapes[c];
+			while ('\0' != (*out++ = *escape++))
+				;
+		}
+		
+		char mEscapes[256][5];
+};/*}}}*/
+
+static const EscapeTable s_escapes;
 
 std::string StringLiteral::EscapeAsciiString(const std::string& ascstr)/*{{{*/
 {
-    std::string esc;
-    for (std::string::const_iterator i= ascstr.begin() ; i!=ascstr.end() ; ++i) {
-             if ((*i)=='\n') esc += "\\n";    // 0x0a newline
-        else if ((*i)=='\r') esc += "\\r";    // 0x0d carriage return
-        else if ((*i)=='\t') esc += "\\t";    // 0x09 tab
-        else if ((*i)=='\\') esc += "\\\\";   // 0x5c backslash
-        else if ((*i)=='\v') esc += "\\v";    // 0x0b vertical tab
-        else if ((*i)=='\b') esc += "\\b";    // 0x08 backspace
-        else if ((*i)=='\f') esc += "\\f";    // 0x0c form feed
-        else if ((*i)=='\a') esc += "\\a";    // 0x07 bell
-        else if ((*i)=='\"') esc += "\\\"";   // 0x22 double quote
-        else if (isprint(*i))
-            esc += (*i);
-        else
-            esc += str(boost::format("\\x%02x") % (int)(*i));
-    }
-    return esc;
+	std::string esc;
+	esc.reserve(ascstr.size() + ascstr.size() / 4);
+	
+	const char* begin = ascstr.data();
+	const char* end   = begin + ascstr.size();
+	const char* run   = begin;   // start of characters not yet copied
+	
+	for (const char* i = begin; i != end; i++)
+	{
+		const char* escape = s_escapes.Escape((unsigned char)*i);
+		if ('\0' != *escape)
+		{
+			esc.append(run, i);
+			esc.append(escape);
+			run = i + 1;
+		}
+	}
+	esc.append(run, end);
+	
+	return esc;
 }/*}}}*/
 
 Addr GlobalVariable::Address()
@@ -225,7 +233,7 @@ Addr GlobalVariable::Address()
 #if 1
 bool Expression::Equal(Expression_ptr a, Expression_ptr b)
 {
-//	msg("Comparing two expressions\n");
+//	message("Comparing two expressions\n");
 	
 	if (a->Type() != b->Type() ||
 			a->SubExpressionCount() != b->SubExpressionCount())
@@ -240,10 +248,18 @@ bool Expression::Equal(Expression_ptr a, Expression_ptr b)
 	switch (a->Type())
 	{
 		case UNARY_EXPRESSION:
+			return 
+				static_cast<UnaryExpression*>(a.get())->Operation() ==
+				static_cast<UnaryExpression*>(b.get())->Operation();
+
 		case BINARY_EXPRESSION:
+			return 
+				static_cast<BinaryExpression*>(a.get())->Operation() ==
+				static_cast<BinaryExpression*>(b.get())->Operation();
+
 		case TERNARY_EXPRESSION:
-			// TODO: check operators
-			return false;
+			// The operands were compared above
+			return true;
 
 		case REGISTER:
 			return 
@@ -255,10 +271,64 @@ bool Expression::Equal(Expression_ptr a, Expression_ptr b)
 				static_cast<NumericLiteral*>(a.get())->Value() ==
 				static_cast<NumericLiteral*>(b.get())->Value();
 
-			// TODO: handle all types
+		case STRING_LITERAL:
+			return 
+				static_cast<StringLiteral*>(a.get())->Value() ==
+				static_cast<StringLiteral*>(b.get())->Value();
+
+		case GLOBAL:
+		case STACK_VARIABLE:
+			return 
+				static_cast<Location*>(a.get())->Name() ==
+				static_cast<Location*>(b.get())->Name() &&
+				static_cast<Location*>(a.get())->Index() ==
+				static_cast<Location*>(b.get())->Index();
+
+		case CALL:
+			// The function and the parameters were compared above
+		case DUMMY:
+			return true;
 	}
 
 	return false;
 }
 #endif
 
+bool Expression::ContainsCall(Expression_ptr e)/*{{{*/
+{
+	if (e->IsType(CALL))
+		return true;
+
+	for (int i = 0; i < e->SubExpressionCount(); i++)
+	{
+		if (ContainsCall(e->SubExpression(i)))
+			return true;
+	}
+	return false;
+}/*}}}*/
+
+bool Expression::ReadsMemory(Expression_ptr e)/*{{{*/
+{
+	switch (e->Type())
+	{
+		case CALL:
+		case GLOBAL:
+		case STACK_VARIABLE:
+			return true;
+
+		case UNARY_EXPRESSION:
+			if ("*" == static_cast<UnaryExpression*>(e.get())->Operation())
+				return true;
+			break;
+
+		default:
+			break;
+	}
+
+	for (int i = 0; i < e->SubExpressionCount(); i++)
+	{
+		if (ReadsMemory(e->SubExpression(i)))
+			return true;
+	}
+	return false;
+}/*}}}*/
@@ -23,11 +23,11 @@
 #ifndef _EXPRESSION_HPP
 #define _EXPRESSION_HPP
 
-#include <ida.hpp>
-
 #include "desquirr.hpp"
+#include "printer.hpp"
+#include "counters.hpp"
 /*
-Expression    [ SubExpressionCount, SubExpression, GenerateCode, Accept, AcceptDepthFirst ]
+Expression    [ SubExpressionCount, SubExpression, SubExpressionSlot, GenerateCode, Accept, AcceptDepthFirst ]
     UnaryExpression   ... operation, operand
     BinaryExpression  ... first, operation, second
     TernaryExpression ... cond, thenval, elseval
@@ -282,7 +282,7 @@ class ExpressionVisitor
 /**
  * Abstract base class for all expressions
  */
-class Expression/*{{{*/
+class Expression : public Counted<OBJECT_EXPRESSION>/*{{{*/
 {
 	public:
 		enum ExpressionType
@@ -329,6 +329,15 @@ class Expression/*{{{*/
 		{
 		}
 
+		/**
+		 * Get where a sub-expression is stored, so it can be read or
+		 * replaced without copying the pointer
+		 */
+		virtual Expression_ptr* SubExpressionSlot(int index)
+		{
+			return NULL;
+		}
+
 		virtual void GenerateCode(std::ostream& os)
 		{
 			os << "NYI";
@@ -337,20 +346,25 @@ class Expression/*{{{*/
 		virtual void Accept(ExpressionVisitor& visitor) = 0;
 
 		/**
-		 * Apply visitor to all sub-expressions with depth-first search
+		 * Apply visitor to all sub-expressions with depth-first search.
+		 * Use an ExpressionWalker directly to reuse its stack.
 		 */
-		virtual void AcceptDepthFirst(ExpressionVisitor& visitor)
-		{
-			for (int i = 0; i < SubExpressionCount(); i++)
-				SubExpression(i)->AcceptDepthFirst(visitor);
-			Accept(visitor);
-		}
+		void AcceptDepthFirst(ExpressionVisitor& visitor);
 
 		static bool Equal(Expression_ptr a, Expression_ptr b);
 
+		/** \return true if e or one of its sub-expressions is a call */
+		static bool ContainsCall(Expression_ptr e);
+
+		/**
+		 * \return true if the value of e depends on memory: it calls a
+		 * function, dereferences a pointer or reads a variable
+		 */
+		static bool ReadsMemory(Expression_ptr e);
+
 	protected:
 		Expression(ExpressionType type)
-			: mType(type)
+			: Counted<OBJECT_EXPRESSION>(type), mType(type)
 		{
 		}
     public:
@@ -398,6 +412,11 @@ class UnaryExpression : public Expression/*{{{*/
 			mOperand = e;
 		}
 
+		virtual Expression_ptr* SubExpressionSlot(int /*index*/)
+		{
+			return &mOperand;
+		}
+
 		void Operand(Expression_ptr operand) { mOperand = operand; }
 		Expression_ptr Operand() { return mOperand; }
 
@@ -433,7 +452,7 @@ class BinaryExpression : public Expression/*{{{*/
 		BinaryExpression(Expression_ptr first, const char* operation, 
 				Expression_ptr second)
 			: Expression(BINARY_EXPRESSION), mFirst(first), mOperation(operation),
-				mSecond(second)
+				mSecond(second), mPrecedence(precedencemap.binaryprecedence(mOperation))
 		{}
         virtual void print(std::ostream& os)
         {
@@ -446,7 +465,7 @@ class BinaryExpression : public Expression/*{{{*/
 		}
 
         virtual int Precedence() const {
-            return precedencemap.binaryprecedence(mOperation);
+            return mPrecedence;
         }
            
 		virtual int SubExpressionCount()
@@ -470,6 +489,14 @@ class BinaryExpression : public Expression/*{{{*/
 				mSecond = e;
 		}
 
+		virtual Expression_ptr* SubExpressionSlot(int index)
+		{
+			if (0 == index)
+				return &mFirst;
+			else
+				return &mSecond;
+		}
+
 		void First(Expression_ptr first) { mFirst = first; }
 		Expression_ptr First() { return mFirst; }
 
@@ -507,6 +534,7 @@ class BinaryExpression : public Expression/*{{{*/
 		Expression_ptr mFirst;
 		std::string mOperation;
 		Expression_ptr mSecond;
+		int mPrecedence;      // looked up once, the operation never changes
 };/*}}}*/
 
 /**
@@ -550,6 +578,11 @@ class TernaryExpression : public Expression/*{{{*/
 		{
 			mOperands[index] = e;
 		}
+
+		virtual Expression_ptr* SubExpressionSlot(int index)
+		{
+			return &mOperands[index];
+		}
 		
 		virtual void GenerateCode(std::ostream& os)
 		{
@@ -635,6 +668,11 @@ class CallExpression : public Expression/*{{{*/
 			mSubExpressions[index] = e;
 		}
 
+		virtual Expression_ptr* SubExpressionSlot(int index)
+		{
+			return &mSubExpressions[index];
+		}
+
 		int ParameterCount() const { return mParameterCount; }
 
 		void ParameterCountFromStack(int parameterCount)
@@ -736,16 +774,6 @@ class CallExpression : public Expression/*{{{*/
 			}
 		}
 
-		/** special overloaded version */
-		virtual void AcceptDepthFirst(ExpressionVisitor& visitor)
-		{
-			// First subexpression is function, but we want it to be examined last
-			for (int i = 1; i < SubExpressionCount(); i++)
-				SubExpression(i)->AcceptDepthFirst(visitor);
-		  SubExpression(0)->AcceptDepthFirst(visitor);
-			Accept(visitor);
-		}
-
 		virtual void GenerateCode(std::ostream& os)
 		{
 #if DUMP_DATA_TYPES
@@ -762,6 +790,7 @@ class CallExpression : public Expression/*{{{*/
 		}
 
 		Addr Address() { return mFunctionAddress; }
+		void Address(Addr address) { mFunctionAddress = address; }
 
 		void ParameterCount(int parameterCount)
 		{
@@ -778,8 +807,7 @@ class CallExpression : public Expression/*{{{*/
 		Calling mCallingConvention;
 		bool mFinishedAddingParameters;
 
-		void LoadTypeInformation();
-		void LoadFunctionInformation();
+		void LoadCalleeSummary();
 };/*}}}*/
 
 class NumericLiteral : public Expression/*{{{*/
@@ -792,7 +820,7 @@ class NumericLiteral : public Expression/*{{{*/
 		}
         virtual void print(std::ostream& os)
         {
-            os << boost::format("NUMLITERAL:%08lx") % Value();
+            os << "NUMLITERAL:" << Hex8(Value());
         }
 
 		virtual void Accept(ExpressionVisitor& visitor)
@@ -814,10 +842,12 @@ class NumericLiteral : public Expression/*{{{*/
 				os << (signed long)mValue;
 			else
 			{
-				if (mValue < 0x10)
-					os << boost::format("%d") % mValue;
+				if (mValue < 10)
+					os.put((char)('0' + mValue));
+				else if (mValue < 0x10)
+					os << mValue;
 				else
-					os << boost::format("0x%x") % mValue;
+					os << "0x" << Hex(mValue);
 			}
 		}
 
@@ -844,11 +874,11 @@ class StringLiteral : public Expression/*{{{*/
 		}
         virtual void print(std::ostream& os)
         {
-            os << boost::format("STRINGLITERAL:%s:'%s'") 
-                % (mStringType==STRING_UNICODE? "L":
+            os << "STRINGLITERAL:"
+                << (mStringType==STRING_UNICODE? "L":
                     mStringType==STRING_ULEN2? "2":
                     mStringType==STRING_ULEN4? "4":"")
-                % mValue;
+                << ":'" << mValue << '\'';
         }
 
 		virtual void Accept(ExpressionVisitor& visitor)
@@ -875,8 +905,12 @@ class StringLiteral : public Expression/*{{{*/
 			os << '"' << EscapeAsciiString(mValue) << '"';
 		}
 
-		static Expression_ptr CreateFrom(ea_t address);
-		static std::string GetString(ea_t address, ulong type);
+		const std::string& Value() const { return mValue; }
+		unsigned long StringType() const { return mStringType; }
+
+		/** Implemented by the IDA frontend, in idapro.cpp */
+		static Expression_ptr CreateFrom(Addr address);
+		static std::string GetString(Addr address, unsigned long type);
 
 		static std::string EscapeAsciiString(const std::string& str);
 
@@ -899,7 +933,7 @@ class Register : public Expression/*{{{*/
 		}
         virtual void print(std::ostream& os)
         {
-            os << boost::format("REGISTER:%s") % Register::Name(Index());
+            os << "REGISTER:" << Register::Name(Index());
         }
 
 		virtual void Accept(ExpressionVisitor& visitor)
@@ -961,12 +995,14 @@ class Location : public Expression/*{{{*/
 		{}
         virtual void print(std::ostream& os)
         {
-            os << boost::format("LOCATION:%s") % mName;
+            os << "LOCATION:" << mName;
             if (mIndex)
-                os << boost::format("[%d]") % mIndex;
+                os << '[' << mIndex << ']';
         }
 
 		std::string Name() const throw() { return mName; }
+		void Name(const std::string& name) { mName = name; }
+		int Index() const throw() { return mIndex; }
 
 		virtual void GenerateCode(std::ostream& os)
 		{
@@ -998,9 +1034,7 @@ class GlobalVariable : public Location/*{{{*/
 		}
         virtual void print(std::ostream& os)
         {
-            os << boost::format("GLOBAL:%s") % Name();
-//            if (mIndex)
-//                os << boost::format("[%d]") % mIndex;
+            os << "GLOBAL:" << Name();
         }
 
 		virtual void Accept(ExpressionVisitor& visitor)
@@ -1009,13 +1043,21 @@ class GlobalVariable : public Location/*{{{*/
 		}
 
 		Addr Address();
+
+		/** Rename, the address is looked up again from the new name */
+		void Name(const std::string& name)
+		{
+			Location::Name(name);
+			mAddress = INVALID_ADDR;
+		}
+		using Location::Name;
 	
         virtual int Precedence() const {
             return precedencemap.atomprecedence();
         }
 
-		static Expression_ptr CreateFrom(ea_t ea, ea_t from = INVALID_ADDR);
-		static std::string GetName(ea_t ea, ea_t from = INVALID_ADDR);
+		static Expression_ptr CreateFrom(Addr ea, Addr from = INVALID_ADDR);
+		static std::string GetName(Addr ea, Addr from = INVALID_ADDR);
 
 	private:
 		Addr mAddress;
@@ -1031,9 +1073,7 @@ class StackVariable : public Location/*{{{*/
 		}
         virtual void print(std::ostream& os)
         {
-            os << boost::format("LOCAL:%s") % Name();
-//            if (mIndex)
-//                os << boost::format("[%d]") % mIndex;
+            os << "LOCAL:" << Name();
         }
 
 		virtual void Accept(ExpressionVisitor& visitor)
@@ -1077,5 +1117,195 @@ class Dummy : public Expression/*{{{*/
 
 };/*}}}*/
 
+/**
+ * Visit an expression with a type switch on Type() instead of the virtual
+ * Accept, see Dispatch(Instruction&, Visitor&)
+ */
+template<class Visitor>
+void Dispatch(Expression& expression, Visitor& visitor)/*{{{*/
+{
+	switch (expression.Type())
+	{
+		case Expression::BINARY_EXPRESSION:
+			visitor.Visitor::Visit(static_cast<BinaryExpression&>(expression));
+			break;
+		case Expression::CALL:
+			visitor.Visitor::Visit(static_cast<CallExpression&>(expression));
+			break;
+		case Expression::DUMMY:
+			visitor.Visitor::Visit(static_cast<Dummy&>(expression));
+			break;
+		case Expression::GLOBAL:
+			visitor.Visitor::Visit(static_cast<GlobalVariable&>(expression));
+			break;
+		case Expression::NUMERIC_LITERAL:
+			visitor.Visitor::Visit(static_cast<NumericLiteral&>(expression));
+			break;
+		case Expression::REGISTER:
+			visitor.Visitor::Visit(static_cast<Register&>(expression));
+			break;
+		case Expression::STACK_VARIABLE:
+			visitor.Visitor::Visit(static_cast<StackVariable&>(expression));
+			break;
+		case Expression::STRING_LITERAL:
+			visitor.Visitor::Visit(static_cast<StringLiteral&>(expression));
+			break;
+		case Expression::TERNARY_EXPRESSION:
+			visitor.Visitor::Visit(static_cast<TernaryExpression&>(expression));
+			break;
+		case Expression::UNARY_EXPRESSION:
+			visitor.Visitor::Visit(static_cast<UnaryExpression&>(expression));
+			break;
+	}
+}/*}}}*/
+
+/**
+ * Expression visited through its base class, Accept is the only way
+ */
+inline void Dispatch(Expression& expression, ExpressionVisitor& visitor)
+{
+	expression.Accept(visitor);
+}
+
+/**
+ * Non-recursive depth-first traversal of expression trees.
+ *
+ * The walker keeps its stack between calls, so keep one around instead of
+ * creating one per expression. Children are reached through raw pointers
+ * and SubExpressionSlot, without copying any Expression_ptr. As in
+ * AcceptDepthFirst, the function of a call comes after its parameters.
+ * A walker must not be used again from inside a visitor it is running.
+ */
+class ExpressionWalker/*{{{*/
+{
+	public:
+		/** Visit each expression before its sub-expressions */
+		template<class Visitor>
+		void PreOrder(Expression& root, Visitor& visitor)/*{{{*/
+		{
+			Dispatch(root, visitor);
+			Push(&root);
+
+			while (!mStack.empty())
+			{
+				Frame& frame = mStack.back();
+
+				if (frame.next < frame.count)
+				{
+					Expression* child = Child(frame);
+					Dispatch(*child, visitor);
+					Push(child);
+				}
+				else
+				{
+					mStack.pop_back();
+				}
+			}
+		}/*}}}*/
+
+		/** Visit each expression after its sub-expressions */
+		template<class Visitor>
+		void PostOrder(Expression& root, Visitor& visitor)/*{{{*/
+		{
+			Push(&root);
+
+			while (!mStack.empty())
+			{
+				Frame& frame = mStack.back();
+
+				if (frame.next < frame.count)
+				{
+					Push(Child(frame));
+				}
+				else
+				{
+					Expression* expression = frame.expression;
+					mStack.pop_back();
+					Dispatch(*expression, visitor);
+				}
+			}
+		}/*}}}*/
+
+		/**
+		 * Offer every expression to replacer in pre-order, as the place
+		 * it is stored in. replacer(Expression_ptr& slot) returns true if it
+		 * assigned a new expression to slot, which is then not descended
+		 * into. The caller marks the instruction that holds root changed,
+		 * see Instruction::OperandChanged.
+		 *
+		 * \return true if anything was replaced
+		 */
+		template<class Replacer>
+		bool Replace(Expression_ptr& root, Replacer& replacer)/*{{{*/
+		{
+			if (replacer(root))
+				return true;
+
+			bool replaced = false;
+			Push(root.get());
+
+			while (!mStack.empty())
+			{
+				Frame& frame = mStack.back();
+
+				if (frame.next < frame.count)
+				{
+					Expression_ptr* slot = ChildSlot(frame);
+					if (replacer(*slot))
+						replaced = true;
+					else
+						Push(slot->get());
+				}
+				else
+				{
+					mStack.pop_back();
+				}
+			}
+
+			return replaced;
+		}/*}}}*/
+
+	private:
+		struct Frame
+		{
+			Expression* expression;
+			int next;    // position of the next sub-expression to visit
+			int count;
+		};
+
+		void Push(Expression* expression)
+		{
+			Frame frame;
+			frame.expression = expression;
+			frame.next = 0;
+			frame.count = expression->SubExpressionCount();
+			mStack.push_back(frame);
+		}
+
+		/** Advance frame to its next sub-expression, calls do the function last */
+		static Expression_ptr* ChildSlot(Frame& frame)
+		{
+			int index = frame.next++;
+
+			if (frame.expression->IsType(Expression::CALL))
+				index = (index + 1) % frame.count;
+
+			return frame.expression->SubExpressionSlot(index);
+		}
+
+		static Expression* Child(Frame& frame)
+		{
+			return ChildSlot(frame)->get();
+		}
+
+		std::vector<Frame> mStack;
+};/*}}}*/
+
+inline void Expression::AcceptDepthFirst(ExpressionVisitor& visitor)
+{
+	ExpressionWalker walker;
+	walker.PostOrder(*this, visitor);
+}
+
 #endif
 
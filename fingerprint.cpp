@@ -0,0 +1,399 @@
+// 
+// Copyright (c) 2002 David Eriksson <david@2good.nu>
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a
+// copy of this software and associated documentation files (the "Software"),
+// to deal in the Software without restriction, including without limitation
+// the rights to use, copy, modify, merge, publish, distribute, sublicense,
+// and/or sell copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+// DEALINGS IN THE SOFTWARE.
+//
+// $Id$
+#include <set>
+#include <sstream>
+
+#include "fingerprint.hpp"
+#include "instruction.hpp"
+#include "expression.hpp"
+#include "node.hpp"
+
+#include "lowlevel.hpp"
+
+/**
+ * Writes the normalized form of instructions and their operands
+ */
+class FingerprintBuilder/*{{{*/
+{
+	public:
+		FingerprintBuilder(FunctionFingerprint& fingerprint)
+			: mFingerprint(fingerprint)
+		{}
+
+		void Add(Instruction& instruction)/*{{{*/
+		{
+			mOut << 'I' << instruction.Type() << '@' 
+				<< Relative(instruction.Address()) << ' ';
+
+			switch (instruction.Type())
+			{
+				case Instruction::LABEL:
+					mOut << 'L' << Slot(static_cast<Label&>(instruction).Name()) << ' ';
+					break;
+
+				case Instruction::CASE:
+					AddCase(static_cast<Case&>(instruction));
+					break;
+
+				case Instruction::SWITCH:
+					AddSwitch(static_cast<Switch&>(instruction));
+					break;
+
+				case Instruction::THROW:
+					mOut << static_cast<Throw&>(instruction).DataType().size() << ':'
+						<< static_cast<Throw&>(instruction).DataType() << ' ';
+					break;
+
+				case Instruction::LOW_LEVEL:
+					AddLowLevel(static_cast<LowLevel&>(instruction).Insn());
+					break;
+
+				default:
+					break;
+			}
+
+			for (int i = 0; i < instruction.OperandCount(); i++)
+			{
+				Expression_ptr* slot = instruction.OperandSlot(i);
+				if (NULL == slot || NULL == slot->get())
+				{
+					mOut << "- ";
+					continue;
+				}
+
+				mOut << "( ";
+				mWalker.PreOrder(**slot, *this);
+				mOut << ") ";
+			}
+		}/*}}}*/
+
+		std::string Key() const { return mOut.str(); }
+
+		//
+		// Expressions, called by the walker
+		//
+
+		void Visit(BinaryExpression& e)  { mOut << 'B' << e.Operation() << ' '; }
+		void Visit(UnaryExpression& e)   { mOut << 'U' << e.Operation() << ' '; }
+		void Visit(TernaryExpression&)   { mOut << "T "; }
+		void Visit(Dummy&)               { mOut << "D "; }
+		void Visit(NumericLiteral& e)    { mOut << 'N' << e.Value() << ' '; }
+		void Visit(Register& e)          { mOut << 'R' << e.Index() << ' '; }
+
+		void Visit(CallExpression& e)
+		{
+			mOut << 'C' << e.ParameterCount() << ',' << e.CallingConvention()
+				<< ',' << e.SubExpressionCount() << ' ';
+		}
+
+		void Visit(GlobalVariable& e)
+		{
+			mOut << 'G' << Slot(e.Name()) << '[' << e.Index() << "] ";
+		}
+
+		void Visit(StackVariable& e)
+		{
+			mOut << 'S' << Slot(e.Name()) << '[' << e.Index() << "] ";
+		}
+
+		void Visit(StringLiteral& e)
+		{
+			mOut << 'Q' << e.StringType() << ',' << e.Value().size() << ':' 
+				<< e.Value() << ' ';
+		}
+
+	private:
+		unsigned long Relative(Addr address)
+		{
+			return address - mFingerprint.mStart;
+		}
+
+		int Slot(const std::string& name)
+		{
+			return mFingerprint.Slot(name);
+		}
+
+		void AddCase(Case& instruction)
+		{
+			mOut << (instruction.IsDefault() ? 'd' : 'c');
+			for (int i = 0; i < instruction.ValueCount(); i++)
+				mOut << ',' << instruction.Value(i);
+			mOut << ' ';
+		}
+
+		void AddSwitch(Switch& instruction)
+		{
+			const SwitchCase_vector& cases = instruction.Cases();
+			mOut << 'W' << Relative(instruction.DefaultTarget());
+			for (SwitchCase_vector::const_iterator item = cases.begin();
+					item != cases.end();
+					item++)
+			{
+				mOut << ',' << item->value << '>' << Relative(item->target);
+			}
+			mOut << ' ';
+		}
+
+		void AddLowLevel(const DecodedInsn& insn)
+		{
+			mOut << 'X' << insn.itype << ',' << insn.size << ',' << insn.auxpref
+				<< ',' << (int)insn.segpref;
+			for (int i = 0; i < DecodedInsn::OPERAND_COUNT; i++)
+			{
+				const DecodedOperand& op = insn.Operands[i];
+				if (DecodedOperand::TYPE_VOID == op.type)
+					break;
+				mOut << ',' << (int)op.type << ':' << (int)op.dtyp << ':' << op.reg 
+					<< ':' << op.value << ':' << Relative(op.addr) << ':' << op.specval;
+			}
+			mOut << ' ';
+		}
+
+		FunctionFingerprint& mFingerprint;
+		std::ostringstream mOut;
+		ExpressionWalker mWalker;
+};/*}}}*/
+
+void FunctionFingerprint::Compute(Addr start, Instruction_list& instructions)/*{{{*/
+{
+	mStart = start;
+	mNames.clear();
+	mSlots.clear();
+
+	FingerprintBuilder builder(*this);
+	for (Instruction_list::iterator item = instructions.begin();
+			item != instructions.end();
+			item++)
+	{
+		builder.Add(**item);
+	}
+
+	mKey = builder.Key();
+}/*}}}*/
+
+int FunctionFingerprint::Slot(const std::string& name)/*{{{*/
+{
+	Slot_map::iterator item = mSlots.find(name);
+	if (mSlots.end() != item)
+		return item->second;
+
+	int slot = mNames.size();
+	mSlots[name] = slot;
+	mNames.push_back(name);
+	return slot;
+}/*}}}*/
+
+/**
+ * Finds the named expressions of a cached node list and their slots. The
+ * names are changed after the walk, so no name is looked up after it was
+ * already replaced.
+ */
+class RenameCollector/*{{{*/
+{
+	public:
+		typedef std::map<std::string, int> Slot_map;
+		typedef std::vector< std::pair<Location*, int> > Location_vector;
+
+		RenameCollector(const std::vector<std::string>& names)
+		{
+			for (size_t i = 0; i < names.size(); i++)
+				mSlots[names[i]] = i;
+		}
+
+		int Slot(const std::string& name)
+		{
+			Slot_map::iterator item = mSlots.find(name);
+			return (mSlots.end() == item) ? -1 : item->second;
+		}
+
+		void Visit(GlobalVariable& e) { Collect(e, mGlobals); }
+		void Visit(StackVariable& e)  { Collect(e, mStackVariables); }
+
+		void Visit(CallExpression& e)
+		{
+			if (mSeen.insert(&e).second)
+				mCalls.push_back(&e);
+		}
+
+		void Visit(BinaryExpression&)  {}
+		void Visit(Dummy&)             {}
+		void Visit(NumericLiteral&)    {}
+		void Visit(Register&)          {}
+		void Visit(StringLiteral&)     {}
+		void Visit(TernaryExpression&) {}
+		void Visit(UnaryExpression&)   {}
+
+		Location_vector& Globals()        { return mGlobals; }
+		Location_vector& StackVariables() { return mStackVariables; }
+		std::vector<CallExpression*>& Calls() { return mCalls; }
+
+	private:
+		void Collect(Location& e, Location_vector& locations)
+		{
+			// passes may share one expression between instructions
+			if (!mSeen.insert(&e).second)
+				return;
+
+			int slot = Slot(e.Name());
+			if (slot >= 0)
+				locations.push_back(std::make_pair(&e, slot));
+		}
+
+		Slot_map mSlots;
+		std::set<Expression*> mSeen;
+		Location_vector mGlobals;
+		Location_vector mStackVariables;
+		std::vector<CallExpression*> mCalls;
+};/*}}}*/
+
+Node_list* CloneCache::Find(const FunctionFingerprint& fingerprint)/*{{{*/
+{
+	Entry_map::iterator item = mEntries.find(fingerprint.Key());
+	if (mEntries.end() == item)
+	{
+		mMisses++;
+		return NULL;
+	}
+
+	mHits++;
+	Rename(item->second, fingerprint);
+	return &item->second.nodes;
+}/*}}}*/
+
+void CloneCache::Add(const FunctionFingerprint& fingerprint, /*{{{*/
+		const Node_list& nodes)
+{
+	std::pair<Entry_map::iterator, bool> inserted = mEntries.insert(
+			std::make_pair(fingerprint.Key(), Entry()));
+	Entry& entry = inserted.first->second;
+	
+	if (inserted.second)
+		mOrder.push_back(fingerprint.Key());
+	else
+		Disconnect(entry.nodes);
+
+	entry.start = fingerprint.Start();
+	entry.names = fingerprint.Names();
+	entry.nodes = nodes;
+
+	// forget the oldest functions, a run over a whole database would
+	// otherwise keep all of them
+	while (mOrder.size() > MAX_ENTRIES)
+	{
+		Entry_map::iterator oldest = mEntries.find(mOrder.front());
+		Disconnect(oldest->second.nodes);
+		mEntries.erase(oldest);
+		mOrder.pop_front();
+	}
+}/*}}}*/
+
+void CloneCache::Clear()/*{{{*/
+{
+	for (Entry_map::iterator item = mEntries.begin(); item != mEntries.end(); item++)
+		Disconnect(item->second.nodes);
+	
+	mEntries.clear();
+	mOrder.clear();
+	mHits = 0;
+	mMisses = 0;
+}/*}}}*/
+
+void CloneCache::Disconnect(Node_list& nodes)/*{{{*/
+{
+	for (Node_list::iterator node = nodes.begin(); node != nodes.end(); node++)
+		(**node).DisconnectSuccessors();
+}/*}}}*/
+
+/**
+ * Give the cached node list the names and addresses of fingerprint:
+ * instruction, node, successor and switch target addresses move with
+ * the function, labels and variables get the names of the new function
+ * and calls the address of their renamed callee.
+ */
+void CloneCache::Rename(Entry& entry, const FunctionFingerprint& fingerprint)/*{{{*/
+{
+	const std::vector<std::string>& names = fingerprint.Names();
+	RenameCollector collector(entry.names);
+	ExpressionWalker walker;
+	std::vector< std::pair<Label*, int> > labels;
+
+	for (Node_list::iterator node = entry.nodes.begin();
+			node != entry.nodes.end();
+			node++)
+	{
+		(**node).Move(entry.start, fingerprint.Start());
+		
+		Instruction_list& instructions = (**node).Instructions();
+		for (Instruction_list::iterator item = instructions.begin();
+				item != instructions.end();
+				item++)
+		{
+			Instruction& instruction = **item;
+			instruction.Address(instruction.Address() - entry.start + fingerprint.Start());
+
+			if (instruction.IsType(Instruction::SWITCH))
+				static_cast<Switch&>(instruction).MoveTargets(entry.start, fingerprint.Start());
+
+			if (instruction.IsType(Instruction::LABEL))
+			{
+				Label& label = static_cast<Label&>(instruction);
+				int slot = collector.Slot(label.Name());
+				if (slot >= 0)
+					labels.push_back(std::make_pair(&label, slot));
+			}
+
+			for (int i = 0; i < instruction.OperandCount(); i++)
+			{
+				Expression_ptr* slot = instruction.OperandSlot(i);
+				if (NULL != slot && NULL != slot->get())
+					walker.PreOrder(**slot, collector);
+			}
+		}
+	}
+
+	for (size_t i = 0; i < labels.size(); i++)
+		labels[i].first->Name(names[labels[i].second]);
+
+	RenameCollector::Location_vector& globals = collector.Globals();
+	for (size_t i = 0; i < globals.size(); i++)
+		static_cast<GlobalVariable*>(globals[i].first)->Name(names[globals[i].second]);
+
+	RenameCollector::Location_vector& stackVariables = collector.StackVariables();
+	for (size_t i = 0; i < stackVariables.size(); i++)
+		stackVariables[i].first->Name(names[stackVariables[i].second]);
+
+	// a renamed callee is looked up again, other calls move with the code
+	std::vector<CallExpression*>& calls = collector.Calls();
+	for (size_t i = 0; i < calls.size(); i++)
+	{
+		CallExpression* call = calls[i];
+		Expression_ptr function = call->SubExpression(0);
+		if (function->IsType(Expression::GLOBAL))
+			call->Address(static_cast<GlobalVariable*>(function.get())->Address());
+		else
+			call->Address(Node::Move(call->Address(), entry.start, fingerprint.Start()));
+	}
+
+	entry.start = fingerprint.Start();
+	entry.names = names;
+}/*}}}*/
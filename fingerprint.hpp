@@ -0,0 +1,125 @@
+// 
+// Copyright (c) 2002 David Eriksson <david@2good.nu>
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a
+// copy of this software and associated documentation files (the "Software"),
+// to deal in the Software without restriction, including without limitation
+// the rights to use, copy, modify, merge, publish, distribute, sublicense,
+// and/or sell copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+// DEALINGS IN THE SOFTWARE.
+//
+// $Id$
+#ifndef _FINGERPRINT_HPP
+#define _FINGERPRINT_HPP
+
+#include <deque>
+
+#include "desquirr.hpp"
+
+/**
+ * Normalized form of a lifted function. Instruction addresses are kept
+ * relative to the entry, and labels, globals and stack variables are
+ * replaced by the order in which their names first appear, so byte
+ * identical functions at other addresses or with other names compare
+ * equal.
+ */
+class FunctionFingerprint/*{{{*/
+{
+	public:
+		FunctionFingerprint()
+			: mStart(INVALID_ADDR)
+		{}
+
+		void Compute(Addr start, Instruction_list& instructions);
+
+		Addr Start() const { return mStart; }
+		const std::string& Key() const { return mKey; }
+		
+		/** Names in the order of their slots */
+		const std::vector<std::string>& Names() const { return mNames; }
+
+	private:
+		friend class FingerprintBuilder;
+		
+		/** Slot of a name, a new one the first time it is seen */
+		int Slot(const std::string& name);
+
+		typedef std::map<std::string, int> Slot_map;
+
+		Addr mStart;
+		std::string mKey;
+		std::vector<std::string> mNames;
+		Slot_map mSlots;
+};/*}}}*/
+
+/**
+ * Decompiled functions by fingerprint for one run. A function that
+ * matches an earlier one reuses its node list, renamed and moved to the
+ * new address, instead of running the passes again.
+ */
+class CloneCache/*{{{*/
+{
+	public:
+		enum
+		{
+			MAX_ENTRIES = 1024   // functions kept, the oldest go first
+		};
+		
+		CloneCache()
+			: mHits(0), mMisses(0)
+		{}
+
+		~CloneCache() { Clear(); }
+
+		/**
+		 * Find the decompilation of a function with the same fingerprint,
+		 * and give it the names and address of fingerprint
+		 *
+		 * \return NULL if no such function was decompiled in this run; the
+		 * list stays valid until the next Find, Add or Clear
+		 */
+		Node_list* Find(const FunctionFingerprint& fingerprint);
+
+		/**
+		 * Remember the decompilation of the function of fingerprint. The
+		 * successors of the nodes are disconnected when it is forgotten.
+		 */
+		void Add(const FunctionFingerprint& fingerprint, const Node_list& nodes);
+
+		void Clear();
+
+		size_t Size() const { return mEntries.size(); }
+		unsigned long Hits() const { return mHits; }
+		unsigned long Misses() const { return mMisses; }
+
+	private:
+		struct Entry
+		{
+			Addr start;
+			std::vector<std::string> names;  // current names of the slots
+			Node_list nodes;
+		};
+
+		typedef std::map<std::string, Entry> Entry_map;
+
+		static void Rename(Entry& entry, const FunctionFingerprint& fingerprint);
+		static void Disconnect(Node_list& nodes);
+
+		Entry_map mEntries;
+		std::deque<std::string> mOrder;   // keys, oldest first
+		unsigned long mHits;
+		unsigned long mMisses;
+};/*}}}*/
+
+#endif // _FINGERPRINT_HPP
@@ -35,3 +35,43 @@ Frontend& Frontend::Get()
 	return *mCurrentFrontend.get();
 }
 
+int message(const char *format,...)
+{
+  va_list va;
+  va_start(va, format);
+  int nbytes = Frontend::Get().vmsg(format, va);
+  va_end(va);
+  return nbytes;
+}
+int message(const std::string& str)
+{
+    int nbytes=0;
+    for (size_t i= 0 ; i<str.size() ; i+=1024)
+        nbytes += message("%s", str.substr(i, 1024).c_str());
+    return nbytes;
+}
+
+Addr Frontend::AddressFromName(const char *name, Addr referer)
+{
+	if (INVALID_ADDR != referer)
+		return LookupAddress(name, referer);
+
+	Addr address;
+	if (!mNames.FindAddress(name, address))
+	{
+		address = LookupAddress(name, referer);
+		mNames.AddAddress(name, address);
+	}
+	return address;
+}
+
+const CalleeSummary& Frontend::Callee(Addr address)
+{
+	const CalleeSummary* summary = mCallees.Find(address);
+	if (summary)
+		return *summary;
+
+	CalleeSummary lookup;
+	LookupCallee(address, lookup);
+	return mCallees.Add(address, lookup);
+}
@@ -24,10 +24,14 @@
 #define _FRONTEND_HPP
 
 #include "desquirr.hpp"
+#include "namecache.hpp"
+#include "callee.hpp"
 
 #include <stdarg.h>
 
 class Frontend;
+class DataFlowAnalysis;
+class Assignment;
 typedef boost::shared_ptr<Frontend> Frontend_ptr;
 
 class Frontend
@@ -36,8 +40,28 @@ class Frontend
 		virtual std::string RegisterName(RegisterIndex index) const = 0;
 		virtual int vmsg(const char *format, va_list va) = 0;
 
-		virtual Addr AddressFromName(const char *name, 
-				Addr referer = INVALID_ADDR) = 0;
+		/** True if the target passes call parameters on the stack */
+		virtual bool ParametersOnStack() = 0;
+
+		/** Called by the data flow analysis for each assignment */
+		virtual void OnAssignment(DataFlowAnalysis* /*analysis*/,
+				Assignment* /*assignment*/)
+		{}
+
+		/**
+		 * Address of a name, names looked up without a referer are
+		 * remembered in Names()
+		 */
+		Addr AddressFromName(const char *name, 
+				Addr referer = INVALID_ADDR);
+
+		/** Names resolved in this session */
+		NameCache& Names() { return mNames; }
+
+		/** Summary of the function at address, looked up once per session */
+		const CalleeSummary& Callee(Addr address);
+
+		CalleeCache& Callees() { return mCallees; }
 
 #if 0
 		virtual Address GetStartAddress() = 0;
@@ -46,6 +70,14 @@ class Frontend
 
 		static void Set(Frontend_ptr frontend);
 		static Frontend& Get();
+
+	protected:
+		virtual Addr LookupAddress(const char *name, Addr referer) = 0;
+		virtual void LookupCallee(Addr address, CalleeSummary& summary) = 0;
+
+	private:
+		NameCache mNames;
+		CalleeCache mCallees;
 };
 
 #endif
@@ -24,6 +24,8 @@
 #include "ida-arm.hpp"
 #include "analysis.hpp"
 #include "ida-arm2.hpp"
+#include "log.hpp"
+#include "trace.hpp"
 
 std::string IdaArm::RegisterName(RegisterIndex index) const/*{{{*/
 {
@@ -79,7 +81,7 @@ const char* const IdaArm::ConditionOp(int condition)/*{{{*/
 	}
 }/*}}}*/
 
-void IdaArm::DumpInsn(insn_t& insn)/*{{{*/
+void IdaArm::DumpInsn(const DecodedInsn& insn)/*{{{*/
 {
 	msg("ea=%p, itype=\"%s\" (%i)", insn.ea, ::ph.instruc[insn.itype].name, insn.itype);
 
@@ -88,9 +90,9 @@ void IdaArm::DumpInsn(insn_t& insn)/*{{{*/
 
 	msg("\n");
 	
-	for (int i = 0; i < UA_MAXOP; i++)
+	for (int i = 0; i < DecodedInsn::OPERAND_COUNT; i++)
 	{
-		op_t& op = insn.Operands[i];
+		const DecodedOperand& op = insn.Operands[i];
 		
 		if (op.type == o_void)
 			break;
@@ -135,7 +137,7 @@ void IdaArm::DumpInsn(insn_t& insn)/*{{{*/
 }/*}}}*/
 
 /*{{{ Expression_ptr FromOperand */
-static Expression_ptr FromOperand(insn_t& insn, int operand/*,
+static Expression_ptr FromOperand(const DecodedInsn& insn, int operand/*,
 				TypeInformation* type = NULL*/)
 {
 	Expression_ptr result;
@@ -150,7 +152,7 @@ static Expression_ptr FromOperand(insn_t& insn, int operand/*,
 			return result;
 	}
 
-	op_t op = insn.Operands[operand];
+	DecodedOperand op = insn.Operands[operand];
 	
 	switch (op.type)
 	{
@@ -213,7 +215,7 @@ static Expression_ptr FromOperand(insn_t& insn, int operand/*,
 					}
 					else
 					{
-						insn_t insxx= insn;
+						DecodedInsn insxx= insn;
 						insxx.Operands[operand].addr= ptr;
 						// XXX: maybe use & operator for result?
 						result = CreateGlobalVariable(insxx, operand);
@@ -281,31 +283,40 @@ static Expression_ptr FromOperand(insn_t& insn, int operand/*,
 	return result;
 }/*}}}*/
 
-bool OperandIsRegister(insn_t& insn, int operand)/*{{{*/
+bool OperandIsRegister(const DecodedInsn& insn, int operand)/*{{{*/
 {
 	return 
 		o_reg == insn.Operands[operand].type;
 }/*}}}*/
 
-bool OperandIsImmediate(insn_t& insn, int operand)/*{{{*/
+bool OperandIsImmediate(const DecodedInsn& insn, int operand)/*{{{*/
 {
 	return 
 		o_imm == insn.Operands[operand].type;
 }/*}}}*/
 
-class ArmAnalysis : public Analysis/*{{{*/
+class ArmAnalysis : public AnalysisImpl<ArmAnalysis>/*{{{*/
 {
 	public:
+		// the DecodedInsn overloads below would hide the default hooks
+		using AnalysisImpl<ArmAnalysis>::OnPush;
+		using AnalysisImpl<ArmAnalysis>::OnPop;
 
 		void AnalyzeFunction(func_t* function, Instruction_list& instructions)/*{{{*/
 		{
 			Instructions(&instructions);
-			MakeLowLevelList(function);
+			{
+				TraceSpan span("MakeLowLevelList");
+				MakeLowLevelList(function);
+			}
 
 			//memset(&mFlagUpdate, 0, sizeof(mFlagUpdate));
 			//mFlagUpdateItem = Instructions().end();
 
-			AnalyzeInstructionList();
+			{
+				TraceSpan span("idioms");
+				AnalyzeInstructionList();
+			}
 			Instructions(NULL);
 		}/*}}}*/
 
@@ -314,64 +325,67 @@ class ArmAnalysis : public Analysis/*{{{*/
 		{
 			Instructions().clear();
 
-			for(ea_t address = function->startEA; 
-					address < function->endEA;
-					address = get_item_end(address))
+			FunctionScan& scan = CurrentScan();
+			scan.Scan(function->startEA);
+
+			// end of the previous chunk, until the tail gets its label
+			Addr previousChunkEnd = INVALID_ADDR;
+
+			for(ScannedItem_vector::const_iterator item = scan.Items().begin(); 
+					item != scan.Items().end();
+					item++)
 			{
-				flags_t flags = getFlags(address);
+				ea_t address = item->address;
 
-				if (!isCode(flags))
-				{
-					if (isUnknown(flags))
-					{
-						msg("Warning, converting non-code bytes in function at offset %p\n", 
-								address);
+				if (INVALID_ADDR != item->previousChunkEnd)
+					previousChunkEnd = item->previousChunkEnd;
 
-						ua_code(address);
-						flags = getFlags(address);
-						if (!isCode(flags))
-						{
-							msg("Error, could not convert non-code bytes in function at offset %p\n", 
-									address);
-							break;
-						}
-					}
-					else if (isData(flags)) {
-						continue;
-					}
-					else
-					{
-						msg("Warning, skipping byte with flags %p at offset %p\n",
-								flags,
-								address);
-						//						address++;
-						continue;
-					}
+				if (ScannedItem::DATA == item->kind)
+					continue;
+
+				if (ScannedItem::CODE != item->kind)
+				{
+					msg("Warning, skipping byte with flags %p at offset %p\n",
+							item->flags,
+							address);
+					continue;
 				}
 
-				if (hasRef(flags) /*|| has_any_name(flags)*/)
+				Instruction_ptr label;
+				if (item->referenced)
 				{
-					int index;
-					std::string name= GetLocalCodeLabel(address, &index);
-					if (name.empty() || index)
+					std::string name;
+					scan.Label(address, name);
+					if (name.empty())
 					{
 						msg("%p Warning: referenced offset without name\n", address);
 					}
 					else
 					{
 						//msg("%p Name=%s\n", address, name.c_str());
-						Instruction_ptr label(new Label(address, name.c_str()));
-						Instructions().push_back(label);
+						label.reset(new Label(address, name.c_str()));
 					}
 				}
 
+				// A tail starts a new node even where nothing jumps to it
+				if (INVALID_ADDR != previousChunkEnd)
+				{
+					if (!label.get())
+						label = CreateLocalCodeLabel(address);
+					static_cast<Label*>(label.get())->PreviousChunkEnd(previousChunkEnd);
+					previousChunkEnd = INVALID_ADDR;
+				}
+
+				if (label.get())
+					Instructions().push_back(label);
+
 				Instructions().push_back( Instruction_ptr(
 							new LowLevel( GetLowLevelInstruction(address) )
 							));
 			}
 		}/*}}}*/
 
-		void DumpInsn(insn_t& insn)
+		void DumpInsn(const DecodedInsn& insn)
 		{
 			static_cast<IdaPro&>(Frontend::Get()).DumpInsn(insn);
 		}
@@ -430,7 +444,7 @@ class ArmAnalysis : public Analysis/*{{{*/
 			return IdaArm::ConditionOp(condition);
 		}
 
-		void InsertLabel(insn_t& insn)
+		void InsertLabel(const DecodedInsn& insn)
 		{
 			ea_t ea = get_item_end(insn.ea);
 			Instruction_ptr label= CreateLocalCodeLabel(ea);
@@ -438,12 +452,12 @@ class ArmAnalysis : public Analysis/*{{{*/
 				Insert(label);
 		}
 
-		void InsertConditional(insn_t& insn)
+		void InsertConditional(const DecodedInsn& insn)
 		{
 			int op1, op2;
 			std::string name("Cond");
 
-			op_t op = mFlagUpdate.Operands[2];
+			DecodedOperand op = mFlagUpdate.Operands[2];
 
 			if (op.type == o_void) {
 				op1 = 0; op2 = 1;
@@ -451,7 +465,7 @@ class ArmAnalysis : public Analysis/*{{{*/
 				op1 = 1; op2 = 2;
 			}
 
-			msg("%p - using conditional: %d \n", insn.ea, insn.segpref);
+			LOG(LOG_DEBUG, LOG_LIFT, ("%p - using conditional: %d \n", insn.ea, insn.segpref));
 			Insert(new ConditionalJump(
 								insn.ea,
 								Expression_ptr(new BinaryExpression(
@@ -473,9 +487,9 @@ class ArmAnalysis : public Analysis/*{{{*/
 		/**
 		 * Handle a LowLevel instruction
 		 */
-		virtual void OnLowLevel(Instruction* lowLevel)/*{{{*/
+		void OnLowLevel(Instruction* lowLevel)/*{{{*/
 		{
-			insn_t insn = static_cast<LowLevel*>(lowLevel)->Insn();
+			const DecodedInsn& insn = static_cast<LowLevel*>(lowLevel)->Insn();
 
 			// insn.segpref contains the condition code in the arm module.
 			if (cNV == insn.segpref)
@@ -583,16 +597,16 @@ class ArmAnalysis : public Analysis/*{{{*/
 			}
 		}/*}}}*/
 
-		void OnOperator(insn_t& insn, const char* operation, int operand1, int operand2)/*{{{*/
+		void OnOperator(const DecodedInsn& insn, const char* operation, int operand1, int operand2)/*{{{*/
 		{
-			op_t op = insn.Operands[operand2];
+			DecodedOperand op = insn.Operands[operand2];
 
 			if (op.type == o_void) {
 				operand1 = 0; operand2 = 1;
 			}
 
 			if ((insn.auxpref & aux_cond)!=0) {
-				msg("%p setting conditional for operator\n", insn.ea);
+				LOG(LOG_DEBUG, LOG_LIFT, ("%p setting conditional for operator\n", insn.ea));
 				mFlagUpdate = insn;
 				mFlagUpdateOp = operation;
 				mFlagUpdateItem = Instructions().end();
@@ -623,7 +637,7 @@ class ArmAnalysis : public Analysis/*{{{*/
 				InsertLabel(insn);
 		}/*}}}*/
 
-		void OnTestOperator(insn_t& insn, const char* operation)/*{{{*/
+		void OnTestOperator(const DecodedInsn& insn, const char* operation)/*{{{*/
 		{
 			if (insn.segpref != cAL)
 				InsertConditional(insn);
@@ -653,7 +667,7 @@ class ArmAnalysis : public Analysis/*{{{*/
 				InsertLabel(insn);
 		}/*}}}*/
 
-		void OnBic(insn_t& insn)/*{{{*/
+		void OnBic(const DecodedInsn& insn)/*{{{*/
 		{
 			if (insn.segpref != cAL)
 				InsertConditional(insn);
@@ -674,7 +688,7 @@ class ArmAnalysis : public Analysis/*{{{*/
 				InsertLabel(insn);
 		}/*}}}*/
 
-		void OnAddSp(insn_t& insn)/*{{{*/
+		void OnAddSp(const DecodedInsn& insn)/*{{{*/
 		{
 			if (insn.segpref != cAL)
 				InsertConditional(insn);
@@ -691,10 +705,10 @@ class ArmAnalysis : public Analysis/*{{{*/
 				InsertLabel(insn);
 		}/*}}}*/
 
-		void OnMov(insn_t& insn)/*{{{*/
+		void OnMov(const DecodedInsn& insn)/*{{{*/
 		{
 			if ((insn.auxpref & aux_cond)!=0) {
-				msg("%p setting conditional for MOVS\n", insn.ea);
+				LOG(LOG_DEBUG, LOG_LIFT, ("%p setting conditional for MOVS\n", insn.ea));
 				mFlagUpdate = insn;
 				mFlagUpdateItem = Instructions().end();
 				Insert( new Assignment(
@@ -725,7 +739,7 @@ class ArmAnalysis : public Analysis/*{{{*/
 				InsertLabel(insn);
 		}/*}}}*/
 
-		void OnMvn(insn_t& insn)/*{{{*/
+		void OnMvn(const DecodedInsn& insn)/*{{{*/
 		{
 			if (insn.segpref != cAL)
 				InsertConditional(insn);
@@ -742,14 +756,14 @@ class ArmAnalysis : public Analysis/*{{{*/
 				InsertLabel(insn);
 		}/*}}}*/
 
-		void OnMla(insn_t& insn)/*{{{*/
+		void OnMla(const DecodedInsn& insn)/*{{{*/
 		{
 
 			if (insn.Operands[2].type!=o_idpspec1) {
 				msg("ERROR: expected MLA op2=o_tworeg\n");
 				return;
 			}
-			op_t op2= insn.Operands[2];
+			DecodedOperand op2= insn.Operands[2];
 			// reg       = firstreg
 			// specflag1 = secreg
 
@@ -767,7 +781,7 @@ class ArmAnalysis : public Analysis/*{{{*/
 						));
 		}/*}}}*/
 
-		void OnNeg(insn_t& insn)
+		void OnNeg(const DecodedInsn& insn)
 		{
 			mFlagUpdate = insn;
 			mFlagUpdateOp = "-";
@@ -782,7 +796,7 @@ class ArmAnalysis : public Analysis/*{{{*/
 						));
 		}
 
-		void OnB(insn_t& insn)/*{{{*/
+		void OnB(const DecodedInsn& insn)/*{{{*/
 		{
 			// 
 			// Branch
@@ -796,7 +810,7 @@ class ArmAnalysis : public Analysis/*{{{*/
 			else
 			{
 				int op1, op2;
-				op_t op = mFlagUpdate.Operands[2];
+				DecodedOperand op = mFlagUpdate.Operands[2];
 
 				if (op.type == o_void) {
 					op1 = 0; op2 = 1;
@@ -822,7 +836,7 @@ class ArmAnalysis : public Analysis/*{{{*/
 			
 		}/*}}}*/
 
-		void OnBl(insn_t& insn)/*{{{*/
+		void OnBl(const DecodedInsn& insn)/*{{{*/
 		{
 			// 
 			// Branch with link (function call)
@@ -845,7 +859,7 @@ class ArmAnalysis : public Analysis/*{{{*/
 			
 		}/*}}}*/
 
-		void OnBx(insn_t& insn)/*{{{*/
+		void OnBx(const DecodedInsn& insn)/*{{{*/
 		{
 			// 
 			// Branch with exchange
@@ -872,7 +886,7 @@ class ArmAnalysis : public Analysis/*{{{*/
 				InsertLabel(insn);
 		}/*}}}*/
 
-		void OnLdr(insn_t& insn)/*{{{*/
+		void OnLdr(const DecodedInsn& insn)/*{{{*/
 		{
 			if (insn.segpref != cAL)
 				InsertConditional(insn);
@@ -908,7 +922,7 @@ class ArmAnalysis : public Analysis/*{{{*/
 				InsertLabel(insn);
 		}/*}}}*/
 
-		void OnLdm(insn_t& insn)/*{{{*/
+		void OnLdm(const DecodedInsn& insn)/*{{{*/
 		{
 			if (o_reg      != insn.Operands[0].type &&
 					o_idpspec2 != insn.Operands[1].type)
@@ -960,7 +974,7 @@ class ArmAnalysis : public Analysis/*{{{*/
 			}
 		}/*}}}*/
 
-		void OnStr(insn_t& insn)/*{{{*/
+		void OnStr(const DecodedInsn& insn)/*{{{*/
 		{
 			if (insn.segpref != cAL)
 				InsertConditional(insn);
@@ -984,7 +998,7 @@ class ArmAnalysis : public Analysis/*{{{*/
 				InsertLabel(insn);
 		}/*}}}*/
 
-		void OnStm(insn_t& insn)/*{{{*/
+		void OnStm(const DecodedInsn& insn)/*{{{*/
 		{
 			if (o_reg      != insn.Operands[0].type &&
 					o_idpspec2 != insn.Operands[1].type)
@@ -1022,7 +1036,7 @@ class ArmAnalysis : public Analysis/*{{{*/
 			}
 		}/*}}}*/
 
-		void OnRet(insn_t& insn)
+		void OnRet(const DecodedInsn& insn)
 		{
 			if (insn.segpref != cAL)
 				InsertConditional(insn);
@@ -1033,15 +1047,15 @@ class ArmAnalysis : public Analysis/*{{{*/
 				InsertLabel(insn);
 		}
 
-		void OnPush(insn_t &insn)
+		void OnPush(const DecodedInsn&insn)
 		{
-			msg("Enter OnPush\n");
+			LOG(LOG_DEBUG, LOG_LIFT, ("Enter OnPush\n"));
 			if (insn.Operands[0].type == o_idpspec2)
 			{
 				for (RegisterIndex i = 0; i < IdaArm::NR_NORMAL_REGISTERS ; i++)
 					if (insn.Operands[0].specval & (1 << i))
 					{
-						msg("PUSH %d\n",i);
+						LOG(LOG_DEBUG, LOG_LIFT, ("PUSH %d\n",i));
 						Insert(new Push(
 									insn.ea,
 									Expression_ptr( new Register(i) )));
@@ -1056,7 +1070,7 @@ class ArmAnalysis : public Analysis/*{{{*/
 			}
 		}
 
-		void OnPop(insn_t &insn)
+		void OnPop(const DecodedInsn&insn)
 		{
 			if (insn.Operands[0].type == o_idpspec2)
 			{
@@ -1083,7 +1097,7 @@ class ArmAnalysis : public Analysis/*{{{*/
 			}
 		}
 
-		void OnSwp(insn_t &insn)
+		void OnSwp(const DecodedInsn&insn)
 		{
 			if (insn.segpref != cAL)
 				InsertConditional(insn);
@@ -1110,40 +1124,16 @@ class ArmAnalysis : public Analysis/*{{{*/
 				InsertLabel(insn);
 		}
 
-		bool GetInstructions(int count, insn_vector& instructions)/*{{{*/
+		bool GetInstructions(int count, InsnWindow& window)/*{{{*/
 		{
-			for(Instruction_list::iterator item = Iterator();
-					count > 0 && item != Instructions().end();
-					item++)
-			{
-				if ((**item).IsType(Instruction::LOW_LEVEL))
-				{
-					instructions.push_back(
-							static_cast<LowLevel*>(item->get())->Insn());
-				}
-				else
-					break;
-
-				count--;
-			}
-	
-			// Fill with empty elements if needed
-			if (0 < count)
-			{
-				insn_t empty;
-				memset(&empty, 0, sizeof(empty));
-				while (count--)
-					instructions.push_back(empty);
-			}
-			
-			return 0 == count;
+			return window.Fill(Iterator(), Instructions().end(), count);
 		}/*}}}*/
 
-		bool TryAnd(insn_t& insn)/*{{{*/
+		bool TryAnd(const DecodedInsn& insn)/*{{{*/
 		{
-			insn_vector idiom;
+			InsnWindow idiom;
 
-			msg("%p TryAnd\n", insn.ea);
+			LOG(LOG_DEBUG, LOG_LIFT, ("%p TryAnd\n", insn.ea));
 
 			if (!GetInstructions(2, idiom))
 				return false;
@@ -1159,7 +1149,7 @@ class ArmAnalysis : public Analysis/*{{{*/
 					idiom[0].Operands[0].reg == idiom[1].Operands[1].reg &&
 					idiom[0].Operands[2].value == idiom[1].Operands[2].value)
 			{
-				msg("%p TryAnd: operand 2: %d, %x\n", insn.ea, idiom[0].Operands[2].type, idiom[0].Operands[2].value);
+				LOG(LOG_DEBUG, LOG_LIFT, ("%p TryAnd: operand 2: %d, %x\n", insn.ea, idiom[0].Operands[2].type, idiom[0].Operands[2].value));
 				Insert(new Assignment(
 						insn.ea,
 						::FromOperand(idiom[1], 0),
@@ -1180,7 +1170,7 @@ class ArmAnalysis : public Analysis/*{{{*/
 		// Sometimes ADD R3,R1,0 is used to move a value.
 		// Recognize this and replace by a straight assignment
 
-		bool TryAddMov(insn_t& insn)/*{{{*/
+		bool TryAddMov(const DecodedInsn& insn)/*{{{*/
 		{
 			if (insn.Operands[2].type == o_imm && insn.Operands[2].value == 0) {
 				OnMov(insn);
@@ -1188,7 +1178,7 @@ class ArmAnalysis : public Analysis/*{{{*/
 			}
 			return false;
 		}
-		bool TryAddSp(insn_t& insn)/*{{{*/
+		bool TryAddSp(const DecodedInsn& insn)/*{{{*/
 		{
 			if (OperandIsRegister(insn, 1) && insn.Operands[1].reg == REG_SP
 				&& insn.Operands[2].type == o_imm) {
@@ -1201,9 +1191,9 @@ class ArmAnalysis : public Analysis/*{{{*/
 		// Mov subroutine address to R?
 		// MOV LR, PC
 		// BX  R?
-		bool TryMovBx(insn_t& insn)/*{{{*/
+		bool TryMovBx(const DecodedInsn& insn)/*{{{*/
 		{
-			insn_vector idiom;
+			InsnWindow idiom;
 
 			if (!GetInstructions(2, idiom))
 				return false;
@@ -1228,11 +1218,11 @@ class ArmAnalysis : public Analysis/*{{{*/
 
 		AnalysisResult OnInstruction()
 		{
-			msg("%p: Analysis: Instruction Type %d\n",Instr()->Address(), Instr()->Type());
+			LOG(LOG_DEBUG, LOG_LIFT, ("%p: Analysis: Instruction Type %d\n",Instr()->Address(), Instr()->Type()));
 			return CONTINUE;
 		}
 
-		insn_t mFlagUpdate;
+		DecodedInsn mFlagUpdate;
 		const char *mFlagUpdateOp;
 		Instruction_list::iterator mFlagUpdateItem;
 };/*}}}*/
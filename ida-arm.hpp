@@ -25,6 +25,7 @@
 
 #include "desquirr.hpp"
 #include "idapro.hpp"
+#include "architecture.hpp"
 
 // from arm.hpp
 class IdaArm : public IdaPro
@@ -33,8 +34,8 @@ class IdaArm : public IdaPro
 		virtual std::string RegisterName(RegisterIndex index) const;
 		static const char* const ConditionOp(int condition);
 		virtual void FillList(func_t* function, Instruction_list& instructions);
-		virtual void DumpInsn(insn_t& insn);
-        virtual bool ParametersOnStack() { return false; }
+		virtual void DumpInsn(const DecodedInsn& insn);
+        virtual bool ParametersOnStack() { return ArmTraits::PARAMETERS_ON_STACK; }
 
     enum ArmRegNo
     {
@@ -24,6 +24,8 @@
 #include "ida-x86.hpp"
 #include "analysis.hpp"
 #include "expression.hpp"
+#include "log.hpp"
+#include "trace.hpp"
 
 #if IDP_INTERFACE_VERSION<76
 // backward compatibility
@@ -90,7 +92,7 @@ Expression_ptr RegPlusRegTimesValue(unsigned short reg1,unsigned short reg2, uns
 					));
 }/*}}}*/
 
-Expression_ptr GetSibExpression(insn_t& insn, int operand)/*{{{*/
+Expression_ptr GetSibExpression(const DecodedInsn& insn, int operand)/*{{{*/
 {
 	Expression_ptr result;
 	
@@ -190,7 +192,7 @@ Expression_ptr GetSibExpression(insn_t& insn, int operand)/*{{{*/
 }/*}}}*/
 
 /*{{{ Expression_ptr FromOperand */
-static Expression_ptr FromOperand(insn_t& insn, int operand/*,
+static Expression_ptr FromOperand(const DecodedInsn& insn, int operand/*,
 				TypeInformation* type = NULL*/)
 {
 	Expression_ptr result;
@@ -211,7 +213,7 @@ static Expression_ptr FromOperand(insn_t& insn, int operand/*,
 	
 	if (!result.get())
 	{
-		op_t op = insn.Operands[operand];
+		DecodedOperand op = insn.Operands[operand];
 		refinfo_t refinfo;
 
 #if 0
@@ -261,7 +263,7 @@ static Expression_ptr FromOperand(insn_t& insn, int operand/*,
 			case o_mem:
 			case o_far:
 				{
-				insn_t insxx= insn;
+				DecodedInsn insxx= insn;
 				insxx.Operands[operand].addr = op.addr;
 				result = CreateVariable(insxx, operand);
 				}
@@ -378,7 +380,7 @@ static Expression_ptr FromOperand(insn_t& insn, int operand/*,
  * Create an Assignment instruction from instruction and operation.
  * If the last parameter is present, use it as second operand.
  */
-Instruction_ptr AssignFromBinaryExpression(insn_t& insn, const char* operation,/*{{{*/
+Instruction_ptr AssignFromBinaryExpression(const DecodedInsn& insn, const char* operation,/*{{{*/
 		Expression* secondOperand = NULL)
 {
 	Expression_ptr second;
@@ -401,7 +403,7 @@ Instruction_ptr AssignFromBinaryExpression(insn_t& insn, const char* operation,/
 			);
 }/*}}}*/
 
-Expression_ptr CreateCondition(insn_t& condition, const char* operation)/*{{{*/
+Expression_ptr CreateCondition(const DecodedInsn& condition, const char* operation)/*{{{*/
 {
 	return Expression_ptr(new BinaryExpression(
 				FromOperand(condition, 0), 
@@ -410,7 +412,7 @@ Expression_ptr CreateCondition(insn_t& condition, const char* operation)/*{{{*/
 				));
 }/*}}}*/
 
-Instruction_ptr CreateConditionalJump(insn_t& condition, insn_t& destination,/*{{{*/
+Instruction_ptr CreateConditionalJump(const DecodedInsn& condition, const DecodedInsn& destination,/*{{{*/
 		const char* operation)
 {
 	return Instruction_ptr(
@@ -424,7 +426,7 @@ Instruction_ptr CreateConditionalJump(insn_t& condition, insn_t& destination,/*{
 
 #define DUMP_FLAG(flag) if (insn.auxpref & (flag)) msg(", " # flag );
 
-void IdaX86::DumpInsn(insn_t& insn)/*{{{*/
+void IdaX86::DumpInsn(const DecodedInsn& insn)/*{{{*/
 {
 	msg("ea=%p, itype=%i", insn.ea, insn.itype);
 
@@ -447,9 +449,9 @@ void IdaX86::DumpInsn(insn_t& insn)/*{{{*/
 
 	msg("\n");
 	
-	for (int i = 0; i < UA_MAXOP; i++)
+	for (int i = 0; i < DecodedInsn::OPERAND_COUNT; i++)
 	{
-		op_t& op = insn.Operands[i];
+		const DecodedOperand& op = insn.Operands[i];
 		
 		if (op.type == o_void)
 			break;
@@ -471,21 +473,21 @@ void IdaX86::DumpInsn(insn_t& insn)/*{{{*/
 	}
 }/*}}}*/
 
-bool OperandIsRegister(insn_t& insn, int operand, int reg)/*{{{*/
+bool OperandIsRegister(const DecodedInsn& insn, int operand, int reg)/*{{{*/
 {
 	return 
 		o_reg == insn.Operands[operand].type && 
 		reg   == insn.Operands[operand].reg;
 }/*}}}*/
 
-bool OperandIsImmediate(insn_t& insn, int operand, unsigned value)/*{{{*/
+bool OperandIsImmediate(const DecodedInsn& insn, int operand, unsigned value)/*{{{*/
 {
 	return 
 		o_imm == insn.Operands[operand].type && 
 		value == insn.Operands[operand].value;
 }/*}}}*/
 
-bool Equals(op_t& a, op_t& b)/*{{{*/
+bool Equals(const DecodedOperand& a, const DecodedOperand& b)/*{{{*/
 {
 	if (a.type != b.type || a.dtyp != b.dtyp)
 		return false;
@@ -521,8 +523,125 @@ bool Equals(op_t& a, op_t& b)/*{{{*/
 	return false;
 }/*}}}*/
 
-class X86Analysis : public Analysis/*{{{*/
+/**
+ * Operand shape required by one step of an idiom pattern
+ */
+enum IdiomShape/*{{{*/
+{
+	SHAPE_ANY,
+	SHAPE_REG,
+	SHAPE_IMM,
+	SHAPE_SAME    // only for operand 1: equal to operand 0
+};/*}}}*/
+
+enum
+{
+	MAX_IDIOM_LENGTH = 6
+};
+
+/**
+ * One instruction of an idiom pattern: the itype and the shape of the
+ * first two operands. The handler of the idiom does the remaining checks.
+ */
+struct IdiomStep/*{{{*/
+{
+	unsigned short itype;
+	IdiomShape op0;
+	IdiomShape op1;
+	bool rep;
+};/*}}}*/
+
+bool OperandHasShape(const DecodedInsn& insn, int operand, IdiomShape shape)/*{{{*/
+{
+	switch (shape)
+	{
+		case SHAPE_REG:
+			return o_reg == insn.Operands[operand].type;
+		case SHAPE_IMM:
+			return o_imm == insn.Operands[operand].type;
+		case SHAPE_SAME:
+			return Equals(insn.Operands[0], insn.Operands[operand]);
+		default:
+			return true;
+	}
+}/*}}}*/
+
+bool StepMatches(const IdiomStep& step, const DecodedInsn& insn)/*{{{*/
+{
+	return
+		step.itype == insn.itype &&
+		OperandHasShape(insn, 0, step.op0) &&
+		OperandHasShape(insn, 1, step.op1) &&
+		(!step.rep || (insn.auxpref & aux_rep));
+}/*}}}*/
+
+/**
+ * Trie over the itype sequences of all idiom patterns. Each node lists
+ * the patterns that end there, in table order, so walking the LowLevel
+ * list once from a position finds every candidate idiom.
+ */
+class IdiomTrie/*{{{*/
 {
+	public:
+		enum
+		{
+			ROOT = 0,
+			NONE = -1
+		};
+		
+		template<class Pattern>
+			IdiomTrie(const Pattern* patterns, int count)/*{{{*/
+			: mNodes(1)
+		{
+			for (int i = 0; i < count; i++)
+				Add(patterns[i].steps, patterns[i].length, i);
+		}/*}}}*/
+
+		int Next(int node, unsigned short itype) const/*{{{*/
+		{
+			std::map<unsigned short, int>::const_iterator child = 
+				mNodes[node].children.find(itype);
+			if (child == mNodes[node].children.end())
+				return NONE;
+			return child->second;
+		}/*}}}*/
+
+		const std::vector<int>& Idioms(int node) const/*{{{*/
+		{
+			return mNodes[node].idioms;
+		}/*}}}*/
+
+	private:
+		void Add(const IdiomStep* steps, int length, int idiom)/*{{{*/
+		{
+			int node = ROOT;
+			for (int i = 0; i < length; i++)
+			{
+				int next = Next(node, steps[i].itype);
+				if (NONE == next)
+				{
+					next = mNodes.size();
+					mNodes.push_back(TrieNode());
+					mNodes[node].children[steps[i].itype] = next;
+				}
+				node = next;
+			}
+			mNodes[node].idioms.push_back(idiom);
+		}/*}}}*/
+
+		struct TrieNode
+		{
+			std::map<unsigned short, int> children;
+			std::vector<int> idioms;
+		};
+		
+		std::vector<TrieNode> mNodes;
+};/*}}}*/
+
+class X86Analysis : public AnalysisImpl<X86Analysis>/*{{{*/
+{
+	friend class AnalysisImpl<X86Analysis>;
+
 	public:
 		X86Analysis()
 		{
@@ -531,12 +650,18 @@ class X86Analysis : public Analysis/*{{{*/
 		void AnalyzeFunction(func_t* function, Instruction_list& instructions)/*{{{*/
 		{
 			Instructions(&instructions);
-			MakeLowLevelList(function);
+			{
+				TraceSpan span("MakeLowLevelList");
+				MakeLowLevelList(function);
+			}
 
 			memset(&mFlagUpdate, 0, sizeof(mFlagUpdate));
 			mFlagUpdateItem = Instructions().end();
 
-			AnalyzeInstructionList();
+			{
+				TraceSpan span("idioms");
+				AnalyzeInstructionList();
+			}
 			Instructions(NULL);
 		}/*}}}*/
 
@@ -548,7 +673,7 @@ class X86Analysis : public Analysis/*{{{*/
 		} FlagSave;
 
 		
-		// this creates a list of LowLevel(insn_t)
+		// this creates a list of LowLevel(DecodedInsn)
 		// and Label(address, labelname) objects.
 		void MakeLowLevelList(func_t* function)/*{{{*/
 		{
@@ -559,61 +684,67 @@ class X86Analysis : public Analysis/*{{{*/
 			else
 				setbits(IS_16_BIT);
 
-			for(ea_t address = function->startEA; 
-					address < function->endEA;
-					address = get_item_end(address))
+			FunctionScan& scan = CurrentScan();
+			scan.Scan(function->startEA);
+
+			// end of the previous chunk, until the tail gets its label
+			Addr previousChunkEnd = INVALID_ADDR;
+
+			for(ScannedItem_vector::const_iterator item = scan.Items().begin(); 
+					item != scan.Items().end();
+					item++)
 			{
-				flags_t flags = getFlags(address);
+				ea_t address = item->address;
+
+				if (INVALID_ADDR != item->previousChunkEnd)
+					previousChunkEnd = item->previousChunkEnd;
+
+				if (ScannedItem::DATA == item->kind)
+					continue;
+
+				if (ScannedItem::CODE != item->kind)
+				{
+					msg("Warning, skipping byte with flags %p at offset %p\n",
+							item->flags,
+							address);
+					continue;
+				}
 
-				if (hasRef(flags) /*|| has_any_name(flags)*/)
+				Instruction_ptr label;
+				if (item->referenced)
 				{
-                    int index;
-                    std::string name = GetLocalCodeLabel(address, &index);
-					if (name.empty() || index)
+					std::string name;
+					scan.Label(address, name);
+					if (name.empty())
 					{
 						msg("%p Warning: referenced offset without name\n", address);
 					}
 					else
 					{
 						//msg("%p Name=%s\n", address, name.c_str());
-						Instruction_ptr label(new Label(address, name.c_str()));
-						Instructions().push_back(label);
+						label.reset(new Label(address, name.c_str()));
 					}
 				}
 
-				if (!isCode(flags))
+				// A tail starts a new node even where nothing jumps to it
+				if (INVALID_ADDR != previousChunkEnd)
 				{
-					if (isUnknown(flags))
-					{
-						msg("Warning, converting non-code bytes in function at offset %p\n", 
-								address);
-
-						ua_code(address);
-						flags = getFlags(address);
-						if (!isCode(flags))
-						{
-							msg("Error, could not convert non-code bytes in function at offset %p\n", 
-									address);
-							break;
-						}
-					}
-					else
-					{
-						msg("Warning, skipping byte with flags %p at offset %p\n",
-								flags,
-								address);
-						//						address++;
-						continue;
-					}
+					if (!label.get())
+						label = CreateLocalCodeLabel(address);
+					static_cast<Label*>(label.get())->PreviousChunkEnd(previousChunkEnd);
+					previousChunkEnd = INVALID_ADDR;
 				}
 
+				if (label.get())
+					Instructions().push_back(label);
+
 				Instructions().push_back( Instruction_ptr(
 							new LowLevel( GetLowLevelInstruction(address) )
 							));
 			}
 		}/*}}}*/
 
-		void DumpInsn(insn_t& insn)
+		void DumpInsn(const DecodedInsn& insn)
 		{
 			static_cast<IdaPro&>(Frontend::Get()).DumpInsn(insn);
 		}
@@ -621,15 +752,15 @@ class X86Analysis : public Analysis/*{{{*/
 		/**
 		 * Handle a LowLevel instruction
 		 */
-		virtual void OnLowLevel(Instruction* lowLevel)/*{{{*/
+		void OnLowLevel(Instruction* lowLevel)/*{{{*/
 		{
-			insn_t insn = static_cast<LowLevel*>(lowLevel)->Insn();
+			const DecodedInsn& insn = static_cast<LowLevel*>(lowLevel)->Insn();
 			//msg("%p OnLowLevel\n", insn.ea);
 
 #if 0
-			for (int i = 0; i < UA_MAXOP; i++)
+			for (int i = 0; i < DecodedInsn::OPERAND_COUNT; i++)
 			{
-				op_t& op = insn.Operands[i];
+				const DecodedOperand& op = insn.Operands[i];
 
 				if (op.type == o_void)
 					break;
@@ -648,6 +779,9 @@ class X86Analysis : public Analysis/*{{{*/
 				if (OnSwitchInfo(insn, si))
 					return;
 			}
+
+			if (TryIdioms(insn))
+				return;
 			
 			switch (insn.itype)
 			{
@@ -815,14 +949,6 @@ class X86Analysis : public Analysis/*{{{*/
 					break;
 
 				case NN_mov:
-					if (TryBorlandClass(insn))
-						break;
-					if (TryMemcpy(insn))
-						break;
-					if (TryMemcpy4(insn, false))
-						break;
-					// fall through
-
 				case NN_lea:
 //					msg("mov/movzx/lea: ");
 //					DumpInsn(insn);
@@ -896,36 +1022,82 @@ class X86Analysis : public Analysis/*{{{*/
 			}
 		}/*}}}*/
 
-		bool GetInstructions(int count, insn_vector& instructions)/*{{{*/
+		/**
+		 * An idiom: a pattern over the LowLevel list and the handler that
+		 * verifies the details and replaces the instructions
+		 */
+		struct IdiomPattern/*{{{*/
+		{
+			const char* name;
+			int length;
+			IdiomStep steps[MAX_IDIOM_LENGTH];
+			bool (X86Analysis::*handler)(const DecodedInsn& insn);
+
+			bool Matches(const DecodedInsn** window) const/*{{{*/
+			{
+				for (int i = 0; i < length; i++)
+					if (!StepMatches(steps[i], *window[i]))
+						return false;
+				return true;
+			}/*}}}*/
+		};/*}}}*/
+
+		static const IdiomPattern IDIOMS[];
+		static const int IDIOM_COUNT;
+
+		/**
+		 * Walk the idiom trie along the LowLevel instructions starting at
+		 * the current one and run the handlers of the matching patterns,
+		 * longest first, until one of them accepts
+		 */
+		bool TryIdioms(const DecodedInsn& insn)/*{{{*/
 		{
+			static const IdiomTrie trie(IDIOMS, IDIOM_COUNT);
+			
+			const DecodedInsn* window[MAX_IDIOM_LENGTH];
+			int nodes[MAX_IDIOM_LENGTH];
+			int depth = 0;
+			int node = IdiomTrie::ROOT;
+
 			for(Instruction_list::iterator item = Iterator();
-					count > 0 && item != Instructions().end();
+					depth < MAX_IDIOM_LENGTH && item != Instructions().end();
 					item++)
 			{
-				if ((**item).IsType(Instruction::LOW_LEVEL))
-				{
-					instructions.push_back(
-							static_cast<LowLevel*>(item->get())->Insn());
-				}
-				else
+				const DecodedInsn* current = LowLevel::Insn(*item);
+				if (!current)
+					break;
+
+				node = trie.Next(node, current->itype);
+				if (IdiomTrie::NONE == node)
 					break;
 
-				count--;
+				window[depth] = current;
+				nodes[depth] = node;
+				depth++;
 			}
-	
-			// Fill with empty elements if needed
-			if (0 < count)
+
+			while (depth-- > 0)
 			{
-				insn_t empty;
-				memset(&empty, 0, sizeof(empty));
-				while (count--)
-					instructions.push_back(empty);
+				const std::vector<int>& idioms = trie.Idioms(nodes[depth]);
+				for (std::vector<int>::const_iterator idiom = idioms.begin();
+						idiom != idioms.end();
+						idiom++)
+				{
+					const IdiomPattern& pattern = IDIOMS[*idiom];
+					if (pattern.Matches(window) && (this->*pattern.handler)(insn))
+						return true;
+				}
 			}
-			
-			return 0 == count;
+
+			return false;
 		}/*}}}*/
 
-		bool TryNegSbb(insn_t& insn)/*{{{*/
+		bool GetInstructions(int count, InsnWindow& window)/*{{{*/
+		{
+			return window.Fill(Iterator(), Instructions().end(), count);
+		}/*}}}*/
+
+		bool TryNegSbb(const DecodedInsn& insn)/*{{{*/
 		{
 			/*
 				neg eax
@@ -945,7 +1117,7 @@ class X86Analysis : public Analysis/*{{{*/
 			if (o_reg != insn.Operands[0].type)
 				return false;
 
-			insn_vector idiom;
+			InsnWindow idiom;
 			if (!GetInstructions(3, idiom))
 				return false;
 				
@@ -989,9 +1161,9 @@ class X86Analysis : public Analysis/*{{{*/
 			return false;
 		}/*}}}*/
 
-		bool TryMemcpy(insn_t& insn)/*{{{*/
+		bool TryMemcpy(const DecodedInsn& insn)/*{{{*/
 		{
-			insn_vector idiom;
+			InsnWindow idiom;
 			if (!GetInstructions(6, idiom))
 				return false;
 
@@ -1047,9 +1219,9 @@ class X86Analysis : public Analysis/*{{{*/
 			return false;
 		}/*}}}*/ 
 
-		bool TryMemcpy4(insn_t& insn, bool haveCld = true)/*{{{*/
+		bool TryMemcpy4(const DecodedInsn& insn, bool haveCld = true)/*{{{*/
 		{
-			insn_vector idiom;
+			InsnWindow idiom;
 			if (!GetInstructions(5, idiom))
 				return false;
 
@@ -1128,7 +1300,17 @@ class X86Analysis : public Analysis/*{{{*/
 			return false;
 		}/*}}}*/ 
 
-		bool TryProlog(insn_t& insn)/*{{{*/
+		bool TryCldMemcpy4(const DecodedInsn& insn)/*{{{*/
+		{
+			return TryMemcpy4(insn, true);
+		}/*}}}*/
+
+		bool TryMovMemcpy4(const DecodedInsn& insn)/*{{{*/
+		{
+			return TryMemcpy4(insn, false);
+		}/*}}}*/
+
+		bool TryProlog(const DecodedInsn& insn)/*{{{*/
 		{
 			/*
 				push ebp
@@ -1138,7 +1320,7 @@ class X86Analysis : public Analysis/*{{{*/
 				push esi		; optional
 			*/
 			
-			insn_vector idiom;
+			InsnWindow idiom;
 			if (!GetInstructions(5, idiom))
 				return false;
 
@@ -1177,14 +1359,14 @@ class X86Analysis : public Analysis/*{{{*/
 			return false;
 		}/*}}}*/
     
-		bool TryPushPop(insn_t& insn)/*{{{*/
+		bool TryPushPop(const DecodedInsn& insn)/*{{{*/
 		{
 			/*
 				push register|immediate
         pop register
 			*/
 			
-			insn_vector idiom;
+			InsnWindow idiom;
 			if (!GetInstructions(2, idiom))
 				return false;
 
@@ -1206,7 +1388,7 @@ class X86Analysis : public Analysis/*{{{*/
 		}/*}}}*/
 
 
-		bool TryXorCmpSet(insn_t& insn)/*{{{*/
+		bool TryXorCmpSet(const DecodedInsn& insn)/*{{{*/
 		{
 			/*
 					xor edx,edx
@@ -1217,7 +1399,7 @@ class X86Analysis : public Analysis/*{{{*/
 
 					edx = (X == Y)   or    edx = (X != Y)
 			*/
-			insn_vector idiom;
+			InsnWindow idiom;
 			if (!GetInstructions(3, idiom))
 				return false;
 
@@ -1251,7 +1433,7 @@ class X86Analysis : public Analysis/*{{{*/
 			return false;
 		}/*}}}*/
 
-		bool TryStrlen(insn_t& insn)/*{{{*/
+		bool TryStrlen(const DecodedInsn& insn)/*{{{*/
 		{
 			/*
 					; xor al,al
@@ -1267,7 +1449,7 @@ class X86Analysis : public Analysis/*{{{*/
 
 					eax = strlen(edi)	; assumes al is zero on entry
 			*/
-			insn_vector idiom;
+			InsnWindow idiom;
 			if (!GetInstructions(6, idiom))
 				return false;
 
@@ -1307,7 +1489,7 @@ class X86Analysis : public Analysis/*{{{*/
 			return false;
 		}/*}}}*/
 
-		bool TryStrcmpWithLiteral(insn_t& insn)/*{{{*/
+		bool TryStrcmpWithLiteral(const DecodedInsn& insn)/*{{{*/
 		{
 			/*
 					; mov esi, ?
@@ -1321,7 +1503,7 @@ class X86Analysis : public Analysis/*{{{*/
 					or al, 1			; optional
 			*/
 
-			insn_vector idiom;
+			InsnWindow idiom;
 			if (!GetInstructions(4, idiom))
 				return false;
 
@@ -1389,7 +1571,7 @@ class X86Analysis : public Analysis/*{{{*/
 			return false;
 		}/*}}}*/
 
-		bool TryCdqIdiv(insn_t& insn)/*{{{*/
+		bool TryCdqIdiv(const DecodedInsn& insn)/*{{{*/
 		{
 			/*
 					cdq
@@ -1400,7 +1582,7 @@ class X86Analysis : public Analysis/*{{{*/
 					eax = eax / ecx
 					edx = eax % ecx
 			*/
-			insn_vector idiom;
+			InsnWindow idiom;
 			if (!GetInstructions(2, idiom))
 				return false;
 
@@ -1420,7 +1602,7 @@ class X86Analysis : public Analysis/*{{{*/
 		}/*}}}*/
 
 #if 0
-		bool TryXchgMov(insn_t& insn)/*{{{*/
+		bool TryXchgMov(const DecodedInsn& insn)/*{{{*/
 		{
 			/*
 					xchg al, ah
@@ -1431,7 +1613,7 @@ class X86Analysis : public Analysis/*{{{*/
 					*(esi+4) = ah;
 					*(esi+5) = al;
 			*/
-			insn_vector idiom;
+			InsnWindow idiom;
 			if (!GetInstructions(2, idiom))
 				return false;
 
@@ -1472,9 +1654,9 @@ class X86Analysis : public Analysis/*{{{*/
 		}/*}}}*/
 #endif
 
-		bool TryBorlandClass(insn_t& insn)/*{{{*/
+		bool TryBorlandClass(const DecodedInsn& insn)/*{{{*/
 		{
-			insn_vector idiom;
+			InsnWindow idiom;
 			if (!GetInstructions(2, idiom))
 				return false;
 
@@ -1537,7 +1719,7 @@ class X86Analysis : public Analysis/*{{{*/
 			return false;
 		}/*}}}*/
 		
-		void OnCall(insn_t& insn)/*{{{*/
+		void OnCall(const DecodedInsn& insn)/*{{{*/
 		{
 			Expression_ptr e;
 
@@ -1573,32 +1755,32 @@ class X86Analysis : public Analysis/*{{{*/
 			if (call->IsCdecl())
 			{
 				Instruction_list::iterator next_item = ++Iterator();
-				insn_t next;
+				const DecodedInsn* next = NULL;
 
 				if (next_item != Instructions().end() && 
-						LowLevel::Insn(*next_item, next))
+						NULL != (next = LowLevel::Insn(*next_item)))
 				{
 					/*
 						 call ?
 						 pop cx
 						 pop cx   ; optional, same register again
 						 */
-					if (NN_pop == next.itype &&
-							o_reg == next.Operands[0].type && 
-							REG_BP != next.Operands[0].reg)
+					if (NN_pop == next->itype &&
+							o_reg == next->Operands[0].type && 
+							REG_BP != next->Operands[0].reg)
 					{
 						//msg("%p found idiom: call/pop\n", insn.ea);
 						Erase(next_item);
 
 						int pop_count = 1;
-						unsigned short reg = next.Operands[0].reg;
+						unsigned short reg = next->Operands[0].reg;
 
 						next_item++;
 						if (next_item != Instructions().end() && 
-								LowLevel::Insn(*next_item, next))
+								NULL != (next = LowLevel::Insn(*next_item)))
 						{
-							if (NN_pop == next.itype &&
-									OperandIsRegister(next, 0, reg))
+							if (NN_pop == next->itype &&
+									OperandIsRegister(*next, 0, reg))
 							{
 								Erase(next_item);
 								pop_count++;
@@ -1614,37 +1796,37 @@ class X86Analysis : public Analysis/*{{{*/
 					 * call ?
 					 * add sp, ?
 					 */
-					else if (NN_add ==         next.itype &&
-									 OperandIsRegister(next, 0, REG_SP) &&
-							     o_imm ==          next.Operands[1].type)
+					else if (NN_add ==         next->itype &&
+									 OperandIsRegister(*next, 0, REG_SP) &&
+							     o_imm ==          next->Operands[1].type)
 					{
 						//msg("%p found idiom: call/add sp\n", insn.ea);
 						int shift = -1;
 
-						if (dt_word == next.Operands[0].dtyp)
+						if (dt_word == next->Operands[0].dtyp)
 							shift = 1;
-						else if (dt_dword == next.Operands[0].dtyp)
+						else if (dt_dword == next->Operands[0].dtyp)
 							shift = 2;	
 						else
-							msg("%p Unexpected word size\n", next.ea);
+							msg("%p Unexpected word size\n", next->ea);
 
 						if (shift >= 0)
 						{
-							if (next.Operands[1].value > 0x100)
+							if (next->Operands[1].value > 0x100)
 							{
 								msg("%p Error! Very large or negative stack change: %i\n", 
-										next.ea,
-										next.Operands[1].value);
+										next->ea,
+										next->Operands[1].value);
 							}
 							else
 							{
-								call->ParameterCountFromCall(next.Operands[1].value >> shift);
+								call->ParameterCountFromCall(next->Operands[1].value >> shift);
 								Erase(next_item);
 							}
 						}
 					}
                     else {
-                        msg("WARNING: unhandled call instruction\n");
+                        LOG(LOG_WARNING, LOG_LIFT, ("%p WARNING: unhandled call instruction\n", insn.ea));
                     }
 				}
 			}
@@ -1664,11 +1846,8 @@ class X86Analysis : public Analysis/*{{{*/
 						Expression_ptr(call)));
 		}/*}}}*/
 
-		void OnNeg(insn_t& insn)/*{{{*/
+		void OnNeg(const DecodedInsn& insn)/*{{{*/
 		{
-			if (TryNegSbb(insn))
-				return;
-
 			mFlagUpdate = insn;
 			mFlagUpdateItem = Replace(
 					new Assignment(
@@ -1679,7 +1858,7 @@ class X86Analysis : public Analysis/*{{{*/
 								FromOperand(insn, 0)))));
 		}/*}}}*/
 
-		void OnAnd(insn_t& insn)/*{{{*/
+		void OnAnd(const DecodedInsn& insn)/*{{{*/
 		{
 			if (o_imm == insn.Operands[1].type && 
 					0     == insn.Operands[1].value)
@@ -1697,18 +1876,12 @@ class X86Analysis : public Analysis/*{{{*/
 			}
 		}/*}}}*/
 
-		void OnLowLevelPush(insn_t& insn)/*{{{*/
+		void OnLowLevelPush(const DecodedInsn& insn)/*{{{*/
 		{
-			if (TryProlog(insn))
-				return;
-
-			if (TryPushPop(insn))
-				return;
-
 			Replace( new Push(insn.ea, FromOperand(insn, 0)) ); 
 		}/*}}}*/
 
-		void ReplaceFromFlagUpdate(insn_t& insn, const char* operation, /*{{{*/
+		void ReplaceFromFlagUpdate(const DecodedInsn& insn, const char* operation, /*{{{*/
 				Signness signness = UNKNOWN_SIGN)
 		{
 #if 0
@@ -1729,7 +1902,7 @@ class X86Analysis : public Analysis/*{{{*/
 					);
 		}/*}}}*/
 
-		void OnConditionalJump(insn_t& insn, const char* operation, /*{{{*/
+		void OnConditionalJump(const DecodedInsn& insn, const char* operation, /*{{{*/
 				Signness signness = UNKNOWN_SIGN)
 		{
 			switch (mFlagUpdate.itype)
@@ -1817,15 +1990,12 @@ class X86Analysis : public Analysis/*{{{*/
 			DumpInsn(mFlagUpdate);
 		}/*}}}*/
 
-		void OnXor(insn_t& insn)/*{{{*/
+		void OnXor(const DecodedInsn& insn)/*{{{*/
 		{
 			mFlagUpdate = insn;
 
 			if (Equals(insn.Operands[0], insn.Operands[1]))
 			{
-				if (TryXorCmpSet(insn))
-					return;
-				
 				// XOR AX, AX  ->  AX = 0
 				mFlagUpdateItem = Replace(new Assignment(
 							insn.ea,
@@ -1838,7 +2008,7 @@ class X86Analysis : public Analysis/*{{{*/
 			}
 		}/*}}}*/
 
-		void OnSet(insn_t& insn, const char* operation)/*{{{*/
+		void OnSet(const DecodedInsn& insn, const char* operation)/*{{{*/
 		{
 			switch (mFlagUpdate.itype)
 			{
@@ -1862,7 +2032,7 @@ class X86Analysis : public Analysis/*{{{*/
 
 		}/*}}}*/
 
-		void OnTest(insn_t& insn)/*{{{*/
+		void OnTest(const DecodedInsn& insn)/*{{{*/
 		{
 			mFlagUpdate = insn;
 			mFlagUpdateItem = Instructions().end();
@@ -1870,12 +2040,12 @@ class X86Analysis : public Analysis/*{{{*/
 		}/*}}}*/
 
 		/** used for LEA, MOV, MOVSX, MOVZX */
-		void OnMov(insn_t& insn, Signness signness = UNKNOWN_SIGN)/*{{{*/
+		void OnMov(const DecodedInsn& insn, Signness signness = UNKNOWN_SIGN)/*{{{*/
 		{
 			/*if (insn.ea == 0x102D5)
 			{
 				DumpInsn(insn);
-				insn_t tmp = Instruction::GetLowLevelInstruction(insn.ea);
+				DecodedInsn tmp = Instruction::GetLowLevelInstruction(insn.ea);
 				DumpInsn(tmp);
 			}*/
 			
@@ -1899,7 +2069,7 @@ class X86Analysis : public Analysis/*{{{*/
 			}
 		}/*}}}*/
 
-		void OnDiv(insn_t& insn, Signness signness = UNKNOWN_SIGN)/*{{{*/
+		void OnDiv(const DecodedInsn& insn, Signness signness = UNKNOWN_SIGN)/*{{{*/
 		{
 			// First modulus, then divide, because divide redefined eax
 			Insert(
@@ -1914,7 +2084,7 @@ class X86Analysis : public Analysis/*{{{*/
 			Erase(Iterator());
 		}/*}}}*/
 
-		void OnMul(insn_t& insn, Signness signness = UNKNOWN_SIGN)/*{{{*/
+		void OnMul(const DecodedInsn& insn, Signness signness = UNKNOWN_SIGN)/*{{{*/
 		{
 #if 0
 			Insert(
@@ -1939,29 +2109,17 @@ class X86Analysis : public Analysis/*{{{*/
 			Erase(Iterator());
 		}/*}}}*/
 
-		void OnCld(insn_t& insn)/*{{{*/
+		void OnCld(const DecodedInsn& insn)/*{{{*/
 		{
-			if (TryStrlen(insn))
-				return;
-
-			if (TryMemcpy4(insn))
-				return;
-
-			if (TryStrcmpWithLiteral(insn))
-				return;
-
 			DumpInsn(insn);
 		}/*}}}*/
 
-		void OnCdq(insn_t& insn)/*{{{*/
+		void OnCdq(const DecodedInsn& insn)/*{{{*/
 		{
-			if (TryCdqIdiv(insn))
-				return;
-
 			DumpInsn(insn);
 		}/*}}}*/
 	
-		void OnXchg(insn_t& insn)/*{{{*/
+		void OnXchg(const DecodedInsn& insn)/*{{{*/
 		{
 			if (o_reg == insn.Operands[0].type &&
 					o_reg == insn.Operands[1].type &&
@@ -1991,50 +2149,60 @@ class X86Analysis : public Analysis/*{{{*/
 			DumpInsn(insn);
 		}/*}}}*/
 		
-		bool OnSwitchInfo(insn_t& insn, switch_info_t& si)/*{{{*/
+		bool OnSwitchInfo(const DecodedInsn& insn, switch_info_t& si)/*{{{*/
 		{
+			/*
+				 jmp ds:jumps[reg*4]      ; or [reg*2] for 16-bit entries
+			*/
+			int element_size = (si.flags & SWI_J32) ? 4 : 2;
+			int scale        = (4 == element_size) ? 2 : 1;
+
+			if (IsIndirectSwitch(insn.ea, si))
+			{
+				/*
+					 movzx reg, ds:values[value]  ; value table indexes jumps
+					 jmp ds:jumps[reg*4]
+				*/
+				msg("%p Indirect switch is not supported\n", insn.ea);
+				return false;
+			}
+
 			if (NN_jmpni == insn.itype &&
 					o_mem    == insn.Operands[0].type &&
 					si.jumps == insn.Operands[0].addr &&
 					insn.Operands[0].hasSIB &&
-					(insn.Operands[0].sib & 0xff) == 0x85)
+					(insn.Operands[0].sib & 7) == 5 &&               // no base
+					((insn.Operands[0].sib >> 6) & 3) == scale)
 			{
+				SwitchCase_vector cases;
+				if (!ReadSwitchTable(insn, si, element_size, cases))
+				{
+					msg("%p Error, could not read switch table at %p\n", 
+							insn.ea, si.jumps);
+					return false;
+				}
+
+				Addr default_target = (si.flags & SWI_DEFAULT) ? 
+					si.defjump : INVALID_ADDR;
+				
 				// Erase instructions in switch header
 				for (Instruction_list::iterator item = Iterator(); 
 						(**item).Address() >= si.startea;
 						item--)
 				{
 					Erase(item);
+					if (Instructions().begin() == item)
+						break;
 				}
 
-				int i = 0;
-				ulong address = get_long(si.jumps);
-
-				// Find case statements
-				for (Instruction_list::iterator item = Iterator(); 
-						item != Instructions().end();
-						item++)
-				{
-					if ((**item).Address() == address &&
-							(**item).IsType(Instruction::LABEL))
-					{
-						//msg("%p case %i statement here\n", address, i);
-						Erase(item);
-
-						Instructions().insert(item, 
-								Instruction_ptr(new Case(address, i)));
-
-						if (++i == si.ncases)
-							break;
-						
-						address = get_long(si.jumps + 4*i);
-					}
-				}
+				MakeCaseLabels(cases, default_target);
 
+				RegisterIndex index = (insn.Operands[0].sib >> 3) & 7;
 				Insert(new Switch(
 							si.startea, 
-							Register::Create(REG_AX)/*,
-							si*/));
+							Register::Create(index),
+							cases,
+							default_target));
 
 				return true;
 			}
@@ -2059,11 +2227,232 @@ class X86Analysis : public Analysis/*{{{*/
 			}
 		}/*}}}*/
 		
-		insn_t mFlagUpdate;
+		/**
+		 * An indirect switch has jcases jump table entries, selected by a
+		 * value table. The jump is indexed by the value table entry, not
+		 * by the switch value. Only the extended structure has the flag.
+		 */
+		static bool IsIndirectSwitch(ea_t ea, const switch_info_t& si)/*{{{*/
+		{
+#ifdef SWI2_INDIRECT
+			if (!(si.flags & SWI_EXTENDED))
+				return false;
+
+			switch_info_ex_t si_ex;
+			si_ex.cb = sizeof(si_ex);
+			if (get_switch_info_ex(ea, &si_ex, sizeof(si_ex)) <= 0)
+				return false;
+
+			return 0 != (si_ex.flags2 & SWI2_INDIRECT);
+#else
+			(void)ea;
+			(void)si;
+			return false;
+#endif
+		}/*}}}*/
+
+		/**
+		 * Read the jump table, and the value table of a sparse switch, with
+		 * one database access each
+		 */
+		static bool ReadSwitchTable(const DecodedInsn& insn, switch_info_t& si,/*{{{*/
+				int element_size, SwitchCase_vector& cases)
+		{
+			std::vector<unsigned long> jumps;
+			if (!ReadTable(si.jumps, si.ncases, element_size, jumps))
+				return false;
+
+			std::vector<unsigned long> values;
+			if (si.flags & SWI_SPARSE)
+			{
+				if (!ReadTable(si.values, si.ncases, 
+							(si.flags & SWI_V32) ? 4 : 2, values))
+					return false;
+			}
+
+			cases.resize(si.ncases);
+			for (int i = 0; i < si.ncases; i++)
+			{
+				if (si.flags & SWI_SPARSE)
+					cases[i].value = values[i];
+				else
+					cases[i].value = si.lowcase + i;
+
+				if (si.flags & SWI_ELBASE)
+					cases[i].target = si.elbase + jumps[i];
+				else if (2 == element_size)
+					// Copy current segment value for 16-bit adresses
+					cases[i].target = (insn.ea & 0xffff0000) | jumps[i];
+				else
+					cases[i].target = jumps[i];
+			}
+
+			return true;
+		}/*}}}*/
+
+		static bool ReadTable(ea_t address, int count, int element_size,/*{{{*/
+				std::vector<unsigned long>& table)
+		{
+			table.resize(count);
+			if (0 == count)
+				return true;
+			
+			std::vector<unsigned char> bytes(count * element_size);
+			if (!get_many_bytes(address, &bytes[0], bytes.size()))
+				return false;
+
+			for (int i = 0; i < count; i++)
+			{
+				unsigned long value = 0;
+				for (int b = element_size - 1; b >= 0; b--)
+					value = (value << 8) | bytes[i*element_size + b];
+				table[i] = value;
+			}
+			
+			return true;
+		}/*}}}*/
+
+		/**
+		 * Replace the labels at the targets of a switch with Case
+		 * instructions. Targets may lie before or after the switch, so
+		 * the labels of the whole list are collected in one pass.
+		 */
+		void MakeCaseLabels(const SwitchCase_vector& cases, Addr default_target)/*{{{*/
+		{
+			typedef std::map<Addr, Instruction_ptr> Case_map;
+			Case_map targets;
+			
+			for (SwitchCase_vector::const_iterator item = cases.begin();
+					item != cases.end();
+					item++)
+			{
+				Instruction_ptr& target = targets[item->target];
+				if (!target.get())
+					target.reset(new Case(item->target));
+				static_cast<Case*>(target.get())->AddValue(item->value);
+			}
+
+			if (INVALID_ADDR != default_target)
+			{
+				Instruction_ptr& target = targets[default_target];
+				if (!target.get())
+					target.reset(new Case(default_target));
+				static_cast<Case*>(target.get())->SetDefault();
+			}
+
+			typedef std::map<Addr, Instruction_list::iterator> Label_map;
+			Label_map labels;
+
+			for (Instruction_list::iterator item = Instructions().begin(); 
+					item != Instructions().end();
+					item++)
+			{
+				if ((**item).IsType(Instruction::LABEL))
+					labels.insert(Label_map::value_type((**item).Address(), item));
+			}
+
+			size_t found = 0;
+			for (Case_map::iterator target = targets.begin();
+					target != targets.end();
+					target++)
+			{
+				Label_map::iterator label = labels.find(target->first);
+				if (labels.end() == label)
+					continue;
+
+				//msg("%p case statement here\n", target->first);
+				Erase(label->second);
+				Instructions().insert(label->second, target->second);
+				found++;
+			}
+
+			if (found < targets.size())
+				msg("Warning, %lu switch targets without label\n",
+						(unsigned long)(targets.size() - found));
+		}/*}}}*/
+
+		DecodedInsn mFlagUpdate;
 		Instruction_list::iterator mFlagUpdateItem;
 
 };/*}}}*/
 
+/**
+ * Idioms recognized by X86Analysis. Patterns sharing a prefix share trie
+ * nodes; among patterns of equal length the first one listed wins.
+ */
+const X86Analysis::IdiomPattern X86Analysis::IDIOMS[] = /*{{{*/
+{
+	{ "neg/sbb", 2, {
+			{ NN_neg, SHAPE_REG },
+			{ NN_sbb, SHAPE_REG, SHAPE_SAME } },
+		&X86Analysis::TryNegSbb },
+	{ "memcpy", 6, {
+			{ NN_mov,  SHAPE_REG, SHAPE_REG },
+			{ NN_shr,  SHAPE_REG, SHAPE_IMM },
+			{ NN_movs, SHAPE_ANY, SHAPE_ANY, true },
+			{ NN_mov,  SHAPE_REG, SHAPE_REG },
+			{ NN_and,  SHAPE_REG, SHAPE_IMM },
+			{ NN_movs, SHAPE_ANY, SHAPE_ANY, true } },
+		&X86Analysis::TryMemcpy },
+	{ "borland class", 2, {
+			{ NN_mov, SHAPE_REG, SHAPE_IMM },
+			{ NN_mov, SHAPE_ANY, SHAPE_REG } },
+		&X86Analysis::TryBorlandClass },
+	{ "memcpy4", 2, {
+			{ NN_mov,  SHAPE_REG, SHAPE_IMM },
+			{ NN_movs, SHAPE_ANY, SHAPE_ANY, true } },
+		&X86Analysis::TryMovMemcpy4 },
+	{ "cld/memcpy4", 3, {
+			{ NN_cld },
+			{ NN_mov,  SHAPE_REG, SHAPE_IMM },
+			{ NN_movs, SHAPE_ANY, SHAPE_ANY, true } },
+		&X86Analysis::TryCldMemcpy4 },
+	{ "prolog", 2, {
+			{ NN_push, SHAPE_REG },
+			{ NN_mov,  SHAPE_REG, SHAPE_REG } },
+		&X86Analysis::TryProlog },
+	{ "push/pop", 2, {
+			{ NN_push },
+			{ NN_pop, SHAPE_REG } },
+		&X86Analysis::TryPushPop },
+	{ "xor/cmp/setz", 3, {
+			{ NN_xor, SHAPE_REG, SHAPE_SAME },
+			{ NN_cmp },
+			{ NN_setz, SHAPE_REG } },
+		&X86Analysis::TryXorCmpSet },
+	{ "xor/cmp/setnz", 3, {
+			{ NN_xor, SHAPE_REG, SHAPE_SAME },
+			{ NN_cmp },
+			{ NN_setnz, SHAPE_REG } },
+		&X86Analysis::TryXorCmpSet },
+	{ "strlen", 6, {
+			{ NN_cld },
+			{ NN_mov,  SHAPE_REG, SHAPE_IMM },
+			{ NN_scas },
+			{ NN_mov,  SHAPE_REG, SHAPE_REG },
+			{ NN_not,  SHAPE_REG },
+			{ NN_dec,  SHAPE_REG } },
+		&X86Analysis::TryStrlen },
+	{ "strcmp (xor)", 4, {
+			{ NN_cld },
+			{ NN_xor,  SHAPE_REG, SHAPE_SAME },
+			{ NN_cmps, SHAPE_ANY, SHAPE_ANY, true },
+			{ NN_jz } },
+		&X86Analysis::TryStrcmpWithLiteral },
+	{ "strcmp (test)", 4, {
+			{ NN_cld },
+			{ NN_test, SHAPE_REG, SHAPE_IMM },
+			{ NN_cmps, SHAPE_ANY, SHAPE_ANY, true },
+			{ NN_jz } },
+		&X86Analysis::TryStrcmpWithLiteral },
+	{ "cdq/idiv", 2, {
+			{ NN_cdq },
+			{ NN_idiv } },
+		&X86Analysis::TryCdqIdiv },
+};/*}}}*/
+
+const int X86Analysis::IDIOM_COUNT = sizeof(IDIOMS) / sizeof(IDIOMS[0]);
+
 
 
 void IdaX86::FillList(func_t* function, Instruction_list& instructions)/*{{{*/
@@ -25,6 +25,7 @@
 
 #include "desquirr.hpp"
 #include "idapro.hpp"
+#include "architecture.hpp"
 #include "x86.hpp"
 
 class IdaX86 : public IdaPro
@@ -37,13 +38,19 @@ class IdaX86 : public IdaPro
 
 		virtual std::string RegisterName(RegisterIndex index) const;
 		virtual void FillList(func_t* function, Instruction_list& instructions);
-		virtual void DumpInsn(insn_t& insn);
-        virtual bool ParametersOnStack() { return true; }
+		virtual void DumpInsn(const DecodedInsn& insn);
+        virtual bool ParametersOnStack() { return X86Traits::PARAMETERS_ON_STACK; }
 
 		/** Look for Borland C++ throw instruction */
 		static void TryBorlandThrow(DataFlowAnalysis* analysis, 
 				Assignment* assignment);
 
+		virtual void OnAssignment(DataFlowAnalysis* analysis,
+				Assignment* assignment)
+		{
+			TryBorlandThrow(analysis, assignment);
+		}
+
 	private:
 		bool mIs32Bit;
 };
@@ -39,42 +39,18 @@
 
 #include "desquirr.hpp"
 #include "instruction.hpp"
+#include "decoded.hpp"
+#include "lowlevel.hpp"
+#include "scan.hpp"
 
 
-typedef std::vector<insn_t> insn_vector;
+DecodedInsn GetLowLevelInstruction(ea_t address);
 
-class LowLevel : public Instruction /*{{{*/
-{
-	public:
-		LowLevel(insn_t insn)
-			: Instruction(LOW_LEVEL, insn.ea),
-				mInsn(insn)
-		{}
+/** Decoded instructions of the current database */
+DecodedInstructionCache& DecodedInstructions();
 
-		virtual void Accept(InstructionVisitor& visitor)
-		{
-			visitor.Visit(*this);
-		}
-
-		insn_t& Insn() { return mInsn; }
-		
-		static bool Insn(Instruction_ptr instruction, insn_t& insn) 
-		{ 
-			if (instruction->IsType(Instruction::LOW_LEVEL))
-			{
-				insn = static_cast<LowLevel*>(instruction.get())->Insn();
-				return true;
-			}
-		
-			return false; 
-		}
-		
-	private:
-		insn_t mInsn;
-		
-};/*}}}*/
-
-insn_t GetLowLevelInstruction(ea_t address);
+/** Items of the function being lifted */
+FunctionScan& CurrentScan();
 
 
 #endif // _IDAINTERNAL_HPP
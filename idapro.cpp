@@ -24,6 +24,7 @@
 #include "idapro.hpp"
 #include "instruction.hpp"
 #include "analysis.hpp"
+#include "log.hpp"
 
 #include <memory>
 
@@ -47,7 +48,7 @@ bool get_ti(ea_t ea, type_t *buf, size_t bufsize, p_list *fnames, size_t fnsize)
     return get_ti(ea, buf, fnames);
 }
 #endif
-std::string get_struct_path(struc_t *struc, int offset, int *pIndex)
+static std::string LookupStructPath(struc_t *struc, int offset, int *pIndex)
 {
 	member_t* member = NULL;  /* must live here, not inside while */
 	std::ostringstream buffer;
@@ -91,8 +92,50 @@ std::string get_struct_path(struc_t *struc, int offset, int *pIndex)
 	return buffer.str();
 }/*}}}*/
 
+std::string get_struct_path(struc_t *struc, int offset, int *pIndex)/*{{{*/
+{
+	if (!struc)
+		return "";
+
+	NameCache& names = Frontend::Get().Names();
+	std::string path;
+	int index = 0;
+
+	if (!names.FindStructPath(struc->id, offset, path, index))
+	{
+		path = LookupStructPath(struc, offset, &index);
+		names.AddStructPath(struc->id, offset, path, index);
+	}
+
+	if (index && pIndex)
+		*pIndex = index;
+	return path;
+}/*}}}*/
+
+typedef std::string (*NameLookup)(ea_t ea, int *pIndex, ea_t *pBase);
+
+// Look up a name through the session cache
+static std::string CachedName(NameCache::Kind kind, ea_t ea, int *pIndex, /*{{{*/
+		NameLookup lookup)
+{
+	NameCache& names = Frontend::Get().Names();
+	std::string name;
+	int index = 0;
+
+	if (!names.FindName(kind, ea, name, index))
+	{
+		ea_t base = ea;
+		name = lookup(ea, &index, &base);
+		names.AddName(kind, ea, name, index, base);
+	}
+
+	if (pIndex)
+		*pIndex = index;
+	return name;
+}/*}}}*/
+
 // used from CreateStackVariable
-std::string GetStackVariableName(const insn_t &insn, int operand, int* pIndex)/*{{{*/
+std::string GetStackVariableName(const DecodedInsn& insn, int operand, int* pIndex)/*{{{*/
 {
 	if (pIndex)
 		*pIndex = 0;
@@ -123,7 +166,7 @@ std::string GetStackVariableName(const insn_t &insn, int operand, int* pIndex)/*
 
 // returns name such that get_func_name(ea) == name and get_func(ea).startEA+*pIndex == ea
 // used by GetGlobalVariableName
-std::string GetGlobalCodeLabel(ea_t ea, int *pIndex)/*{{{*/
+static std::string LookupGlobalCodeLabel(ea_t ea, int *pIndex, ea_t *pBase)/*{{{*/
 {
     // return funcname + offset
     char name[MAXSTR];
@@ -135,16 +178,22 @@ std::string GetGlobalCodeLabel(ea_t ea, int *pIndex)/*{{{*/
     }
     if (get_func_name(ea, name, MAXSTR)) {
         *pIndex= ea - func->startEA;
+        *pBase= func->startEA;
         return std::string(name);
     }
     else {
         message("%p Warning: referenced code offset not in a function\n", ea);
         return "";
     }
-}
+}/*}}}*/
+
+std::string GetGlobalCodeLabel(ea_t ea, int *pIndex)/*{{{*/
+{
+	return CachedName(NameCache::GLOBAL_LABEL, ea, pIndex, LookupGlobalCodeLabel);
+}/*}}}*/
 
 // returns name such that get_name_ea(ea - *pIndex) == name
-std::string GetLocalCodeLabel(ea_t ea, int *pIndex)/*{{{*/
+static std::string LookupLocalCodeLabel(ea_t ea, int *pIndex, ea_t *pBase)/*{{{*/
 {
     char name[MAXSTR];
 
@@ -155,6 +204,7 @@ std::string GetLocalCodeLabel(ea_t ea, int *pIndex)/*{{{*/
 
         if (get_name(ea, lea, name, sizeof(name))) {
             *pIndex= ea-lea;
+            *pBase= lea;
 			if (*pIndex)
 				message("Unexpected locallabel with name=%s index=%d\n", name, *pIndex);
             return std::string(name);
@@ -169,6 +219,80 @@ std::string GetLocalCodeLabel(ea_t ea, int *pIndex)/*{{{*/
     return "";
 }/*}}}*/
 
+/* Function scan {{{ */
+class IdaDatabase : public DatabaseAccess
+{
+	public:
+		virtual void Chunks(Addr function, AddressRange_vector& chunks)
+		{
+			func_t* pfn = get_func(function);
+			if (NULL == pfn)
+				return;
+
+			// main() yields the entry chunk, next() the tails
+			func_tail_iterator_t fti(pfn);
+			for (bool ok = fti.main(); ok; ok = fti.next())
+			{
+				const area_t& chunk = fti.chunk();
+				chunks.push_back(AddressRange(chunk.startEA, chunk.endEA));
+			}
+		}
+
+		virtual void Describe(Addr address, ScannedItem& item)
+		{
+			flags_t flags = getFlags(address);
+
+			item.address    = address;
+			item.end        = get_item_end(address);
+			item.flags      = flags;
+			item.referenced = hasRef(flags) /*|| has_any_name(flags)*/;
+
+			if (isCode(flags))
+				item.kind = ScannedItem::CODE;
+			else if (isUnknown(flags))
+				item.kind = ScannedItem::UNKNOWN;
+			else if (isData(flags))
+				item.kind = ScannedItem::DATA;
+			else
+				item.kind = ScannedItem::OTHER;
+		}
+
+		virtual void MakeCode(Addr address)
+		{
+			ua_code(address);
+		}
+
+		virtual std::string LocalLabel(Addr address)
+		{
+			int index;
+			std::string name = CachedName(NameCache::LOCAL_LABEL, address, &index, 
+					LookupLocalCodeLabel);
+			return index ? std::string() : name;
+		}
+};
+
+static IdaDatabase s_database;
+static FunctionScan s_scan(s_database);
+
+FunctionScan& CurrentScan()
+{
+	return s_scan;
+}
+
+// returns name such that get_name_ea(ea - *pIndex) == name
+std::string GetLocalCodeLabel(ea_t ea, int *pIndex)
+{
+	// Labels in the function being lifted were collected by the scan
+	std::string name;
+	if (s_scan.Covers(ea) && s_scan.Label(ea, name) && !name.empty())
+	{
+		*pIndex = 0;
+		return name;
+	}
+
+	return CachedName(NameCache::LOCAL_LABEL, ea, pIndex, LookupLocalCodeLabel);
+}/*}}}*/
+
 Instruction_ptr CreateLocalCodeLabel(ea_t ea)
 {
     int index;
@@ -176,7 +300,7 @@ Instruction_ptr CreateLocalCodeLabel(ea_t ea)
     if (index || name.empty()) {
         name.resize(32);
         name.resize(qsnprintf(&name[0], name.size(), "loc_%X", ea));
-        message("NOTE: created new label %s\n", name.c_str());
+        LOG(LOG_NOTE, LOG_NAMES, ("NOTE: created new label %s\n", name.c_str()));
     }
     Instruction_ptr instr;
     // todo: think of a better way to represent local function labels.
@@ -191,7 +315,7 @@ Expression_ptr CreateLocalCodeReference(ea_t ea)
     if (index || name.empty()) {
         name.resize(32);
         name.resize(qsnprintf(&name[0], name.size(), "loc_%X", ea));
-        message("NOTE: created new label %s\n", name.c_str());
+        LOG(LOG_NOTE, LOG_NAMES, ("NOTE: created new label %s\n", name.c_str()));
     }
     Expression_ptr expr;
     // todo: think of a better way to represent local function labels.
@@ -205,12 +329,12 @@ Expression_ptr CreateGlobalCodeLabel(ea_t ea)
     if (name.empty()) {
         name.resize(32);
         name.resize(qsnprintf(&name[0], name.size(), "proc_%X", ea));
-        message("NOTE: created new function name %s\n", name.c_str());
+        LOG(LOG_NOTE, LOG_NAMES, ("NOTE: created new function name %s\n", name.c_str()));
     }
     else if (index!=0) {
         name.resize(name.size()+16);
         name.resize(qsnprintf(&name[0], name.size(), "%s+0x%X", name.c_str(), index));
-        message("NOTE: using func+offs name: %s\n", name.c_str());
+        LOG(LOG_NOTE, LOG_NAMES, ("NOTE: using func+offs name: %s\n", name.c_str()));
     }
     Expression_ptr expr;
     expr.reset(new GlobalVariable(name, 0, ea));
@@ -218,7 +342,7 @@ Expression_ptr CreateGlobalCodeLabel(ea_t ea)
 }
 
 // todo: figure out how to get the structure type of the data at a specific offset.
-std::string GetGlobalVariableName(ea_t ea, int* pIndex)/*{{{*/
+static std::string LookupGlobalVariableName(ea_t ea, int* pIndex, ea_t* pBase)/*{{{*/
 {
 	std::ostringstream buffer;
 
@@ -228,7 +352,9 @@ std::string GetGlobalVariableName(ea_t ea, int* pIndex)/*{{{*/
     flags_t flags= ::getFlags(ea);
 
     if (isCode(flags)) {
-        return GetGlobalCodeLabel(ea, pIndex);
+        std::string name = GetGlobalCodeLabel(ea, pIndex);
+        *pBase = ea - *pIndex;
+        return name;
     }
 /*
     else if (!isData(flags)) {
@@ -257,16 +383,23 @@ std::string GetGlobalVariableName(ea_t ea, int* pIndex)/*{{{*/
 			}
 			tid_t tid= get_strid(head);
 			struc_t *struc= get_struc(tid);
+			*pBase= head;
 			return headname + "." + get_struct_path(struc, ea-head, pIndex);
         }
     }
 }/*}}}*/
+
+std::string GetGlobalVariableName(ea_t ea, int* pIndex)/*{{{*/
+{
+	return CachedName(NameCache::GLOBAL_VARIABLE, ea, pIndex, LookupGlobalVariableName);
+}/*}}}*/
+
 bool is_local_to_function(ea_t funcea, ea_t ea)
 {
 	func_t *func= get_func(funcea);
 	return func_contains(func, ea);
 }
-Expression_ptr CreateVariable(const insn_t &insn, int operand)
+Expression_ptr CreateVariable(const DecodedInsn& insn, int operand)
 {
 	ea_t ea= insn.Operands[operand].addr;
 
@@ -275,7 +408,7 @@ Expression_ptr CreateVariable(const insn_t &insn, int operand)
 	else
 		return CreateGlobalVariable(insn, operand);
 }
-Expression_ptr CreateGlobalVariable(const insn_t &insn, int operand)
+Expression_ptr CreateGlobalVariable(const DecodedInsn& insn, int operand)
 {
     Expression_ptr expr;
 
@@ -287,7 +420,7 @@ Expression_ptr CreateGlobalVariable(const insn_t &insn, int operand)
     if (name.empty()) {
         name.resize(32);
         name.resize(qsnprintf(&name[0], name.size(), "gvar_%X", ea));
-        message("NOTE: created new globalvar %s\n", name.c_str());
+        LOG(LOG_NOTE, LOG_NAMES, ("NOTE: created new globalvar %s\n", name.c_str()));
     }
 
     expr.reset(new GlobalVariable(name, index, ea));
@@ -295,9 +428,32 @@ Expression_ptr CreateGlobalVariable(const insn_t &insn, int operand)
     return expr;
 }
 
+Expression_ptr StringLiteral::CreateFrom(Addr address)/*{{{*/
+{
+	Expression_ptr result;
+	
+	ulong type = get_str_type(address);
+
+    std::string value = GetString(address, type);
+	if (!value.empty())
+		result.reset(new StringLiteral(value, type));
+	else
+		message("ERROR: StringLiteral::CreateFrom(%08lx) -> NULL\n", address);
+
+	return result;
+}/*}}}*/
+
+std::string StringLiteral::GetString(Addr address, unsigned long type)/*{{{*/
+{
+	size_t len = get_max_ascii_length(address, type, false);
+	boost::shared_array<char> str(new char[len+1]);
+	get_ascii_contents(address, len, type, str.get(), len+1);
+	return str.get();
+}/*}}}*/
 
 
-Expression_ptr CreateStackVariable(insn_t& insn, int operand)/*{{{*/
+
+Expression_ptr CreateStackVariable(const DecodedInsn& insn, int operand)/*{{{*/
 {
 	Expression_ptr result;
 	
@@ -308,7 +464,9 @@ Expression_ptr CreateStackVariable(insn_t& insn, int operand)/*{{{*/
 	{
 		// Try to add a stack variable and try again!
 //		message("%p Warning: trying to create stack variable\n", insn.ea);
-		if (!add_stkvar(insn.Operands[operand], insn.Operands[operand].addr)) {
+		// add_stkvar needs the full op_t and works on 'cmd', decode again
+		ua_ana0(insn.ea);
+		if (!add_stkvar(cmd.Operands[operand], insn.Operands[operand].addr)) {
 			message("error in add_stkvar(%08lx, %08lx)\n", insn.Operands[operand].dtyp, insn.Operands[operand].addr);
 			return Expression_ptr();
 		}
@@ -316,6 +474,8 @@ Expression_ptr CreateStackVariable(insn_t& insn, int operand)/*{{{*/
 			message("error in op_stkvar(%08lx, %08lx)\n", insn.ea, operand);
 			return Expression_ptr();
 		}
+		// the frame has a new member
+		Frontend::Get().Names().StructChanged();
 		name = GetStackVariableName(insn, operand, &index);
 	}
 	
@@ -348,7 +508,7 @@ static const char* const optype_string[] = {/*{{{*/
 	"o_last"
 };/*}}}*/
 
-const char* IdaPro::GetOptypeString(op_t& op)/*{{{*/
+const char* IdaPro::GetOptypeString(const DecodedOperand& op)/*{{{*/
 {
 //	if (op.type >= 0 && op.type <= o_last)
 		return optype_string[op.type];
@@ -356,17 +516,76 @@ const char* IdaPro::GetOptypeString(op_t& op)/*{{{*/
 		return "INVALID";*/
 }/*}}}*/
 
-insn_t GetLowLevelInstruction(ea_t address)/*{{{*/
+/* Decoded instructions {{{ */
+static void FromInsn(const insn_t& insn, DecodedInsn& decoded)
+{
+	decoded.ea      = insn.ea;
+	decoded.itype   = insn.itype;
+	decoded.size    = insn.size;
+	decoded.auxpref = insn.auxpref;
+	decoded.segpref = insn.segpref;
+
+	for (int i = 0; i < DecodedInsn::OPERAND_COUNT; i++)
+	{
+		const op_t& op = insn.Operands[i];
+		DecodedOperand& operand = decoded.Operands[i];
+
+		operand.n         = op.n;
+		operand.type      = op.type;
+		operand.flags     = op.flags;
+		operand.dtyp      = op.dtyp;
+		operand.reg       = op.reg;
+		operand.value     = op.value;
+		operand.addr      = op.addr;
+		operand.specval   = op.specval;
+		operand.specflag1 = op.specflag1;
+		operand.specflag2 = op.specflag2;
+		operand.specflag3 = op.specflag3;
+		operand.specflag4 = op.specflag4;
+	}
+}
+
+class IdaDecoder : public InstructionDecoder
+{
+	public:
+		virtual bool Decode(Addr address, DecodedInsn& insn)
+		{
+			// note: ua_ana0  sets the global 'cmd' variable
+			if (0 == ua_ana0(address))
+				return false;
+
+			FromInsn(cmd, insn);
+			return true;
+		}
+};
+
+static IdaDecoder s_decoder;
+static DecodedInstructionCache s_decoded(s_decoder);
+
+DecodedInstructionCache& DecodedInstructions()
+{
+	return s_decoded;
+}
+
+DecodedInsn GetLowLevelInstruction(ea_t address)
 {
-	// note: ua_ana0  sets the global 'cmd' variable
-	ua_ana0(address);
-	return cmd;
+	const DecodedInsn* decoded = s_decoded.Get(address);
+
+	if (decoded)
+		return *decoded;
+
+	msg("%p Error, could not decode instruction\n", address);
+	DecodedInsn insn = DecodedInsn();
+	insn.ea = address;
+	return insn;
 }/*}}}*/
 
 void IdaPro::DumpInsn(Addr address)/*{{{*/
 {
-	insn_t insn = ::GetLowLevelInstruction(address);
-	DumpInsn(insn);
+	// Decode again instead of trusting the cache
+	DecodedInsn insn;
+	if (s_decoder.Decode(address, insn))
+		DumpInsn(insn);
 }/*}}}*/
 
 
@@ -375,29 +594,45 @@ int IdaPro::vmsg(const char *format, va_list va)
 	return ::vmsg(format, va);
 }
 
-Addr IdaPro::AddressFromName(const char *name, Addr referer)
+Addr IdaPro::LookupAddress(const char *name, Addr referer)
 {
 	return ::get_name_ea(referer, name);
 }
 
-void IdaPro::LoadCallTypeInformation(CallExpression* call)
+void IdaPro::LookupCallee(Addr address, CalleeSummary& summary)
 {
-	if (BADADDR == call->Address())
-		return;
+	func_t* func = get_func(address);
+	if (func)
+	{
+		if (func->argsize > 0)
+		{
+//			msg("Function at %p purges %i bytes\n", address, func->argsize);
+			summary.purge = func->argsize;
+		}
+	}
+	else
+	{
+		ulong purge = get_ind_purged(address);
+		if (purge != (ulong)-1)
+		{
+//			msg("Function at %p purges %i bytes\n", address, purge);
+			summary.purge = purge;
+		}
+	}
 
 	type_t type[MAXSTR];
 	p_list names[MAXSTR];
 	
-	if (!get_ti(call->Address(), type, MAXSTR, names, MAXSTR))
+	if (!get_ti(address, type, MAXSTR, names, MAXSTR))
   {
-    message("No type information for function at %p!\n", 
-        call->Address());
+    LOG(LOG_NOTE, LOG_TYPES, ("No type information for function at %p!\n", 
+        address));
 		return;
   }
 
 	// CM (calling convention & model)
-	cm_t cm = type[1];
-	call->CallingConvention(cm);
+	summary.hasType = true;
+	summary.callingConvention = type[1] & CALLING_MASK;
 
 	ulong plocations[CallExpression::MAX_PARAMETERS];
 	memset(plocations, 0, sizeof(plocations));
@@ -407,32 +642,25 @@ void IdaPro::LoadCallTypeInformation(CallExpression* call)
 	memset(DataTypes,      0, sizeof(DataTypes));
 	memset(ParameterNames, 0, sizeof(ParameterNames));
 
-	call->ParameterCount(
+	summary.parameterCount = 
 			build_funcarg_arrays(type, names, plocations, 
-			(type_t**)DataTypes, (char**)ParameterNames, CallExpression::MAX_PARAMETERS, false));
-
-#if 0
-	char buffer[MAXSTR]; 
-	for (int i = 0; i < mParameterCount; i++)
-	{
-		buffer[0] = '\0';
-		print_type_to_one_line(buffer, sizeof(buffer), idati, mDataTypes[i]);
-		msg("Parameter %i type: %s %s\n", i, buffer, mParameterNames[i]);
-	}
-#endif
+			(type_t**)DataTypes, (char**)ParameterNames, CallExpression::MAX_PARAMETERS, false);
 
 	type_t return_type[MAXSTR];
 	if (::extract_func_ret_type(type, return_type, sizeof(return_type)))
 	{
-		//DataType().Set(return_type);
-#if 0
-		buffer[0] = '\0';
-		print_type_to_one_line(buffer, sizeof(buffer), idati, mReturnType);
-		msg("Return type: %s\n", buffer);
-#endif
+		if (is_type_void(return_type[0]))
+			summary.returnClass = CalleeSummary::RETURN_VOID;
+		else if (is_type_ptr(return_type[0]))
+			summary.returnClass = CalleeSummary::RETURN_POINTER;
+		else if (is_type_floating(return_type[0]))
+			summary.returnClass = CalleeSummary::RETURN_FLOAT;
+		else if (is_type_integral(return_type[0]))
+			summary.returnClass = CalleeSummary::RETURN_INTEGER;
+		else
+			summary.returnClass = CalleeSummary::RETURN_OTHER;
 	}
 
 	free_funcarg_arrays(DataTypes, ParameterNames, CallExpression::MAX_PARAMETERS);
-	
 }
 
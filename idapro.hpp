@@ -33,8 +33,8 @@ class DataFlowAnalysis;
 class Assignment;
 class CallExpression;
 class func_t;
-class insn_t;
-class op_t;
+struct DecodedInsn;
+struct DecodedOperand;
 
 class IdaPro : public Frontend
 {
@@ -44,25 +44,23 @@ class IdaPro : public Frontend
 		}
 		
 		virtual int vmsg(const char *format, va_list va);
-		virtual Addr AddressFromName(const char *name, 
-				Addr referer = INVALID_ADDR);
 		
 		virtual void FillList(func_t* function, Instruction_list& instructions) = 0;
 		void DumpInsn(Addr address);
-        virtual bool ParametersOnStack() = 0;
-		virtual void DumpInsn(insn_t& insn) = 0;
-		static void LoadCallTypeInformation(CallExpression* call);
+		virtual void DumpInsn(const DecodedInsn& insn) = 0;
 
 	protected:
-		const char* GetOptypeString(op_t& op);
+		virtual Addr LookupAddress(const char *name, Addr referer);
+		virtual void LookupCallee(Addr address, CalleeSummary& summary);
+		const char* GetOptypeString(const DecodedOperand& op);
 };
 
 extern std::string GetStackVariableName(ea_t ea, int operand, int *pIndex);
-extern Expression_ptr CreateStackVariable(insn_t &insn, int operand);
+extern Expression_ptr CreateStackVariable(const DecodedInsn& insn, int operand);
 
 // used in expression.cpp GlobalVariable::CreateFrom
-extern Expression_ptr CreateGlobalVariable(const insn_t &insn, int operand);
-extern Expression_ptr CreateVariable(const insn_t &insn, int operand);
+extern Expression_ptr CreateGlobalVariable(const DecodedInsn& insn, int operand);
+extern Expression_ptr CreateVariable(const DecodedInsn& insn, int operand);
 // used in ida-*.cpp CreateLabel / MakeLowLevelList
 extern std::string GetLocalCodeLabel(ea_t ea, int *pIndex);
 extern Expression_ptr CreateLocalCodeReference(ea_t ea);
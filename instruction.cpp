@@ -26,11 +26,7 @@
 //
 #include <stack>
 
-//
-// IDA headers
-//
-#include <ida.hpp>
-#include <nalt.hpp>
+#include <boost/thread/tss.hpp>
 
 //
 // Local headers
@@ -75,6 +71,121 @@ const int BoolArray::POWER_OF_2[BoolArray::SIZE] =/*{{{*/
 };/*}}}*/
 
 
+/* Register occurrences {{{ */
+class IndexRegistersHelper
+{
+	public:
+		IndexRegistersHelper(RegisterOccurrence_vector& occurrences, 
+				BoolArray& registers, int operand)
+			: mOccurrences(occurrences), mRegisters(registers), mOperand(operand)
+		{}
+
+		/** Called with every slot, never replaces anything */
+		bool operator() (Expression_ptr& slot)
+		{
+			if (slot->IsType(Expression::REGISTER))
+			{
+				Register* reg = static_cast<Register*>(slot.get());
+				RegisterOccurrence occurrence;
+
+				occurrence.slot = &slot;
+				occurrence.operand = mOperand;
+				occurrence.index = reg->Index();
+				mOccurrences.push_back(occurrence);
+
+				mRegisters.Set(reg->SimpleIndex());
+			}
+			return false;
+		}
+
+	private:
+		RegisterOccurrence_vector& mOccurrences;
+		BoolArray& mRegisters;
+		int mOperand;
+};
+
+// Only used by IndexRegisters, which does not nest. One per thread, so
+// its stack is reused without sharing it between threads.
+static boost::thread_specific_ptr<ExpressionWalker> s_index_walker;
+
+void Instruction::IndexRegisters()
+{
+	if (NULL == s_index_walker.get())
+		s_index_walker.reset(new ExpressionWalker());
+	ExpressionWalker& walker = *s_index_walker;
+
+	mOccurrences.clear();
+
+	for (int i = 0; i < MAX_OPERANDS; i++)
+	{
+		mOperandRegisters[i].Clear();
+
+		Expression_ptr* slot = OperandSlot(i);
+		if (slot && slot->get())
+		{
+			IndexRegistersHelper helper(mOccurrences, mOperandRegisters[i], i);
+			walker.Replace(*slot, helper);
+		}
+	}
+
+	mOccurrencesValid = true;
+}
+
+const RegisterOccurrence_vector& Instruction::RegisterOccurrences()
+{
+	if (!mOccurrencesValid)
+		IndexRegisters();
+	return mOccurrences;
+}
+
+int Instruction::RegisterCount(int index, unsigned short reg)
+{
+	const RegisterOccurrence_vector& occurrences = RegisterOccurrences();
+	int count = 0;
+
+	for (RegisterOccurrence_vector::const_iterator item = occurrences.begin();
+			item != occurrences.end();
+			item++)
+	{
+		if (item->operand == index && item->index == reg)
+			count++;
+	}
+	return count;
+}
+
+int Instruction::ReplaceRegister(int index, unsigned short reg, Expression_ptr replacement)
+{
+	const RegisterOccurrence_vector& occurrences = RegisterOccurrences();
+	int count = 0;
+
+	for (RegisterOccurrence_vector::const_iterator item = occurrences.begin();
+			item != occurrences.end();
+			item++)
+	{
+		if (item->operand != index || item->index != reg)
+			continue;
+
+		// A slot is listed twice if its parent occurs twice in the operand,
+		// and a subtree shared with another instruction may have been
+		// changed through it since the index was built
+		Expression* current = item->slot->get();
+		if (current == replacement.get())
+			continue;
+		if (!current || !current->IsType(Expression::REGISTER) ||
+				static_cast<Register*>(current)->Index() != reg)
+			continue;
+
+		// Replacing a leaf does not move any other slot
+		*item->slot = replacement;
+		count++;
+	}
+
+	// The replacement has registers of its own
+	if (count)
+		OperandChanged();
+	return count;
+}/*}}}*/
+
 /* Find DU-chains {{{ */
 class FindDefintionUseChainsHelper
 {
@@ -118,6 +229,8 @@ class FindDefintionUseChainsHelper
 		{
 			Instruction_ptr instr = *item;
 			BoolArray& def = instr->Definitions();
+
+			instr->ClearDuChain();
 			
 			for (int reg = 0; reg < BoolArray::SIZE; reg++)
 			{
@@ -145,12 +258,12 @@ void Instruction::FindDefintionUseChains(Instruction_list& instructions)
 
 #if 0
 		Instruction_ptr instr = *item;
-		msg("%p DU chain:\n", instr->Address());
+		message("%p DU chain:\n", instr->Address());
 		for (RegisterToAddress_map::iterator du = instr->mDuChain.begin();
 				du != instr->mDuChain.end();
 				du++)
 		{
-			msg("\t%s -> %p\n", Register::Name(du->first).c_str(), du->second);
+			message("\t%s -> %p\n", Register::Name(du->first).c_str(), du->second);
 		}
 #endif
 	}
@@ -177,7 +290,7 @@ std::ostream& operator<< (std::ostream& os, const RegisterToAddress_map& vs)
 
         if (!bFirstAddr)
             os << ", ";
-        os << boost::format("%08lx") % (*i).second;
+        os << Hex8((*i).second);
         bFirstAddr= false;
     }
     if (!bFirstAddr)
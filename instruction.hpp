@@ -25,7 +25,7 @@
 /*
  *
 Instruction   ... ea
-    LowLevel  ... insn_t
+    LowLevel  ... DecodedInsn
     Label     ... name
     Case      ... case_value
     Throw     ... exception_expr, datatype
@@ -43,8 +43,8 @@ Instruction   ... ea
 #include <sstream>
 #include "desquirr.hpp"
 
-#include "kernwin.hpp"
 // Local includes
+#include "counters.hpp"
 
 #include "expression.hpp"
 
@@ -139,6 +139,10 @@ class BoolArray/*{{{*/
 			mBitfield |= other.mBitfield;
 		}
 
+		/** The set as one word, for snapshots */
+		unsigned long Bits() const { return mBitfield; }
+		void Bits(unsigned long bits) { mBitfield = bits; }
+
 		int CountSet() const
 		{
 			int count = 0;
@@ -213,10 +217,22 @@ void Accept(Node_list& nodes, InstructionVisitor& visitor);
 void Accept(Instruction_list& instructions, InstructionVisitor& visitor);
 
 
+/**
+ * Where a register is used in the operands of an instruction
+ */
+struct RegisterOccurrence/*{{{*/
+{
+	Expression_ptr* slot;         // the Register is stored here
+	int operand;
+	unsigned short index;         // Register::Index()
+};/*}}}*/
+
+typedef std::vector<RegisterOccurrence> RegisterOccurrence_vector;
+
 /**
  * an instruction
  */
-class Instruction/*{{{*/
+class Instruction : public Counted<OBJECT_INSTRUCTION>/*{{{*/
 {
 	public:
 		enum InstructionType
@@ -243,6 +259,11 @@ class Instruction/*{{{*/
 			USE,
 			USE_AND_DEFINITION
 		};
+
+		enum
+		{
+			MAX_OPERANDS = 2
+		};
 		
 		virtual ~Instruction()
 		{}
@@ -258,7 +279,7 @@ class Instruction/*{{{*/
 		{
 			// Default implementation
 			Expression_ptr result;
-			msg("ERROR: default implementation for Instruction::Operand called\n");
+			message("ERROR: default implementation for Instruction::Operand called\n");
 			return result;
 		}
 
@@ -271,12 +292,19 @@ class Instruction/*{{{*/
 		{
 			return INVALID;
 		}
+
+		/** Get where an operand is stored, NULL if there is no such operand */
+		virtual Expression_ptr* OperandSlot(int index)
+		{
+			return NULL;
+		}
 #endif
 	
 		virtual Addr Address() const { return mAddress; }
-		virtual InstructionType Type() const { return mType; }
+		void Address(Addr ea) { mAddress = ea; }
+		InstructionType Type() const { return mType; }
 		
-		virtual bool IsType(InstructionType type)
+		bool IsType(InstructionType type) const
 		{
 			return Type() == type;
 		}
@@ -306,6 +334,55 @@ class Instruction/*{{{*/
 					);
 		}
 
+		/** 
+		 * Dirty instructions need their uses and definitions recomputed,
+		 * new instructions start out dirty
+		 */
+		void MarkDirty() { mDirty = true; }
+		bool IsDirty() const { return mDirty; }
+
+		/**
+		 * Must be called when an operand is set, or a sub-expression of
+		 * an operand is replaced or added
+		 */
+		void OperandChanged() { mOccurrencesValid = false; }
+		void ClearDirty() { mDirty = false; }
+
+		/**
+		 * Registers in the operands and where they are stored.
+		 *
+		 * Built when first needed and again after OperandChanged.
+		 * Different instructions can be indexed on different threads.
+		 */
+		const RegisterOccurrence_vector& RegisterOccurrences();
+
+		/** Registers in an operand, as BoolArray (simple) indexes */
+		const BoolArray& OperandRegisters(int index)
+		{
+			RegisterOccurrences();
+			return mOperandRegisters[index];
+		}
+
+		/** Number of uses of a register in an operand */
+		int RegisterCount(int index, unsigned short reg);
+
+		/**
+		 * Replace every use of a register in an operand
+		 *
+		 * Only slots that still hold the register are written, a slot
+		 * is listed once for each time its subtree occurs.
+		 *
+		 * \return the number of replaced uses
+		 */
+		int ReplaceRegister(int index, unsigned short reg, Expression_ptr replacement);
+
+		/** Forget DU-chains and last definitions before they are recomputed */
+		void ClearDuChain()
+		{
+			mDuChain.clear();
+			mLastDefinitions.Clear();
+		}
+
 		bool DefinitionHasNoUses(unsigned short reg)
 		{
 			return mDuChain.count(reg) == 0;
@@ -345,8 +422,7 @@ class Instruction/*{{{*/
 
         virtual void print(std::ostream& os)
         {
-            os << boost::format("   insn %08lx")
-                    % Address();
+            os << "   insn " << Hex8(Address());
             os << " use=" << Uses();
             os << " def=" << Definitions();
             os << " last=" << LastDefinitions();
@@ -355,10 +431,13 @@ class Instruction/*{{{*/
         }
 	protected:
 		Instruction(InstructionType type, Addr ea)
-			: mType(type), mAddress(ea)
+			: Counted<OBJECT_INSTRUCTION>(type), mType(type), mAddress(ea), mDirty(true),
+				mOccurrencesValid(false)
 		{}
-		
+
 	private:
+		void IndexRegisters();
+
 		InstructionType mType;
 		Addr mAddress;
 		BoolArray mDefinitions;
@@ -366,6 +445,10 @@ class Instruction/*{{{*/
 		BoolArray mLastDefinitions;
 		BoolArray mFlagDefinitions;
 		RegisterToAddress_map mDuChain;
+		bool mDirty;
+		RegisterOccurrence_vector mOccurrences;
+		BoolArray mOperandRegisters[MAX_OPERANDS];
+		bool mOccurrencesValid;
 };/*}}}*/
 
 /*
@@ -376,16 +459,23 @@ class Label : public Instruction/*{{{*/
 {
 	public:
 		Label(Addr ea, const char* name)
-			: Instruction(LABEL, ea), mName(name)
+			: Instruction(LABEL, ea), mName(name), mPreviousChunkEnd(INVALID_ADDR)
 		{}
         virtual void print(std::ostream& os)
         {
             Instruction::print(os);
-            os << boost::format("LABEL %s\n")
-                    % Name();
+            os << "LABEL " << Name() << '\n';
         }
 
 		const std::string& Name() const { return mName; }
+		void Name(const std::string& name) { mName = name; }
+
+		/**
+		 * Set on the label that starts a function tail: the instruction
+		 * before it in the list falls through to this address instead
+		 */
+		Addr PreviousChunkEnd() const { return mPreviousChunkEnd; }
+		void PreviousChunkEnd(Addr end) { mPreviousChunkEnd = end; }
 
 		virtual void Accept(InstructionVisitor& visitor)
 		{
@@ -393,6 +483,7 @@ class Label : public Instruction/*{{{*/
 		}
 	private:
 		std::string mName;
+		Addr mPreviousChunkEnd;
 };/*}}}*/
 
 /**
@@ -401,7 +492,7 @@ class Label : public Instruction/*{{{*/
 class UnaryInstruction : public Instruction/*{{{*/
 {
 	public:
-		void Operand(Expression_ptr operand) { mOperand = operand; }
+		void Operand(Expression_ptr operand) { mOperand = operand; OperandChanged(); }
 		Expression_ptr Operand() { return mOperand; }
 
 #if 1
@@ -416,16 +507,21 @@ class UnaryInstruction : public Instruction/*{{{*/
 			if (0 == index)
 				result = mOperand;
 			else
-				msg("ERROR: UnaryInstruction::Operand(%d) -> NULL\n", index);
+				message("ERROR: UnaryInstruction::Operand(%d) -> NULL\n", index);
 			return result;
 		}
 
 		virtual void Operand(int index, Expression_ptr e)
 		{
 			if (0 == index)
-				mOperand = e;
+				Operand(e);
 			else
-				msg("ERROR: UnaryInstruction(%d, %08lx)\n", index, e.get());
+				message("ERROR: UnaryInstruction(%d, %08lx)\n", index, e.get());
+		}
+
+		virtual Expression_ptr* OperandSlot(int index)
+		{
+			return (0 == index) ? &mOperand : NULL;
 		}
 #endif
 	
@@ -444,10 +540,10 @@ class UnaryInstruction : public Instruction/*{{{*/
 class BinaryInstruction : public Instruction/*{{{*/
 {
 	public:
-		void First(Expression_ptr first) { mFirst = first; }
+		void First(Expression_ptr first) { mFirst = first; OperandChanged(); }
 		Expression_ptr First() { return mFirst; }
 
-		void Second(Expression_ptr second) { mSecond = second; }
+		void Second(Expression_ptr second) { mSecond = second; OperandChanged(); }
 		Expression_ptr Second() { return mSecond; }
 
 #if 1
@@ -464,18 +560,28 @@ class BinaryInstruction : public Instruction/*{{{*/
 			else if (1 == index)
 				result = mSecond;
 			else
-				msg("ERROR: BinaryInstruction::Operand(%d) -> NULL\n", index);
+				message("ERROR: BinaryInstruction::Operand(%d) -> NULL\n", index);
 			return result;
 		}
 
 		virtual void Operand(int index, Expression_ptr e)
 		{
 			if (0 == index)
-				mFirst = e;
+				First(e);
+			else if (1 == index)
+				Second(e);
+			else
+				message("ERROR: BinaryInstruction(%d, %08lx)\n", index, e.get());
+		}
+
+		virtual Expression_ptr* OperandSlot(int index)
+		{
+			if (0 == index)
+				return &mFirst;
 			else if (1 == index)
-				mSecond = e;
+				return &mSecond;
 			else
-				msg("ERROR: BinaryInstruction(%d, %08lx)\n", index, e.get());
+				return NULL;
 		}
 #endif
 	
@@ -706,9 +812,8 @@ class Assignment : public BinaryInstruction/*{{{*/
 			First( Dummy::Create() );
 			Definitions().Clear(reg);
 
-			// TODO: if the second operand does not contain a CALL expression we can 
-			// return true here
-			return !IsCall();
+			// a call must stay for its side effects, wherever it is
+			return !Expression::ContainsCall(Second());
 		}
 };/*}}}*/
 
@@ -717,11 +822,23 @@ class Assignment : public BinaryInstruction/*{{{*/
  * Switch/case instructions
  */
 
+/** One entry of a switch table */
+struct SwitchCase/*{{{*/
+{
+	unsigned long value;
+	Addr target;
+};/*}}}*/
+
+typedef std::vector<SwitchCase> SwitchCase_vector;
+
 class Switch : public UnaryInstruction/*{{{*/
 {
 	public:
-		Switch(Addr ea, Expression_ptr value/*, switch_info_t& si*/)
-			: UnaryInstruction(SWITCH, ea, value)//, mSwitchInfo(si)
+		Switch(Addr ea, Expression_ptr value, 
+				const SwitchCase_vector& cases = SwitchCase_vector(),
+				Addr defaultTarget = INVALID_ADDR)
+			: UnaryInstruction(SWITCH, ea, value), mCases(cases),
+				mDefaultTarget(defaultTarget)
 		{}
         virtual void print(std::ostream& os)
         {
@@ -739,24 +856,58 @@ class Switch : public UnaryInstruction/*{{{*/
 			return USE;
 		}
 
+		const SwitchCase_vector& Cases() const { return mCases; }
+		
+		/** INVALID_ADDR if the table has no default */
+		Addr DefaultTarget() const { return mDefaultTarget; }
+
+		/** Move the targets as Node::Move moves the successors */
+		void MoveTargets(Addr from, Addr to)
+		{
+			for (size_t i = 0; i < mCases.size(); i++)
+				mCases[i].target = mCases[i].target - from + to;
+			if (INVALID_ADDR != mDefaultTarget)
+				mDefaultTarget = mDefaultTarget - from + to;
+		}
+
 	private:
-		//switch_info_t mSwitchInfo;	
+		SwitchCase_vector mCases;
+		Addr mDefaultTarget;
 };/*}}}*/
 
 
+/**
+ * Start of the code for one or more values of a switch, or for the
+ * default
+ */
 class Case : public Instruction/*{{{*/
 {
 	public:
+		Case(Addr ea)
+			: Instruction(CASE, ea), mDefault(false)
+		{}
 		Case(Addr ea, unsigned int value)
-			: Instruction(CASE, ea), mValue(value)
+			: Instruction(CASE, ea), mValues(1, value), mDefault(false)
 		{}
         virtual void print(std::ostream& os)
         {
             Instruction::print(os);
-            os << boost::format("CASE %08lx\n") % Value();
+            os << "CASE";
+            for (unsigned i = 0; i < mValues.size(); i++)
+                os << ' ' << Hex8(mValues[i]);
+            if (mDefault)
+                os << " DEFAULT";
+            os << "\n";
         }
 
-		unsigned int Value() { return mValue; }
+		unsigned int Value() { return mValues.empty() ? 0 : mValues[0]; }
+
+		int ValueCount() const { return mValues.size(); }
+		unsigned int Value(int index) const { return mValues[index]; }
+		void AddValue(unsigned int value) { mValues.push_back(value); }
+
+		bool IsDefault() const { return mDefault; }
+		void SetDefault() { mDefault = true; }
 		
 		virtual void Accept(InstructionVisitor& visitor)
 		{
@@ -764,7 +915,8 @@ class Case : public Instruction/*{{{*/
 		}
 
 	private:
-		unsigned int mValue;
+		std::vector<unsigned int> mValues;
+		bool mDefault;
 };/*}}}*/
 
 /**
@@ -802,16 +954,24 @@ class Throw : public Instruction/*{{{*/
 			if (0 == index)
 				result = mException;
 			else
-				msg("ERROR: Throw(%d) -> NULL\n", index);
+				message("ERROR: Throw(%d) -> NULL\n", index);
 			return result;
 		}
 
 		virtual void Operand(int index, Expression_ptr e)
 		{
 			if (0 == index)
+			{
 				mException = e;
+				OperandChanged();
+			}
 			else
-				msg("ERROR: Throw(%d, %08lx)\n", index, e.get());
+				message("ERROR: Throw(%d, %08lx)\n", index, e.get());
+		}
+
+		virtual Expression_ptr* OperandSlot(int index)
+		{
+			return (0 == index && !IsRethrow()) ? &mException : NULL;
 		}
 
 		bool IsRethrow()
@@ -831,26 +991,68 @@ class Throw : public Instruction/*{{{*/
 		std::string mDataType;
 };/*}}}*/
 
+/**
+ * Visit an instruction with a type switch on Type() instead of the
+ * virtual Accept. The Visit calls are qualified with Visitor, so they are
+ * bound at compile time even if Visitor implements InstructionVisitor.
+ * LowLevel is only declared here and still goes through Accept.
+ */
+template<class Visitor>
+void Dispatch(Instruction& instruction, Visitor& visitor)/*{{{*/
+{
+	switch (instruction.Type())
+	{
+		case Instruction::ASSIGNMENT:
+			visitor.Visitor::Visit(static_cast<Assignment&>(instruction));
+			break;
+		case Instruction::CASE:
+			visitor.Visitor::Visit(static_cast<Case&>(instruction));
+			break;
+		case Instruction::CONDITIONAL_JUMP:
+			visitor.Visitor::Visit(static_cast<ConditionalJump&>(instruction));
+			break;
+		case Instruction::JUMP:
+			visitor.Visitor::Visit(static_cast<Jump&>(instruction));
+			break;
+		case Instruction::LABEL:
+			visitor.Visitor::Visit(static_cast<Label&>(instruction));
+			break;
+		case Instruction::PUSH:
+			visitor.Visitor::Visit(static_cast<Push&>(instruction));
+			break;
+		case Instruction::POP:
+			visitor.Visitor::Visit(static_cast<Pop&>(instruction));
+			break;
+		case Instruction::RETURN:
+			visitor.Visitor::Visit(static_cast<Return&>(instruction));
+			break;
+		case Instruction::SWITCH:
+			visitor.Visitor::Visit(static_cast<Switch&>(instruction));
+			break;
+		case Instruction::THROW:
+			visitor.Visitor::Visit(static_cast<Throw&>(instruction));
+			break;
+		default:
+			instruction.Accept(visitor);
+			break;
+	}
+}/*}}}*/
+
 
 class ErasePool/*{{{*/
 {
 	private:
-		typedef std::list<Instruction_list::iterator> IteratorList;
+		typedef std::pair<Instruction_list*, Instruction_list::iterator> Item;
+		typedef std::list<Item> IteratorList;
 
 		IteratorList mIterators;
 		Instruction_list& mInstructions;
 
 		struct EraseHelper
 		{
-			EraseHelper(Instruction_list& instructions)
-				: mInstructions(instructions)
-			{}
-		
-			Instruction_list& mInstructions;
-			
-			void operator () (Instruction_list::iterator item)
+			void operator () (Item item)
 			{
-				mInstructions.erase(item);
+				item.first->erase(item.second);
 			}
 		};
 			
@@ -861,15 +1063,23 @@ class ErasePool/*{{{*/
 			
 		~ErasePool()
 		{
-			for_each(mIterators.begin(), mIterators.end(), EraseHelper(mInstructions));
+			for_each(mIterators.begin(), mIterators.end(), EraseHelper());
 		}
 
-		void Erase(Instruction_list::iterator item)
+		bool Erase(Instruction_list::iterator item)
+		{
+			return Erase(mInstructions, item);
+		}
+
+		/** Erase an instruction from another list than the one of the pool */
+		bool Erase(Instruction_list& instructions, Instruction_list::iterator item)
 		{
 			if ((**item).MarkForDeletion())
 			{
-				mIterators.push_back(item);
+				mIterators.push_back(Item(&instructions, item));
+				return true;
 			}
+			return false;
 		}
 };/*}}}*/
 
@@ -0,0 +1,107 @@
+// 
+// Copyright (c) 2002 David Eriksson <david@2good.nu>
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a
+// copy of this software and associated documentation files (the "Software"),
+// to deal in the Software without restriction, including without limitation
+// the rights to use, copy, modify, merge, publish, distribute, sublicense,
+// and/or sell copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+// DEALINGS IN THE SOFTWARE.
+//
+// $Id$
+#include <iomanip>
+
+#include "json.hpp"
+
+/**
+ * How each byte is written inside a JSON string, empty if it stands for
+ * itself. Bytes above 0x7f are taken as Latin-1, so the output is always
+ * valid UTF-8 whatever the database holds.
+ */
+class JsonEscapeTable/*{{{*/
+{
+	public:
+		JsonEscapeTable()
+		{
+			// not HexDigits, which may not be constructed yet
+			static const char DIGITS[] = "0123456789abcdef";
+			
+			for (int c = 0; c < 256; c++)
+			{
+				if (c >= 0x20 && c < 0x7f)
+				{
+					mEscapes[c][0] = '\0';
+				}
+				else
+				{
+					Set(c, "\\u00");
+					mEscapes[c][4] = DIGITS[c >> 4];
+					mEscapes[c][5] = DIGITS[c & 0xf];
+					mEscapes[c][6] = '\0';
+				}
+			}
+
+			Set('"',  "\\\"");
+			Set('\\', "\\\\");
+			Set('\n', "\\n");
+			Set('\r', "\\r");
+			Set('\t', "\\t");
+		}
+
+		const char* Escape(unsigned char c) const { return mEscapes[c]; }
+
+	private:
+		void Set(unsigned char c, const char* escape)
+		{
+			char* out = mEscapes[c];
+			while ('\0' != (*out++ = *escape++))
+				;
+		}
+
+		char mEscapes[256][7];
+};/*}}}*/
+
+static const JsonEscapeTable s_escapes;
+
+void JsonWriter::String(const char* str, size_t length)/*{{{*/
+{
+	Separate();
+	mOut.put('"');
+
+	const char* end = str + length;
+	const char* run = str;    // start of characters not yet written
+	for (const char* i = str; i != end; i++)
+	{
+		const char* escape = s_escapes.Escape((unsigned char)*i);
+		if ('\0' != *escape)
+		{
+			mOut.write(run, i - run);
+			mOut << escape;
+			run = i + 1;
+		}
+	}
+	mOut.write(run, end - run);
+	
+	mOut.put('"');
+}/*}}}*/
+
+void JsonWriter::Number(double value)/*{{{*/
+{
+	Separate();
+	std::ios_base::fmtflags flags = mOut.flags();
+	std::streamsize precision = mOut.precision();
+	mOut << std::fixed << std::setprecision(3) << value;
+	mOut.flags(flags);
+	mOut.precision(precision);
+}/*}}}*/
@@ -0,0 +1,99 @@
+// 
+// Copyright (c) 2002 David Eriksson <david@2good.nu>
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a
+// copy of this software and associated documentation files (the "Software"),
+// to deal in the Software without restriction, including without limitation
+// the rights to use, copy, modify, merge, publish, distribute, sublicense,
+// and/or sell copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+// DEALINGS IN THE SOFTWARE.
+//
+// $Id$
+#ifndef _JSON_HPP
+#define _JSON_HPP
+
+#include "desquirr.hpp"
+
+/**
+ * Streaming JSON writer. Values go straight to the stream; the writer
+ * only remembers whether a comma is needed at each nesting level.
+ */
+class JsonWriter/*{{{*/
+{
+	public:
+		enum
+		{
+			MAX_DEPTH = 16
+		};
+		
+		JsonWriter(std::ostream& out)
+			: mOut(out), mDepth(0), mKeyPending(false)
+		{
+			mFirst[0] = true;
+		}
+
+		void BeginObject() { Separate(); mOut.put('{'); Push(); }
+		void EndObject()   { mDepth--; mOut.put('}'); }
+		void BeginArray()  { Separate(); mOut.put('['); Push(); }
+		void EndArray()    { mDepth--; mOut.put(']'); }
+
+		/** Key of the next value in an object */
+		void Key(const char* key)
+		{
+			Separate();
+			mOut.put('"');
+			mOut << key;
+			mOut.write("\":", 2);
+			mKeyPending = true;
+		}
+
+		void String(const char* str, size_t length);
+		void String(const std::string& str) { String(str.data(), str.size()); }
+		void Number(unsigned long value)    { Separate(); mOut << value; }
+		void Number(long value)             { Separate(); mOut << value; }
+		void Number(int value)              { Separate(); mOut << value; }
+		void Number(double value);
+		void Bool(bool value)               { Separate(); mOut << (value ? "true" : "false"); }
+
+	private:
+		/** Comma before every value but the first of an array or object */
+		void Separate()
+		{
+			if (mKeyPending)
+			{
+				mKeyPending = false;
+				return;
+			}
+			
+			if (mFirst[mDepth])
+				mFirst[mDepth] = false;
+			else
+				mOut.put(',');
+		}
+
+		void Push()
+		{
+			if (mDepth + 1 < MAX_DEPTH)
+				mDepth++;
+			mFirst[mDepth] = true;
+			mKeyPending = false;
+		}
+
+		std::ostream& mOut;
+		int mDepth;
+		bool mFirst[MAX_DEPTH];
+		bool mKeyPending;
+};/*}}}*/
+
+#endif // _JSON_HPP
@@ -0,0 +1,52 @@
+// 
+// Copyright (c) 2002 David Eriksson <david@2good.nu>
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a
+// copy of this software and associated documentation files (the "Software"),
+// to deal in the Software without restriction, including without limitation
+// the rights to use, copy, modify, merge, publish, distribute, sublicense,
+// and/or sell copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+// DEALINGS IN THE SOFTWARE.
+//
+// $Id$
+#include "log.hpp"
+
+int Log::sLevel[LOG_CATEGORY_COUNT] = 
+{
+	LOG_WARNING,    // LOG_GENERAL
+	LOG_WARNING,    // LOG_LIFT
+	LOG_WARNING,    // LOG_NAMES
+	LOG_WARNING,    // LOG_TYPES
+	LOG_WARNING,    // LOG_DATAFLOW
+	LOG_WARNING     // LOG_PASSES
+};
+
+unsigned long Log::sCount[LOG_CATEGORY_COUNT];
+unsigned long Log::sLimit = 100;
+
+void Log::Reset()/*{{{*/
+{
+	for (int i = 0; i < LOG_CATEGORY_COUNT; i++)
+		sCount[i] = 0;
+}/*}}}*/
+
+bool Log::Suppressed(LogCategory category)/*{{{*/
+{
+	if (sCount[category] == sLimit + 1)
+		message("Further messages of category %i suppressed\n", category);
+	
+	// keep the counter from wrapping around
+	sCount[category] = sLimit + 2;
+	return false;
+}/*}}}*/
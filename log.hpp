@@ -0,0 +1,101 @@
+// 
+// Copyright (c) 2002 David Eriksson <david@2good.nu>
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a
+// copy of this software and associated documentation files (the "Software"),
+// to deal in the Software without restriction, including without limitation
+// the rights to use, copy, modify, merge, publish, distribute, sublicense,
+// and/or sell copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+// DEALINGS IN THE SOFTWARE.
+//
+// $Id$
+#ifndef _LOG_HPP
+#define _LOG_HPP
+
+#include "desquirr.hpp"
+
+/*
+ * Leveled logging by category.
+ *
+ *   LOG(LOG_NOTE, LOG_NAMES, ("NOTE: created new label %s\n", name));
+ *
+ * Messages above DESQUIRR_LOG_LEVEL are removed by the compiler, the
+ * others are checked against the level of their category at run time and
+ * only the first Log::Limit() messages of a category are printed.
+ */
+
+#define LOG_ERROR    0
+#define LOG_WARNING  1
+#define LOG_NOTE     2
+#define LOG_DEBUG    3
+
+#ifndef DESQUIRR_LOG_LEVEL
+#define DESQUIRR_LOG_LEVEL LOG_WARNING
+#endif
+
+enum LogCategory
+{
+	LOG_GENERAL,
+	LOG_LIFT,       // lifters and idioms
+	LOG_NAMES,      // labels and variable names
+	LOG_TYPES,      // type information
+	LOG_DATAFLOW,
+	LOG_PASSES,
+	LOG_CATEGORY_COUNT
+};
+
+class Log/*{{{*/
+{
+	public:
+		static bool Enabled(int level, LogCategory category)
+		{
+			return level <= sLevel[category];
+		}
+
+		/**
+		 * Count a message of category
+		 *
+		 * \return false if the message should be dropped
+		 */
+		static bool Admit(LogCategory category)
+		{
+			return ++sCount[category] <= sLimit || Suppressed(category);
+		}
+
+		/** Set the run-time level of a category */
+		static void Level(LogCategory category, int level) { sLevel[category] = level; }
+		
+		/** Messages per category and session, 0 for no limit */
+		static void Limit(unsigned long limit) { sLimit = limit ? limit : ~0UL; }
+
+		/** Start counting again, e.g. for a new session */
+		static void Reset();
+
+	private:
+		static bool Suppressed(LogCategory category);
+		
+		static int sLevel[LOG_CATEGORY_COUNT];
+		static unsigned long sCount[LOG_CATEGORY_COUNT];
+		static unsigned long sLimit;
+};/*}}}*/
+
+#define LOG(level, category, args) \
+	do { \
+		if ((level) <= DESQUIRR_LOG_LEVEL && \
+				Log::Enabled((level), (category)) && \
+				Log::Admit(category)) \
+			message args; \
+	} while (0)
+
+#endif // _LOG_HPP
@@ -0,0 +1,118 @@
+// 
+// Copyright (c) 2002 David Eriksson <david@2good.nu>
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a
+// copy of this software and associated documentation files (the "Software"),
+// to deal in the Software without restriction, including without limitation
+// the rights to use, copy, modify, merge, publish, distribute, sublicense,
+// and/or sell copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+// DEALINGS IN THE SOFTWARE.
+//
+// $Id$
+#ifndef _LOWLEVEL_HPP
+#define _LOWLEVEL_HPP
+
+#include "desquirr.hpp"
+#include "instruction.hpp"
+#include "decoded.hpp"
+
+/**
+ * Instruction that has not been lifted yet, in decoded form
+ */
+class LowLevel : public Instruction /*{{{*/
+{
+	public:
+		LowLevel(const DecodedInsn& insn)
+			: Instruction(LOW_LEVEL, insn.ea),
+				mInsn(insn)
+		{}
+
+		virtual void Accept(InstructionVisitor& visitor)
+		{
+			visitor.Visit(*this);
+		}
+
+		DecodedInsn& Insn() { return mInsn; }
+		
+		/** \return NULL if instruction is not a LowLevel */
+		static DecodedInsn* Insn(const Instruction_ptr& instruction) 
+		{ 
+			if (instruction->IsType(Instruction::LOW_LEVEL))
+				return &static_cast<LowLevel*>(instruction.get())->Insn();
+		
+			return NULL; 
+		}
+		
+	private:
+		DecodedInsn mInsn;
+		
+};/*}}}*/
+
+/**
+ * The LowLevel instructions following a position in an instruction list,
+ * without copying them. Positions past the last LowLevel instruction read
+ * as an empty instruction.
+ */
+class InsnWindow/*{{{*/
+{
+	public:
+		enum
+		{
+			MAX_SIZE = 8
+		};
+		
+		InsnWindow()
+			: mSize(0)
+		{}
+
+		/**
+		 * Look at up to count instructions from item
+		 *
+		 * \return true if there are count LowLevel instructions
+		 */
+		bool Fill(Instruction_list::iterator item, 
+				Instruction_list::iterator end, int count)/*{{{*/
+		{
+			mSize = 0;
+			
+			for(; mSize < count && mSize < MAX_SIZE && item != end; item++)
+			{
+				DecodedInsn* insn = LowLevel::Insn(*item);
+				if (!insn)
+					break;
+
+				mItems[mSize++] = insn;
+			}
+
+			return mSize == count;
+		}/*}}}*/
+
+		int Size() const { return mSize; }
+
+		const DecodedInsn& operator[](int index) const/*{{{*/
+		{
+			static const DecodedInsn empty = DecodedInsn();
+			
+			if (index < mSize)
+				return *mItems[index];
+			else
+				return empty;
+		}/*}}}*/
+
+	private:
+		DecodedInsn* mItems[MAX_SIZE];
+		int mSize;
+};/*}}}*/
+
+#endif // _LOWLEVEL_HPP
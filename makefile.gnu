@@ -73,7 +73,8 @@ CDEFS=-DWIN32 -D_USRDLL -D__NT__ -D__IDP__ -DMAXSTR=1024
 CINCS=-I $(idasdk)\include -I $(boost) -I $(idasdk)\module
 COPTS=-GX -GR -Gz -nologo  -Zi 
 
-LDLIBS=/libpath:$(idasdk)\LIBVC.W32  $(idasdk)\LIBVC.W32\ida.lib
+# boost_thread is found by the boost auto-linking
+LDLIBS=/libpath:$(idasdk)\LIBVC.W32  $(idasdk)\LIBVC.W32\ida.lib /libpath:$(boost)\lib
 LDFLAGS=/nologo /dll /export:PLUGIN  /debug
 
 # msvc 12.00 does not support -Wall yet -> use -W4.
@@ -91,13 +92,13 @@ all: $(objdir) $(objdir)/desquirr.plw
 $(objdir):
 	mkdir -p $(objdir)
 
-$(objdir)/desquirr.plw: $(objdir)/desquirr.obj $(objdir)/instruction.obj $(objdir)/dataflow.obj $(objdir)/node.obj $(objdir)/expression.obj $(objdir)/idapro.obj $(objdir)/codegen.obj $(objdir)/usedefine.obj $(objdir)/function.obj $(objdir)/frontend.obj $(objdir)/ida-arm.obj $(objdir)/ida-x86.obj
+$(objdir)/desquirr.plw: $(objdir)/desquirr.obj $(objdir)/instruction.obj $(objdir)/dataflow.obj $(objdir)/node.obj $(objdir)/expression.obj $(objdir)/idapro.obj $(objdir)/codegen.obj $(objdir)/usedefine.obj $(objdir)/function.obj $(objdir)/frontend.obj $(objdir)/ida-arm.obj $(objdir)/ida-x86.obj $(objdir)/passmanager.obj $(objdir)/decoded.obj $(objdir)/scan.obj $(objdir)/namecache.obj $(objdir)/callee.obj $(objdir)/log.obj $(objdir)/fingerprint.obj $(objdir)/snapshot.obj $(objdir)/printer.obj $(objdir)/json.obj $(objdir)/counters.obj $(objdir)/trace.obj
 ifdef USEMSC
 	@LINK $(LDFLAGS) $(LDLIBS) $^ /out:$@ /map:desquirr.map
 else
 	echo "EXPORTS"        >$(objdir)/desquirr.def
 	echo "  _PLUGIN @1"  >>$(objdir)/desquirr.def
-	@g++ -Wl,--dll -shared -mno-cygwin $^ $(idasdk)/libgcc.w32/ida.a -o $@  --def $(objdir)/desquirr.def
+	@g++ -Wl,--dll -shared -mno-cygwin $^ $(idasdk)/libgcc.w32/ida.a -L$(boost)/lib -lboost_thread -o $@  --def $(objdir)/desquirr.def
 endif
 
 clean:
@@ -0,0 +1,124 @@
+// 
+// Copyright (c) 2002 David Eriksson <david@2good.nu>
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a
+// copy of this software and associated documentation files (the "Software"),
+// to deal in the Software without restriction, including without limitation
+// the rights to use, copy, modify, merge, publish, distribute, sublicense,
+// and/or sell copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+// DEALINGS IN THE SOFTWARE.
+//
+// $Id$
+#include "namecache.hpp"
+
+bool NameCache::FindName(Kind kind, Addr address, /*{{{*/
+		std::string& name, int& index)
+{
+	Name_map::iterator item = mNames.find(std::make_pair((int)kind, address));
+	if (mNames.end() == item)
+	{
+		mMisses++;
+		return false;
+	}
+
+	mHits++;
+	name  = item->second.name;
+	index = item->second.index;
+	return true;
+}/*}}}*/
+
+void NameCache::AddName(Kind kind, Addr address, const std::string& name, /*{{{*/
+		int index, Addr base)
+{
+	Entry& entry = mNames[std::make_pair((int)kind, address)];
+	entry.name  = name;
+	entry.index = index;
+	entry.base  = base;
+}/*}}}*/
+
+bool NameCache::FindAddress(const std::string& name, Addr& address)/*{{{*/
+{
+	Address_map::iterator item = mAddresses.find(name);
+	if (mAddresses.end() == item)
+	{
+		mMisses++;
+		return false;
+	}
+
+	mHits++;
+	address = item->second;
+	return true;
+}/*}}}*/
+
+void NameCache::AddAddress(const std::string& name, Addr address)/*{{{*/
+{
+	mAddresses[name] = address;
+}/*}}}*/
+
+bool NameCache::FindStructPath(unsigned long id, int offset, /*{{{*/
+		std::string& path, int& index)
+{
+	StructPath_map::iterator item = mStructPaths.find(std::make_pair(id, offset));
+	if (mStructPaths.end() == item)
+	{
+		mMisses++;
+		return false;
+	}
+
+	mHits++;
+	path  = item->second.name;
+	index = item->second.index;
+	return true;
+}/*}}}*/
+
+void NameCache::AddStructPath(unsigned long id, int offset, /*{{{*/
+		const std::string& path, int index)
+{
+	Entry& entry = mStructPaths[std::make_pair(id, offset)];
+	entry.name  = path;
+	entry.index = index;
+	entry.base  = INVALID_ADDR;
+}/*}}}*/
+
+void NameCache::Renamed(Addr address, const char* name)/*{{{*/
+{
+	// Renames are rare, a linear sweep is fine
+	for (Name_map::iterator item = mNames.begin(); item != mNames.end(); )
+	{
+		if (address == item->first.second || address == item->second.base)
+			mNames.erase(item++);
+		else
+			item++;
+	}
+
+	for (Address_map::iterator item = mAddresses.begin(); item != mAddresses.end(); )
+	{
+		if (address == item->second)
+			mAddresses.erase(item++);
+		else
+			item++;
+	}
+
+	if (name)
+		mAddresses.erase(name);
+}/*}}}*/
+
+void NameCache::Clear()/*{{{*/
+{
+	mNames.clear();
+	mAddresses.clear();
+	mStructPaths.clear();
+	mHits = 0;
+	mMisses = 0;
+}/*}}}*/
@@ -0,0 +1,92 @@
+// 
+// Copyright (c) 2002 David Eriksson <david@2good.nu>
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a
+// copy of this software and associated documentation files (the "Software"),
+// to deal in the Software without restriction, including without limitation
+// the rights to use, copy, modify, merge, publish, distribute, sublicense,
+// and/or sell copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+// DEALINGS IN THE SOFTWARE.
+//
+// $Id$
+#ifndef _NAMECACHE_HPP
+#define _NAMECACHE_HPP
+
+#include "desquirr.hpp"
+
+/**
+ * Names by address, addresses by name and structure member paths by
+ * (structure id, offset), resolved once per decompilation session.
+ *
+ * Every name remembers the address it was built from (a function start
+ * for "func+offset" names, the head of a structure for member names) so
+ * a rename of that address drops it.
+ */
+class NameCache/*{{{*/
+{
+	public:
+		enum Kind
+		{
+			LOCAL_LABEL,
+			GLOBAL_LABEL,
+			GLOBAL_VARIABLE
+		};
+
+		NameCache()
+			: mHits(0), mMisses(0)
+		{}
+
+		bool FindName(Kind kind, Addr address, std::string& name, int& index);
+		void AddName(Kind kind, Addr address, const std::string& name, 
+				int index, Addr base);
+
+		bool FindAddress(const std::string& name, Addr& address);
+		void AddAddress(const std::string& name, Addr address);
+
+		bool FindStructPath(unsigned long id, int offset, 
+				std::string& path, int& index);
+		void AddStructPath(unsigned long id, int offset, 
+				const std::string& path, int index);
+
+		/** The name at address changed to name */
+		void Renamed(Addr address, const char* name);
+
+		/** A structure or its members were changed, renamed or deleted */
+		void StructChanged() { mStructPaths.clear(); }
+
+		void Clear();
+
+		unsigned long Hits() const { return mHits; }
+		unsigned long Misses() const { return mMisses; }
+
+	private:
+		struct Entry
+		{
+			std::string name;
+			int index;
+			Addr base;
+		};
+
+		typedef std::map<std::pair<int, Addr>, Entry> Name_map;
+		typedef std::map<std::string, Addr> Address_map;
+		typedef std::map<std::pair<unsigned long, int>, Entry> StructPath_map;
+
+		Name_map mNames;
+		Address_map mAddresses;
+		StructPath_map mStructPaths;
+		unsigned long mHits;
+		unsigned long mMisses;
+};/*}}}*/
+
+#endif // _NAMECACHE_HPP
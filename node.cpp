@@ -21,12 +21,35 @@
 //
 // $Id: node.cpp,v 1.4 2005/10/15 23:56:03 wjhengeveld Exp $
 
+#include <deque>
+#include <set>
 #include <stack>
 
 #include "node.hpp"
 #include "dataflow.hpp"
+#include "trace.hpp"
 
 // this finds consequetive sequences of instructions.
+/**
+ * Address control flows to from the instruction before next. That is
+ * next itself, except where next starts a function tail.
+ */
+static Addr FallThroughAddress(Instruction_list::iterator next,/*{{{*/
+		Instruction_list::iterator end)
+{
+	if (end == next)
+		return INVALID_ADDR;
+
+	if (Instruction::LABEL == (**next).Type())
+	{
+		Addr previousChunkEnd = static_cast<Label*>(next->get())->PreviousChunkEnd();
+		if (INVALID_ADDR != previousChunkEnd)
+			return previousChunkEnd;
+	}
+
+	return (**next).Address();
+}/*}}}*/
+
 void Node::CreateList(Instruction_list& instructions, Node_list& nodes)/*{{{*/
 {
 	Instruction_list::iterator cur = instructions.begin();
@@ -48,7 +71,7 @@ void Node::CreateList(Instruction_list& instructions, Node_list& nodes)/*{{{*/
 			case Instruction::CONDITIONAL_JUMP:
 				cur++;
 				node = ConditionalJumpNode::CreateFrom(instruction, 
-						instructions.end() == cur ? INVALID_ADDR : (**cur).Address(),
+						FallThroughAddress(cur, instructions.end()),
 						begin, cur);
 				begin = cur;
 				break;
@@ -63,7 +86,8 @@ void Node::CreateList(Instruction_list& instructions, Node_list& nodes)/*{{{*/
 			case Instruction::CASE:
 				if (begin != cur)
 				{
-					node.reset( new FallThroughNode(instruction->Address(), begin, cur) );
+					node.reset( new FallThroughNode(
+								FallThroughAddress(cur, instructions.end()), begin, cur) );
 					begin = cur; 
 				}
 				cur++;	// yes, increase after node creation, not before 
@@ -83,13 +107,12 @@ void Node::CreateList(Instruction_list& instructions, Node_list& nodes)/*{{{*/
                 begin = cur;
                 break;
 */
-/*
 			case Instruction::SWITCH:
-                cur++;
-                node.reset( new N_WayNode(GetSwitchExpression(), begin, cur) );
-                begin = cur;
-                break;
-*/
+				cur++;
+				node = N_WayNode::CreateFrom(instruction, begin, cur);
+				begin = cur;
+				break;
+
 			default:
 				cur++;
 				break;
@@ -148,19 +171,35 @@ Node_ptr ConditionalJumpNode::CreateFrom(Instruction_ptr i,/*{{{*/
 	return Node_ptr( new ConditionalJumpNode(address, follower, begin, end) );
 }/*}}}*/
 
+Node_ptr N_WayNode::CreateFrom(Instruction_ptr i,/*{{{*/
+		Instruction_list::iterator begin,
+		Instruction_list::iterator end)
+{
+	return Node_ptr( new N_WayNode(*static_cast<Switch*>(i.get()), begin, end) );
+}/*}}}*/
+
 /* Find DU-chains {{{ */
 struct FindDefintionUseChainsHelper
 {
+	bool mDirtyOnly;
+
+	FindDefintionUseChainsHelper(bool dirtyOnly)
+		: mDirtyOnly(dirtyOnly)
+	{}
+
 	void operator() (Node_ptr node)
 	{
-		Instruction::FindDefintionUseChains(node->Instructions());
+		// DU-chains do not cross node boundaries
+		if (!mDirtyOnly || node->IsDirty(ANALYSIS_DU_CHAINS))
+			Instruction::FindDefintionUseChains(node->Instructions());
+		node->ClearDirty(ANALYSIS_DU_CHAINS);
 	}
 };
 
-void Node::FindDefintionUseChains(Node_list& nodes)
+void Node::FindDefintionUseChains(Node_list& nodes, bool dirtyOnly)
 {
 	for_each(nodes.begin(), nodes.end(), 
-			FindDefintionUseChainsHelper());
+			FindDefintionUseChainsHelper(dirtyOnly));
 }/*}}}*/
 
 /* Connect successors {{{ */
@@ -199,7 +238,11 @@ struct ConnectSuccessorsHelper
 			if (mMap.end() != item)
 			{
 				bool success = node->ConnectSuccessor(i, item->second);
-				if (!success)
+				if (success)
+				{
+					item->second->AddPredecessor(node.get());
+				}
+				else
 				{
 					message("Failed to connect successor\n");
 				}
@@ -217,6 +260,9 @@ struct ConnectSuccessorsHelper
 void Node::ConnectSuccessors(Node_list& nodes)
 {
 	Node_map map;
+
+	for (Node_list::iterator n = nodes.begin(); n != nodes.end(); n++)
+		(**n).mPredecessors.clear();
 	
 	for_each(nodes.begin(), nodes.end(), 
 			ConnectSuccessorsMapBuilder(map));
@@ -226,13 +272,28 @@ void Node::ConnectSuccessors(Node_list& nodes)
 }/*}}}*/
 
 /* Live register analysis {{{ */
-void Node::LiveRegisterAnalysis(Node_list& nodes)
+void Node::LiveRegisterAnalysis(Node_list& nodes, bool dirtyOnly)
 {
+	if (dirtyOnly)
+	{
+		UpdateLiveRegisters(nodes);
+		return;
+	}
+
 	bool changed;
 
+	// Start from scratch, the sets may be left over from before a rewrite
+	for (Node_list::iterator n = nodes.begin(); n != nodes.end(); n++)
+	{
+		(**n).mLiveIn.Clear();
+		(**n).mLiveOut.Clear();
+		(**n).ClearDirty(ANALYSIS_LIVENESS);
+	}
+
 	do
 	{
 //		message(".");
+		TraceSpan span("liveness iteration");
 		changed = false;
 
 		for (Node_list::reverse_iterator item = nodes.rbegin();
@@ -257,5 +318,170 @@ void Node::LiveRegisterAnalysis(Node_list& nodes)
 		}
 	
 	} while (changed);
+}
+
+/*
+ * Propagate liveness from the dirty nodes only, using the previous
+ * results everywhere else. 
+ *
+ * This finds a fixed point, but not necessarily the smallest one: when
+ * a use inside a loop is removed, the register stays live around the
+ * loop because the nodes in the loop keep each other's LiveIn. That
+ * errs on the safe side, a full LiveRegisterAnalysis gives exact sets.
+ */
+void Node::UpdateLiveRegisters(Node_list& nodes)
+{
+	std::deque<Node*> worklist;
+	std::set<Node*> queued;
+
+	for (Node_list::iterator n = nodes.begin(); n != nodes.end(); n++)
+	{
+		if ((**n).IsDirty(ANALYSIS_LIVENESS))
+		{
+			worklist.push_back(n->get());
+			queued.insert(n->get());
+			(**n).ClearDirty(ANALYSIS_LIVENESS);
+		}
+	}
+
+	while (!worklist.empty())
+	{
+		Node* node = worklist.front();
+		worklist.pop_front();
+		queued.erase(node);
+
+		BoolArray live_out;
+		for (int i = 0; i < node->SuccessorCount(); i++)
+		{
+			if (node->Successor(i).get())
+				live_out |= node->Successor(i)->mLiveIn;
+		}
+
+		BoolArray live_in = node->Uses() | (live_out & ~node->Definitions());
+		node->mLiveOut = live_out;
+
+		if (live_in != node->mLiveIn)
+		{
+			node->mLiveIn = live_in;
+
+			for (size_t p = 0; p < node->mPredecessors.size(); p++)
+			{
+				if (queued.insert(node->mPredecessors[p]).second)
+					worklist.push_back(node->mPredecessors[p]);
+			}
+		}
+	}
 }/*}}}*/
 
+/* Dominator analysis {{{ */
+
+/*
+ * Iterative algorithm from Cooper, Harvey and Kennedy, "A Simple, Fast
+ * Dominance Algorithm". Nodes are numbered in reverse postorder from the
+ * first node in the list.
+ */
+typedef std::map<Node*, int> NodeNumber_map;
+
+static int IntersectDominators(const std::vector<int>& idom, int a, int b)
+{
+	while (a != b)
+	{
+		while (a > b)
+			a = idom[a];
+		while (b > a)
+			b = idom[b];
+	}
+	return a;
+}
+
+void Node::DominatorAnalysis(Node_list& nodes)
+{
+	std::vector<Node*> order;
+	NodeNumber_map number;
+
+	for (Node_list::iterator n = nodes.begin(); n != nodes.end(); n++)
+		(**n).mImmediateDominator = NULL;
+
+	if (nodes.empty())
+		return;
+
+	// Depth-first search without recursion: (node, next successor index)
+	std::stack< std::pair<Node*, int> > stack;
+	std::set<Node*> visited;
+	std::vector<Node*> postorder;
+
+	stack.push(std::make_pair(nodes.front().get(), 0));
+	visited.insert(nodes.front().get());
+
+	while (!stack.empty())
+	{
+		Node* node = stack.top().first;
+		int index = stack.top().second;
+
+		if (index < node->SuccessorCount())
+		{
+			stack.top().second++;
+			Node* successor = node->Successor(index).get();
+			if (successor && visited.insert(successor).second)
+				stack.push(std::make_pair(successor, 0));
+		}
+		else
+		{
+			postorder.push_back(node);
+			stack.pop();
+		}
+	}
+
+	order.assign(postorder.rbegin(), postorder.rend());
+	for (size_t i = 0; i < order.size(); i++)
+		number[order[i]] = i;
+
+	std::vector< std::vector<int> > predecessors(order.size());
+	for (size_t i = 0; i < order.size(); i++)
+	{
+		for (int s = 0; s < order[i]->SuccessorCount(); s++)
+		{
+			NodeNumber_map::iterator item = number.find(order[i]->Successor(s).get());
+			if (number.end() != item)
+				predecessors[item->second].push_back(i);
+		}
+	}
+
+	std::vector<int> idom(order.size(), -1);
+	idom[0] = 0;
+
+	bool changed;
+	do
+	{
+		changed = false;
+
+		for (size_t b = 1; b < order.size(); b++)
+		{
+			int new_idom = -1;
+
+			for (size_t p = 0; p < predecessors[b].size(); p++)
+			{
+				int predecessor = predecessors[b][p];
+				if (-1 == idom[predecessor])
+					continue;
+				
+				if (-1 == new_idom)
+					new_idom = predecessor;
+				else
+					new_idom = IntersectDominators(idom, predecessor, new_idom);
+			}
+
+			if (idom[b] != new_idom)
+			{
+				idom[b] = new_idom;
+				changed = true;
+			}
+		}
+	} while (changed);
+
+	for (size_t b = 1; b < order.size(); b++)
+	{
+		if (-1 != idom[b])
+			order[b]->mImmediateDominator = order[idom[b]];
+	}
+}/*}}}*/
@@ -42,7 +42,27 @@ Node  ... begin-end
 // 
 #include "desquirr.hpp"
 #include "instruction.hpp"
-class Node/*{{{*/
+
+/**
+ * Analyses whose results are stored in the nodes and instructions.
+ *
+ * The values are bits, so a set of analyses can be passed around as an
+ * AnalysisSet. They are also used to tell which results of a node are
+ * out of date after it was rewritten.
+ */
+enum AnalysisKind
+{
+	ANALYSIS_NONE                 = 0,
+	ANALYSIS_USES_AND_DEFINITIONS = 1,
+	ANALYSIS_LIVENESS             = 2,
+	ANALYSIS_DU_CHAINS            = 4,
+	ANALYSIS_DOMINATORS           = 8,
+	ANALYSIS_ALL                  = 15
+};
+
+typedef unsigned int AnalysisSet;
+
+class Node : public Counted<OBJECT_NODE>/*{{{*/
 {
 	public:
 		enum NodeType
@@ -51,7 +71,7 @@ class Node/*{{{*/
 			CONDITIONAL_JUMP,
 			FALL_THROUGH,
 			JUMP,
-			N_WAY,							// XXX: not yet implemented
+			N_WAY,
 			RETURN
 		};
 
@@ -69,30 +89,75 @@ class Node/*{{{*/
 			return mLiveOut.Get(reg);
 		}
 
+		/** Mark results of the node as out of date after a rewrite */
+		void MarkDirty(AnalysisSet analyses = ANALYSIS_ALL) { mDirty |= analyses; }
+		bool IsDirty(AnalysisKind kind) const { return 0 != (mDirty & kind); }
+		void ClearDirty(AnalysisKind kind) { mDirty &= ~kind; }
+
+		int PredecessorCount() const { return mPredecessors.size(); }
+		Node* Predecessor(int index) { return mPredecessors[index]; }
+		void AddPredecessor(Node* node) { mPredecessors.push_back(node); }
+
+		/** Valid after DominatorAnalysis, NULL for the entry node */
+		Node* ImmediateDominator() const { return mImmediateDominator; }
+
+		bool Dominates(const Node* other) const
+		{
+			for (; other; other = other->mImmediateDominator)
+			{
+				if (this == other)
+					return true;
+			}
+			return false;
+		}
+
 		virtual int SuccessorCount() 
 		{ 
 			// default implementation
 			return 0;
 		}
 
-		virtual Addr SuccessorAddress(int index)
+		virtual Addr SuccessorAddress(int /*index*/)
 		{
 			// default implementation
 			return INVALID_ADDR;
 		}
 
-		virtual Node_ptr Successor(int index)
+		virtual Node_ptr Successor(int /*index*/)
 		{
 			Node_ptr result;
-			msg("ERROR: Node::Successor called\n");
+			message("ERROR: Node::Successor called\n");
 			return result;
 		}
 
-		virtual bool ConnectSuccessor(int index, Node_ptr successor)
+		virtual bool ConnectSuccessor(int /*index*/, Node_ptr /*successor*/)
 		{
 			// default implementation
 			return false;
 		}
+
+		/**
+		 * Move the node and its successor addresses from a function at
+		 * from to the same code at to, for a clone of a function
+		 */
+		virtual void Move(Addr from, Addr to)
+		{
+			mAddress = Move(mAddress, from, to);
+		}
+
+		/**
+		 * Drop the references to the successors, which form cycles in
+		 * functions with loops and keep the nodes alive
+		 */
+		virtual void DisconnectSuccessors()
+		{
+			// default implementation
+		}
+
+		static Addr Move(Addr address, Addr from, Addr to)
+		{
+			return INVALID_ADDR == address ? address : address - from + to;
+		}
         friend std::ostream& operator<< (std::ostream& os, Node& n)
         {
             n.print(os);
@@ -101,10 +166,9 @@ class Node/*{{{*/
         }
         virtual void print(std::ostream& os)
         {
-            os << boost::format("node %08lx-%08lx #insn=%d")
-                    % Address()
-					% (Instructions().size() ? Instructions().back()->Address() : 0)
-                    % Instructions().size();
+            os << "node " << Hex8(Address()) << '-'
+                    << Hex8(Instructions().size() ? Instructions().back()->Address() : 0)
+                    << " #insn=" << Instructions().size();
             os << " use=" << Uses();
             os << " def=" << Definitions();
             os << " in=" << LiveIn();
@@ -114,14 +178,20 @@ class Node/*{{{*/
 				Node_list& nodes);
 		static void ConnectSuccessors(Node_list& nodes);
 
-		static void FindDefintionUseChains(Node_list& nodes);
-		static void LiveRegisterAnalysis(Node_list& nodes);
+		/*
+		 * With dirtyOnly set, only nodes marked dirty for the analysis
+		 * are recomputed, the others keep their previous results.
+		 */
+		static void FindDefintionUseChains(Node_list& nodes, bool dirtyOnly = false);
+		static void LiveRegisterAnalysis(Node_list& nodes, bool dirtyOnly = false);
+		static void DominatorAnalysis(Node_list& nodes);
 
 	protected:
 		Node(NodeType type, 
 				Instruction_list::iterator begin,
 				Instruction_list::iterator end)
-			: mAddress(INVALID_ADDR), mType(type)
+			: Counted<OBJECT_NODE>(type), mAddress(INVALID_ADDR), mType(type), mDirty(ANALYSIS_NONE),
+				mImmediateDominator(NULL)
 		{
 			for(Instruction_list::iterator item = begin;
 					item != end; 
@@ -144,6 +214,8 @@ class Node/*{{{*/
         virtual ~Node() {}
 
 	private:
+		static void UpdateLiveRegisters(Node_list& nodes);
+
 		Addr mAddress;
 		NodeType mType;
 		Instruction_list mInstructions;
@@ -152,6 +224,11 @@ class Node/*{{{*/
 		BoolArray mDefinitions;
 		BoolArray mLiveIn;
 		BoolArray mLiveOut;
+		AnalysisSet mDirty;
+
+		// owned by the node list
+		std::vector<Node*> mPredecessors;
+		Node* mImmediateDominator;
 };/*}}}*/
 
 class OneWayNode : public Node/*{{{*/
@@ -170,7 +247,9 @@ class OneWayNode : public Node/*{{{*/
 
 		virtual Addr SuccessorAddress(int index)
 		{
-			return 0 == index ? mSuccessorAddress : INVALID_ADDR;
+			if (0 == index)
+				return mSuccessorAddress;
+			return INVALID_ADDR;
 		}
 
 		virtual Node_ptr Successor(int index)
@@ -179,7 +258,7 @@ class OneWayNode : public Node/*{{{*/
 			if (0 == index)
 				result = mSuccessor;
 			else
-				msg("ERROR: OneWayNode::Successor(%d) called\n", index);
+				message("ERROR: OneWayNode::Successor(%d) called\n", index);
 			return result;
 		}
 
@@ -194,6 +273,17 @@ class OneWayNode : public Node/*{{{*/
 				return false;
 		}
 
+		virtual void Move(Addr from, Addr to)
+		{
+			Node::Move(from, to);
+			mSuccessorAddress = Node::Move(mSuccessorAddress, from, to);
+		}
+
+		virtual void DisconnectSuccessors()
+		{
+			mSuccessor.reset();
+		}
+
 
 	private:
 		Addr mSuccessorAddress;
@@ -238,7 +328,7 @@ class TwoWayNode : public Node/*{{{*/
 					result = mSuccessor[index];
                     break;
 				default:
-					msg("ERROR: TwoWayNode::Successor(%d) called\n", index);
+					message("ERROR: TwoWayNode::Successor(%d) called\n", index);
 			}
 			return result;
 		}
@@ -261,23 +351,59 @@ class TwoWayNode : public Node/*{{{*/
 			}
 		}
 
+		virtual void Move(Addr from, Addr to)
+		{
+			Node::Move(from, to);
+			for (int i = 0; i < 2; i++)
+				mSuccessorAddress[i] = Node::Move(mSuccessorAddress[i], from, to);
+		}
+
+		virtual void DisconnectSuccessors()
+		{
+			mSuccessor[0].reset();
+			mSuccessor[1].reset();
+		}
+
 
 	private:
 		Addr mSuccessorAddress[2];
 		Node_ptr mSuccessor[2];
 };/*}}}*/
-#if 0
+/**
+ * Node ending in a switch. The successors are the distinct targets of the
+ * table followed by the default, and each case knows the index of its
+ * successor so dispatching a case does not search.
+ */
 class N_WayNode : public Node/*{{{*/
 {
-	protected:
-		N_WayNode(const std::vector<Addr> &successor_list, 
+	public:
+		N_WayNode(Switch& instruction,
 				Instruction_list::iterator begin,
 				Instruction_list::iterator end)
-			: Node(N_WAY, begin, end)
+			: Node(N_WAY, begin, end), mDefaultSuccessor(-1)
 		{
-			mSuccessorAddress = successor_list;
-			mSuccessor.resize(successor_list.size());
+			std::map<Addr, int> index;
+			const SwitchCase_vector& cases = instruction.Cases();
+
+			mCaseSuccessor.reserve(cases.size());
+			for (SwitchCase_vector::const_iterator item = cases.begin();
+					item != cases.end();
+					item++)
+			{
+				mCaseSuccessor.push_back(AddSuccessor(index, item->target));
+			}
+
+			if (INVALID_ADDR != instruction.DefaultTarget())
+				mDefaultSuccessor = AddSuccessor(index, instruction.DefaultTarget());
+
+			mSuccessor.resize(mSuccessorAddress.size());
 		}
+        virtual void print(std::ostream& os)
+        {
+            Node::print(os);
+            os << "N_WAY #cases=" << mCaseSuccessor.size()
+                    << " #successors=" << mSuccessorAddress.size() << '\n';
+        }
 
 		virtual int SuccessorCount() 
 		{ 
@@ -286,40 +412,71 @@ class N_WayNode : public Node/*{{{*/
 
 		virtual Addr SuccessorAddress(int index)
 		{
-            if (index<0 || index>=mSuccessorAddress.size())
-                return INVALID_ADDR;
-            return mSuccessorAddress[index];
+			if (index < 0 || index >= SuccessorCount())
+				return INVALID_ADDR;
+			return mSuccessorAddress[index];
 		}
 
 		virtual Node_ptr Successor(int index)
 		{
-			Node_ptr result;
-            if (index<0 || index>=mSuccessor.size()) {
-                msg("ERROR: N_WayNode::Successor(%d) called\n", index);
-                return result;
-            }
-
-            return mSuccessor[index];
+			if (index < 0 || index >= SuccessorCount())
+			{
+				message("ERROR: N_WayNode::Successor(%d) called\n", index);
+				return Node_ptr();
+			}
+			return mSuccessor[index];
 		}
 
 		virtual bool ConnectSuccessor(int index, Node_ptr successor)
 		{
-            if (index<0 || index>=mSuccessorAddress.size())
-                return false;
-
-            if (successor->Address() == mSuccessorAddress[index])
-            {
-                mSuccessor[index] = successor;
-                return true;
-            }
+			if (index < 0 || index >= SuccessorCount() ||
+					successor->Address() != mSuccessorAddress[index])
+				return false;
+
+			mSuccessor[index] = successor;
+			return true;
+		}
+
+		virtual void Move(Addr from, Addr to)
+		{
+			Node::Move(from, to);
+			for (size_t i = 0; i < mSuccessorAddress.size(); i++)
+				mSuccessorAddress[i] = Node::Move(mSuccessorAddress[i], from, to);
 		}
 
+		virtual void DisconnectSuccessors()
+		{
+			for (size_t i = 0; i < mSuccessor.size(); i++)
+				mSuccessor[i].reset();
+		}
+
+		/** Successor index of the case at index in the switch table */
+		int CaseSuccessor(int index) const { return mCaseSuccessor[index]; }
+
+		/** Successor index of the default, -1 if there is none */
+		int DefaultSuccessor() const { return mDefaultSuccessor; }
+
+		static Node_ptr CreateFrom(Instruction_ptr i,
+				Instruction_list::iterator begin,
+				Instruction_list::iterator end);
 
 	private:
-        std::vector<Addr> mSuccessorAddress;
-        std::vector<Node_ptr> mSuccessor;
+		int AddSuccessor(std::map<Addr, int>& index, Addr target)
+		{
+			std::map<Addr, int>::iterator item = index.find(target);
+			if (index.end() != item)
+				return item->second;
+
+			mSuccessorAddress.push_back(target);
+			return index[target] = mSuccessorAddress.size() - 1;
+		}
+		
+		std::vector<Addr> mSuccessorAddress;
+		std::vector<Node_ptr> mSuccessor;
+		std::vector<int> mCaseSuccessor;
+		int mDefaultSuccessor;
 };/*}}}*/
-#endif
+
 class JumpNode : public OneWayNode/*{{{*/
 {
 	public:
@@ -331,8 +488,7 @@ class JumpNode : public OneWayNode/*{{{*/
         virtual void print(std::ostream& os)
         {
             Node::print(os);
-            os << boost::format("JUMP target=%08lx\n")
-                    % SuccessorAddress(0);
+            os << "JUMP target=" << Hex8(SuccessorAddress(0)) << '\n';
         }
 
 		static Node_ptr CreateFrom(Instruction_ptr i,
@@ -352,9 +508,8 @@ class ConditionalJumpNode : public TwoWayNode /*{{{*/
         virtual void print(std::ostream& os)
         {
             Node::print(os);
-            os << boost::format("CONDJUMP target=%08lx follow=%08lx\n")
-                    % SuccessorAddress(0)
-                    % SuccessorAddress(1);
+            os << "CONDJUMP target=" << Hex8(SuccessorAddress(0))
+                    << " follow=" << Hex8(SuccessorAddress(1)) << '\n';
         }
 
 
@@ -376,8 +531,7 @@ class FallThroughNode : public OneWayNode/*{{{*/
         virtual void print(std::ostream& os)
         {
             Node::print(os);
-            os << boost::format("FALLTHROUGH follow=%08lx\n")
-                    % SuccessorAddress(0);
+            os << "FALLTHROUGH follow=" << Hex8(SuccessorAddress(0)) << '\n';
         }
 
 
@@ -395,7 +549,7 @@ class ReturnNode : public Node/*{{{*/
         virtual void print(std::ostream& os)
         {
             Node::print(os);
-            os << boost::format("RETURN\n");
+            os << "RETURN\n";
         }
 };/*}}}*/
 
@@ -412,9 +566,8 @@ class CallNode : public TwoWayNode
         virtual void print(std::ostream& os)
         {
             Node::print(os);
-            os << boost::format("CALL target=%08lx follow=%08lx\n")
-                % SuccessorAddress(0)
-                % SuccessorAddress(1);
+            os << "CALL target=" << Hex8(SuccessorAddress(0))
+                << " follow=" << Hex8(SuccessorAddress(1)) << '\n';
         }
 };
 
@@ -0,0 +1,381 @@
+// 
+// Copyright (c) 2002 David Eriksson <david@2good.nu>
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a
+// copy of this software and associated documentation files (the "Software"),
+// to deal in the Software without restriction, including without limitation
+// the rights to use, copy, modify, merge, publish, distribute, sublicense,
+// and/or sell copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+// DEALINGS IN THE SOFTWARE.
+//
+// $Id$
+#include "passmanager.hpp"
+#include "node.hpp"
+#include "usedefine.hpp"
+#include "dataflow.hpp"
+#include "trace.hpp"
+
+/* Analysis cache {{{ */
+
+// in dependency order: an analysis only depends on analyses before it
+static const AnalysisKind ANALYSIS_ORDER[] =
+{
+	ANALYSIS_USES_AND_DEFINITIONS,
+	ANALYSIS_LIVENESS,
+	ANALYSIS_DU_CHAINS,
+	ANALYSIS_DOMINATORS
+};
+
+static const int ANALYSIS_COUNT = sizeof(ANALYSIS_ORDER) / sizeof(ANALYSIS_ORDER[0]);
+
+AnalysisSet AnalysisCache::Dependencies(AnalysisKind kind)
+{
+	switch (kind)
+	{
+		case ANALYSIS_LIVENESS:
+		case ANALYSIS_DU_CHAINS:
+			return ANALYSIS_USES_AND_DEFINITIONS;
+
+		default:
+			return ANALYSIS_NONE;
+	}
+}
+
+void AnalysisCache::Require(AnalysisSet analyses)
+{
+	int i;
+
+	for (i = ANALYSIS_COUNT - 1; i >= 0; i--)
+	{
+		if (analyses & ANALYSIS_ORDER[i])
+			analyses |= Dependencies(ANALYSIS_ORDER[i]);
+	}
+
+	for (i = 0; i < ANALYSIS_COUNT; i++)
+	{
+		AnalysisKind kind = ANALYSIS_ORDER[i];
+
+		if (!(analyses & kind))
+			continue;
+
+		if (!IsValid(kind))
+			Compute(kind, false);
+		else if (mStale & kind)
+			Compute(kind, true);
+	}
+}
+
+void AnalysisCache::Invalidate(AnalysisSet preserved, AnalysisSet maintained)
+{
+	mStale |= mValid & maintained & ~preserved;
+	mValid &= preserved | maintained;
+
+	// An analysis is only as fresh as the analyses it was computed from
+	for (int i = 0; i < ANALYSIS_COUNT; i++)
+	{
+		if (!IsValid(Dependencies(ANALYSIS_ORDER[i])))
+			mValid &= ~ANALYSIS_ORDER[i];
+	}
+
+	mStale &= mValid;
+}
+
+void AnalysisCache::Compute(AnalysisKind kind, bool incremental)
+{
+	const char* detail = incremental ? "dirty nodes" : NULL;
+	
+	switch (kind)
+	{
+		case ANALYSIS_USES_AND_DEFINITIONS:
+			{
+				message("-> Update uses and definitions%s\n", incremental ? " (dirty nodes)" : "");
+				TraceSpan span("uses and definitions", INVALID_ADDR, detail);
+				UpdateUsesAndDefinitions(mNodes, incremental);
+			}
+			break;
+
+		case ANALYSIS_LIVENESS:
+			{
+				message("-> Live register analysis%s\n", incremental ? " (dirty nodes)" : "");
+				TraceSpan span("liveness", INVALID_ADDR, detail);
+				Node::LiveRegisterAnalysis(mNodes, incremental);
+			}
+			break;
+
+		case ANALYSIS_DU_CHAINS:
+			{
+				message("-> Finding DU chains%s\n", incremental ? " (dirty nodes)" : "");
+				TraceSpan span("DU chains", INVALID_ADDR, detail);
+				Node::FindDefintionUseChains(mNodes, incremental);
+			}
+			break;
+
+		case ANALYSIS_DOMINATORS:
+			{
+				message("-> Dominator analysis\n");
+				TraceSpan span("dominators");
+				Node::DominatorAnalysis(mNodes);
+			}
+			break;
+
+		default:
+			message("Error! Unknown analysis %i\n", kind);
+			return;
+	}
+
+	mValid |= kind;
+	mStale &= ~kind;
+}/*}}}*/
+
+/* Passes {{{ */
+class DataFlowPass : public Pass
+{
+	public:
+		virtual const char* Name() const { return "dataflow"; }
+
+		virtual AnalysisSet Required() const
+		{
+			return ANALYSIS_USES_AND_DEFINITIONS | ANALYSIS_LIVENESS | ANALYSIS_DU_CHAINS;
+		}
+
+		virtual AnalysisSet Preserved() const
+		{
+			// Instructions are rewritten and removed, but never jumps
+			return ANALYSIS_DOMINATORS;
+		}
+
+		virtual AnalysisSet Maintained() const
+		{
+			// Every rewrite marks its instruction and node dirty
+			return ANALYSIS_USES_AND_DEFINITIONS | ANALYSIS_LIVENESS | ANALYSIS_DU_CHAINS;
+		}
+
+		virtual bool Run(Node_list& nodes)
+		{
+			DataFlowAnalysis analysis(nodes);
+			analysis.AnalyzeNodeList();
+			return analysis.ChangeCount() > 0;
+		}
+};
+
+class DumpPass : public Pass
+{
+	public:
+		virtual const char* Name() const { return "dump"; }
+
+		virtual AnalysisSet Required() const
+		{
+			return ANALYSIS_USES_AND_DEFINITIONS | ANALYSIS_LIVENESS | ANALYSIS_DU_CHAINS;
+		}
+
+		virtual bool Run(Node_list& nodes)
+		{
+			DumpList(nodes);
+			return false;
+		}
+};
+
+template<class T>
+static Pass* CreatePassInstance()
+{
+	return new T();
+}
+
+struct PassInfo
+{
+	const char* name;
+	Pass* (*create)();
+};
+
+static const PassInfo PASSES[] =
+{
+	{ "dataflow", CreatePassInstance<DataFlowPass> },
+	{ "dump",     CreatePassInstance<DumpPass> }
+};
+
+Pass_ptr PassManager::CreatePass(const std::string& name)
+{
+	for (size_t i = 0; i < sizeof(PASSES) / sizeof(PASSES[0]); i++)
+	{
+		if (name == PASSES[i].name)
+			return Pass_ptr( PASSES[i].create() );
+	}
+	return Pass_ptr();
+}/*}}}*/
+
+/* Pipeline {{{ */
+struct PassManager::Step
+{
+	Step()
+		: repeat(false)
+	{}
+
+	Pass_ptr pass;        // empty for a group
+	Step_vector group;
+	bool repeat;
+};
+
+static void SkipSpaces(const std::string& pipeline, size_t& pos)
+{
+	while (pos < pipeline.size() && ' ' == pipeline[pos])
+		pos++;
+}
+
+static bool IsPassNameCharacter(char c)
+{
+	return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || 
+		(c >= '0' && c <= '9') || '_' == c || '-' == c;
+}
+
+bool PassManager::Parse(const std::string& pipeline, size_t& pos, Step_vector& steps)
+{
+	for (;;)
+	{
+		Step_ptr step(new Step);
+
+		SkipSpaces(pipeline, pos);
+		if (pos < pipeline.size() && '(' == pipeline[pos])
+		{
+			pos++;
+			if (!Parse(pipeline, pos, step->group))
+				return false;
+
+			if (pos >= pipeline.size() || ')' != pipeline[pos])
+			{
+				message("Error! Missing ')' in pipeline \"%s\"\n", pipeline.c_str());
+				return false;
+			}
+			pos++;
+		}
+		else
+		{
+			size_t begin = pos;
+			while (pos < pipeline.size() && IsPassNameCharacter(pipeline[pos]))
+				pos++;
+
+			std::string name = pipeline.substr(begin, pos - begin);
+			step->pass = CreatePass(name);
+			if (!step->pass.get())
+			{
+				message("Error! Unknown pass \"%s\" in pipeline \"%s\"\n", 
+						name.c_str(), pipeline.c_str());
+				return false;
+			}
+		}
+
+		SkipSpaces(pipeline, pos);
+		if (pos < pipeline.size() && '*' == pipeline[pos])
+		{
+			step->repeat = true;
+			pos++;
+			SkipSpaces(pipeline, pos);
+		}
+
+		steps.push_back(step);
+
+		if (pos < pipeline.size() && ',' == pipeline[pos])
+			pos++;
+		else
+			return true;
+	}
+}
+
+bool PassManager::Parse(const std::string& pipeline, Step_vector& steps)
+{
+	size_t pos = 0;
+
+	if (!Parse(pipeline, pos, steps))
+		return false;
+
+	if (pos != pipeline.size())
+	{
+		message("Error! Unexpected '%c' in pipeline \"%s\"\n", 
+				pipeline[pos], pipeline.c_str());
+		return false;
+	}
+	return true;
+}
+
+bool PassManager::IsValid(const std::string& pipeline)
+{
+	Step_vector steps;
+	return Parse(pipeline, steps);
+}
+
+bool PassManager::Run(const std::string& pipeline)
+{
+	Step_vector steps;
+
+	if (!Parse(pipeline, steps))
+		return false;
+
+	Run(steps);
+	return true;
+}
+
+bool PassManager::Run(Step_vector& steps)
+{
+	bool changed = false;
+
+	for (Step_vector::iterator item = steps.begin(); item != steps.end(); item++)
+	{
+		if (Run(**item))
+			changed = true;
+	}
+	return changed;
+}
+
+bool PassManager::Run(Step& step)
+{
+	bool changed = false;
+	int iteration;
+
+	for (iteration = 0; iteration < MAX_ITERATIONS; iteration++)
+	{
+		bool step_changed;
+
+		if (step.pass.get())
+		{
+			mCache.Require(step.pass->Required());
+
+			message("-> Pass %s\n", step.pass->Name());
+			{
+				TraceSpan span(step.pass->Name(), INVALID_ADDR, "pass");
+				step_changed = step.pass->Run(mCache.Nodes());
+			}
+			ObjectCounters::Sample(step.pass->Name());
+			if (step_changed)
+				mCache.Invalidate(step.pass->Preserved(), step.pass->Maintained());
+		}
+		else
+		{
+			step_changed = Run(step.group);
+		}
+
+		if (!step_changed)
+			break;
+
+		changed = true;
+
+		if (!step.repeat)
+			break;
+	}
+
+	if (MAX_ITERATIONS == iteration)
+	{
+		message("Warning! No fixed point after %i iterations\n", MAX_ITERATIONS);
+	}
+
+	return changed;
+}/*}}}*/
@@ -0,0 +1,150 @@
+// 
+// Copyright (c) 2002 David Eriksson <david@2good.nu>
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a
+// copy of this software and associated documentation files (the "Software"),
+// to deal in the Software without restriction, including without limitation
+// the rights to use, copy, modify, merge, publish, distribute, sublicense,
+// and/or sell copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+// DEALINGS IN THE SOFTWARE.
+//
+// $Id$
+#ifndef _PASSMANAGER_HPP
+#define _PASSMANAGER_HPP
+
+#include "desquirr.hpp"
+#include "node.hpp"
+
+/**
+ * Lazily computed analysis results for the nodes of one function
+ */
+class AnalysisCache/*{{{*/
+{
+	public:
+		AnalysisCache(Node_list& nodes)
+			: mNodes(nodes), mValid(ANALYSIS_NONE), mStale(ANALYSIS_NONE)
+		{}
+
+		/** Compute the analyses (and what they depend on) unless cached */
+		void Require(AnalysisSet analyses);
+
+		/**
+		 * Forget everything except the preserved analyses.
+		 *
+		 * Maintained analyses are kept but marked stale, the next Require
+		 * only updates them for the nodes marked dirty.
+		 */
+		void Invalidate(AnalysisSet preserved, AnalysisSet maintained = ANALYSIS_NONE);
+
+		bool IsValid(AnalysisSet analyses) const 
+		{ 
+			return analyses == (mValid & analyses); 
+		}
+
+		Node_list& Nodes() { return mNodes; }
+
+	private:
+		void Compute(AnalysisKind kind, bool incremental);
+
+		/** Analyses that must be valid before kind can be computed */
+		static AnalysisSet Dependencies(AnalysisKind kind);
+
+		Node_list& mNodes;
+		AnalysisSet mValid;
+		AnalysisSet mStale;   // valid, but not yet updated for dirty nodes
+};/*}}}*/
+
+/**
+ * A transformation or inspection step on the nodes of a function
+ */
+class Pass/*{{{*/
+{
+	public:
+		virtual ~Pass() {}
+
+		virtual const char* Name() const = 0;
+
+		/** Analyses that must be up to date when Run is called */
+		virtual AnalysisSet Required() const { return ANALYSIS_NONE; }
+
+		/** Analyses still valid after Run has changed the function */
+		virtual AnalysisSet Preserved() const { return ANALYSIS_ALL; }
+
+		/**
+		 * Analyses not preserved, but kept updatable by marking changed
+		 * instructions and nodes dirty
+		 */
+		virtual AnalysisSet Maintained() const { return ANALYSIS_NONE; }
+
+		/**
+		 * Run the pass
+		 *
+		 * \return true if the instructions of the function were changed
+		 */
+		virtual bool Run(Node_list& nodes) = 0;
+};/*}}}*/
+
+typedef boost::shared_ptr<Pass> Pass_ptr;
+
+/**
+ * Run passes on a function as described by a pipeline string.
+ *
+ * A pipeline is a comma-separated list of pass names. Parentheses group
+ * passes, and a trailing '*' repeats a pass or group until it no longer
+ * changes the function, e.g. "dump,(dataflow)*,dump".
+ */
+class PassManager/*{{{*/
+{
+	public:
+		enum
+		{
+			MAX_ITERATIONS = 16   // upper bound for '*' repetitions
+		};
+
+		PassManager(Node_list& nodes)
+			: mCache(nodes)
+		{}
+
+		/**
+		 * Run a pipeline
+		 *
+		 * \return false if the pipeline could not be parsed
+		 */
+		bool Run(const std::string& pipeline);
+
+		/**
+		 * Parse a pipeline without running it, so a bad one can be
+		 * reported before any function is decompiled
+		 */
+		static bool IsValid(const std::string& pipeline);
+
+		AnalysisCache& Cache() { return mCache; }
+
+		/** Create a registered pass by name, returns an empty pointer if unknown */
+		static Pass_ptr CreatePass(const std::string& name);
+
+	private:
+		struct Step;
+		typedef boost::shared_ptr<Step> Step_ptr;
+		typedef std::vector<Step_ptr> Step_vector;
+
+		static bool Parse(const std::string& pipeline, Step_vector& steps);
+		static bool Parse(const std::string& pipeline, size_t& pos, Step_vector& steps);
+		bool Run(Step_vector& steps);
+		bool Run(Step& step);
+
+		AnalysisCache mCache;
+};/*}}}*/
+
+#endif // _PASSMANAGER_HPP
@@ -0,0 +1,138 @@
+// 
+// Copyright (c) 2002 David Eriksson <david@2good.nu>
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a
+// copy of this software and associated documentation files (the "Software"),
+// to deal in the Software without restriction, including without limitation
+// the rights to use, copy, modify, merge, publish, distribute, sublicense,
+// and/or sell copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+// DEALINGS IN THE SOFTWARE.
+//
+// $Id$
+#include <cstring>
+
+#include "desquirr.hpp"
+#include "printer.hpp"
+#include "instruction.hpp"
+#include "node.hpp"
+
+const HexDigits HexDigits::TABLE;
+
+HexDigits::HexDigits()/*{{{*/
+{
+	static const char DIGITS[] = "0123456789abcdef";
+	for (int i = 0; i < 256; i++)
+	{
+		mDigits[i][0] = DIGITS[i >> 4];
+		mDigits[i][1] = DIGITS[i & 0xf];
+	}
+}/*}}}*/
+
+void OutputStream::Flush()/*{{{*/
+{
+	// message() formats into a buffer of MAXSTR characters
+	static const size_t PIECE = 1000;
+	char piece[PIECE + 1];
+
+	const char* data = Data();
+	for (size_t offset = 0; offset < Size(); offset += PIECE)
+	{
+		size_t length = std::min(PIECE, Size() - offset);
+		memcpy(piece, data + offset, length);
+		piece[length] = '\0';
+		message("%s", piece);
+	}
+
+	Clear();
+}/*}}}*/
+
+// .... dump helpers
+struct DumpInsnHelper {
+    DumpInsnHelper(std::ostream& os)
+        : os(os) 
+    {}
+    void operator() (Instruction_ptr item)
+    {
+        os << *item.get();
+    }
+    std::ostream& os;
+};
+
+std::ostream& printlist(std::ostream& os, Instruction_list& list)
+{
+    for_each(list.begin(), list.end(), DumpInsnHelper(os));
+
+    return os;
+}
+
+void DumpList(Instruction_list& list)
+{
+    OutputStream out;
+    printlist(out, list);
+    out.Flush();
+}
+
+struct DumpNodeHelper {
+    DumpNodeHelper(std::ostream& os)
+        : os(os) 
+    {}
+    void operator() (Node_ptr item)
+    {
+        os << *item.get();
+    }
+    std::ostream& os;
+};
+
+std::ostream& printlist(std::ostream& os, Node_list& list)
+{
+    for_each(list.begin(), list.end(), DumpNodeHelper(os));
+
+    return os;
+}
+
+void DumpList(Node_list& list)
+{
+    OutputStream out;
+    printlist(out, list);
+    out.Flush();
+}
+
+struct DumpExprHelper {
+    DumpExprHelper(std::ostream& os)
+        : os(os), first(true)
+    {}
+    void operator() (Expression_ptr item)
+    {
+        if (!first)
+            os << ", ";
+        os << *item.get();
+        first= false;
+    }
+    std::ostream& os;
+    bool first;
+};
+
+std::ostream& printvector(std::ostream& os, Expression_vector& list)
+{
+    for_each(list.begin(), list.end(), DumpExprHelper(os));
+
+    return os;
+}
+
+void DumpVector(Expression_vector& list)
+{
+    std::ostringstream strstr;
+    printvector(strstr, list);
+    message(strstr.str());
+}
@@ -0,0 +1,150 @@
+// 
+// Copyright (c) 2002 David Eriksson <david@2good.nu>
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a
+// copy of this software and associated documentation files (the "Software"),
+// to deal in the Software without restriction, including without limitation
+// the rights to use, copy, modify, merge, publish, distribute, sublicense,
+// and/or sell copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+// DEALINGS IN THE SOFTWARE.
+//
+// $Id$
+#ifndef _PRINTER_HPP
+#define _PRINTER_HPP
+
+#include <ostream>
+#include <streambuf>
+#include <vector>
+
+/**
+ * Two lower-case hex digits for every byte value, so a word is written
+ * with four table lookups instead of a format string
+ */
+class HexDigits/*{{{*/
+{
+	public:
+		static const char* Byte(unsigned char value) 
+		{ 
+			return TABLE.mDigits[value]; 
+		}
+
+		/** Eight digits into out, like "%08lx" but truncated to 32 bits */
+		static void Word(unsigned long value, char* out)
+		{
+			for (int shift = 24, i = 0; shift >= 0; shift -= 8, i += 2)
+			{
+				const char* digits = Byte((unsigned char)(value >> shift));
+				out[i]     = digits[0];
+				out[i + 1] = digits[1];
+			}
+		}
+
+	private:
+		HexDigits();
+		
+		char mDigits[256][2];
+		static const HexDigits TABLE;
+};/*}}}*/
+
+/**
+ * Write a value as eight hex digits: os << Hex8(address)
+ */
+struct Hex8/*{{{*/
+{
+	explicit Hex8(unsigned long value) : value(value) {}
+	unsigned long value;
+};/*}}}*/
+
+inline std::ostream& operator<< (std::ostream& os, const Hex8& hex)
+{
+	char digits[8];
+	HexDigits::Word(hex.value, digits);
+	return os.write(digits, sizeof(digits));
+}
+
+/**
+ * Write a value as hex without leading zeros, like "%x"
+ */
+struct Hex/*{{{*/
+{
+	explicit Hex(unsigned long value) : value(value) {}
+	unsigned long value;
+};/*}}}*/
+
+inline std::ostream& operator<< (std::ostream& os, const Hex& hex)
+{
+	char digits[8];
+	HexDigits::Word(hex.value, digits);
+	
+	int first = 0;
+	while (first < 7 && '0' == digits[first])
+		first++;
+	return os.write(digits + first, sizeof(digits) - first);
+}
+
+/**
+ * Output stream over a buffer that keeps its memory when it is flushed,
+ * so printing many functions does not allocate again for each of them
+ */
+class OutputStream : public std::ostream/*{{{*/
+{
+	public:
+		OutputStream()
+			: std::ostream(NULL)
+		{
+			rdbuf(&mBuffer);
+		}
+
+		size_t Size() const { return mBuffer.Size(); }
+		const char* Data() const { return mBuffer.Data(); }
+
+		/** Forget what was written, the memory is kept */
+		void Clear() { mBuffer.Clear(); clear(); }
+
+		/** Pass what was written to message() in large pieces, then Clear() */
+		void Flush();
+
+	private:
+		class Buffer : public std::streambuf
+		{
+			public:
+				size_t Size() const { return mData.size(); }
+				const char* Data() const { return mData.empty() ? "" : &mData[0]; }
+				void Clear() { mData.clear(); }
+
+			protected:
+				virtual int_type overflow(int_type c)
+				{
+					if (!traits_type::eq_int_type(c, traits_type::eof()))
+						mData.push_back(traits_type::to_char_type(c));
+					return traits_type::not_eof(c);
+				}
+
+				virtual std::streamsize xsputn(const char* s, std::streamsize n)
+				{
+					mData.insert(mData.end(), s, s + n);
+					return n;
+				}
+
+			private:
+				std::vector<char> mData;
+		};
+
+		OutputStream(const OutputStream&);
+		OutputStream& operator= (const OutputStream&);
+
+		Buffer mBuffer;
+};/*}}}*/
+
+#endif // _PRINTER_HPP
@@ -0,0 +1,101 @@
+// 
+// Copyright (c) 2002 David Eriksson <david@2good.nu>
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a
+// copy of this software and associated documentation files (the "Software"),
+// to deal in the Software without restriction, including without limitation
+// the rights to use, copy, modify, merge, publish, distribute, sublicense,
+// and/or sell copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+// DEALINGS IN THE SOFTWARE.
+//
+// $Id$
+#include "scan.hpp"
+
+void FunctionScan::Scan(Addr function)/*{{{*/
+{
+	Clear();
+	mDatabase.Chunks(function, mChunks);
+
+	Addr previousChunkEnd = INVALID_ADDR;
+	for (AddressRange_vector::const_iterator chunk = mChunks.begin();
+			chunk != mChunks.end();
+			chunk++)
+	{
+		ScanChunk(*chunk, previousChunkEnd);
+		previousChunkEnd = chunk->end;
+	}
+}/*}}}*/
+
+void FunctionScan::ScanChunk(const AddressRange& chunk, Addr previousChunkEnd)/*{{{*/
+{
+	ScannedItem item;
+	for (Addr address = chunk.start; address < chunk.end; address = item.end)
+	{
+		mDatabase.Describe(address, item);
+
+		if (ScannedItem::UNKNOWN == item.kind)
+		{
+			message("Warning, converting non-code bytes in function at offset %p\n", 
+					address);
+
+			mDatabase.MakeCode(address);
+			mDatabase.Describe(address, item);
+			if (ScannedItem::CODE != item.kind)
+			{
+				message("Error, could not convert non-code bytes in function at offset %p\n", 
+						address);
+				break;
+			}
+		}
+
+		if (address == chunk.start)
+			item.previousChunkEnd = previousChunkEnd;
+		else
+			item.previousChunkEnd = INVALID_ADDR;
+
+		if (item.referenced)
+			mLabels[address] = mDatabase.LocalLabel(address);
+
+		mItems.push_back(item);
+	}
+}/*}}}*/
+
+void FunctionScan::Clear()/*{{{*/
+{
+	mChunks.clear();
+	mItems.clear();
+	mLabels.clear();
+}/*}}}*/
+
+bool FunctionScan::Covers(Addr address) const/*{{{*/
+{
+	for (AddressRange_vector::const_iterator chunk = mChunks.begin();
+			chunk != mChunks.end();
+			chunk++)
+	{
+		if (chunk->Contains(address))
+			return true;
+	}
+	return false;
+}/*}}}*/
+
+bool FunctionScan::Label(Addr address, std::string& name) const/*{{{*/
+{
+	Label_map::const_iterator item = mLabels.find(address);
+	if (mLabels.end() == item)
+		return false;
+
+	name = item->second;
+	return true;
+}/*}}}*/
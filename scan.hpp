@@ -0,0 +1,139 @@
+// 
+// Copyright (c) 2002 David Eriksson <david@2good.nu>
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a
+// copy of this software and associated documentation files (the "Software"),
+// to deal in the Software without restriction, including without limitation
+// the rights to use, copy, modify, merge, publish, distribute, sublicense,
+// and/or sell copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+// DEALINGS IN THE SOFTWARE.
+//
+// $Id$
+#ifndef _SCAN_HPP
+#define _SCAN_HPP
+
+#include "desquirr.hpp"
+
+/**
+ * What the database says about one item of a function
+ */
+struct ScannedItem/*{{{*/
+{
+	enum Kind
+	{
+		CODE,
+		DATA,
+		UNKNOWN,
+		OTHER
+	};
+	
+	Addr address;
+	Addr end;             // first address after the item
+	unsigned long flags;  // raw flags, only for messages
+	Kind kind;
+	bool referenced;
+	Addr previousChunkEnd; // set on the first item of a function tail
+};/*}}}*/
+
+typedef std::vector<ScannedItem> ScannedItem_vector;
+
+/**
+ * One chunk of a function, end is the first address after it
+ */
+struct AddressRange/*{{{*/
+{
+	AddressRange(Addr start, Addr end)
+		: start(start), end(end)
+	{}
+
+	bool Contains(Addr address) const
+	{
+		return address >= start && address < end;
+	}
+
+	Addr start;
+	Addr end;
+};/*}}}*/
+
+typedef std::vector<AddressRange> AddressRange_vector;
+
+/**
+ * Access to the database, implemented on top of IDA by the frontend or by
+ * a stand-in that describes a local buffer
+ */
+class DatabaseAccess/*{{{*/
+{
+	public:
+		virtual ~DatabaseAccess() {}
+
+		/** Chunks of the function at address, the entry chunk first */
+		virtual void Chunks(Addr function, AddressRange_vector& chunks) = 0;
+
+		/** Describe the item starting at address */
+		virtual void Describe(Addr address, ScannedItem& item) = 0;
+
+		/** Try to turn unexplored bytes at address into code */
+		virtual void MakeCode(Addr address) = 0;
+
+		/** Name of a referenced address, empty if it has none */
+		virtual std::string LocalLabel(Addr address) = 0;
+};/*}}}*/
+
+/**
+ * Items and referenced addresses of a function, collected in one sweep
+ * over the database before lifting
+ */
+class FunctionScan/*{{{*/
+{
+	public:
+		FunctionScan(DatabaseAccess& database)
+			: mDatabase(database)
+		{}
+
+		/**
+		 * Sweep the items of every chunk of the function at address. Data
+		 * items are stepped over whole. Unexplored bytes are turned into
+		 * code; the sweep of a chunk stops where that fails.
+		 */
+		void Scan(Addr function);
+
+		/** Forget the last scan */
+		void Clear();
+
+		const ScannedItem_vector& Items() const { return mItems; }
+		const AddressRange_vector& Chunks() const { return mChunks; }
+
+		/** Was address in one of the chunks of the last scan? */
+		bool Covers(Addr address) const;
+
+		/**
+		 * Look up the label of a referenced address
+		 *
+		 * \return false if the address was not referenced, name is empty if
+		 * it was referenced but has no name
+		 */
+		bool Label(Addr address, std::string& name) const;
+
+	private:
+		typedef std::map<Addr, std::string> Label_map;
+		
+		void ScanChunk(const AddressRange& chunk, Addr previousChunkEnd);
+		
+		DatabaseAccess& mDatabase;
+		AddressRange_vector mChunks;
+		ScannedItem_vector mItems;
+		Label_map mLabels;
+};/*}}}*/
+
+#endif // _SCAN_HPP
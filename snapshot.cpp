@@ -0,0 +1,971 @@
+// 
+// Copyright (c) 2002 David Eriksson <david@2good.nu>
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a
+// copy of this software and associated documentation files (the "Software"),
+// to deal in the Software without restriction, including without limitation
+// the rights to use, copy, modify, merge, publish, distribute, sublicense,
+// and/or sell copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+// DEALINGS IN THE SOFTWARE.
+//
+// $Id$
+#include <cstdio>
+#include <cstring>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "snapshot.hpp"
+#include "instruction.hpp"
+#include "expression.hpp"
+#include "node.hpp"
+
+#include "lowlevel.hpp"
+
+/**
+ * Collects the records of a node list, then lays out the sections
+ */
+class SnapshotWriter/*{{{*/
+{
+	public:
+		SnapshotWriter(Addr start)
+			: mStart(start)
+		{}
+
+		void Add(Node_list& nodes);
+		void Write(std::vector<char>& buffer);
+
+		/** Called by the walker, children come before their parents */
+		template<class T>
+		void Visit(T& expression)
+		{
+			AddExpression(expression);
+		}
+
+	private:
+		typedef std::map<const Expression*, SnapshotWord> Expression_map;
+		typedef std::map<const Node*, SnapshotWord> Node_map;
+		typedef std::map<std::string, SnapshotWord> String_map;
+
+		void AddInstruction(Instruction& instruction);
+		void AddExpression(Expression& expression);
+		SnapshotWord AddLowLevel(const DecodedInsn& insn);
+		SnapshotWord AddString(const std::string& str);
+
+		SnapshotWord Operand(Expression_ptr* slot);
+
+		template<class T>
+		static void Append(std::vector<char>& buffer, const std::vector<T>& records)
+		{
+			if (!records.empty())
+			{
+				const char* data = reinterpret_cast<const char*>(&records[0]);
+				buffer.insert(buffer.end(), data, data + records.size() * sizeof(T));
+			}
+		}
+
+		Addr mStart;
+		std::vector<SnapshotNode> mNodes;
+		std::vector<SnapshotInstruction> mInstructions;
+		std::vector<SnapshotExpression> mExpressions;
+		std::vector<SnapshotDuChain> mDuChains;
+		std::vector<SnapshotLowLevel> mLowLevel;
+		std::vector<SnapshotWord> mIndexes;
+		std::vector<char> mStrings;
+		Expression_map mExpressionIndex;
+		String_map mStringOffsets;
+		ExpressionWalker mWalker;
+};/*}}}*/
+
+void SnapshotWriter::Add(Node_list& nodes)/*{{{*/
+{
+	Node_map nodeIndex;
+	for (Node_list::iterator n = nodes.begin(); n != nodes.end(); n++)
+	{
+		SnapshotWord index = nodeIndex.size();
+		nodeIndex[n->get()] = index;
+	}
+	
+	for (Node_list::iterator n = nodes.begin(); n != nodes.end(); n++)
+	{
+		Node& node = **n;
+		SnapshotNode record;
+		
+		record.type               = node.Type();
+		record.address            = node.Address();
+		record.firstInstruction   = mInstructions.size();
+		record.instructionCount   = node.Instructions().size();
+		record.firstSuccessor     = mIndexes.size();
+		record.successorCount     = node.SuccessorCount();
+		record.immediateDominator = node.ImmediateDominator() ?
+			nodeIndex[node.ImmediateDominator()] : SNAPSHOT_NONE;
+		record.uses               = node.Uses().Bits();
+		record.definitions        = node.Definitions().Bits();
+		record.liveIn             = node.LiveIn().Bits();
+		record.liveOut            = node.LiveOut().Bits();
+		mNodes.push_back(record);
+
+		for (int i = 0; i < node.SuccessorCount(); i++)
+			mIndexes.push_back(node.SuccessorAddress(i));
+
+		Instruction_list& instructions = node.Instructions();
+		for (Instruction_list::iterator item = instructions.begin();
+				item != instructions.end();
+				item++)
+		{
+			AddInstruction(**item);
+		}
+	}
+}/*}}}*/
+
+void SnapshotWriter::AddInstruction(Instruction& instruction)/*{{{*/
+{
+	SnapshotInstruction record;
+	
+	record.type            = instruction.Type();
+	record.address         = instruction.Address();
+	record.uses            = instruction.Uses().Bits();
+	record.definitions     = instruction.Definitions().Bits();
+	record.lastDefinitions = instruction.LastDefinitions().Bits();
+	record.flagDefinitions = instruction.FlagDefinitions().Bits();
+	record.firstDuChain    = mDuChains.size();
+	record.duChainCount    = instruction.DuChain().size();
+	record.operandCount    = instruction.OperandCount();
+	record.operands[0]     = Operand(instruction.OperandSlot(0));
+	record.operands[1]     = Operand(instruction.OperandSlot(1));
+	record.extra[0]        = SNAPSHOT_NONE;
+	record.extra[1]        = SNAPSHOT_NONE;
+	record.extra[2]        = SNAPSHOT_NONE;
+
+	switch (instruction.Type())
+	{
+		case Instruction::LABEL:
+			{
+				Label& label = static_cast<Label&>(instruction);
+				record.extra[0] = AddString(label.Name());
+				record.extra[1] = label.PreviousChunkEnd();
+			}
+			break;
+
+		case Instruction::CASE:
+			{
+				Case& c = static_cast<Case&>(instruction);
+				record.extra[0] = mIndexes.size();
+				record.extra[1] = c.ValueCount();
+				record.extra[2] = c.IsDefault();
+				for (int i = 0; i < c.ValueCount(); i++)
+					mIndexes.push_back(c.Value(i));
+			}
+			break;
+
+		case Instruction::SWITCH:
+			{
+				const SwitchCase_vector& cases = static_cast<Switch&>(instruction).Cases();
+				record.extra[0] = mIndexes.size();
+				record.extra[1] = cases.size();
+				record.extra[2] = static_cast<Switch&>(instruction).DefaultTarget();
+				for (SwitchCase_vector::const_iterator item = cases.begin();
+						item != cases.end();
+						item++)
+				{
+					mIndexes.push_back(item->value);
+					mIndexes.push_back(item->target);
+				}
+			}
+			break;
+
+		case Instruction::THROW:
+			record.extra[0] = AddString(static_cast<Throw&>(instruction).DataType());
+			break;
+
+		case Instruction::LOW_LEVEL:
+			record.extra[0] = AddLowLevel(static_cast<LowLevel&>(instruction).Insn());
+			break;
+
+		default:
+			break;
+	}
+
+	mInstructions.push_back(record);
+
+	RegisterToAddress_map& chain = instruction.DuChain();
+	for (RegisterToAddress_map::iterator item = chain.begin();
+			item != chain.end();
+			item++)
+	{
+		SnapshotDuChain link;
+		link.reg     = item->first;
+		link.address = item->second;
+		mDuChains.push_back(link);
+	}
+}/*}}}*/
+
+SnapshotWord SnapshotWriter::Operand(Expression_ptr* slot)/*{{{*/
+{
+	if (NULL == slot || NULL == slot->get())
+		return SNAPSHOT_NONE;
+
+	mWalker.PostOrder(**slot, *this);
+	return mExpressionIndex[slot->get()];
+}/*}}}*/
+
+void SnapshotWriter::AddExpression(Expression& expression)/*{{{*/
+{
+	if (mExpressionIndex.count(&expression))
+		return;
+
+	SnapshotExpression record;
+	record.type       = expression.Type();
+	record.firstChild = mIndexes.size();
+	record.childCount = expression.SubExpressionCount();
+	record.text       = SNAPSHOT_NONE;
+	record.value      = 0;
+	record.extra      = 0;
+
+	for (int i = 0; i < expression.SubExpressionCount(); i++)
+		mIndexes.push_back(mExpressionIndex[expression.SubExpression(i).get()]);
+
+	switch (expression.Type())
+	{
+		case Expression::UNARY_EXPRESSION:
+			record.text = AddString(static_cast<UnaryExpression&>(expression).Operation());
+			break;
+
+		case Expression::BINARY_EXPRESSION:
+			record.text = AddString(static_cast<BinaryExpression&>(expression).Operation());
+			break;
+
+		case Expression::CALL:
+			{
+				CallExpression& call = static_cast<CallExpression&>(expression);
+				record.value = call.ParameterCount();
+				record.extra = call.CallingConvention();
+				if (call.IsFinishedAddingParameters())
+					record.text = SNAPSHOT_CALL_FINISHED;
+			}
+			break;
+
+		case Expression::GLOBAL:
+			{
+				GlobalVariable& global = static_cast<GlobalVariable&>(expression);
+				record.text  = AddString(global.Name());
+				record.value = global.Index();
+				record.extra = global.Address();
+			}
+			break;
+
+		case Expression::STACK_VARIABLE:
+			record.text  = AddString(static_cast<StackVariable&>(expression).Name());
+			record.value = static_cast<StackVariable&>(expression).Index();
+			break;
+
+		case Expression::NUMERIC_LITERAL:
+			record.value = static_cast<NumericLiteral&>(expression).Value();
+			break;
+
+		case Expression::REGISTER:
+			record.value = static_cast<Register&>(expression).Index();
+			break;
+
+		case Expression::STRING_LITERAL:
+			record.text  = AddString(static_cast<StringLiteral&>(expression).Value());
+			record.value = static_cast<StringLiteral&>(expression).StringType();
+			break;
+
+		default:
+			break;
+	}
+
+	mExpressionIndex[&expression] = mExpressions.size();
+	mExpressions.push_back(record);
+}/*}}}*/
+
+SnapshotWord SnapshotWriter::AddLowLevel(const DecodedInsn& insn)/*{{{*/
+{
+	SnapshotLowLevel record;
+	record.ea      = insn.ea;
+	record.itype   = insn.itype;
+	record.size    = insn.size;
+	record.auxpref = insn.auxpref;
+	record.segpref = (unsigned char)insn.segpref;
+
+	for (int i = 0; i < DecodedInsn::OPERAND_COUNT; i++)
+	{
+		const DecodedOperand& op = insn.Operands[i];
+		SnapshotOperand& out = record.operands[i];
+		out.type      = op.type;
+		out.flags     = op.flags;
+		out.dtyp      = (unsigned char)op.dtyp;
+		out.reg       = op.reg;
+		out.value     = op.value;
+		out.addr      = op.addr;
+		out.specval   = op.specval;
+		out.specflags = (unsigned char)op.specflag1 | 
+			(unsigned char)op.specflag2 << 8 | 
+			(unsigned char)op.specflag3 << 16 | 
+			(SnapshotWord)(unsigned char)op.specflag4 << 24;
+	}
+
+	mLowLevel.push_back(record);
+	return mLowLevel.size() - 1;
+}/*}}}*/
+
+SnapshotWord SnapshotWriter::AddString(const std::string& str)/*{{{*/
+{
+	String_map::iterator item = mStringOffsets.find(str);
+	if (mStringOffsets.end() != item)
+		return item->second;
+
+	SnapshotWord offset = mStrings.size();
+	SnapshotWord length = str.size();
+	const char* bytes = reinterpret_cast<const char*>(&length);
+	
+	mStrings.insert(mStrings.end(), bytes, bytes + sizeof(length));
+	mStrings.insert(mStrings.end(), str.begin(), str.end());
+	
+	// NUL, then pad so the next length word is aligned
+	do
+		mStrings.push_back('\0');
+	while (mStrings.size() % sizeof(SnapshotWord));
+
+	mStringOffsets[str] = offset;
+	return offset;
+}/*}}}*/
+
+void SnapshotWriter::Write(std::vector<char>& buffer)/*{{{*/
+{
+	SnapshotHeader header;
+	header.magic   = SNAPSHOT_MAGIC;
+	header.version = SNAPSHOT_VERSION;
+	header.start   = mStart;
+
+	buffer.clear();
+	buffer.resize(sizeof(header));
+
+#define SNAPSHOT_SECTION(kind, records) \
+	header.sections[kind].offset = buffer.size(); \
+	header.sections[kind].count  = records.size(); \
+	Append(buffer, records);
+
+	SNAPSHOT_SECTION(SNAPSHOT_NODES,        mNodes)
+	SNAPSHOT_SECTION(SNAPSHOT_INSTRUCTIONS, mInstructions)
+	SNAPSHOT_SECTION(SNAPSHOT_EXPRESSIONS,  mExpressions)
+	SNAPSHOT_SECTION(SNAPSHOT_DU_CHAINS,    mDuChains)
+	SNAPSHOT_SECTION(SNAPSHOT_LOW_LEVEL,    mLowLevel)
+	SNAPSHOT_SECTION(SNAPSHOT_INDEXES,      mIndexes)
+	SNAPSHOT_SECTION(SNAPSHOT_STRINGS,      mStrings)
+
+#undef SNAPSHOT_SECTION
+
+	header.size = buffer.size();
+	memcpy(&buffer[0], &header, sizeof(header));
+}/*}}}*/
+
+void WriteSnapshot(Addr start, Node_list& nodes, std::vector<char>& buffer)/*{{{*/
+{
+	SnapshotWriter writer(start);
+	writer.Add(nodes);
+	writer.Write(buffer);
+}/*}}}*/
+
+bool SaveSnapshot(const char* path, Addr start, Node_list& nodes)/*{{{*/
+{
+	std::vector<char> buffer;
+	WriteSnapshot(start, nodes, buffer);
+
+	FILE* file = fopen(path, "wb");
+	if (NULL == file)
+	{
+		message("Error, could not create snapshot file %s\n", path);
+		return false;
+	}
+
+	bool ok = fwrite(&buffer[0], 1, buffer.size(), file) == buffer.size();
+	if (0 != fclose(file))
+		ok = false;
+	
+	if (!ok)
+		message("Error, could not write snapshot file %s\n", path);
+	return ok;
+}/*}}}*/
+
+bool Snapshot::IsValid() const/*{{{*/
+{
+	static const size_t RECORD_SIZE[SNAPSHOT_SECTION_COUNT] = 
+	{
+		sizeof(SnapshotNode),
+		sizeof(SnapshotInstruction),
+		sizeof(SnapshotExpression),
+		sizeof(SnapshotDuChain),
+		sizeof(SnapshotLowLevel),
+		sizeof(SnapshotWord),
+		1
+	};
+	
+	if (NULL == mData || mSize < sizeof(SnapshotHeader))
+		return false;
+
+	const SnapshotHeader& header = Header();
+	if (SNAPSHOT_MAGIC != header.magic || 
+			SNAPSHOT_VERSION != header.version ||
+			header.size > mSize)
+		return false;
+
+	for (int i = 0; i < SNAPSHOT_SECTION_COUNT; i++)
+	{
+		const SnapshotSection& section = header.sections[i];
+		if (section.offset % sizeof(SnapshotWord) ||
+				section.offset > header.size ||
+				section.count > (header.size - section.offset) / RECORD_SIZE[i])
+			return false;
+	}
+
+	for (SnapshotWord i = 0; i < Count(SNAPSHOT_EXPRESSIONS); i++)
+	{
+		if (!IsValidExpression(i))
+			return false;
+	}
+
+	for (SnapshotWord i = 0; i < Count(SNAPSHOT_INSTRUCTIONS); i++)
+	{
+		if (!IsValidInstruction(i))
+			return false;
+	}
+
+	for (SnapshotWord i = 0; i < Count(SNAPSHOT_NODES); i++)
+	{
+		if (!IsValidNode(i))
+			return false;
+	}
+
+	return true;
+}/*}}}*/
+
+/** Are the count records from first all in the section? */
+bool Snapshot::IsValidRun(SnapshotSectionKind kind, /*{{{*/
+		SnapshotWord first, SnapshotWord count) const
+{
+	return 0 == count || 
+		(first < Count(kind) && count <= Count(kind) - first);
+}/*}}}*/
+
+bool Snapshot::IsValidString(SnapshotWord offset) const/*{{{*/
+{
+	SnapshotWord size = Count(SNAPSHOT_STRINGS);
+	if (offset % sizeof(SnapshotWord) || 
+			size < sizeof(SnapshotWord) ||
+			offset > size - sizeof(SnapshotWord))
+		return false;
+
+	// the bytes and the NUL must fit too
+	SnapshotWord length = StringLength(offset);
+	return length < size - offset - sizeof(SnapshotWord) &&
+		'\0' == String(offset)[length];
+}/*}}}*/
+
+bool Snapshot::IsValidExpression(SnapshotWord index) const/*{{{*/
+{
+	const SnapshotExpression& record = Expression(index);
+
+	if (!IsValidRun(SNAPSHOT_INDEXES, record.firstChild, record.childCount))
+		return false;
+
+	for (SnapshotWord i = 0; i < record.childCount; i++)
+	{
+		if (Index(record.firstChild + i) >= index)
+			return false;
+	}
+
+	switch (record.type)
+	{
+		case ::Expression::BINARY_EXPRESSION:
+			return 2 == record.childCount && IsValidString(record.text);
+
+		case ::Expression::UNARY_EXPRESSION:
+			return 1 == record.childCount && IsValidString(record.text);
+
+		case ::Expression::TERNARY_EXPRESSION:
+			return 3 == record.childCount;
+
+		case ::Expression::CALL:
+			// the parameter count reserves memory; a callee purges at most
+			// 0xffff bytes
+			return record.childCount >= 1 &&
+				((SnapshotWord)CallExpression::UNKNOWN_PARAMETER_COUNT == record.value ||
+				 record.value <= 0xffff / 4);
+
+		case ::Expression::GLOBAL:
+		case ::Expression::STACK_VARIABLE:
+		case ::Expression::STRING_LITERAL:
+			return IsValidString(record.text);
+
+		default:
+			// the loader replaces unknown types by a dummy
+			return true;
+	}
+}/*}}}*/
+
+bool Snapshot::IsValidInstruction(SnapshotWord index) const/*{{{*/
+{
+	const SnapshotInstruction& record = Instruction(index);
+	int required = 0;
+
+	for (int i = 0; i < 2; i++)
+	{
+		if (SNAPSHOT_NONE != record.operands[i] && 
+				record.operands[i] >= Count(SNAPSHOT_EXPRESSIONS))
+			return false;
+	}
+
+	if (!IsValidRun(SNAPSHOT_DU_CHAINS, record.firstDuChain, record.duChainCount))
+		return false;
+
+	switch (record.type)
+	{
+		case ::Instruction::ASSIGNMENT:
+		case ::Instruction::CONDITIONAL_JUMP:
+			required = 2;
+			break;
+
+		case ::Instruction::JUMP:
+		case ::Instruction::PUSH:
+		case ::Instruction::POP:
+		case ::Instruction::RETURN:
+			required = 1;
+			break;
+
+		case ::Instruction::CASE:
+			if (!IsValidRun(SNAPSHOT_INDEXES, record.extra[0], record.extra[1]))
+				return false;
+			break;
+
+		case ::Instruction::LABEL:
+			if (!IsValidString(record.extra[0]))
+				return false;
+			break;
+
+		case ::Instruction::LOW_LEVEL:
+			if (record.extra[0] >= Count(SNAPSHOT_LOW_LEVEL))
+				return false;
+			break;
+
+		case ::Instruction::SWITCH:
+			required = 1;
+			if (record.extra[1] > Count(SNAPSHOT_INDEXES) / 2 ||
+					!IsValidRun(SNAPSHOT_INDEXES, record.extra[0], 2 * record.extra[1]))
+				return false;
+			break;
+
+		case ::Instruction::THROW:
+			if (SNAPSHOT_NONE != record.operands[0] && !IsValidString(record.extra[0]))
+				return false;
+			break;
+
+		default:
+			break;
+	}
+
+	for (int i = 0; i < required; i++)
+	{
+		if (SNAPSHOT_NONE == record.operands[i])
+			return false;
+	}
+	return true;
+}/*}}}*/
+
+bool Snapshot::IsValidNode(SnapshotWord index) const/*{{{*/
+{
+	const SnapshotNode& record = Node(index);
+	return 
+		IsValidRun(SNAPSHOT_INSTRUCTIONS, record.firstInstruction, record.instructionCount) &&
+		IsValidRun(SNAPSHOT_INDEXES, record.firstSuccessor, record.successorCount) &&
+		(SNAPSHOT_NONE == record.immediateDominator || 
+		 record.immediateDominator < Count(SNAPSHOT_NODES));
+}/*}}}*/
+
+/**
+ * Rebuilds expressions and instructions of a snapshot
+ */
+class SnapshotLoader/*{{{*/
+{
+	public:
+		SnapshotLoader(const Snapshot& snapshot)
+			: mSnapshot(snapshot),
+				mExpressions(snapshot.Count(SNAPSHOT_EXPRESSIONS))
+		{
+			// children come first, so one pass in order is enough
+			for (SnapshotWord i = 0; i < mExpressions.size(); i++)
+				mExpressions[i] = CreateExpression(mSnapshot.Expression(i));
+		}
+
+		Instruction_ptr CreateInstruction(const SnapshotInstruction& record);
+
+	private:
+		Expression_ptr CreateExpression(const SnapshotExpression& record);
+		DecodedInsn CreateInsn(const SnapshotLowLevel& record);
+		
+		std::string String(SnapshotWord offset)
+		{
+			return std::string(mSnapshot.String(offset), mSnapshot.StringLength(offset));
+		}
+
+		Expression_ptr Child(const SnapshotExpression& record, SnapshotWord index)
+		{
+			return mExpressions[mSnapshot.Index(record.firstChild + index)];
+		}
+
+		Expression_ptr Operand(const SnapshotInstruction& record, int index)
+		{
+			Expression_ptr result;
+			if (SNAPSHOT_NONE != record.operands[index])
+				result = mExpressions[record.operands[index]];
+			return result;
+		}
+
+		const Snapshot& mSnapshot;
+		Expression_vector mExpressions;
+};/*}}}*/
+
+Expression_ptr SnapshotLoader::CreateExpression(const SnapshotExpression& record)/*{{{*/
+{
+	Expression_ptr result;
+	
+	switch (record.type)
+	{
+		case Expression::BINARY_EXPRESSION:
+			result.reset(new BinaryExpression(Child(record, 0), 
+						String(record.text).c_str(), Child(record, 1)));
+			break;
+
+		case Expression::CALL:
+			{
+				CallExpression* call = new CallExpression(Child(record, 0));
+				result.reset(call);
+				call->ParameterCount(record.value);
+				call->CallingConvention(record.extra);
+				for (SnapshotWord i = 1; i < record.childCount; i++)
+					call->AddParameter(Child(record, i));
+				if (SNAPSHOT_CALL_FINISHED == record.text)
+					call->SetFinishedAddingParameters();
+			}
+			break;
+
+		case Expression::DUMMY:
+			result.reset(new Dummy());
+			break;
+
+		case Expression::GLOBAL:
+			result.reset(new GlobalVariable(String(record.text), record.value, record.extra));
+			break;
+
+		case Expression::NUMERIC_LITERAL:
+			result = NumericLiteral::Create(record.value);
+			break;
+
+		case Expression::REGISTER:
+			result = Register::Create(record.value);
+			break;
+
+		case Expression::STACK_VARIABLE:
+			result.reset(new StackVariable(String(record.text), record.value));
+			break;
+
+		case Expression::STRING_LITERAL:
+			result.reset(new StringLiteral(String(record.text), record.value));
+			break;
+
+		case Expression::TERNARY_EXPRESSION:
+			result.reset(new TernaryExpression(Child(record, 0), Child(record, 1),
+						Child(record, 2)));
+			break;
+
+		case Expression::UNARY_EXPRESSION:
+			result.reset(new UnaryExpression(String(record.text).c_str(), 
+						Child(record, 0)));
+			break;
+
+		default:
+			message("Error, unknown expression type %u in snapshot\n", record.type);
+			result.reset(new Dummy());
+			break;
+	}
+
+	return result;
+}/*}}}*/
+
+DecodedInsn SnapshotLoader::CreateInsn(const SnapshotLowLevel& record)/*{{{*/
+{
+	DecodedInsn insn;
+	memset(&insn, 0, sizeof(insn));
+	insn.ea      = record.ea;
+	insn.itype   = record.itype;
+	insn.size    = record.size;
+	insn.auxpref = record.auxpref;
+	insn.segpref = record.segpref;
+
+	for (int i = 0; i < DecodedInsn::OPERAND_COUNT; i++)
+	{
+		const SnapshotOperand& op = record.operands[i];
+		DecodedOperand& out = insn.Operands[i];
+		out.n         = i;
+		out.type      = op.type;
+		out.flags     = op.flags;
+		out.dtyp      = op.dtyp;
+		out.reg       = op.reg;
+		out.value     = op.value;
+		out.addr      = op.addr;
+		out.specval   = op.specval;
+		out.specflag1 = op.specflags;
+		out.specflag2 = op.specflags >> 8;
+		out.specflag3 = op.specflags >> 16;
+		out.specflag4 = op.specflags >> 24;
+	}
+
+	return insn;
+}/*}}}*/
+
+Instruction_ptr SnapshotLoader::CreateInstruction(const SnapshotInstruction& record)/*{{{*/
+{
+	Instruction_ptr result;
+	Addr ea = record.address;
+
+	switch (record.type)
+	{
+		case Instruction::ASSIGNMENT:
+			result.reset(new Assignment(ea, Operand(record, 0), Operand(record, 1)));
+			break;
+
+		case Instruction::CASE:
+			{
+				Case* c = new Case(ea);
+				result.reset(c);
+				for (SnapshotWord i = 0; i < record.extra[1]; i++)
+					c->AddValue(mSnapshot.Index(record.extra[0] + i));
+				if (record.extra[2])
+					c->SetDefault();
+			}
+			break;
+
+		case Instruction::CONDITIONAL_JUMP:
+			result.reset(new ConditionalJump(ea, Operand(record, 0), Operand(record, 1)));
+			break;
+
+		case Instruction::JUMP:
+			result.reset(new Jump(ea, Operand(record, 0)));
+			break;
+
+		case Instruction::LABEL:
+			{
+				Label* label = new Label(ea, String(record.extra[0]).c_str());
+				result.reset(label);
+				label->PreviousChunkEnd(record.extra[1]);
+			}
+			break;
+
+		case Instruction::LOW_LEVEL:
+			result.reset(new LowLevel(CreateInsn(mSnapshot.LowLevel(record.extra[0]))));
+			break;
+
+		case Instruction::PUSH:
+			result.reset(new Push(ea, Operand(record, 0)));
+			break;
+
+		case Instruction::POP:
+			result.reset(new Pop(ea, Operand(record, 0)));
+			break;
+
+		case Instruction::RETURN:
+			result.reset(new Return(ea, Operand(record, 0)));
+			break;
+
+		case Instruction::SWITCH:
+			{
+				SwitchCase_vector cases(record.extra[1]);
+				for (SnapshotWord i = 0; i < record.extra[1]; i++)
+				{
+					cases[i].value  = mSnapshot.Index(record.extra[0] + 2*i);
+					cases[i].target = mSnapshot.Index(record.extra[0] + 2*i + 1);
+				}
+				result.reset(new Switch(ea, Operand(record, 0), cases, record.extra[2]));
+			}
+			break;
+
+		case Instruction::THROW:
+			if (SNAPSHOT_NONE == record.operands[0])
+				result.reset(new Throw(ea));
+			else
+				result.reset(new Throw(ea, Operand(record, 0), String(record.extra[0])));
+			break;
+
+		default:
+			message("%p Error, instruction type %u can not be loaded from a snapshot\n",
+					ea, record.type);
+			return result;
+	}
+
+	result->Uses().Bits(record.uses);
+	result->Definitions().Bits(record.definitions);
+	result->LastDefinitions().Bits(record.lastDefinitions);
+	result->FlagDefinitions().Bits(record.flagDefinitions);
+	for (SnapshotWord i = 0; i < record.duChainCount; i++)
+	{
+		const SnapshotDuChain& link = mSnapshot.DuChain(record.firstDuChain + i);
+		result->AddToDuChain(link.reg, link.address);
+	}
+
+	return result;
+}/*}}}*/
+
+void Snapshot::Load(Node_list& nodes) const/*{{{*/
+{
+	SnapshotLoader loader(*this);
+
+	for (SnapshotWord n = 0; n < Count(SNAPSHOT_NODES); n++)
+	{
+		const SnapshotNode& record = Node(n);
+
+		Instruction_list instructions;
+		for (SnapshotWord i = 0; i < record.instructionCount; i++)
+		{
+			Instruction_ptr instruction = 
+				loader.CreateInstruction(Instruction(record.firstInstruction + i));
+			if (instruction.get())
+				instructions.push_back(instruction);
+		}
+
+		Addr successor[2] = { INVALID_ADDR, INVALID_ADDR };
+		for (SnapshotWord i = 0; i < record.successorCount && i < 2; i++)
+			successor[i] = Index(record.firstSuccessor + i);
+
+		Node_ptr node;
+		switch (record.type)
+		{
+			case Node::CONDITIONAL_JUMP:
+				node.reset(new ConditionalJumpNode(successor[0], successor[1],
+							instructions.begin(), instructions.end()));
+				break;
+
+			case Node::FALL_THROUGH:
+				node.reset(new FallThroughNode(successor[0], 
+							instructions.begin(), instructions.end()));
+				break;
+
+			case Node::JUMP:
+				node.reset(new JumpNode(successor[0], 
+							instructions.begin(), instructions.end()));
+				break;
+
+			case Node::N_WAY:
+				if (!instructions.empty() && 
+						instructions.back()->IsType(::Instruction::SWITCH))
+				{
+					node.reset(new N_WayNode(static_cast<Switch&>(*instructions.back()),
+								instructions.begin(), instructions.end()));
+				}
+				break;
+
+			case Node::RETURN:
+				node.reset(new ReturnNode(instructions.begin(), instructions.end()));
+				break;
+
+			default:
+				break;
+		}
+
+		if (!node.get())
+		{
+			message("%p Error, node type %u can not be loaded from a snapshot\n",
+					record.address, record.type);
+			continue;
+		}
+
+		node->Uses().Bits(record.uses);
+		node->Definitions().Bits(record.definitions);
+		node->LiveIn().Bits(record.liveIn);
+		node->LiveOut().Bits(record.liveOut);
+		nodes.push_back(node);
+	}
+
+	Node::ConnectSuccessors(nodes);
+}/*}}}*/
+
+bool SnapshotFile::Open(const char* path)/*{{{*/
+{
+	Close();
+
+#ifdef _WIN32
+	FILE* file = fopen(path, "rb");
+	if (NULL == file)
+		return false;
+
+	fseek(file, 0, SEEK_END);
+	long size = ftell(file);
+	fseek(file, 0, SEEK_SET);
+	if (size > 0)
+	{
+		mBuffer.resize(size);
+		if (fread(&mBuffer[0], 1, size, file) != (size_t)size)
+			mBuffer.clear();
+	}
+	fclose(file);
+
+	if (mBuffer.empty())
+		return false;
+	mView = Snapshot(&mBuffer[0], mBuffer.size());
+#else
+	int fd = open(path, O_RDONLY);
+	if (fd < 0)
+		return false;
+
+	struct stat info;
+	if (0 == fstat(fd, &info) && info.st_size > 0)
+	{
+		void* mapping = mmap(NULL, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+		if (MAP_FAILED != mapping)
+		{
+			mMapping = mapping;
+			mSize = info.st_size;
+		}
+	}
+	close(fd);
+
+	if (NULL == mMapping)
+		return false;
+	mView = Snapshot(mMapping, mSize);
+#endif
+
+	if (!mView.IsValid())
+	{
+		message("Error, %s is not a snapshot of this version or is damaged\n", path);
+		Close();
+		return false;
+	}
+	return true;
+}/*}}}*/
+
+void SnapshotFile::Close()/*{{{*/
+{
+#ifndef _WIN32
+	if (mMapping)
+		munmap(mMapping, mSize);
+#endif
+	mMapping = NULL;
+	mSize = 0;
+	mBuffer.clear();
+	mView = Snapshot();
+}/*}}}*/
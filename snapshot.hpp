@@ -0,0 +1,312 @@
+// 
+// Copyright (c) 2002 David Eriksson <david@2good.nu>
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a
+// copy of this software and associated documentation files (the "Software"),
+// to deal in the Software without restriction, including without limitation
+// the rights to use, copy, modify, merge, publish, distribute, sublicense,
+// and/or sell copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+// DEALINGS IN THE SOFTWARE.
+//
+// $Id$
+#ifndef _SNAPSHOT_HPP
+#define _SNAPSHOT_HPP
+
+#include <boost/cstdint.hpp>
+
+#include "desquirr.hpp"
+
+/*
+ * Binary snapshot of the node list of a function.
+ *
+ * A snapshot is one block of memory: a header with a table of sections,
+ * then the sections, each an array of fixed-size records of 32-bit words.
+ * Records refer to each other by index and to strings by byte offset into
+ * the string section, so a file can be mapped and read in place. Words
+ * are in host byte order.
+ *
+ * Expressions are stored once even if several instructions share them,
+ * children before their parents. Variable-length lists (children of an
+ * expression, case values, switch tables, successors) are runs in the
+ * index section.
+ */
+
+typedef boost::uint32_t SnapshotWord;
+
+enum
+{
+	SNAPSHOT_MAGIC   = 0x53515344,   // "DSQS"
+	SNAPSHOT_VERSION = 1,
+	SNAPSHOT_NONE    = 0xffffffff,   // no record, string or address
+	SNAPSHOT_CALL_FINISHED = 1       // text of a call with all its parameters
+};
+
+enum SnapshotSectionKind
+{
+	SNAPSHOT_NODES,
+	SNAPSHOT_INSTRUCTIONS,
+	SNAPSHOT_EXPRESSIONS,
+	SNAPSHOT_DU_CHAINS,
+	SNAPSHOT_LOW_LEVEL,
+	SNAPSHOT_INDEXES,
+	SNAPSHOT_STRINGS,
+	SNAPSHOT_SECTION_COUNT
+};
+
+struct SnapshotSection/*{{{*/
+{
+	SnapshotWord offset;   // from the start of the snapshot
+	SnapshotWord count;    // records, or bytes for the strings
+};/*}}}*/
+
+struct SnapshotHeader/*{{{*/
+{
+	SnapshotWord magic;
+	SnapshotWord version;
+	SnapshotWord size;     // of the whole snapshot
+	SnapshotWord start;    // entry of the function
+	SnapshotSection sections[SNAPSHOT_SECTION_COUNT];
+};/*}}}*/
+
+struct SnapshotNode/*{{{*/
+{
+	SnapshotWord type;               // Node::NodeType
+	SnapshotWord address;
+	SnapshotWord firstInstruction;
+	SnapshotWord instructionCount;
+	SnapshotWord firstSuccessor;     // successor addresses in the indexes
+	SnapshotWord successorCount;
+	SnapshotWord immediateDominator; // node index
+	SnapshotWord uses;
+	SnapshotWord definitions;
+	SnapshotWord liveIn;
+	SnapshotWord liveOut;
+};/*}}}*/
+
+struct SnapshotInstruction/*{{{*/
+{
+	SnapshotWord type;               // Instruction::InstructionType
+	SnapshotWord address;
+	SnapshotWord uses;
+	SnapshotWord definitions;
+	SnapshotWord lastDefinitions;
+	SnapshotWord flagDefinitions;
+	SnapshotWord firstDuChain;
+	SnapshotWord duChainCount;
+	SnapshotWord operandCount;
+	SnapshotWord operands[2];        // expression index or SNAPSHOT_NONE
+
+	/*
+	 * LABEL:     name, end of the previous chunk
+	 * CASE:      first value in the indexes, value count, is default
+	 * SWITCH:    first (value, target) pair in the indexes, pair count,
+	 *            default target
+	 * THROW:     data type
+	 * LOW_LEVEL: record in the low-level section
+	 */
+	SnapshotWord extra[3];
+};/*}}}*/
+
+struct SnapshotExpression/*{{{*/
+{
+	SnapshotWord type;               // Expression::ExpressionType
+	SnapshotWord firstChild;         // in the indexes, in SubExpression order
+	SnapshotWord childCount;
+
+	/*
+	 * UNARY, BINARY:   operation
+	 * CALL:            parameter count, calling convention, text is
+ *                  SNAPSHOT_CALL_FINISHED once all parameters were added
+	 * GLOBAL:          name, index, address
+	 * STACK_VARIABLE:  name, index
+	 * NUMERIC_LITERAL: value
+	 * REGISTER:        register index
+	 * STRING_LITERAL:  value, string type
+	 */
+	SnapshotWord text;
+	SnapshotWord value;
+	SnapshotWord extra;
+};/*}}}*/
+
+struct SnapshotDuChain/*{{{*/
+{
+	SnapshotWord reg;
+	SnapshotWord address;
+};/*}}}*/
+
+struct SnapshotOperand/*{{{*/
+{
+	SnapshotWord type;
+	SnapshotWord flags;
+	SnapshotWord dtyp;
+	SnapshotWord reg;
+	SnapshotWord value;
+	SnapshotWord addr;
+	SnapshotWord specval;
+	SnapshotWord specflags;  // specflag1 in the low byte
+};/*}}}*/
+
+/** A DecodedInsn of a LowLevel instruction */
+struct SnapshotLowLevel/*{{{*/
+{
+	SnapshotWord ea;
+	SnapshotWord itype;
+	SnapshotWord size;
+	SnapshotWord auxpref;
+	SnapshotWord segpref;
+	SnapshotOperand operands[3];
+};/*}}}*/
+
+/**
+ * Write a snapshot of the nodes of the function at start to buffer
+ */
+void WriteSnapshot(Addr start, Node_list& nodes, std::vector<char>& buffer);
+
+/**
+ * Write a snapshot to a file
+ *
+ * \return false if the file could not be written
+ */
+bool SaveSnapshot(const char* path, Addr start, Node_list& nodes);
+
+/**
+ * Read-only view of a snapshot in memory. Nothing is copied; the memory
+ * must outlive the view.
+ */
+class Snapshot/*{{{*/
+{
+	public:
+		Snapshot()
+			: mData(NULL), mSize(0)
+		{}
+		
+		Snapshot(const void* data, size_t size)
+			: mData(static_cast<const char*>(data)), mSize(size)
+		{}
+
+		/**
+		 * Is the header sane, is every section inside the snapshot and
+		 * does every record refer only to records, indexes and strings
+		 * that exist? Children of an expression must come before it.
+		 */
+		bool IsValid() const;
+
+		const SnapshotHeader& Header() const 
+		{ 
+			return *reinterpret_cast<const SnapshotHeader*>(mData); 
+		}
+
+		SnapshotWord Count(SnapshotSectionKind kind) const
+		{
+			return Header().sections[kind].count;
+		}
+
+		const SnapshotNode& Node(SnapshotWord index) const
+		{
+			return Record<SnapshotNode>(SNAPSHOT_NODES, index);
+		}
+
+		const SnapshotInstruction& Instruction(SnapshotWord index) const
+		{
+			return Record<SnapshotInstruction>(SNAPSHOT_INSTRUCTIONS, index);
+		}
+
+		const SnapshotExpression& Expression(SnapshotWord index) const
+		{
+			return Record<SnapshotExpression>(SNAPSHOT_EXPRESSIONS, index);
+		}
+
+		const SnapshotDuChain& DuChain(SnapshotWord index) const
+		{
+			return Record<SnapshotDuChain>(SNAPSHOT_DU_CHAINS, index);
+		}
+
+		const SnapshotLowLevel& LowLevel(SnapshotWord index) const
+		{
+			return Record<SnapshotLowLevel>(SNAPSHOT_LOW_LEVEL, index);
+		}
+
+		SnapshotWord Index(SnapshotWord index) const
+		{
+			return Record<SnapshotWord>(SNAPSHOT_INDEXES, index);
+		}
+
+		/** Strings are stored as a length word followed by the bytes and a NUL */
+		const char* String(SnapshotWord offset) const
+		{
+			return mData + Header().sections[SNAPSHOT_STRINGS].offset + offset + 
+				sizeof(SnapshotWord);
+		}
+
+		SnapshotWord StringLength(SnapshotWord offset) const
+		{
+			return *reinterpret_cast<const SnapshotWord*>(
+					mData + Header().sections[SNAPSHOT_STRINGS].offset + offset);
+		}
+
+		/**
+		 * Rebuild the node list. Call expressions look up their callee, so
+		 * a frontend must be set.
+		 */
+		void Load(Node_list& nodes) const;
+
+	private:
+		bool IsValidRun(SnapshotSectionKind kind, SnapshotWord first, 
+				SnapshotWord count) const;
+		bool IsValidString(SnapshotWord offset) const;
+		bool IsValidExpression(SnapshotWord index) const;
+		bool IsValidInstruction(SnapshotWord index) const;
+		bool IsValidNode(SnapshotWord index) const;
+		
+		template<class T>
+		const T& Record(SnapshotSectionKind kind, SnapshotWord index) const
+		{
+			return reinterpret_cast<const T*>(
+					mData + Header().sections[kind].offset)[index];
+		}
+
+		const char* mData;
+		size_t mSize;
+};/*}}}*/
+
+/**
+ * A snapshot file, mapped into memory where the system allows it and read
+ * otherwise
+ */
+class SnapshotFile/*{{{*/
+{
+	public:
+		SnapshotFile()
+			: mMapping(NULL), mSize(0)
+		{}
+		
+		~SnapshotFile() { Close(); }
+
+		/** \return false if the file could not be read or is no snapshot */
+		bool Open(const char* path);
+		void Close();
+
+		const Snapshot& View() const { return mView; }
+
+	private:
+		SnapshotFile(const SnapshotFile&);
+		SnapshotFile& operator= (const SnapshotFile&);
+		
+		void* mMapping;
+		size_t mSize;
+		std::vector<char> mBuffer;
+		Snapshot mView;
+};/*}}}*/
+
+#endif // _SNAPSHOT_HPP
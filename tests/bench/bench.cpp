@@ -0,0 +1,410 @@
+// 
+// Copyright (c) 2002 David Eriksson <david@2good.nu>
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a
+// copy of this software and associated documentation files (the "Software"),
+// to deal in the Software without restriction, including without limitation
+// the rights to use, copy, modify, merge, publish, distribute, sublicense,
+// and/or sell copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+// DEALINGS IN THE SOFTWARE.
+//
+// $Id$
+//
+// Microbenchmarks of the expression subsystem: construction, post-order
+// visiting, Expression::Equal and GenerateCode, on expression shapes the
+// x86 lifter produces. Prints nodes per second for each shape.
+//
+// usage: bench [-s seconds] [shape ...]
+//
+//   -s  run each measurement for at least this long, default 0.2
+//
+#include <cstdarg>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include <time.h>
+
+#include "desquirr.hpp"
+#include "frontend.hpp"
+#include "expression.hpp"
+#include "printer.hpp"
+
+enum
+{
+	EAX, ECX, EDX, EBX, ESP, EBP, ESI, EDI,
+	BATCH = 256    // trees built or walked between two looks at the clock
+};
+
+/**
+ * Frontend without a database, register names as the x86 frontend
+ * prints them
+ */
+class BenchFrontend : public Frontend/*{{{*/
+{
+	public:
+		virtual std::string RegisterName(RegisterIndex index) const/*{{{*/
+		{
+			static const char* const NAMES[] = 
+			{
+				"eax","ecx","edx","ebx","esp","ebp","esi","edi"
+			};
+
+			if (index < sizeof(NAMES) / sizeof(NAMES[0]))
+				return NAMES[index];
+			return "REGISTER";
+		}/*}}}*/
+
+		virtual int vmsg(const char *format, va_list va)
+		{
+			return vfprintf(stderr, format, va);
+		}
+
+		virtual bool ParametersOnStack() { return true; }
+
+	protected:
+		virtual Addr LookupAddress(const char* /*name*/, Addr /*referer*/)
+		{
+			return INVALID_ADDR;
+		}
+		
+		virtual void LookupCallee(Addr /*address*/, CalleeSummary& /*summary*/)
+		{
+		}
+};/*}}}*/
+
+//
+// Shapes
+//
+
+static Expression_ptr R(RegisterIndex reg)
+{
+	return Register::Create(reg);
+}
+
+static Expression_ptr N(unsigned long value)
+{
+	return NumericLiteral::Create(value);
+}
+
+static Expression_ptr B(Expression_ptr first, const char* operation,
+		Expression_ptr second)
+{
+	return Expression_ptr(new BinaryExpression(first, operation, second));
+}
+
+static Expression_ptr U(const char* operation, Expression_ptr operand)
+{
+	return Expression_ptr(new UnaryExpression(operation, operand));
+}
+
+/** mov eax, [ebx+esi*4+10h] ; add eax, ds:table[ecx*8] */
+static Expression_ptr SibAddress()/*{{{*/
+{
+	return B(
+			U("*", B(B(R(EBX), "+", B(R(ESI), "*", N(4))), "+", N(0x10))),
+			"+",
+			U("*", B(Expression_ptr(new GlobalVariable("table", 0, 0x404000)), 
+					"+", B(R(ECX), "*", N(8)))));
+}/*}}}*/
+
+static Expression_ptr Call(const char* name, Addr address, 
+		Expression_ptr a, Expression_ptr b)/*{{{*/
+{
+	CallExpression* call = new CallExpression(
+			Expression_ptr(new GlobalVariable(name, 0, address)));
+	Expression_ptr result(call);
+	call->AddParameter(a);
+	call->AddParameter(b);
+	call->SetFinishedAddingParameters();
+	return result;
+}/*}}}*/
+
+/** f(g(eax + 1, "name"), h(arg_0, i(ecx, 2))) */
+static Expression_ptr NestedCalls()/*{{{*/
+{
+	return Call("f", 0x401000,
+			Call("g", 0x401100, 
+				B(R(EAX), "+", N(1)), 
+				Expression_ptr(new StringLiteral("name", 0))),
+			Call("h", 0x401200, 
+				Expression_ptr(new StackVariable("arg_0")),
+				Call("i", 0x401300, R(ECX), N(2))));
+}/*}}}*/
+
+/** Sixteen comparisons joined by && and ||, as from a chain of jcc */
+static Expression_ptr BooleanChain()/*{{{*/
+{
+	static const char* const COMPARISONS[] = { "==", "!=", "<", ">=" };
+
+	Expression_ptr chain = B(R(EAX), "==", N(0));
+	for (int i = 1; i < 16; i++)
+	{
+		Expression_ptr term = B(R(i % 8), COMPARISONS[i % 4], N(i));
+		if (i % 3)
+			chain = B(chain, "&&", term);
+		else
+			chain = B(term, "||", chain);
+	}
+	return chain;
+}/*}}}*/
+
+/** eax = (ecx - edx) * (ebx + 3) >> 2 | ~esi & 0xff, with a ternary */
+static Expression_ptr Arithmetic()/*{{{*/
+{
+	return TernaryExpression::Create(
+			B(R(EDI), "<", N(0)),
+			B(B(B(B(R(ECX), "-", R(EDX)), "*", B(R(EBX), "+", N(3))), ">>", N(2)),
+				"|", B(U("~", R(ESI)), "&", N(0xff))),
+			U("-", R(EDI)));
+}/*}}}*/
+
+struct Shape
+{
+	const char* name;
+	Expression_ptr (*Build)();
+};
+
+static const Shape SHAPES[] = 
+{
+	{ "sib",        SibAddress },
+	{ "calls",      NestedCalls },
+	{ "boolean",    BooleanChain },
+	{ "arithmetic", Arithmetic }
+};
+
+//
+// Measurements
+//
+
+static double Now()
+{
+	timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return now.tv_sec + now.tv_nsec / 1e9;
+}
+
+/** Counts the nodes of a tree, the visitor of the traversal benchmark */
+class CountingVisitor : public ExpressionVisitor/*{{{*/
+{
+	public:
+		CountingVisitor()
+			: mCount(0)
+		{}
+
+		virtual void Visit(BinaryExpression&)  { mCount++; }
+		virtual void Visit(CallExpression&)    { mCount++; }
+		virtual void Visit(Dummy&)             { mCount++; }
+		virtual void Visit(GlobalVariable&)    { mCount++; }
+		virtual void Visit(NumericLiteral&)    { mCount++; }
+		virtual void Visit(Register&)          { mCount++; }
+		virtual void Visit(StackVariable&)     { mCount++; }
+		virtual void Visit(StringLiteral&)     { mCount++; }
+		virtual void Visit(TernaryExpression&) { mCount++; }
+		virtual void Visit(UnaryExpression&)   { mCount++; }
+
+		unsigned long Count() const { return mCount; }
+
+	private:
+		unsigned long mCount;
+};/*}}}*/
+
+/**
+ * One benchmark: Run does BATCH trees worth of work and returns something
+ * that depends on it, so that it cannot be optimized away
+ */
+class Benchmark/*{{{*/
+{
+	public:
+		Benchmark(const Shape& shape)
+			: mShape(shape)
+		{
+			for (int i = 0; i < BATCH; i++)
+			{
+				mTrees.push_back(shape.Build());
+				mCopies.push_back(shape.Build());
+			}
+		}
+
+		virtual ~Benchmark() {}
+		
+		virtual const char* Name() const = 0;
+		virtual unsigned long Run() = 0;
+
+		const char* ShapeName() const { return mShape.name; }
+
+		/** Nodes in one tree of the shape */
+		unsigned long Nodes()
+		{
+			CountingVisitor counter;
+			mTrees[0]->AcceptDepthFirst(counter);
+			return counter.Count();
+		}
+
+	protected:
+		const Shape& mShape;
+		Expression_vector mTrees;
+		Expression_vector mCopies;    // equal to mTrees, not shared
+};/*}}}*/
+
+class ConstructBenchmark : public Benchmark/*{{{*/
+{
+	public:
+		ConstructBenchmark(const Shape& shape) : Benchmark(shape) {}
+
+		virtual const char* Name() const { return "construct"; }
+
+		// includes the destruction of the trees of the previous batch
+		virtual unsigned long Run()
+		{
+			for (int i = 0; i < BATCH; i++)
+				mTrees[i] = mShape.Build();
+			return mTrees.size();
+		}
+};/*}}}*/
+
+class VisitBenchmark : public Benchmark/*{{{*/
+{
+	public:
+		VisitBenchmark(const Shape& shape) : Benchmark(shape) {}
+
+		virtual const char* Name() const { return "visit"; }
+
+		virtual unsigned long Run()
+		{
+			CountingVisitor counter;
+			for (int i = 0; i < BATCH; i++)
+				mTrees[i]->AcceptDepthFirst(counter);
+			return counter.Count();
+		}
+};/*}}}*/
+
+/**
+ * Compares each tree with its copy, which walks every node of both
+ */
+class EqualBenchmark : public Benchmark/*{{{*/
+{
+	public:
+		EqualBenchmark(const Shape& shape) : Benchmark(shape) {}
+
+		virtual const char* Name() const { return "equal"; }
+
+		virtual unsigned long Run()
+		{
+			unsigned long equal = 0;
+			for (int i = 0; i < BATCH; i++)
+				equal += Expression::Equal(mTrees[i], mCopies[i]);
+			return equal;
+		}
+};/*}}}*/
+
+class PrintBenchmark : public Benchmark/*{{{*/
+{
+	public:
+		PrintBenchmark(const Shape& shape) : Benchmark(shape) {}
+
+		virtual const char* Name() const { return "print"; }
+
+		virtual unsigned long Run()
+		{
+			mOut.Clear();
+			for (int i = 0; i < BATCH; i++)
+				mTrees[i]->GenerateCode(mOut);
+			return mOut.Size();
+		}
+
+	private:
+		OutputStream mOut;
+};/*}}}*/
+
+/** Run benchmark for at least seconds and print its nodes per second */
+static void Measure(Benchmark& benchmark, double seconds)/*{{{*/
+{
+	unsigned long nodes = benchmark.Nodes();
+	unsigned long batches = 0;
+	unsigned long result = 0;
+	
+	benchmark.Run();   // warm up
+	
+	double start = Now();
+	double elapsed;
+	do
+	{
+		result += benchmark.Run();
+		batches++;
+		elapsed = Now() - start;
+	} while (elapsed < seconds);
+
+	double total = (double)batches * BATCH * nodes;
+	printf("%-10s %-10s %6lu %10.2f %8.1f %10lu\n", 
+			benchmark.Name(), benchmark.ShapeName(), nodes, total / elapsed / 1e6, 
+			elapsed * 1e9 / total, result);
+}/*}}}*/
+
+static void Usage()
+{
+	fprintf(stderr, "usage: bench [-s seconds] [shape ...]\n");
+	exit(2);
+}
+
+int main(int argc, char** argv)/*{{{*/
+{
+	double seconds = 0.2;
+	std::vector<const Shape*> shapes;
+	const int shapeCount = sizeof(SHAPES) / sizeof(SHAPES[0]);
+	
+	for (int i = 1; i < argc; i++)
+	{
+		if (0 == strcmp(argv[i], "-s") && i + 1 < argc)
+			seconds = atof(argv[++i]);
+		else if ('-' == argv[i][0])
+			Usage();
+		else
+		{
+			int s;
+			for (s = 0; s < shapeCount; s++)
+				if (0 == strcmp(argv[i], SHAPES[s].name))
+					break;
+			if (s == shapeCount)
+				Usage();
+			shapes.push_back(&SHAPES[s]);
+		}
+	}
+
+	if (shapes.empty())
+		for (int s = 0; s < shapeCount; s++)
+			shapes.push_back(&SHAPES[s]);
+
+	Frontend::Set(Frontend_ptr(new BenchFrontend()));
+
+	// check only depends on the work done, so that it is not optimized away
+	printf("%-10s %-10s %6s %10s %8s %10s\n", 
+			"benchmark", "shape", "nodes", "Mnodes/s", "ns/node", "check");
+	
+	for (size_t s = 0; s < shapes.size(); s++)
+	{
+		const Shape& shape = *shapes[s];
+		
+		ConstructBenchmark construct(shape);
+		VisitBenchmark visit(shape);
+		EqualBenchmark equal(shape);
+		PrintBenchmark print(shape);
+		Benchmark* benchmarks[] = { &construct, &visit, &equal, &print };
+
+		for (int b = 0; b < 4; b++)
+			Measure(*benchmarks[b], seconds);
+	}
+	
+	return 0;
+}/*}}}*/
@@ -0,0 +1,112 @@
+// 
+// Copyright (c) 2002 David Eriksson <david@2good.nu>
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a
+// copy of this software and associated documentation files (the "Software"),
+// to deal in the Software without restriction, including without limitation
+// the rights to use, copy, modify, merge, publish, distribute, sublicense,
+// and/or sell copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+// DEALINGS IN THE SOFTWARE.
+//
+// $Id$
+#include "corpus.hpp"
+
+static Expression_ptr R(RegisterIndex reg)
+{
+	return Register::Create(reg);
+}
+
+static Expression_ptr N(unsigned long value)
+{
+	return NumericLiteral::Create(value);
+}
+
+static Expression_ptr B(Expression_ptr first, const char* operation,
+		Expression_ptr second)
+{
+	return Expression_ptr(new BinaryExpression(first, operation, second));
+}
+
+static Expression_ptr Code(const char* name, Addr address)
+{
+	return Expression_ptr(new GlobalVariable(name, 0, address));
+}
+
+static void Add(Instruction_list& instructions, Instruction* instruction)
+{
+	instructions.push_back(Instruction_ptr(instruction));
+}
+
+/** Constants and copies that data flow analysis folds into the return */
+static void StraightLine(Instruction_list& l)/*{{{*/
+{
+	Add(l, new Label(0x1000, "straight_line"));
+	Add(l, new Assignment(0x1000, R(EAX), N(1)));
+	Add(l, new Assignment(0x1005, R(ECX), B(R(EAX), "+", N(2))));
+	Add(l, new Assignment(0x1008, R(EDX), B(R(ECX), "*", R(EAX))));
+	Add(l, new Assignment(0x100b, R(EAX), R(EDX)));
+	Add(l, new Return(0x100d, R(EAX)));
+}/*}}}*/
+
+/** Two-way branch that joins before the return */
+static void IfElse(Instruction_list& l)/*{{{*/
+{
+	Add(l, new Label(0x2000, "if_else"));
+	Add(l, new Assignment(0x2000, R(ECX), 
+				Expression_ptr(new StackVariable("arg_0"))));
+	Add(l, new ConditionalJump(0x2004, B(R(ECX), "==", N(0)), 
+				Code("loc_2010", 0x2010)));
+	Add(l, new Assignment(0x2006, R(EAX), N(1)));
+	Add(l, new Jump(0x200b, Code("loc_2015", 0x2015)));
+	Add(l, new Label(0x2010, "loc_2010"));
+	Add(l, new Assignment(0x2010, R(EAX), N(2)));
+	Add(l, new Label(0x2015, "loc_2015"));
+	Add(l, new Return(0x2015, R(EAX)));
+}/*}}}*/
+
+/** Loop with a back edge, the registers stay live around it */
+static void Loop(Instruction_list& l)/*{{{*/
+{
+	Add(l, new Label(0x3000, "loop"));
+	Add(l, new Assignment(0x3000, R(EAX), N(0)));
+	Add(l, new Assignment(0x3002, R(ECX), N(10)));
+	Add(l, new Label(0x3007, "loc_3007"));
+	Add(l, new Assignment(0x3007, R(EAX), B(R(EAX), "+", R(ECX))));
+	Add(l, new Assignment(0x3009, R(ECX), B(R(ECX), "-", N(1))));
+	Add(l, new ConditionalJump(0x300a, B(R(ECX), "!=", N(0)), 
+				Code("loc_3007", 0x3007)));
+	Add(l, new Return(0x300c, R(EAX)));
+}/*}}}*/
+
+/** Parameters pushed on the stack become call arguments */
+static void Call(Instruction_list& l)/*{{{*/
+{
+	Add(l, new Label(0x4000, "call"));
+	Add(l, new Push(0x4000, N(1)));
+	Add(l, new Push(0x4002, N(2)));
+	Add(l, new Assignment(0x4004, R(EAX), 
+				Expression_ptr(new CallExpression(Code("callee", 0x5000)))));
+	Add(l, new Assignment(0x4009, R(ESP), B(R(ESP), "+", N(8))));
+	Add(l, new Return(0x400c, R(EAX)));
+}/*}}}*/
+
+const CorpusCase CORPUS_CASES[] = 
+{
+	{ "straight_line", 0x1000, StraightLine },
+	{ "if_else",       0x2000, IfElse },
+	{ "loop",          0x3000, Loop },
+	{ "call",          0x4000, Call }
+};
+
+const int CORPUS_CASE_COUNT = sizeof(CORPUS_CASES) / sizeof(CORPUS_CASES[0]);
@@ -0,0 +1,57 @@
+// 
+// Copyright (c) 2002 David Eriksson <david@2good.nu>
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a
+// copy of this software and associated documentation files (the "Software"),
+// to deal in the Software without restriction, including without limitation
+// the rights to use, copy, modify, merge, publish, distribute, sublicense,
+// and/or sell copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+// DEALINGS IN THE SOFTWARE.
+//
+// $Id$
+#ifndef _CORPUS_HPP
+#define _CORPUS_HPP
+
+#include "desquirr.hpp"
+#include "instruction.hpp"
+#include "expression.hpp"
+
+/**
+ * A function written by hand as the instruction list a lifter would
+ * produce, for code paths no recorded snapshot covers yet
+ */
+struct CorpusCase/*{{{*/
+{
+	const char* name;
+	Addr start;
+	void (*Build)(Instruction_list& instructions);
+};/*}}}*/
+
+extern const CorpusCase CORPUS_CASES[];
+extern const int CORPUS_CASE_COUNT;
+
+/** Register numbers of the x86 frontend */
+enum CorpusRegister
+{
+	EAX, ECX, EDX, EBX, ESP, EBP, ESI, EDI
+};
+
+/**
+ * Heap use of the runner, counted by the operator new of heap.cpp
+ */
+long HeapInUse();
+long HeapPeak();
+void ResetHeapPeak();   // start a new peak at the current use
+
+#endif // _CORPUS_HPP
@@ -0,0 +1,9 @@
+-> Update uses and definitions
+-> Live register analysis
+-> Finding DU chains
+-> Pass dataflow
+0x4004 I guess this function call takes 2 parameters.
+call:
+  eax = callee(2, 1);
+  return eax;
+
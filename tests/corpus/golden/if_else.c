@@ -0,0 +1,16 @@
+-> Update uses and definitions
+-> Live register analysis
+-> Finding DU chains
+-> Pass dataflow
+if_else:
+  if (arg_0 == 0) goto loc_2010;
+
+  eax = 1;
+  goto loc_2015;
+
+loc_2010:
+  eax = 2;
+
+loc_2015:
+  return eax;
+
@@ -0,0 +1,15 @@
+-> Update uses and definitions
+-> Live register analysis
+-> Finding DU chains
+-> Pass dataflow
+loop:
+  eax = 0;
+  ecx = 10;
+
+loc_3007:
+  eax = eax + ecx;
+  ecx = ecx - 1;
+  if (ecx != 0) goto loc_3007;
+
+  return eax;
+
@@ -0,0 +1,8 @@
+-> Update uses and definitions
+-> Live register analysis
+-> Finding DU chains
+-> Pass dataflow
+straight_line:
+  eax = 1;
+  return (eax + 2) * eax;
+
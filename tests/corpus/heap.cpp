@@ -0,0 +1,87 @@
+// 
+// Copyright (c) 2002 David Eriksson <david@2good.nu>
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a
+// copy of this software and associated documentation files (the "Software"),
+// to deal in the Software without restriction, including without limitation
+// the rights to use, copy, modify, merge, publish, distribute, sublicense,
+// and/or sell copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+// DEALINGS IN THE SOFTWARE.
+//
+// $Id$
+#include <cstdlib>
+#include <new>
+
+#include "corpus.hpp"
+
+//
+// Heap use, counted by replacing the global operator new. Code generation
+// may allocate from several threads.
+//
+
+static volatile long s_allocated = 0;
+static volatile long s_peak = 0;
+
+enum { HEADER_SIZE = 16 };   // keeps the alignment of malloc
+
+static void* Allocate(size_t size)/*{{{*/
+{
+	char* block = static_cast<char*>(malloc(size + HEADER_SIZE));
+	if (NULL == block)
+		throw std::bad_alloc();
+
+	*reinterpret_cast<size_t*>(block) = size;
+
+	long allocated = __sync_add_and_fetch(&s_allocated, (long)size);
+	long peak = s_peak;
+	while (allocated > peak)
+	{
+		long seen = __sync_val_compare_and_swap(&s_peak, peak, allocated);
+		if (seen == peak)
+			break;
+		peak = seen;
+	}
+	
+	return block + HEADER_SIZE;
+}/*}}}*/
+
+static void Free(void* p)/*{{{*/
+{
+	if (NULL == p)
+		return;
+
+	char* block = static_cast<char*>(p) - HEADER_SIZE;
+	__sync_sub_and_fetch(&s_allocated, (long)*reinterpret_cast<size_t*>(block));
+	free(block);
+}/*}}}*/
+
+void* operator new(size_t size) throw(std::bad_alloc) { return Allocate(size); }
+void* operator new[](size_t size) throw(std::bad_alloc) { return Allocate(size); }
+void operator delete(void* p) throw() { Free(p); }
+void operator delete[](void* p) throw() { Free(p); }
+
+long HeapInUse()
+{
+	return s_allocated;
+}
+
+long HeapPeak()
+{
+	return s_peak;
+}
+
+void ResetHeapPeak()
+{
+	s_peak = s_allocated;
+}
@@ -0,0 +1,472 @@
+// 
+// Copyright (c) 2002 David Eriksson <david@2good.nu>
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a
+// copy of this software and associated documentation files (the "Software"),
+// to deal in the Software without restriction, including without limitation
+// the rights to use, copy, modify, merge, publish, distribute, sublicense,
+// and/or sell copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+// DEALINGS IN THE SOFTWARE.
+//
+// $Id$
+//
+// Corpus runner: decompiles recorded snapshots and the hand-written cases
+// of cases.cpp, compares the code with the golden files and the time and
+// peak memory of each function with a stored baseline.
+//
+// usage: runner [-u] [-t percent] [-f ms] [-r repeats] [-d dir] 
+//               [-p pipeline] [-T trace.json] [snapshot.dsq ...]
+//
+//   -u  accept the current output and measurements as golden and baseline
+//   -t  tolerance for time and memory regressions, default 25 percent
+//   -f  time differences below this are noise, default 0.5 ms
+//   -r  decompile each function this many times and keep the fastest
+//   -d  directory with golden/ and baseline.txt, default .
+//   -p  pass pipeline, default "dataflow"
+//   -T  write a trace of the stages, see trace.hpp; the peak memory then
+//       includes the trace buffer
+//
+// Exits with 1 if any function differs from its golden file, regressed or
+// could not be decompiled.
+//
+#include <cstdarg>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include <time.h>
+
+#include "desquirr.hpp"
+#include "frontend.hpp"
+#include "node.hpp"
+#include "codegen.hpp"
+#include "passmanager.hpp"
+#include "snapshot.hpp"
+#include "log.hpp"
+#include "trace.hpp"
+
+#include "corpus.hpp"
+
+/**
+ * Frontend without a database: names as the x86 frontend prints them,
+ * messages collected as the output of the function
+ */
+class CorpusFrontend : public Frontend/*{{{*/
+{
+	public:
+		virtual std::string RegisterName(RegisterIndex index) const/*{{{*/
+		{
+			static const char* const NAMES[] = 
+			{
+				"eax","ecx","edx","ebx","esp","ebp","esi","edi",
+				"al","cl","dl","bl","ah","ch","dh","bh"
+			};
+
+			if (index < sizeof(NAMES) / sizeof(NAMES[0]))
+				return NAMES[index];
+
+			char buffer[32];
+			snprintf(buffer, sizeof(buffer), "REGISTER_%lu", index);
+			return buffer;
+		}/*}}}*/
+
+		virtual int vmsg(const char *format, va_list va)/*{{{*/
+		{
+			char buffer[1024];
+			int length = vsnprintf(buffer, sizeof(buffer), format, va);
+			if (length > 0)
+				mOutput.append(buffer, 
+						length < (int)sizeof(buffer) ? length : sizeof(buffer) - 1);
+			return length;
+		}/*}}}*/
+
+		virtual bool ParametersOnStack() { return true; }
+
+		const std::string& Output() const { return mOutput; }
+
+	protected:
+		virtual Addr LookupAddress(const char* /*name*/, Addr /*referer*/)
+		{
+			return INVALID_ADDR;
+		}
+		
+		virtual void LookupCallee(Addr /*address*/, CalleeSummary& /*summary*/)
+		{
+		}
+
+	private:
+		std::string mOutput;
+};/*}}}*/
+
+struct Measurement/*{{{*/
+{
+	Measurement()
+		: milliseconds(0), peak(0)
+	{}
+	
+	double milliseconds;
+	long peak;             // bytes
+};/*}}}*/
+
+typedef std::map<std::string, Measurement> Baseline;
+
+/**
+ * A function of the corpus, from a snapshot file or from cases.cpp
+ */
+struct Entry/*{{{*/
+{
+	Entry()
+		: handWritten(NULL)
+	{}
+	
+	std::string name;
+	std::string path;
+	const CorpusCase* handWritten;
+};/*}}}*/
+
+static double Now()
+{
+	timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return now.tv_sec * 1000.0 + now.tv_nsec / 1000000.0;
+}
+
+static bool ReadFile(const std::string& path, std::string& contents)/*{{{*/
+{
+	FILE* file = fopen(path.c_str(), "rb");
+	if (NULL == file)
+		return false;
+
+	contents.clear();
+	char buffer[4096];
+	size_t count;
+	while ((count = fread(buffer, 1, sizeof(buffer), file)) > 0)
+		contents.append(buffer, count);
+	
+	fclose(file);
+	return true;
+}/*}}}*/
+
+static bool WriteFile(const std::string& path, const std::string& contents)/*{{{*/
+{
+	FILE* file = fopen(path.c_str(), "wb");
+	if (NULL == file)
+		return false;
+
+	bool ok = contents.size() == fwrite(contents.data(), 1, contents.size(), file);
+	return 0 == fclose(file) && ok;
+}/*}}}*/
+
+static void ReadBaseline(const std::string& path, Baseline& baseline)/*{{{*/
+{
+	FILE* file = fopen(path.c_str(), "r");
+	if (NULL == file)
+		return;
+
+	char line[512];
+	while (fgets(line, sizeof(line), file))
+	{
+		char name[256];
+		Measurement measurement;
+		if ('#' != line[0] && 3 == sscanf(line, "%255s %lf %ld", 
+					name, &measurement.milliseconds, &measurement.peak))
+			baseline[name] = measurement;
+	}
+
+	fclose(file);
+}/*}}}*/
+
+static bool WriteBaseline(const std::string& path, const Baseline& baseline)/*{{{*/
+{
+	FILE* file = fopen(path.c_str(), "w");
+	if (NULL == file)
+		return false;
+
+	fprintf(file, "# function milliseconds peak-bytes\n");
+	for (Baseline::const_iterator item = baseline.begin(); 
+			item != baseline.end(); 
+			item++)
+	{
+		fprintf(file, "%s %.3f %ld\n", item->first.c_str(), 
+				item->second.milliseconds, item->second.peak);
+	}
+
+	return 0 == fclose(file);
+}/*}}}*/
+
+/**
+ * Decompile one function with a fresh frontend
+ *
+ * \return false if the snapshot could not be read or the pipeline parsed
+ */
+static bool Decompile(const Entry& entry, const std::string& pipeline, /*{{{*/
+		std::string& output)
+{
+	CorpusFrontend* frontend = new CorpusFrontend();
+	Frontend::Set(Frontend_ptr(frontend));
+	Log::Reset();
+	TraceSpan span("function", 
+			entry.handWritten ? entry.handWritten->start : INVALID_ADDR, 
+			entry.name.c_str());
+
+	Node_list nodes;
+	if (entry.handWritten)
+	{
+		Instruction_list instructions;
+		entry.handWritten->Build(instructions);
+		TraceSpan span("CreateList");
+		Node::CreateList(instructions, nodes);
+	}
+	else
+	{
+		SnapshotFile file;
+		if (!file.Open(entry.path.c_str()))
+		{
+			fprintf(stderr, "%s: not a snapshot\n", entry.path.c_str());
+			return false;
+		}
+		file.View().Load(nodes);
+	}
+
+	PassManager passes(nodes);
+	if (!passes.Run(pipeline))
+	{
+		fprintf(stderr, "bad pipeline '%s'\n", pipeline.c_str());
+		return false;
+	}
+
+	GenerateCode(nodes, C_STYLE);
+
+	output = frontend->Output();
+	return true;
+}/*}}}*/
+
+/** Print the first line where actual differs from expected */
+static void ReportDifference(const std::string& expected, /*{{{*/
+		const std::string& actual)
+{
+	size_t start = 0;
+	int line = 1;
+	for (;;)
+	{
+		size_t expectedEnd = expected.find('\n', start);
+		size_t actualEnd = actual.find('\n', start);
+		std::string expectedLine = expected.substr(start, 
+				std::string::npos == expectedEnd ? std::string::npos : expectedEnd - start);
+		std::string actualLine = actual.substr(start, 
+				std::string::npos == actualEnd ? std::string::npos : actualEnd - start);
+
+		if (expectedLine != actualLine || expectedEnd != actualEnd)
+		{
+			printf("    line %d\n    expected: %s\n    actual:   %s\n", 
+					line, expectedLine.c_str(), actualLine.c_str());
+			return;
+		}
+		
+		if (std::string::npos == expectedEnd)
+			return;
+
+		start = expectedEnd + 1;
+		line++;
+	}
+}/*}}}*/
+
+static std::string BaseName(const std::string& path)/*{{{*/
+{
+	size_t slash = path.find_last_of('/');
+	std::string name = std::string::npos == slash ? path : path.substr(slash + 1);
+	size_t dot = name.rfind('.');
+	return std::string::npos == dot ? name : name.substr(0, dot);
+}/*}}}*/
+
+static void Usage()
+{
+	fprintf(stderr, "usage: runner [-u] [-t percent] [-f ms] [-r repeats] "
+			"[-d dir] [-p pipeline] [-T trace.json] [snapshot.dsq ...]\n");
+	exit(2);
+}
+
+int main(int argc, char** argv)/*{{{*/
+{
+	bool update = false;
+	double tolerance = 25;
+	double floor = 0.5;
+	int repeats = 1;
+	std::string dir = ".";
+	std::string pipeline = "dataflow";
+	
+	std::vector<Entry> entries;
+	for (int i = 0; i < CORPUS_CASE_COUNT; i++)
+	{
+		Entry entry;
+		entry.name = CORPUS_CASES[i].name;
+		entry.handWritten = &CORPUS_CASES[i];
+		entries.push_back(entry);
+	}
+
+	for (int i = 1; i < argc; i++)
+	{
+		std::string arg = argv[i];
+		bool hasValue = i + 1 < argc;
+
+		if ("-u" == arg)
+			update = true;
+		else if ("-t" == arg && hasValue)
+			tolerance = atof(argv[++i]);
+		else if ("-f" == arg && hasValue)
+			floor = atof(argv[++i]);
+		else if ("-r" == arg && hasValue)
+			repeats = atoi(argv[++i]);
+		else if ("-d" == arg && hasValue)
+			dir = argv[++i];
+		else if ("-p" == arg && hasValue)
+			pipeline = argv[++i];
+		else if ("-T" == arg && hasValue)
+		{
+			if (!Trace::Open(argv[++i]))
+			{
+				fprintf(stderr, "could not write %s\n", argv[i]);
+				return 2;
+			}
+		}
+		else if ('-' == arg[0])
+			Usage();
+		else
+		{
+			Entry entry;
+			entry.name = BaseName(arg);
+			entry.path = arg;
+			entries.push_back(entry);
+		}
+	}
+
+	if (repeats < 1)
+		repeats = 1;
+
+	CorpusFrontend* frontend = new CorpusFrontend();
+	Frontend::Set(Frontend_ptr(frontend));
+	if (!PassManager::IsValid(pipeline))
+	{
+		fputs(frontend->Output().c_str(), stderr);
+		return 2;
+	}
+
+	std::string baselinePath = dir + "/baseline.txt";
+	Baseline baseline;
+	ReadBaseline(baselinePath, baseline);
+
+	Baseline measured = baseline;   // -u keeps functions not run this time
+	int failures = 0;
+	
+	for (size_t e = 0; e < entries.size(); e++)
+	{
+		const Entry& entry = entries[e];
+
+		std::string output;
+		Measurement measurement;
+		bool ok = true;
+		
+		for (int r = 0; ok && r < repeats; r++)
+		{
+			std::string run;
+			long before = HeapInUse();
+			ResetHeapPeak();
+			double start = Now();
+
+			ok = Decompile(entry, pipeline, run);
+			
+			double milliseconds = Now() - start;
+			if (0 == r)
+			{
+				output = run;
+				measurement.milliseconds = milliseconds;
+				measurement.peak = HeapPeak() - before;
+			}
+			else if (milliseconds < measurement.milliseconds)
+				measurement.milliseconds = milliseconds;
+		}
+
+		if (!ok)
+		{
+			printf("%-24s ERROR\n", entry.name.c_str());
+			failures++;
+			continue;
+		}
+
+		measured[entry.name] = measurement;
+
+		std::string goldenPath = dir + "/golden/" + entry.name + ".c";
+		std::string golden;
+		const char* status = "ok";
+		bool differs = false;
+		
+		if (update)
+		{
+			if (!WriteFile(goldenPath, output))
+			{
+				fprintf(stderr, "could not write %s\n", goldenPath.c_str());
+				failures++;
+			}
+			status = "updated";
+		}
+		else if (!ReadFile(goldenPath, golden))
+		{
+			status = "NO GOLDEN";
+			failures++;
+		}
+		else if (golden != output)
+		{
+			status = "DIFFERS";
+			differs = true;
+			failures++;
+		}
+
+		printf("%-24s %-9s %9.3f ms %9ld bytes", entry.name.c_str(), status,
+				measurement.milliseconds, measurement.peak);
+
+		Baseline::const_iterator base = baseline.find(entry.name);
+		if (!update && base != baseline.end())
+		{
+			double factor = 1 + tolerance / 100;
+			const Measurement& old = base->second;
+			
+			if (measurement.milliseconds > old.milliseconds * factor &&
+					measurement.milliseconds - old.milliseconds > floor)
+			{
+				printf("  SLOWER (%.3f ms)", old.milliseconds);
+				failures++;
+			}
+			
+			if (measurement.peak > old.peak * factor)
+			{
+				printf("  MORE MEMORY (%ld bytes)", old.peak);
+				failures++;
+			}
+		}
+		printf("\n");
+
+		if (differs)
+			ReportDifference(golden, output);
+	}
+
+	if (update && !WriteBaseline(baselinePath, measured))
+	{
+		fprintf(stderr, "could not write %s\n", baselinePath.c_str());
+		failures++;
+	}
+	
+	Trace::Close();
+	printf("%lu functions, %d failures\n", (unsigned long)entries.size(), failures);
+	return failures ? 1 : 0;
+}/*}}}*/
@@ -0,0 +1,321 @@
+// 
+// Copyright (c) 2002 David Eriksson <david@2good.nu>
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a
+// copy of this software and associated documentation files (the "Software"),
+// to deal in the Software without restriction, including without limitation
+// the rights to use, copy, modify, merge, publish, distribute, sublicense,
+// and/or sell copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+// DEALINGS IN THE SOFTWARE.
+//
+// $Id$
+//
+// Tests and a benchmark of DecodedInstructionCache, with a decoder that
+// reads instructions from a local buffer instead of an IDA database.
+//
+// usage: decoded [-b] [-s seconds]
+//
+//   -b  benchmark lookups in the cache against decoding every time. The
+//       stand-in decodes with a few loads, so its row is only the floor;
+//       ua_ana0 and the byte reads through IDA cost much more.
+//   -s  run each measurement for at least this long, default 0.2
+//
+// Exits with 1 if any test fails.
+//
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+#include <time.h>
+
+#include "desquirr.hpp"
+#include "decoded.hpp"
+
+enum
+{
+	BASE = 0x1000,     // address of the first byte of the buffer
+	BATCH = 256        // lookups between two looks at the clock
+};
+
+/**
+ * Decoder over a byte buffer. An instruction is its length (1-15) and
+ * its itype; a length of 0 is not an instruction.
+ */
+class BufferDecoder : public InstructionDecoder/*{{{*/
+{
+	public:
+		BufferDecoder()
+			: mDecodes(0)
+		{}
+
+		/** Append an instruction, the bytes after the itype are zero */
+		Addr Add(unsigned char length, unsigned char itype)
+		{
+			Addr address = BASE + mBytes.size();
+			mBytes.push_back(length);
+			mBytes.push_back(itype);
+			for (int i = 2; i < length; i++)
+				mBytes.push_back(0);
+			return address;
+		}
+
+		void Patch(Addr address, unsigned char value)
+		{
+			mBytes[address - BASE] = value;
+		}
+
+		virtual bool Decode(Addr address, DecodedInsn& insn)
+		{
+			mDecodes++;
+			if (address < BASE || address + 1 >= BASE + mBytes.size())
+				return false;
+
+			unsigned char length = mBytes[address - BASE];
+			if (length < 2 || address + length > BASE + mBytes.size())
+				return false;
+
+			insn = DecodedInsn();
+			insn.ea = address;
+			insn.size = length;
+			insn.itype = mBytes[address - BASE + 1];
+			return true;
+		}
+
+		unsigned long Decodes() const { return mDecodes; }
+
+	private:
+		std::vector<unsigned char> mBytes;
+		unsigned long mDecodes;
+};/*}}}*/
+
+static int s_failures = 0;
+
+#define CHECK(condition) \
+	do { \
+		if (!(condition)) \
+		{ \
+			printf("%s:%d: %s\n", __FILE__, __LINE__, #condition); \
+			s_failures++; \
+		} \
+	} while (0)
+
+/** A second lookup is answered without decoding */
+static void TestHit()/*{{{*/
+{
+	BufferDecoder decoder;
+	Addr first = decoder.Add(3, 7);
+	DecodedInstructionCache cache(decoder);
+
+	const DecodedInsn* insn = cache.Get(first);
+	CHECK(insn && 7 == insn->itype && 3 == insn->size);
+	CHECK(insn == cache.Get(first));
+	CHECK(1 == decoder.Decodes());
+	CHECK(1 == cache.Hits() && 1 == cache.Misses());
+}/*}}}*/
+
+/** Lookups in any order find their own instruction */
+static void TestOrder()/*{{{*/
+{
+	BufferDecoder decoder;
+	Addr first = decoder.Add(2, 1);
+	Addr second = decoder.Add(2, 2);
+	Addr third = decoder.Add(2, 3);
+	DecodedInstructionCache cache(decoder);
+
+	CHECK(3 == cache.Get(third)->itype);
+	CHECK(1 == cache.Get(first)->itype);
+	CHECK(2 == cache.Get(second)->itype);
+	CHECK(3 == cache.Get(third)->itype);
+	CHECK(2 == cache.Get(second)->itype);
+	CHECK(1 == cache.Get(first)->itype);
+	CHECK(3 == decoder.Decodes() && 3 == cache.Hits());
+}/*}}}*/
+
+/** A patched byte inside an instruction makes it decode again in place */
+static void TestInvalidate()/*{{{*/
+{
+	BufferDecoder decoder;
+	Addr first = decoder.Add(4, 1);
+	Addr second = decoder.Add(2, 2);
+	DecodedInstructionCache cache(decoder);
+
+	const DecodedInsn* insn = cache.Get(first);
+	cache.Get(second);
+
+	decoder.Patch(first + 1, 9);
+	cache.Invalidate(first + 1);
+	CHECK(insn == cache.Get(first));
+	CHECK(9 == insn->itype);
+	CHECK(3 == decoder.Decodes());
+
+	// The next instruction was not touched
+	cache.Get(second);
+	CHECK(3 == decoder.Decodes());
+
+	// Its last byte belongs to the first instruction only
+	cache.Invalidate(first + 3);
+	cache.Get(second);
+	CHECK(3 == decoder.Decodes());
+	cache.Get(first);
+	CHECK(4 == decoder.Decodes());
+}/*}}}*/
+
+/** New code over a range makes every overlapping instruction decode again */
+static void TestInvalidateRange()/*{{{*/
+{
+	BufferDecoder decoder;
+	Addr first = decoder.Add(4, 1);
+	Addr second = decoder.Add(4, 2);
+	Addr third = decoder.Add(4, 3);
+	DecodedInstructionCache cache(decoder);
+
+	cache.Get(first);
+	cache.Get(second);
+	cache.Get(third);
+
+	cache.Invalidate(first + 2, second + 1);
+	cache.Get(first);
+	cache.Get(second);
+	cache.Get(third);
+	CHECK(5 == decoder.Decodes());
+}/*}}}*/
+
+/** Decoding again can fail, the record keeps what it had */
+static void TestDecodeFails()/*{{{*/
+{
+	BufferDecoder decoder;
+	Addr first = decoder.Add(2, 5);
+	DecodedInstructionCache cache(decoder);
+
+	const DecodedInsn* insn = cache.Get(first);
+	decoder.Patch(first, 0);
+	cache.Invalidate(first);
+	CHECK(NULL == cache.Get(first));
+	CHECK(5 == insn->itype && first == insn->ea);
+
+	decoder.Patch(first, 2);
+	CHECK(insn == cache.Get(first));
+	CHECK(NULL == cache.Get(BASE + 100));
+}/*}}}*/
+
+static void TestClear()/*{{{*/
+{
+	BufferDecoder decoder;
+	Addr first = decoder.Add(2, 5);
+	DecodedInstructionCache cache(decoder);
+
+	cache.Get(first);
+	cache.Clear();
+	CHECK(0 == cache.Size() && 0 == cache.Hits() && 0 == cache.Misses());
+	CHECK(NULL != cache.Get(first));
+	CHECK(2 == decoder.Decodes());
+}/*}}}*/
+
+static double Now()
+{
+	timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return now.tv_sec + now.tv_nsec / 1e9;
+}
+
+/**
+ * Nanoseconds per instruction of looking up every instruction of the
+ * buffer, in the cache or with the decoder
+ */
+static double Measure(BufferDecoder& decoder, DecodedInstructionCache* cache, /*{{{*/
+		const std::vector<Addr>& addresses, double seconds, unsigned long& check)
+{
+	unsigned long count = 0;
+	double start = Now();
+	double elapsed;
+	
+	do
+	{
+		for (int b = 0; b < BATCH; b++)
+		{
+			for (size_t i = 0; i < addresses.size(); i++)
+			{
+				DecodedInsn insn;
+				if (cache)
+					check += cache->Get(addresses[i])->itype;
+				else if (decoder.Decode(addresses[i], insn))
+					check += insn.itype;
+			}
+		}
+		count += BATCH * addresses.size();
+		elapsed = Now() - start;
+	} while (elapsed < seconds);
+
+	return elapsed * 1e9 / count;
+}/*}}}*/
+
+static void Benchmark(double seconds)/*{{{*/
+{
+	BufferDecoder decoder;
+	std::vector<Addr> addresses;
+	for (int i = 0; i < 4096; i++)
+		addresses.push_back(decoder.Add(2 + i % 14, i & 0xff));
+
+	DecodedInstructionCache cache(decoder);
+	unsigned long decodeCheck = 0;
+	unsigned long cacheCheck = 0;
+	
+	double decode = Measure(decoder, NULL, addresses, seconds, decodeCheck);
+	double hit = Measure(decoder, &cache, addresses, seconds, cacheCheck);
+
+	// check only depends on the work done, so that it is not optimized away
+	printf("%-10s %10s %12s\n", "lookup", "ns/insn", "check");
+	printf("%-10s %10.1f %12lu\n", "decode", decode, decodeCheck);
+	printf("%-10s %10.1f %12lu\n", "cache", hit, cacheCheck);
+}/*}}}*/
+
+static void Usage()
+{
+	fprintf(stderr, "usage: decoded [-b] [-s seconds]\n");
+	exit(2);
+}
+
+int main(int argc, char** argv)/*{{{*/
+{
+	bool benchmark = false;
+	double seconds = 0.2;
+
+	for (int i = 1; i < argc; i++)
+	{
+		std::string arg = argv[i];
+
+		if ("-b" == arg)
+			benchmark = true;
+		else if ("-s" == arg && i + 1 < argc)
+			seconds = atof(argv[++i]);
+		else
+			Usage();
+	}
+
+	if (benchmark)
+	{
+		Benchmark(seconds);
+		return 0;
+	}
+
+	TestHit();
+	TestOrder();
+	TestInvalidate();
+	TestInvalidateRange();
+	TestDecodeFails();
+	TestClear();
+
+	printf("%d failures\n", s_failures);
+	return s_failures ? 1 : 0;
+}/*}}}*/
@@ -0,0 +1,469 @@
+// 
+// Copyright (c) 2002 David Eriksson <david@2good.nu>
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a
+// copy of this software and associated documentation files (the "Software"),
+// to deal in the Software without restriction, including without limitation
+// the rights to use, copy, modify, merge, publish, distribute, sublicense,
+// and/or sell copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+// DEALINGS IN THE SOFTWARE.
+//
+// $Id$
+//
+// Differential tests of the data flow passes: random functions are run by
+// an interpreter before and after the passes, on random inputs, and must
+// make the same calls and stores and return the same value. A function
+// that does not is made as small as possible before it is reported.
+//
+// usage: differential [-s seed] [-n functions] [-i inputs] [-l ops] 
+//                     [-m steps] [-p pipeline] [-v]
+//
+//   -s  seed of the first function, function k uses seed + k, default 1
+//   -n  number of functions, default 500
+//   -i  inputs per function, default 8
+//   -l  maximum number of ops per function, default 24
+//   -m  instructions a run may execute before it is stopped, default 10000
+//   -p  pass pipeline, default "dataflow"
+//   -v  print every function
+//
+// The code generated after the passes is also generated with every node
+// run on its own thread, and must be the same bytes as on one thread.
+// Dominators computed before the passes, which the passes claim to
+// preserve, must match dominators computed again after them.
+//
+// Exits with 1 if any function behaves differently after the passes, or
+// its parallel code differs.
+//
+#include <cstdarg>
+#include <cstdio>
+#include <cstdlib>
+
+#include "desquirr.hpp"
+#include "frontend.hpp"
+#include "codegen.hpp"
+#include "passmanager.hpp"
+#include "log.hpp"
+
+#include "differential.hpp"
+
+/**
+ * Frontend without a database: x86 register names, the callees of
+ * differential.hpp, messages collected so they can be shown with a failure
+ */
+class DiffFrontend : public Frontend/*{{{*/
+{
+	public:
+		virtual std::string RegisterName(RegisterIndex index) const/*{{{*/
+		{
+			static const char* const NAMES[] = 
+			{
+				"eax","ecx","edx","ebx","esp","ebp","esi","edi"
+			};
+
+			if (index < sizeof(NAMES) / sizeof(NAMES[0]))
+				return NAMES[index];
+
+			char buffer[32];
+			snprintf(buffer, sizeof(buffer), "REGISTER_%lu", index);
+			return buffer;
+		}/*}}}*/
+
+		virtual int vmsg(const char *format, va_list va)/*{{{*/
+		{
+			char buffer[1024];
+			int length = vsnprintf(buffer, sizeof(buffer), format, va);
+			if (length > 0)
+				mOutput.append(buffer, 
+						length < (int)sizeof(buffer) ? length : sizeof(buffer) - 1);
+			return length;
+		}/*}}}*/
+
+		virtual bool ParametersOnStack() { return true; }
+
+		std::string& Output() { return mOutput; }
+
+	protected:
+		virtual Addr LookupAddress(const char* /*name*/, Addr /*referer*/)
+		{
+			return INVALID_ADDR;
+		}
+		
+		virtual void LookupCallee(Addr address, CalleeSummary& summary)/*{{{*/
+		{
+			if (address < CALLEE_BASE || 
+					address >= CALLEE_BASE + CALLEE_COUNT * OP_SIZE)
+				return;
+
+			summary.hasType = true;
+			summary.parameterCount = (address - CALLEE_BASE) / OP_SIZE;
+			summary.callingConvention = CALLING_CDECL;
+		}/*}}}*/
+
+	private:
+		std::string mOutput;
+};/*}}}*/
+
+typedef std::vector<Input> Input_vector;
+
+struct Options/*{{{*/
+{
+	Options()
+		: seed(1), functions(500), inputs(8), ops(24), steps(10000),
+			pipeline("dataflow"), verbose(false)
+	{}
+	
+	unsigned long seed;
+	int functions;
+	int inputs;
+	int ops;
+	int steps;
+	std::string pipeline;
+	bool verbose;
+};/*}}}*/
+
+static DiffFrontend* s_frontend = NULL;
+
+/**
+ * Build program into nodes, optionally running the pipeline on them
+ *
+ * \return false if the pipeline could not be parsed
+ */
+static bool Prepare(const Program& program, const std::string* pipeline, /*{{{*/
+		Instruction_list& instructions, Node_list& nodes)
+{
+	Log::Reset();
+	Build(program, instructions);
+	Node::CreateList(instructions, nodes);
+
+	if (pipeline)
+	{
+		PassManager passes(nodes);
+		if (!passes.Run(*pipeline))
+			return false;
+	}
+	
+	s_frontend->Output().clear();
+	return true;
+}/*}}}*/
+
+/**
+ * Run program before and after the passes on input
+ *
+ * \return true if the runs differ; a run that hits the step limit before
+ *         the passes is not compared
+ */
+static bool Differs(const Program& program, const Input& input, /*{{{*/
+		const Options& options, Events& before, Events& after)
+{
+	Instruction_list original_instructions;
+	Node_list original;
+	Prepare(program, NULL, original_instructions, original);
+	Interpret(original, input, options.steps, before);
+
+	if (!before.empty() && "step limit" == before.back())
+		return false;
+
+	Instruction_list instructions;
+	Node_list nodes;
+	Prepare(program, &options.pipeline, instructions, nodes);
+	Interpret(nodes, input, options.steps, after);
+
+	return before != after;
+}/*}}}*/
+
+static bool Differs(const Program& program, const Input& input, /*{{{*/
+		const Options& options)
+{
+	Events before;
+	Events after;
+	return Differs(program, input, options, before, after);
+}/*}}}*/
+
+static void CollectSlots(ExprSpec_ptr& spec, std::vector<ExprSpec_ptr*>& slots)/*{{{*/
+{
+	slots.push_back(&spec);
+	if (spec->first.get())
+		CollectSlots(spec->first, slots);
+	if (spec->second.get())
+		CollectSlots(spec->second, slots);
+}/*}}}*/
+
+/**
+ * Remove ops, drop call arguments and replace expressions with their
+ * operands or 0 for as long as the program still differs on input
+ */
+static void Minimize(Program& program, const Input& input, /*{{{*/
+		const Options& options)
+{
+	bool changed = true;
+	while (changed)
+	{
+		changed = false;
+
+		for (size_t i = program.size() - 1; i > 0; i--)
+		{
+			Program candidate = program;
+			candidate.erase(candidate.begin() + i);
+			if (IsWellFormed(candidate) && Differs(candidate, input, options))
+			{
+				program = candidate;
+				changed = true;
+			}
+		}
+
+		for (Program::iterator op = program.begin(); op != program.end(); op++)
+		{
+			while (Op::CALL == op->kind && !op->arguments.empty())
+			{
+				ExprSpec_ptr last = op->arguments.back();
+				op->arguments.pop_back();
+				op->callee--;
+				if (Differs(program, input, options))
+					changed = true;
+				else
+				{
+					op->arguments.push_back(last);
+					op->callee++;
+					break;
+				}
+			}
+		}
+
+		std::vector<ExprSpec_ptr*> slots;
+		for (Program::iterator op = program.begin(); op != program.end(); op++)
+		{
+			if (op->value.get())
+				CollectSlots(op->value, slots);
+			if (op->address.get())
+				CollectSlots(op->address, slots);
+			for (size_t j = 0; j < op->arguments.size(); j++)
+				CollectSlots(op->arguments[j], slots);
+		}
+
+		ExprSpec_ptr zero(new ExprSpec());
+		for (size_t i = 0; i < slots.size(); i++)
+		{
+			ExprSpec_ptr& slot = *slots[i];
+			ExprSpec_ptr previous = slot;
+			ExprSpec_ptr candidates[] = { previous->first, previous->second, zero };
+
+			for (size_t j = 0; j < sizeof(candidates) / sizeof(candidates[0]); j++)
+			{
+				if (!candidates[j].get() || ExprSpec::LITERAL == previous->kind)
+					continue;
+				
+				slot = candidates[j];
+				if (Differs(program, input, options))
+				{
+					changed = true;
+					break;
+				}
+				slot = previous;
+			}
+
+			// the slots below a replaced expression are gone
+			if (slot != previous)
+				break;
+		}
+	}
+}/*}}}*/
+
+/**
+ * Generate the code of program after the passes on one thread and split
+ * over several threads
+ *
+ * \return true if the outputs differ
+ */
+static bool CodeDiffers(const Program& program, const Options& options, /*{{{*/
+		std::string& serial, std::string& parallel)
+{
+	Instruction_list instructions;
+	Node_list nodes;
+	Prepare(program, &options.pipeline, instructions, nodes);
+
+	int parallelNodes = g_iParallelCodeNodes;
+	int threads = g_iCodeThreads;
+
+	g_iCodeThreads = 1;
+	GenerateCode(nodes, C_STYLE);
+	serial.swap(s_frontend->Output());
+	s_frontend->Output().clear();
+
+	g_iParallelCodeNodes = 1;
+	g_iCodeThreads = 3;
+	GenerateCode(nodes, C_STYLE);
+	parallel.swap(s_frontend->Output());
+	s_frontend->Output().clear();
+
+	g_iParallelCodeNodes = parallelNodes;
+	g_iCodeThreads = threads;
+	return serial != parallel;
+}/*}}}*/
+
+/**
+ * Does the pipeline change the dominators it declares preserved?
+ */
+static bool DominatorsDiffer(const Program& program, const Options& options)/*{{{*/
+{
+	Instruction_list instructions;
+	Node_list nodes;
+	Prepare(program, NULL, instructions, nodes);
+
+	PassManager passes(nodes);
+	passes.Cache().Require(ANALYSIS_DOMINATORS);
+	passes.Run(options.pipeline);
+	s_frontend->Output().clear();
+
+	std::vector<Node*> cached;
+	for (Node_list::iterator n = nodes.begin(); n != nodes.end(); n++)
+		cached.push_back((**n).ImmediateDominator());
+
+	Node::DominatorAnalysis(nodes);
+
+	size_t i = 0;
+	for (Node_list::iterator n = nodes.begin(); n != nodes.end(); n++, i++)
+	{
+		if ((**n).ImmediateDominator() != cached[i])
+			return true;
+	}
+	return false;
+}/*}}}*/
+
+static void PrintEvents(const char* title, const Events& events)/*{{{*/
+{
+	printf("  %s:\n", title);
+	for (Events::const_iterator event = events.begin(); event != events.end(); event++)
+		printf("    %s\n", event->c_str());
+}/*}}}*/
+
+static void Report(unsigned long seed, Program& program, /*{{{*/
+		const Input& input, const Options& options)
+{
+	Minimize(program, input, options);
+	
+	Events before;
+	Events after;
+	Differs(program, input, options, before, after);
+
+	printf("seed %lu differs after \"%s\", minimized to:\n%s", 
+			seed, options.pipeline.c_str(), Print(program).c_str());
+	printf("  input: %s\n", Print(input).c_str());
+	PrintEvents("before", before);
+	PrintEvents("after", after);
+
+	Instruction_list instructions;
+	Node_list nodes;
+	Prepare(program, &options.pipeline, instructions, nodes);
+	GenerateCode(nodes, C_STYLE);
+	printf("  code after the passes:\n%s\n", s_frontend->Output().c_str());
+}/*}}}*/
+
+static void Usage()
+{
+	fprintf(stderr, "usage: differential [-s seed] [-n functions] [-i inputs] "
+			"[-l ops] [-m steps] [-p pipeline] [-v]\n");
+	exit(2);
+}
+
+int main(int argc, char** argv)/*{{{*/
+{
+	Options options;
+	
+	for (int i = 1; i < argc; i++)
+	{
+		std::string arg = argv[i];
+		bool hasValue = i + 1 < argc;
+
+		if ("-s" == arg && hasValue)
+			options.seed = strtoul(argv[++i], NULL, 0);
+		else if ("-n" == arg && hasValue)
+			options.functions = atoi(argv[++i]);
+		else if ("-i" == arg && hasValue)
+			options.inputs = atoi(argv[++i]);
+		else if ("-l" == arg && hasValue)
+			options.ops = atoi(argv[++i]);
+		else if ("-m" == arg && hasValue)
+			options.steps = atoi(argv[++i]);
+		else if ("-p" == arg && hasValue)
+			options.pipeline = argv[++i];
+		else if ("-v" == arg)
+			options.verbose = true;
+		else
+			Usage();
+	}
+
+	s_frontend = new DiffFrontend();
+	Frontend::Set(Frontend_ptr(s_frontend));
+
+	if (!PassManager::IsValid(options.pipeline))
+	{
+		fprintf(stderr, "bad pipeline '%s'\n", options.pipeline.c_str());
+		return 2;
+	}
+
+	int failures = 0;
+	int compared = 0;
+	
+	for (int f = 0; f < options.functions; f++)
+	{
+		unsigned long seed = options.seed + f;
+		Random random(seed);
+		
+		Program program;
+		Generate(random, options.ops, program);
+
+		if (options.verbose)
+			printf("seed %lu:\n%s", seed, Print(program).c_str());
+
+		for (int i = 0; i < options.inputs; i++)
+		{
+			Input input;
+			Generate(random, input);
+
+			Events before;
+			Events after;
+			if (Differs(program, input, options, before, after))
+			{
+				Report(seed, program, input, options);
+				failures++;
+				break;
+			}
+
+			if (before.empty() || "step limit" != before.back())
+				compared++;
+		}
+
+		std::string serial;
+		std::string parallel;
+		if (CodeDiffers(program, options, serial, parallel))
+		{
+			printf("seed %lu generates different code on several threads:\n%s", 
+					seed, Print(program).c_str());
+			printf("  one thread:\n%s\n  several threads:\n%s\n", 
+					serial.c_str(), parallel.c_str());
+			failures++;
+		}
+
+		if (DominatorsDiffer(program, options))
+		{
+			printf("seed %lu changes the dominators after \"%s\":\n%s", 
+					seed, options.pipeline.c_str(), Print(program).c_str());
+			failures++;
+		}
+	}
+
+	printf("%d functions, %d runs compared, %d failures\n", 
+			options.functions, compared, failures);
+	return failures ? 1 : 0;
+}/*}}}*/
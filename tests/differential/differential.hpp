@@ -0,0 +1,155 @@
+// 
+// Copyright (c) 2002 David Eriksson <david@2good.nu>
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a
+// copy of this software and associated documentation files (the "Software"),
+// to deal in the Software without restriction, including without limitation
+// the rights to use, copy, modify, merge, publish, distribute, sublicense,
+// and/or sell copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+// DEALINGS IN THE SOFTWARE.
+//
+// $Id$
+#ifndef _DIFFERENTIAL_HPP
+#define _DIFFERENTIAL_HPP
+
+#include <string>
+#include <vector>
+
+#include "desquirr.hpp"
+#include "instruction.hpp"
+#include "expression.hpp"
+#include "node.hpp"
+
+/** Registers the generated programs use, numbered as the x86 frontend does */
+enum DiffRegister
+{
+	EAX, ECX, EDX, EBX, ESP, EBP, ESI, EDI,
+	REGISTER_COUNT
+};
+
+/** Callees f0 to f3, fN takes N parameters */
+enum { CALLEE_COUNT = 4, CALLEE_BASE = 0x8000 };
+
+/** Where the generated function starts, every op gets its own address */
+enum { PROGRAM_BASE = 0x1000, OP_SIZE = 0x10 };
+
+class Random/*{{{*/
+{
+	public:
+		Random(unsigned long seed) 
+			: mState(seed * 2654435761UL + 0x9e3779b9UL)
+		{
+			if (0 == mState)
+				mState = 1;
+		}
+
+		/** xorshift32, the same sequence on every platform */
+		unsigned int Next()
+		{
+			mState ^= mState << 13;
+			mState ^= mState >> 17;
+			mState ^= mState << 5;
+			return mState;
+		}
+
+		/** \return 0 to count - 1 */
+		int Below(int count) { return Next() % count; }
+		
+		bool Chance(int percent) { return Below(100) < percent; }
+
+	private:
+		unsigned int mState;
+};/*}}}*/
+
+/**
+ * An expression of a generated program, built into a fresh Expression
+ * tree for each copy of the program
+ */
+struct ExprSpec/*{{{*/
+{
+	enum Kind
+	{
+		REGISTER,
+		LITERAL,
+		BINARY,
+		UNARY,
+		LOAD       // *(first)
+	};
+
+	ExprSpec()
+		: kind(LITERAL), reg(0), value(0), operation("")
+	{}
+	
+	Kind kind;
+	int reg;
+	unsigned int value;
+	const char* operation;
+	boost::shared_ptr<ExprSpec> first;
+	boost::shared_ptr<ExprSpec> second;
+};/*}}}*/
+
+typedef boost::shared_ptr<ExprSpec> ExprSpec_ptr;
+
+struct Op/*{{{*/
+{
+	enum Kind
+	{
+		LABEL,    // label
+		ASSIGN,   // reg = value
+		STORE,    // *(address) = value
+		CALL,     // push arguments, reg = f<callee>()
+		JUMP,     // goto label
+		BRANCH,   // if (value) goto label
+		RETURN    // return value
+	};
+	
+	Op()
+		: kind(LABEL), reg(0), label(0), callee(0)
+	{}
+	
+	Kind kind;
+	int reg;
+	int label;
+	int callee;
+	ExprSpec_ptr value;
+	ExprSpec_ptr address;
+	std::vector<ExprSpec_ptr> arguments;   // pushed last to first
+};/*}}}*/
+
+typedef std::vector<Op> Program;
+
+/** Values of the registers and memory when the function is entered */
+struct Input/*{{{*/
+{
+	unsigned int registers[REGISTER_COUNT];
+	unsigned int memory;     // seed of the values in memory
+};/*}}}*/
+
+/** What the caller can observe: calls, stores and the return, in order */
+typedef std::vector<std::string> Events;
+
+// generator.cpp
+void Generate(Random& random, int maxOps, Program& program);
+void Generate(Random& random, Input& input);
+bool IsWellFormed(const Program& program);
+void Build(const Program& program, Instruction_list& instructions);
+std::string Print(const Program& program);
+std::string Print(const Input& input);
+Addr LabelAddress(const Program& program, int label);
+
+// interpreter.cpp
+void Interpret(Node_list& nodes, const Input& input, int maxSteps, 
+		Events& events);
+
+#endif // _DIFFERENTIAL_HPP
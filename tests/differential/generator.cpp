@@ -0,0 +1,427 @@
+// 
+// Copyright (c) 2002 David Eriksson <david@2good.nu>
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a
+// copy of this software and associated documentation files (the "Software"),
+// to deal in the Software without restriction, including without limitation
+// the rights to use, copy, modify, merge, publish, distribute, sublicense,
+// and/or sell copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+// DEALINGS IN THE SOFTWARE.
+//
+// $Id$
+//
+// Random programs over a few registers, built into the instruction list
+// a lifter would produce
+//
+#include <cstdio>
+#include <vector>
+
+#include "differential.hpp"
+
+/** Registers the programs compute with, esp and ebp are left alone */
+static const int REGISTERS[] = { EAX, ECX, EDX, EBX, ESI, EDI };
+static const int REGISTER_CHOICES = sizeof(REGISTERS) / sizeof(REGISTERS[0]);
+
+static const char* const NAMES[REGISTER_COUNT] = 
+{
+	"eax","ecx","edx","ebx","esp","ebp","esi","edi"
+};
+
+static const char* const ARITHMETIC[] = 
+{
+	"+", "-", "*", "&", "|", "^", "<<", ">>"
+};
+
+static const char* const COMPARISONS[] = 
+{
+	"==", "!=", "<", ">", "<=", ">="
+};
+
+static const char* const UNARY[] = 
+{
+	"-", "~", "!"
+};
+
+#define CHOOSE(random, array) \
+	(array[(random).Below(sizeof(array) / sizeof(array[0]))])
+
+static ExprSpec_ptr RandomLeaf(Random& random)/*{{{*/
+{
+	ExprSpec_ptr spec(new ExprSpec());
+	if (random.Chance(60))
+	{
+		spec->kind = ExprSpec::REGISTER;
+		spec->reg = REGISTERS[random.Below(REGISTER_CHOICES)];
+	}
+	else
+	{
+		spec->kind = ExprSpec::LITERAL;
+		spec->value = random.Chance(90) ? random.Below(9) : random.Next();
+	}
+	return spec;
+}/*}}}*/
+
+static ExprSpec_ptr RandomExpression(Random& random, int depth)/*{{{*/
+{
+	if (0 == depth || random.Chance(40))
+		return RandomLeaf(random);
+
+	ExprSpec_ptr spec(new ExprSpec());
+	int choice = random.Below(10);
+	if (choice < 7)
+	{
+		spec->kind = ExprSpec::BINARY;
+		spec->operation = CHOOSE(random, ARITHMETIC);
+		spec->first = RandomExpression(random, depth - 1);
+		spec->second = RandomExpression(random, depth - 1);
+	}
+	else if (choice < 8)
+	{
+		spec->kind = ExprSpec::UNARY;
+		spec->operation = CHOOSE(random, UNARY);
+		spec->first = RandomExpression(random, depth - 1);
+	}
+	else
+	{
+		spec->kind = ExprSpec::LOAD;
+		spec->first = RandomExpression(random, depth - 1);
+	}
+	return spec;
+}/*}}}*/
+
+static ExprSpec_ptr RandomCondition(Random& random)/*{{{*/
+{
+	ExprSpec_ptr spec(new ExprSpec());
+	spec->kind = ExprSpec::BINARY;
+	spec->operation = CHOOSE(random, COMPARISONS);
+	spec->first = RandomExpression(random, 1);
+	spec->second = RandomLeaf(random);
+	return spec;
+}/*}}}*/
+
+/**
+ * A function of at most maxOps ops that starts with a label and ends
+ * with a return. Jumps and branches go forward and backward, so some
+ * programs loop.
+ */
+void Generate(Random& random, int maxOps, Program& program)/*{{{*/
+{
+	program.clear();
+	
+	int count = 2 + random.Below(maxOps > 2 ? maxOps - 1 : 1);
+	int labels = 1;
+
+	Op entry;
+	entry.kind = Op::LABEL;
+	program.push_back(entry);
+
+	for (int i = 1; i < count - 1; i++)
+	{
+		Op op;
+		int choice = random.Below(100);
+		
+		if (choice < 40)
+		{
+			op.kind = Op::ASSIGN;
+			op.reg = REGISTERS[random.Below(REGISTER_CHOICES)];
+			op.value = RandomExpression(random, 2);
+		}
+		else if (choice < 50)
+		{
+			op.kind = Op::STORE;
+			op.address = RandomExpression(random, 1);
+			op.value = RandomExpression(random, 1);
+		}
+		else if (choice < 60)
+		{
+			op.kind = Op::CALL;
+			op.reg = random.Chance(80) ? EAX : REGISTERS[random.Below(REGISTER_CHOICES)];
+			op.callee = random.Below(CALLEE_COUNT);
+			for (int j = 0; j < op.callee; j++)
+				op.arguments.push_back(RandomExpression(random, 1));
+		}
+		else if (choice < 72)
+		{
+			op.kind = Op::LABEL;
+			op.label = labels++;
+		}
+		else if (choice < 86)
+		{
+			op.kind = Op::BRANCH;
+			op.value = RandomCondition(random);
+		}
+		else if (choice < 92)
+		{
+			op.kind = Op::JUMP;
+		}
+		else
+		{
+			op.kind = Op::RETURN;
+			op.value = RandomLeaf(random);
+		}
+		program.push_back(op);
+	}
+
+	Op last;
+	last.kind = Op::RETURN;
+	last.value = RandomLeaf(random);
+	program.push_back(last);
+
+	// a jump back would loop forever unless a branch leaves the loop, 
+	// jumps go forward when they can and only branches go back
+	std::vector<int> later;
+	for (size_t i = program.size(); i > 0; i--)
+	{
+		Op& op = program[i - 1];
+		if (Op::LABEL == op.kind)
+			later.push_back(op.label);
+		else if (Op::JUMP == op.kind && !later.empty())
+			op.label = later[random.Below(later.size())];
+		else if (Op::JUMP == op.kind || Op::BRANCH == op.kind)
+			op.label = random.Below(labels);
+	}
+}/*}}}*/
+
+void Generate(Random& random, Input& input)/*{{{*/
+{
+	for (int i = 0; i < REGISTER_COUNT; i++)
+		input.registers[i] = random.Chance(50) ? random.Below(8) : random.Next();
+	input.memory = random.Next();
+}/*}}}*/
+
+Addr LabelAddress(const Program& program, int label)/*{{{*/
+{
+	for (size_t i = 0; i < program.size(); i++)
+	{
+		if (Op::LABEL == program[i].kind && label == program[i].label)
+			return PROGRAM_BASE + i * OP_SIZE;
+	}
+	return INVALID_ADDR;
+}/*}}}*/
+
+/**
+ * Starts with a label, ends with a return and every jump has its label,
+ * as Node::CreateList expects
+ */
+bool IsWellFormed(const Program& program)/*{{{*/
+{
+	if (program.size() < 2 || 
+			Op::LABEL != program.front().kind ||
+			Op::RETURN != program.back().kind)
+		return false;
+
+	for (Program::const_iterator op = program.begin(); op != program.end(); op++)
+	{
+		if ((Op::JUMP == op->kind || Op::BRANCH == op->kind) &&
+				INVALID_ADDR == LabelAddress(program, op->label))
+			return false;
+	}
+	return true;
+}/*}}}*/
+
+static std::string LabelName(Addr address)
+{
+	char name[32];
+	snprintf(name, sizeof(name), "loc_%lx", address);
+	return name;
+}
+
+static std::string CalleeName(int callee)
+{
+	char name[32];
+	snprintf(name, sizeof(name), "f%d", callee);
+	return name;
+}
+
+static Expression_ptr Build(const ExprSpec& spec)/*{{{*/
+{
+	switch (spec.kind)
+	{
+		case ExprSpec::REGISTER:
+			return Register::Create(spec.reg);
+
+		case ExprSpec::LITERAL:
+			return NumericLiteral::Create(spec.value);
+
+		case ExprSpec::BINARY:
+			return Expression_ptr(new BinaryExpression(
+						Build(*spec.first), spec.operation, Build(*spec.second)));
+
+		case ExprSpec::UNARY:
+			return Expression_ptr(new UnaryExpression(
+						spec.operation, Build(*spec.first)));
+
+		case ExprSpec::LOAD:
+		default:
+			return Expression_ptr(new UnaryExpression("*", Build(*spec.first)));
+	}
+}/*}}}*/
+
+static Expression_ptr Code(const Program& program, int label)
+{
+	Addr address = LabelAddress(program, label);
+	return Expression_ptr(new GlobalVariable(LabelName(address), 0, address));
+}
+
+void Build(const Program& program, Instruction_list& instructions)/*{{{*/
+{
+	for (size_t i = 0; i < program.size(); i++)
+	{
+		const Op& op = program[i];
+		Addr address = PROGRAM_BASE + i * OP_SIZE;
+		Instruction* instruction = NULL;
+
+		switch (op.kind)
+		{
+			case Op::LABEL:
+				instruction = new Label(address, LabelName(address).c_str());
+				break;
+
+			case Op::ASSIGN:
+				instruction = new Assignment(address, 
+						Register::Create(op.reg), Build(*op.value));
+				break;
+
+			case Op::STORE:
+				instruction = new Assignment(address, 
+						Expression_ptr(new UnaryExpression("*", Build(*op.address))),
+						Build(*op.value));
+				break;
+
+			case Op::CALL:
+				{
+					for (size_t j = op.arguments.size(); j > 0; j--)
+					{
+						instructions.push_back(Instruction_ptr(new Push(
+										address + op.arguments.size() - j, 
+										Build(*op.arguments[j - 1]))));
+					}
+
+					Addr callee = CALLEE_BASE + op.callee * OP_SIZE;
+					Expression_ptr function(new GlobalVariable(
+								CalleeName(op.callee), 0, callee));
+					instruction = new Assignment(address + OP_SIZE / 2, 
+							Register::Create(op.reg), 
+							Expression_ptr(new CallExpression(function)));
+				}
+				break;
+
+			case Op::JUMP:
+				instruction = new Jump(address, Code(program, op.label));
+				break;
+
+			case Op::BRANCH:
+				instruction = new ConditionalJump(address, Build(*op.value), 
+						Code(program, op.label));
+				break;
+
+			case Op::RETURN:
+				instruction = new Return(address, Build(*op.value));
+				break;
+		}
+
+		instructions.push_back(Instruction_ptr(instruction));
+	}
+}/*}}}*/
+
+static std::string Print(const ExprSpec& spec)/*{{{*/
+{
+	char buffer[32];
+	
+	switch (spec.kind)
+	{
+		case ExprSpec::REGISTER:
+			return NAMES[spec.reg];
+
+		case ExprSpec::LITERAL:
+			snprintf(buffer, sizeof(buffer), spec.value < 10 ? "%u" : "0x%x", 
+					spec.value);
+			return buffer;
+
+		case ExprSpec::BINARY:
+			return "(" + Print(*spec.first) + " " + spec.operation + " " + 
+				Print(*spec.second) + ")";
+
+		case ExprSpec::UNARY:
+			return spec.operation + Print(*spec.first);
+
+		case ExprSpec::LOAD:
+		default:
+			return "*" + Print(*spec.first);
+	}
+}/*}}}*/
+
+std::string Print(const Program& program)/*{{{*/
+{
+	std::string text;
+	
+	for (size_t i = 0; i < program.size(); i++)
+	{
+		const Op& op = program[i];
+
+		switch (op.kind)
+		{
+			case Op::LABEL:
+				text += LabelName(PROGRAM_BASE + i * OP_SIZE) + ":\n";
+				break;
+
+			case Op::ASSIGN:
+				text += "\t" + std::string(NAMES[op.reg]) + " = " + Print(*op.value) + ";\n";
+				break;
+
+			case Op::STORE:
+				text += "\t*" + Print(*op.address) + " = " + Print(*op.value) + ";\n";
+				break;
+
+			case Op::CALL:
+				text += "\t" + std::string(NAMES[op.reg]) + " = " + CalleeName(op.callee) + "(";
+				for (size_t j = 0; j < op.arguments.size(); j++)
+				{
+					if (j)
+						text += ", ";
+					text += Print(*op.arguments[j]);
+				}
+				text += ");\n";
+				break;
+
+			case Op::JUMP:
+				text += "\tgoto " + LabelName(LabelAddress(program, op.label)) + ";\n";
+				break;
+
+			case Op::BRANCH:
+				text += "\tif " + Print(*op.value) + " goto " + 
+					LabelName(LabelAddress(program, op.label)) + ";\n";
+				break;
+
+			case Op::RETURN:
+				text += "\treturn " + Print(*op.value) + ";\n";
+				break;
+		}
+	}
+	return text;
+}/*}}}*/
+
+std::string Print(const Input& input)/*{{{*/
+{
+	std::string text;
+	char buffer[64];
+	
+	for (int i = 0; i < REGISTER_COUNT; i++)
+	{
+		snprintf(buffer, sizeof(buffer), "%s=%x ", NAMES[i], input.registers[i]);
+		text += buffer;
+	}
+	snprintf(buffer, sizeof(buffer), "memory=%x", input.memory);
+	return text + buffer;
+}/*}}}*/
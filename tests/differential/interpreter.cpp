@@ -0,0 +1,350 @@
+// 
+// Copyright (c) 2002 David Eriksson <david@2good.nu>
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a
+// copy of this software and associated documentation files (the "Software"),
+// to deal in the Software without restriction, including without limitation
+// the rights to use, copy, modify, merge, publish, distribute, sublicense,
+// and/or sell copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+// DEALINGS IN THE SOFTWARE.
+//
+// $Id$
+//
+// Interpreter for the intermediate representation, runs a node list the
+// way the generated code would run
+//
+#include <cstdio>
+#include <cstring>
+#include <map>
+
+#include "differential.hpp"
+
+static unsigned int Mix(unsigned int value)/*{{{*/
+{
+	value ^= value >> 16;
+	value *= 0x7feb352dU;
+	value ^= value >> 15;
+	value *= 0x846ca68bU;
+	value ^= value >> 16;
+	return value;
+}/*}}}*/
+
+class Interpreter/*{{{*/
+{
+	public:
+		Interpreter(const Input& input, Events& events)
+			: mInput(input), mEvents(events), mCalls(0), mDone(false)
+		{
+			memcpy(mRegisters, input.registers, sizeof(mRegisters));
+		}
+
+		bool Done() const { return mDone; }
+
+		/** Stop with a final event */
+		void Stop(const std::string& event)
+		{
+			if (!mDone)
+				mEvents.push_back(event);
+			mDone = true;
+		}
+
+		unsigned int Evaluate(Expression_ptr e)/*{{{*/
+		{
+			if (mDone)
+				return 0;
+			
+			switch (e->Type())
+			{
+				case Expression::NUMERIC_LITERAL:
+					return static_cast<NumericLiteral*>(e.get())->Value();
+
+				case Expression::REGISTER:
+					{
+						unsigned short index = Register::Index(e);
+						if (index >= REGISTER_COUNT)
+						{
+							Stop("error: register out of range");
+							return 0;
+						}
+						return mRegisters[index];
+					}
+
+				case Expression::GLOBAL:
+					return static_cast<GlobalVariable*>(e.get())->Address();
+
+				case Expression::BINARY_EXPRESSION:
+					{
+						BinaryExpression* binary = static_cast<BinaryExpression*>(e.get());
+						unsigned int a = Evaluate(binary->First());
+						unsigned int b = Evaluate(binary->Second());
+						return Binary(binary->Operation(), a, b);
+					}
+
+				case Expression::UNARY_EXPRESSION:
+					{
+						UnaryExpression* unary = static_cast<UnaryExpression*>(e.get());
+						unsigned int a = Evaluate(unary->Operand());
+						const std::string& operation = unary->Operation();
+
+						if ("*" == operation) return Load(a);
+						if ("-" == operation) return -a;
+						if ("~" == operation) return ~a;
+						if ("!" == operation) return !a;
+						Stop("error: unary " + operation);
+						return 0;
+					}
+
+				case Expression::TERNARY_EXPRESSION:
+					return Evaluate(e->SubExpression(0)) ? 
+						Evaluate(e->SubExpression(1)) : Evaluate(e->SubExpression(2));
+
+				case Expression::CALL:
+					return Call(static_cast<CallExpression*>(e.get()));
+
+				default:
+					Stop("error: unexpected expression");
+					return 0;
+			}
+		}/*}}}*/
+
+		/** \return false at the end of the node, true if a branch is taken */
+		bool Execute(Instruction_ptr instruction)/*{{{*/
+		{
+			switch (instruction->Type())
+			{
+				case Instruction::ASSIGNMENT:
+					{
+						Assignment* assignment = static_cast<Assignment*>(instruction.get());
+						Expression_ptr target = assignment->First();
+						
+						if (target->IsType(Expression::REGISTER))
+						{
+							unsigned int value = Evaluate(assignment->Second());
+							unsigned short index = Register::Index(target);
+							if (index < REGISTER_COUNT)
+								mRegisters[index] = value;
+							else
+								Stop("error: register out of range");
+						}
+						else if (target->IsType(Expression::UNARY_EXPRESSION))
+						{
+							Expression_ptr address = target->SubExpression(0);
+							Store(Evaluate(address), Evaluate(assignment->Second()));
+						}
+						else if (target->IsType(Expression::DUMMY))
+						{
+							// the result of a call nobody uses
+							Evaluate(assignment->Second());
+						}
+						else
+							Stop("error: unexpected assignment");
+					}
+					break;
+
+				case Instruction::PUSH:
+					mStack.push_back(Evaluate(instruction->Operand(0)));
+					break;
+
+				case Instruction::POP:
+					if (mStack.empty())
+						Stop("error: pop from empty stack");
+					else
+					{
+						Expression_ptr target = instruction->Operand(0);
+						if (target->IsType(Expression::REGISTER) &&
+								Register::Index(target) < REGISTER_COUNT)
+							mRegisters[Register::Index(target)] = mStack.back();
+						mStack.pop_back();
+					}
+					break;
+
+				case Instruction::CONDITIONAL_JUMP:
+					return 0 != Evaluate(instruction->Operand(0));
+
+				case Instruction::RETURN:
+					{
+						char event[32];
+						snprintf(event, sizeof(event), "return %x", 
+								Evaluate(instruction->Operand(0)));
+						Stop(event);
+					}
+					break;
+
+				case Instruction::LABEL:
+				case Instruction::JUMP:
+					break;
+
+				default:
+					Stop("error: unexpected instruction");
+					break;
+			}
+			return false;
+		}/*}}}*/
+
+	private:
+		unsigned int Binary(const std::string& operation, /*{{{*/
+				unsigned int a, unsigned int b)
+		{
+			if ("+" == operation)  return a + b;
+			if ("-" == operation)  return a - b;
+			if ("*" == operation)  return a * b;
+			if ("&" == operation)  return a & b;
+			if ("|" == operation)  return a | b;
+			if ("^" == operation)  return a ^ b;
+			if ("<<" == operation) return a << (b & 31);
+			if (">>" == operation) return a >> (b & 31);
+			if ("==" == operation) return a == b;
+			if ("!=" == operation) return a != b;
+			if ("<" == operation)  return a < b;
+			if (">" == operation)  return a > b;
+			if ("<=" == operation) return a <= b;
+			if (">=" == operation) return a >= b;
+			if ("&&" == operation) return a && b;
+			if ("||" == operation) return a || b;
+			Stop("error: binary " + operation);
+			return 0;
+		}/*}}}*/
+
+		unsigned int Load(unsigned int address)/*{{{*/
+		{
+			std::map<unsigned int, unsigned int>::const_iterator item = 
+				mMemory.find(address);
+			if (item != mMemory.end())
+				return item->second;
+			return Mix(address ^ mInput.memory);
+		}/*}}}*/
+
+		void Store(unsigned int address, unsigned int value)/*{{{*/
+		{
+			if (mDone)
+				return;
+			
+			char event[64];
+			snprintf(event, sizeof(event), "store [%x] = %x", address, value);
+			mEvents.push_back(event);
+			mMemory[address] = value;
+		}/*}}}*/
+
+		/**
+		 * Parameters not collected by the data flow analysis yet are
+		 * taken from the pushes, the one pushed last is the first
+		 */
+		unsigned int Call(CallExpression* call)/*{{{*/
+		{
+			std::vector<unsigned int> parameters;
+
+			if (call->IsFinishedAddingParameters())
+			{
+				for (int i = 1; i < call->SubExpressionCount(); i++)
+					parameters.push_back(Evaluate(call->SubExpression(i)));
+			}
+			else
+			{
+				int count = call->ParameterCount();
+				if (CallExpression::UNKNOWN_PARAMETER_COUNT == count)
+					count = mStack.size();
+				for (; count > 0 && !mStack.empty(); count--)
+				{
+					parameters.push_back(mStack.back());
+					mStack.pop_back();
+				}
+			}
+
+			Expression_ptr function = call->SubExpression(0);
+			std::string name = function->IsType(Expression::GLOBAL) ?
+				static_cast<GlobalVariable*>(function.get())->Name() : "?";
+			
+			unsigned int result = Mix(++mCalls);
+			std::string event = name + "(";
+			for (size_t i = 0; i < parameters.size(); i++)
+			{
+				char buffer[16];
+				snprintf(buffer, sizeof(buffer), i ? ", %x" : "%x", parameters[i]);
+				event += buffer;
+				result = Mix(result ^ parameters[i]);
+			}
+			event += ")";
+			
+			if (!mDone)
+				mEvents.push_back("call " + event);
+			return result;
+		}/*}}}*/
+
+		const Input& mInput;
+		Events& mEvents;
+		unsigned int mRegisters[REGISTER_COUNT];
+		std::map<unsigned int, unsigned int> mMemory;
+		std::vector<unsigned int> mStack;
+		unsigned int mCalls;
+		bool mDone;
+};/*}}}*/
+
+/**
+ * Run nodes from the first one until a return, recording what the
+ * caller can observe. Stops after maxSteps instructions.
+ */
+void Interpret(Node_list& nodes, const Input& input, int maxSteps, /*{{{*/
+		Events& events)
+{
+	events.clear();
+	if (nodes.empty())
+	{
+		events.push_back("no code");
+		return;
+	}
+	
+	Interpreter interpreter(input, events);
+	Node_ptr node = nodes.front();
+	int steps = 0;
+
+	while (!interpreter.Done())
+	{
+		bool taken = false;
+		Instruction_list& instructions = node->Instructions();
+		
+		for (Instruction_list::iterator item = instructions.begin();
+				!interpreter.Done() && item != instructions.end();
+				item++)
+		{
+			taken = interpreter.Execute(*item);
+			
+			if (++steps > maxSteps)
+				interpreter.Stop("step limit");
+		}
+
+		if (interpreter.Done())
+			break;
+
+		Node_ptr next;
+		switch (node->Type())
+		{
+			case Node::CONDITIONAL_JUMP:
+				next = node->Successor(taken ? 0 : 1);
+				break;
+
+			case Node::JUMP:
+			case Node::FALL_THROUGH:
+				next = node->Successor(0);
+				break;
+
+			default:
+				interpreter.Stop("error: unexpected node");
+				break;
+		}
+
+		if (!next.get())
+			interpreter.Stop("end of code");
+		node = next;
+	}
+}/*}}}*/
@@ -0,0 +1,218 @@
+// 
+// Copyright (c) 2002 David Eriksson <david@2good.nu>
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a
+// copy of this software and associated documentation files (the "Software"),
+// to deal in the Software without restriction, including without limitation
+// the rights to use, copy, modify, merge, publish, distribute, sublicense,
+// and/or sell copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+// DEALINGS IN THE SOFTWARE.
+//
+// $Id$
+//
+// Tests of NameCache, alone and behind Frontend::AddressFromName with a
+// frontend that looks names up in a local map instead of an IDA database.
+// The plugin calls Renamed on a rename and StructChanged on structure
+// events, the tests call them where the database would change.
+//
+// usage: namecache
+//
+// Exits with 1 if any test fails.
+//
+#include <cstdio>
+#include <map>
+#include <string>
+
+#include "desquirr.hpp"
+#include "frontend.hpp"
+#include "namecache.hpp"
+
+/**
+ * Frontend with a map of global names, counts the lookups that reach it
+ */
+class MapFrontend : public Frontend/*{{{*/
+{
+	public:
+		MapFrontend()
+			: mLookups(0)
+		{}
+
+		virtual std::string RegisterName(RegisterIndex /*index*/) const
+		{
+			return "reg";
+		}
+
+		virtual int vmsg(const char *format, va_list va)
+		{
+			return vprintf(format, va);
+		}
+
+		virtual bool ParametersOnStack() { return true; }
+
+		/** Give address a name, the old name of address goes away */
+		void Rename(Addr address, const std::string& name)/*{{{*/
+		{
+			for (Name_map::iterator item = mDatabase.begin(); 
+					item != mDatabase.end(); )
+			{
+				if (address == item->second)
+					mDatabase.erase(item++);
+				else
+					item++;
+			}
+			mDatabase[name] = address;
+			Names().Renamed(address, name.c_str());
+		}/*}}}*/
+
+		unsigned long Lookups() const { return mLookups; }
+
+	protected:
+		virtual Addr LookupAddress(const char* name, Addr /*referer*/)/*{{{*/
+		{
+			mLookups++;
+			Name_map::const_iterator item = mDatabase.find(name);
+			if (mDatabase.end() == item)
+				return INVALID_ADDR;
+			return item->second;
+		}/*}}}*/
+		
+		virtual void LookupCallee(Addr /*address*/, CalleeSummary& /*summary*/)
+		{}
+
+	private:
+		typedef std::map<std::string, Addr> Name_map;
+
+		Name_map mDatabase;
+		unsigned long mLookups;
+};/*}}}*/
+
+static int s_failures = 0;
+
+#define CHECK(condition) \
+	do { \
+		if (!(condition)) \
+		{ \
+			printf("%s:%d: %s\n", __FILE__, __LINE__, #condition); \
+			s_failures++; \
+		} \
+	} while (0)
+
+/** Names are kept per kind, every lookup counts as a hit or a miss */
+static void TestFindName()/*{{{*/
+{
+	NameCache names;
+	std::string name;
+	int index = 0;
+
+	CHECK(!names.FindName(NameCache::LOCAL_LABEL, 0x1000, name, index));
+	names.AddName(NameCache::LOCAL_LABEL, 0x1000, "loc_1000", 3, 0x1000);
+	CHECK(names.FindName(NameCache::LOCAL_LABEL, 0x1000, name, index));
+	CHECK("loc_1000" == name && 3 == index);
+	CHECK(!names.FindName(NameCache::GLOBAL_LABEL, 0x1000, name, index));
+	CHECK(1 == names.Hits() && 2 == names.Misses());
+
+	names.Clear();
+	CHECK(0 == names.Hits() && 0 == names.Misses());
+	CHECK(!names.FindName(NameCache::LOCAL_LABEL, 0x1000, name, index));
+}/*}}}*/
+
+/**
+ * A rename drops the names at the address, the names built from it and
+ * the addresses that resolved to it or under the new name
+ */
+static void TestRenamed()/*{{{*/
+{
+	NameCache names;
+	names.AddName(NameCache::GLOBAL_LABEL, 0x1000, "func", 0, 0x1000);
+	names.AddName(NameCache::LOCAL_LABEL, 0x1000, "func", 0, 0x1000);
+	names.AddName(NameCache::GLOBAL_LABEL, 0x1004, "func+4", 0, 0x1000);
+	names.AddName(NameCache::GLOBAL_LABEL, 0x2000, "other", 0, 0x2000);
+	names.AddAddress("func", 0x1000);
+	names.AddAddress("main", INVALID_ADDR);
+	names.AddAddress("other", 0x2000);
+
+	names.Renamed(0x1000, "main");
+
+	std::string name;
+	int index;
+	Addr address;
+	CHECK(!names.FindName(NameCache::GLOBAL_LABEL, 0x1000, name, index));
+	CHECK(!names.FindName(NameCache::LOCAL_LABEL, 0x1000, name, index));
+	CHECK(!names.FindName(NameCache::GLOBAL_LABEL, 0x1004, name, index));
+	CHECK(!names.FindAddress("func", address));
+	CHECK(!names.FindAddress("main", address));
+
+	CHECK(names.FindName(NameCache::GLOBAL_LABEL, 0x2000, name, index));
+	CHECK(names.FindAddress("other", address) && 0x2000 == address);
+
+	// A deleted name has no new name
+	names.Renamed(0x2000, NULL);
+	CHECK(!names.FindAddress("other", address));
+}/*}}}*/
+
+/** Structure events drop the member paths, and only those */
+static void TestStructChanged()/*{{{*/
+{
+	NameCache names;
+	names.AddStructPath(7, 4, "point.y", 1);
+	names.AddStructPath(8, 0, "rect.topLeft.x", 0);
+	names.AddName(NameCache::GLOBAL_VARIABLE, 0x3000, "origin", 0, 0x3000);
+
+	std::string path;
+	int index = 0;
+	CHECK(names.FindStructPath(7, 4, path, index));
+	CHECK("point.y" == path && 1 == index);
+	CHECK(!names.FindStructPath(7, 0, path, index));
+
+	names.StructChanged();
+	CHECK(!names.FindStructPath(7, 4, path, index));
+	CHECK(!names.FindStructPath(8, 0, path, index));
+	CHECK(names.FindName(NameCache::GLOBAL_VARIABLE, 0x3000, path, index));
+}/*}}}*/
+
+/** Lookups through the frontend reach the database once per name */
+static void TestAddressFromName()/*{{{*/
+{
+	MapFrontend* frontend = new MapFrontend();
+	Frontend::Set(Frontend_ptr(frontend));
+	frontend->Rename(0x1000, "func");
+
+	CHECK(0x1000 == frontend->AddressFromName("func"));
+	CHECK(0x1000 == frontend->AddressFromName("func"));
+	CHECK(INVALID_ADDR == frontend->AddressFromName("main"));
+	CHECK(INVALID_ADDR == frontend->AddressFromName("main"));
+	CHECK(2 == frontend->Lookups());
+
+	// With a referer the name may be local, it is not cached
+	CHECK(0x1000 == frontend->AddressFromName("func", 0x1000));
+	CHECK(3 == frontend->Lookups());
+
+	frontend->Rename(0x1000, "main");
+	CHECK(0x1000 == frontend->AddressFromName("main"));
+	CHECK(INVALID_ADDR == frontend->AddressFromName("func"));
+	CHECK(5 == frontend->Lookups());
+	CHECK(0x1000 == frontend->AddressFromName("main"));
+	CHECK(5 == frontend->Lookups());
+}/*}}}*/
+
+int main()/*{{{*/
+{
+	TestFindName();
+	TestRenamed();
+	TestStructChanged();
+	TestAddressFromName();
+
+	printf("%d failures\n", s_failures);
+	return s_failures ? 1 : 0;
+}/*}}}*/
@@ -0,0 +1,307 @@
+// 
+// Copyright (c) 2002 David Eriksson <david@2good.nu>
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a
+// copy of this software and associated documentation files (the "Software"),
+// to deal in the Software without restriction, including without limitation
+// the rights to use, copy, modify, merge, publish, distribute, sublicense,
+// and/or sell copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+// DEALINGS IN THE SOFTWARE.
+//
+// $Id$
+//
+// Tests of FunctionScan, with a database that describes the items of a
+// few chunks kept in a local map instead of an IDA database.
+//
+// usage: scan
+//
+// Exits with 1 if any test fails.
+//
+#include <cstdio>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "desquirr.hpp"
+#include "frontend.hpp"
+#include "scan.hpp"
+
+/**
+ * Frontend without a database, only collects the messages
+ */
+class ScanFrontend : public Frontend/*{{{*/
+{
+	public:
+		virtual std::string RegisterName(RegisterIndex /*index*/) const
+		{
+			return "reg";
+		}
+
+		virtual int vmsg(const char *format, va_list va)/*{{{*/
+		{
+			char buffer[1024];
+			int length = vsnprintf(buffer, sizeof(buffer), format, va);
+			if (length > 0)
+				mOutput.append(buffer, 
+						length < (int)sizeof(buffer) ? length : sizeof(buffer) - 1);
+			return length;
+		}/*}}}*/
+
+		virtual bool ParametersOnStack() { return true; }
+
+		std::string& Output() { return mOutput; }
+
+	protected:
+		virtual Addr LookupAddress(const char* /*name*/, Addr /*referer*/)
+		{
+			return INVALID_ADDR;
+		}
+		
+		virtual void LookupCallee(Addr /*address*/, CalleeSummary& /*summary*/)
+		{}
+
+	private:
+		std::string mOutput;
+};/*}}}*/
+
+/**
+ * Database of items added one by one. Addresses without an item are one
+ * unexplored byte; MakeCode turns the ones marked convertible into one
+ * byte of code.
+ */
+class MapDatabase : public DatabaseAccess/*{{{*/
+{
+	public:
+		MapDatabase()
+			: mDescribes(0)
+		{}
+
+		void AddChunk(Addr start, Addr end)
+		{
+			mChunks.push_back(AddressRange(start, end));
+		}
+
+		void Add(Addr address, Addr size, ScannedItem::Kind kind, 
+				const char* label = NULL)
+		{
+			Item& item = mItems[address];
+			item.size = size;
+			item.kind = kind;
+			item.referenced = (NULL != label);
+			item.label = label ? label : "";
+		}
+
+		void Remove(Addr address) { mItems.erase(address); }
+
+		void Convertible(Addr address) { mConvertible[address] = true; }
+
+		virtual void Chunks(Addr /*function*/, AddressRange_vector& chunks)
+		{
+			chunks = mChunks;
+		}
+
+		virtual void Describe(Addr address, ScannedItem& scanned)/*{{{*/
+		{
+			mDescribes++;
+			scanned.address = address;
+			scanned.flags = 0;
+			scanned.previousChunkEnd = INVALID_ADDR;
+
+			Item_map::const_iterator item = mItems.find(address);
+			if (mItems.end() == item)
+			{
+				scanned.end = address + 1;
+				scanned.kind = ScannedItem::UNKNOWN;
+				scanned.referenced = false;
+				return;
+			}
+
+			scanned.end = address + item->second.size;
+			scanned.kind = item->second.kind;
+			scanned.referenced = item->second.referenced;
+		}/*}}}*/
+
+		virtual void MakeCode(Addr address)
+		{
+			if (mConvertible[address])
+				Add(address, 1, ScannedItem::CODE);
+		}
+
+		virtual std::string LocalLabel(Addr address)
+		{
+			return mItems[address].label;
+		}
+
+		unsigned long Describes() const { return mDescribes; }
+
+	private:
+		struct Item
+		{
+			Addr size;
+			ScannedItem::Kind kind;
+			bool referenced;
+			std::string label;
+		};
+
+		typedef std::map<Addr, Item> Item_map;
+
+		AddressRange_vector mChunks;
+		Item_map mItems;
+		std::map<Addr, bool> mConvertible;
+		unsigned long mDescribes;
+};/*}}}*/
+
+static int s_failures = 0;
+
+#define CHECK(condition) \
+	do { \
+		if (!(condition)) \
+		{ \
+			printf("%s:%d: %s\n", __FILE__, __LINE__, #condition); \
+			s_failures++; \
+		} \
+	} while (0)
+
+/** Items of every chunk in chunk order, a tail knows where the last ended */
+static void TestChunks()/*{{{*/
+{
+	MapDatabase database;
+	database.AddChunk(0x1000, 0x1006);
+	database.AddChunk(0x2000, 0x2004);
+	database.Add(0x1000, 2, ScannedItem::CODE);
+	database.Add(0x1002, 4, ScannedItem::CODE);
+	database.Add(0x2000, 3, ScannedItem::CODE);
+	database.Add(0x2003, 1, ScannedItem::CODE);
+
+	FunctionScan scan(database);
+	scan.Scan(0x1000);
+
+	const ScannedItem_vector& items = scan.Items();
+	CHECK(4 == items.size());
+	CHECK(2 == scan.Chunks().size());
+	if (4 != items.size())
+		return;
+
+	CHECK(0x1000 == items[0].address && 0x1002 == items[0].end);
+	CHECK(0x1002 == items[1].address && 0x1006 == items[1].end);
+	CHECK(0x2000 == items[2].address && 0x2003 == items[2].end);
+	CHECK(0x2003 == items[3].address);
+
+	CHECK(INVALID_ADDR == items[0].previousChunkEnd);
+	CHECK(INVALID_ADDR == items[1].previousChunkEnd);
+	CHECK(0x1006 == items[2].previousChunkEnd);
+	CHECK(INVALID_ADDR == items[3].previousChunkEnd);
+
+	CHECK(scan.Covers(0x1005) && scan.Covers(0x2000));
+	CHECK(!scan.Covers(0x1006) && !scan.Covers(0x2004));
+	CHECK(4 == database.Describes());
+}/*}}}*/
+
+/** Data is stepped over whole, unexplored bytes become code if they can */
+static void TestKinds()/*{{{*/
+{
+	MapDatabase database;
+	database.AddChunk(0x1000, 0x100a);
+	database.AddChunk(0x2000, 0x2002);
+	database.Add(0x1000, 2, ScannedItem::CODE);
+	database.Add(0x1002, 6, ScannedItem::DATA);
+	database.Convertible(0x1008);
+	// 0x1009 stays unexplored, the sweep of the chunk stops there
+	database.Add(0x2000, 2, ScannedItem::CODE);
+
+	ScanFrontend* frontend = new ScanFrontend();
+	Frontend::Set(Frontend_ptr(frontend));
+
+	FunctionScan scan(database);
+	scan.Scan(0x1000);
+
+	const ScannedItem_vector& items = scan.Items();
+	CHECK(4 == items.size());
+	if (4 != items.size())
+		return;
+
+	CHECK(ScannedItem::DATA == items[1].kind && 0x1008 == items[1].end);
+	CHECK(ScannedItem::CODE == items[2].kind && 0x1008 == items[2].address);
+	CHECK(0x2000 == items[3].address && 0x100a == items[3].previousChunkEnd);
+	CHECK(std::string::npos != frontend->Output().find("could not convert"));
+}/*}}}*/
+
+/** Referenced items have a label, an empty one if they have no name */
+static void TestLabels()/*{{{*/
+{
+	MapDatabase database;
+	database.AddChunk(0x1000, 0x1006);
+	database.Add(0x1000, 2, ScannedItem::CODE, "");
+	database.Add(0x1002, 2, ScannedItem::CODE);
+	database.Add(0x1004, 2, ScannedItem::CODE, "loc_1004");
+
+	FunctionScan scan(database);
+	scan.Scan(0x1000);
+
+	std::string name = "x";
+	CHECK(scan.Label(0x1000, name) && name.empty());
+	CHECK(!scan.Label(0x1002, name));
+	CHECK(scan.Label(0x1004, name) && "loc_1004" == name);
+	CHECK(!scan.Label(0x2000, name));
+}/*}}}*/
+
+/** A second scan sees the database as it is now, nothing of the first */
+static void TestRescan()/*{{{*/
+{
+	MapDatabase database;
+	database.AddChunk(0x1000, 0x1004);
+	database.Add(0x1000, 2, ScannedItem::CODE, "first");
+	database.Add(0x1002, 2, ScannedItem::CODE);
+
+	FunctionScan scan(database);
+	scan.Scan(0x1000);
+	CHECK(2 == scan.Items().size());
+
+	// An instruction split in two, the label moved, a tail appended
+	database.Add(0x1000, 2, ScannedItem::CODE);
+	database.Remove(0x1002);
+	database.Add(0x1002, 1, ScannedItem::CODE, "second");
+	database.Add(0x1003, 1, ScannedItem::CODE);
+	database.AddChunk(0x3000, 0x3001);
+	database.Add(0x3000, 1, ScannedItem::CODE);
+
+	scan.Scan(0x1000);
+
+	const ScannedItem_vector& items = scan.Items();
+	CHECK(4 == items.size());
+	CHECK(2 == scan.Chunks().size() && scan.Covers(0x3000));
+
+	std::string name;
+	CHECK(!scan.Label(0x1000, name));
+	CHECK(scan.Label(0x1002, name) && "second" == name);
+	if (4 == items.size())
+		CHECK(0x1004 == items[3].previousChunkEnd);
+
+	scan.Clear();
+	CHECK(scan.Items().empty() && scan.Chunks().empty());
+	CHECK(!scan.Covers(0x1000) && !scan.Label(0x1002, name));
+}/*}}}*/
+
+int main()/*{{{*/
+{
+	Frontend::Set(Frontend_ptr(new ScanFrontend()));
+
+	TestChunks();
+	TestKinds();
+	TestLabels();
+	TestRescan();
+
+	printf("%d failures\n", s_failures);
+	return s_failures ? 1 : 0;
+}/*}}}*/
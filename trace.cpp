@@ -0,0 +1,201 @@
+// 
+// Copyright (c) 2002 David Eriksson <david@2good.nu>
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a
+// copy of this software and associated documentation files (the "Software"),
+// to deal in the Software without restriction, including without limitation
+// the rights to use, copy, modify, merge, publish, distribute, sublicense,
+// and/or sell copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+// DEALINGS IN THE SOFTWARE.
+//
+// $Id$
+#include <cstdio>
+#include <cstring>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <time.h>
+#endif
+
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/tss.hpp>
+
+#include "trace.hpp"
+#include "printer.hpp"
+#include "json.hpp"
+#include "counters.hpp"
+
+bool Trace::sEnabled = false;
+
+static FILE* s_file = NULL;
+static double s_origin = 0;
+static boost::mutex s_mutex;      // s_file and s_threads
+static int s_threads = 0;
+
+/**
+ * Events of one thread not yet written to the file
+ */
+class TraceBuffer/*{{{*/
+{
+	public:
+		TraceBuffer()
+		{
+			boost::mutex::scoped_lock lock(s_mutex);
+			mThread = ++s_threads;
+		}
+
+		~TraceBuffer() { Flush(); }
+
+		std::ostream& Out() { return mOut; }
+		int Thread() const { return mThread; }
+
+		void Flush()/*{{{*/
+		{
+			if (0 == mOut.Size())
+				return;
+			
+			boost::mutex::scoped_lock lock(s_mutex);
+			if (s_file)
+				fwrite(mOut.Data(), 1, mOut.Size(), s_file);
+			mOut.Clear();
+		}/*}}}*/
+
+		void Written()
+		{
+			if (mOut.Size() >= Trace::FLUSH_SIZE)
+				Flush();
+		}
+
+	private:
+		OutputStream mOut;
+		int mThread;
+};/*}}}*/
+
+static boost::thread_specific_ptr<TraceBuffer> s_buffer;
+
+static TraceBuffer& Buffer()
+{
+	if (NULL == s_buffer.get())
+		s_buffer.reset(new TraceBuffer());
+	return *s_buffer;
+}
+
+static double Clock()/*{{{*/
+{
+#ifdef _WIN32
+	static LARGE_INTEGER frequency;
+	if (0 == frequency.QuadPart)
+		QueryPerformanceFrequency(&frequency);
+	
+	LARGE_INTEGER now;
+	QueryPerformanceCounter(&now);
+	return now.QuadPart * 1e6 / frequency.QuadPart;
+#else
+	timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return now.tv_sec * 1e6 + now.tv_nsec / 1e3;
+#endif
+}/*}}}*/
+
+double Trace::Now()
+{
+	return Clock() - s_origin;
+}
+
+bool Trace::Open(const char* path)/*{{{*/
+{
+	Close();
+	
+	FILE* file = fopen(path, "w");
+	if (NULL == file)
+		return false;
+
+	// every event is followed by a comma, Close ends the array
+	fputs("[\n", file);
+
+	boost::mutex::scoped_lock lock(s_mutex);
+	s_file = file;
+	s_origin = Clock();
+	sEnabled = true;
+	return true;
+}/*}}}*/
+
+void Trace::Close()/*{{{*/
+{
+	if (!sEnabled)
+		return;
+
+	sEnabled = false;
+	Buffer().Flush();
+
+	boost::mutex::scoped_lock lock(s_mutex);
+	fputs("{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,"
+			"\"args\":{\"name\":\"desquirr\"}}\n]\n", s_file);
+	fclose(s_file);
+	s_file = NULL;
+}/*}}}*/
+
+void Trace::Complete(const char* name, double start, /*{{{*/
+		Addr address, const char* detail)
+{
+	TraceBuffer& buffer = Buffer();
+	double now = Now();
+	
+	JsonWriter json(buffer.Out());
+	json.BeginObject();
+	json.Key("name"); json.String(name, strlen(name));
+	json.Key("ph");   json.String("X", 1);
+	json.Key("ts");   json.Number(start);
+	json.Key("dur");  json.Number(now - start);
+	json.Key("pid");  json.Number(1);
+	json.Key("tid");  json.Number(buffer.Thread());
+	if (INVALID_ADDR != address || detail)
+	{
+		json.Key("args");
+		json.BeginObject();
+		if (INVALID_ADDR != address)
+		{
+			char text[16];
+			int length = sprintf(text, "%08lx", address);
+			json.Key("address"); json.String(text, length);
+		}
+		if (detail)
+		{
+			json.Key("detail"); json.String(detail, strlen(detail));
+		}
+		json.EndObject();
+	}
+	json.EndObject();
+	buffer.Out().write(",\n", 2);
+
+#if DESQUIRR_COUNT_OBJECTS
+	JsonWriter counter(buffer.Out());
+	counter.BeginObject();
+	counter.Key("name"); counter.String("live objects", 12);
+	counter.Key("ph");   counter.String("C", 1);
+	counter.Key("ts");   counter.Number(now);
+	counter.Key("pid");  counter.Number(1);
+	counter.Key("args");
+	counter.BeginObject();
+	counter.Key("expressions");  counter.Number(ObjectCounters::Live(OBJECT_EXPRESSION));
+	counter.Key("instructions"); counter.Number(ObjectCounters::Live(OBJECT_INSTRUCTION));
+	counter.Key("nodes");        counter.Number(ObjectCounters::Live(OBJECT_NODE));
+	counter.EndObject();
+	counter.EndObject();
+	buffer.Out().write(",\n", 2);
+#endif
+
+	buffer.Written();
+}/*}}}*/
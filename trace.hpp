@@ -0,0 +1,93 @@
+// 
+// Copyright (c) 2002 David Eriksson <david@2good.nu>
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a
+// copy of this software and associated documentation files (the "Software"),
+// to deal in the Software without restriction, including without limitation
+// the rights to use, copy, modify, merge, publish, distribute, sublicense,
+// and/or sell copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+// DEALINGS IN THE SOFTWARE.
+//
+// $Id$
+#ifndef _TRACE_HPP
+#define _TRACE_HPP
+
+#include "desquirr.hpp"
+
+/*
+ * Trace of the stages of a run in the trace event format of Chrome and
+ * Perfetto (chrome://tracing, ui.perfetto.dev).
+ *
+ *   TraceSpan span("liveness");
+ *
+ * records a complete event from construction to destruction while a trace
+ * is open, and costs a test of Trace::Enabled() otherwise. Each thread
+ * writes its events to its own buffer, which goes to the file when it is
+ * full, when the thread ends and when the trace is closed. Builds with
+ * DESQUIRR_COUNT_OBJECTS also get counter tracks of the live IR objects.
+ */
+class Trace/*{{{*/
+{
+	public:
+		enum
+		{
+			FLUSH_SIZE = 64 * 1024   // bytes buffered by a thread before writing
+		};
+		
+		/** \return false if the file could not be created */
+		static bool Open(const char* path);
+		static void Close();
+
+		static bool Enabled() { return sEnabled; }
+
+		/** Microseconds since the trace was opened */
+		static double Now();
+
+		/**
+		 * Write a complete event. detail may be NULL, address may be
+		 * INVALID_ADDR.
+		 */
+		static void Complete(const char* name, double start, 
+				Addr address, const char* detail);
+
+	private:
+		static bool sEnabled;
+};/*}}}*/
+
+class TraceSpan/*{{{*/
+{
+	public:
+		TraceSpan(const char* name, Addr address = INVALID_ADDR, 
+				const char* detail = NULL)
+			: mName(name), mAddress(address), mDetail(detail), 
+				mStart(Trace::Enabled() ? Trace::Now() : 0)
+		{}
+
+		~TraceSpan()
+		{
+			if (Trace::Enabled())
+				Trace::Complete(mName, mStart, mAddress, mDetail);
+		}
+
+	private:
+		TraceSpan(const TraceSpan&);
+		TraceSpan& operator= (const TraceSpan&);
+		
+		const char* mName;
+		Addr mAddress;
+		const char* mDetail;   // must outlive the span
+		double mStart;
+};/*}}}*/
+
+#endif // _TRACE_HPP
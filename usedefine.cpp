@@ -22,45 +22,15 @@
 // $Id: usedefine.cpp,v 1.3 2007/01/30 09:49:50 wjhengeveld Exp $
 #include "usedefine.hpp"
 #include "node.hpp"
-#include "idapro.hpp"
+#include "frontend.hpp"
 #include "instruction.hpp"
 #include "expression.hpp"
+#include "architecture.hpp"
 
-/* Set registers {{{ */
-class SetRegistersVisitor : public ExpressionVisitor
-{
-	public:
-		SetRegistersVisitor(BoolArray& registers)
-			: mRegisters(registers)
-		{
-			// Do not clear registers!
-		}
-		
-		virtual void Visit(Register& expression)
-		{
-			mRegisters.Set( expression.SimpleIndex() );
-		}
-
-		virtual void Visit(BinaryExpression&)  {}
-		virtual void Visit(CallExpression& expression)   {}
- 		virtual void Visit(Dummy&)             {}
-		virtual void Visit(GlobalVariable&)            {}
-		virtual void Visit(NumericLiteral&)    {}
-		virtual void Visit(StackVariable&)     {}
-		virtual void Visit(StringLiteral&)     {}
-		virtual void Visit(TernaryExpression&) {}
-		virtual void Visit(UnaryExpression&)   {}
-	
-	private:
-		BoolArray& mRegisters;
-};
-
-static void SetRegisters(Expression_ptr e, BoolArray& registers)
-{
-	SetRegistersVisitor helper(registers);
-	e->AcceptDepthFirst(helper);
-}/*}}}*/
-
+/**
+ * Compute uses and definitions of individual instructions
+ */
+template<class Traits>
 class UsesAndDefintionsVisitor : public InstructionVisitor
 {
 	private:
@@ -69,29 +39,21 @@ class UsesAndDefintionsVisitor : public InstructionVisitor
 			instruction.Definitions().Clear();
 			instruction.Uses().Clear();
 		}
-
-		void EndInstruction(Instruction& instruction)
-		{
-			// Do not say we use something we define first
-			mCurrentNode->Uses()        |= instruction.Uses() & ~mCurrentNode->Definitions();
-			mCurrentNode->Definitions() |= instruction.Definitions();
-		}
 		
 		void Use(Instruction& instruction, int index)
 		{
-			SetRegisters(instruction.Operand(index), instruction.Uses());
+			instruction.Uses() |= instruction.OperandRegisters(index);
 		}
 		
 		void Define(Instruction& instruction, int index)
 		{
-			SetRegisters(instruction.Operand(index), instruction.Definitions());
+			instruction.Definitions() |= instruction.OperandRegisters(index);
 		}
 
 		void UseOne(Instruction& instruction)
 		{
 			BeginInstruction(instruction);
 			Use(instruction, 0);
-			EndInstruction(instruction);
 		}
 
 	public:
@@ -110,24 +72,30 @@ class UsesAndDefintionsVisitor : public InstructionVisitor
 			}
 
             if (instruction.Operand(1)->IsType(Expression::CALL)) {
-                if (!static_cast<IdaPro&>(Frontend::Get()).ParametersOnStack()) {
-                    CallExpression* call= static_cast<CallExpression*>(instruction.Operand(1).get());
+                CallExpression* call= static_cast<CallExpression*>(instruction.Operand(1).get());
+                // only once, uses and definitions may be updated again later
+                if (!Traits::PARAMETERS_ON_STACK &&
+                        !call->IsFinishedAddingParameters()) {
                     if (call->ParameterCount()==CallExpression::UNKNOWN_PARAMETER_COUNT)
-                        call->ParameterCount(4);
+                        call->ParameterCount(Traits::PARAMETER_REGISTERS);
                     int i= 0;
-                    while (i < 4 && i < call->ParameterCount()) {
+                    while (i < Traits::PARAMETER_REGISTERS && i < call->ParameterCount()) {
                         call->AddParameter( Register::Create(i) );
                         i++;
                     }
+                    call->SetFinishedAddingParameters();
+                    instruction.OperandChanged();
                 }
                 Use(instruction, 1);
-                Define(instruction, 1);
+                // The result is defined above; the parameters are only read,
+                // but the callee may overwrite the parameter registers
+                for (int reg = 0; reg < Traits::PARAMETER_REGISTERS; reg++)
+                    instruction.Definitions().Set(reg);
             }
             else {
                 Use(instruction, 1);
             }
 
-			EndInstruction(instruction);
 		}
 
 		virtual void Visit(ConditionalJump& instruction)
@@ -135,14 +103,12 @@ class UsesAndDefintionsVisitor : public InstructionVisitor
 			BeginInstruction(instruction);
 			Use(instruction, 0);
 			Use(instruction, 1);
-			EndInstruction(instruction);
 		}
 
 		virtual void Visit(Pop& instruction)
 		{
 			BeginInstruction(instruction);
 			Define(instruction, 0);
-			EndInstruction(instruction);
 		}
 
 		virtual void Visit(Case& instruction)     {}
@@ -154,19 +120,48 @@ class UsesAndDefintionsVisitor : public InstructionVisitor
 		virtual void Visit(Return& instruction) { UseOne(instruction); }
 		virtual void Visit(Switch& instruction) { UseOne(instruction); }
 		virtual void Visit(Throw& instruction)  { UseOne(instruction); }
+};
+
+template<class Traits>
+static void UpdateUsesAndDefinitions(Node_list& nodes, bool dirtyOnly)
+{
+	UsesAndDefintionsVisitor<Traits> visitor;
 
-		virtual void NodeBegin(Node_ptr node)
+	for (Node_list::iterator n = nodes.begin(); n != nodes.end(); n++)
+	{
+		Node_ptr node = *n;
+
+		if (dirtyOnly && !node->IsDirty(ANALYSIS_USES_AND_DEFINITIONS))
+			continue;
+
+		node->Uses().Clear();
+		node->Definitions().Clear();
+
+		for (Instruction_list::iterator i = node->Instructions().begin();
+				i != node->Instructions().end();
+				i++)
 		{
-			mCurrentNode = node;
+			Instruction_ptr instruction = *i;
+
+			if (!dirtyOnly || instruction->IsDirty())
+			{
+				Dispatch(*instruction, visitor);
+				instruction->ClearDirty();
+			}
+
+			// Do not say we use something we define first
+			node->Uses()        |= instruction->Uses() & ~node->Definitions();
+			node->Definitions() |= instruction->Definitions();
 		}
 
-	private:
-		Node_ptr mCurrentNode;
-};
+		node->ClearDirty(ANALYSIS_USES_AND_DEFINITIONS);
+	}
+}
 
-void UpdateUsesAndDefinitions(Node_list& nodes)
+void UpdateUsesAndDefinitions(Node_list& nodes, bool dirtyOnly)
 {
-	UsesAndDefintionsVisitor visitor;
-	Accept(nodes, visitor);
+	if (Frontend::Get().ParametersOnStack())
+		UpdateUsesAndDefinitions<X86Traits>(nodes, dirtyOnly);
+	else
+		UpdateUsesAndDefinitions<ArmTraits>(nodes, dirtyOnly);
 }
-
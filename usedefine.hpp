@@ -25,7 +25,11 @@
 
 #include "desquirr.hpp"
 
-void UpdateUsesAndDefinitions(Node_list& nodes);
+/**
+ * Compute uses and definitions of instructions and nodes. With dirtyOnly
+ * set, only instructions and nodes marked dirty are recomputed.
+ */
+void UpdateUsesAndDefinitions(Node_list& nodes, bool dirtyOnly = false);
 
 #endif // _USEDEFINE_HPP
 